@@ -13,10 +13,11 @@
 
 extern int *blk_size[];
 
-int block_write(struct inode * inode, struct file * filp, char * buf, int count)
+int block_writev(struct inode * inode, struct file * filp, struct iovec * iov, int nr, off_t * ppos)
 {
-	int block = filp->f_pos >> BLOCK_SIZE_BITS;
-	int offset = filp->f_pos & (BLOCK_SIZE-1);
+	int count = iov_length(iov,nr);
+	int block = *ppos >> BLOCK_SIZE_BITS;
+	int offset = *ppos & (BLOCK_SIZE-1);
 	int chars;
 	int written = 0;
 	int size;
@@ -44,12 +45,10 @@ int block_write(struct inode * inode, struct file * filp, char * buf, int count)
 			return written?written:-EIO;
 		p = offset + bh->b_data;
 		offset = 0;
-		filp->f_pos += chars;
+		*ppos += chars;
 		written += chars;
 		count -= chars;
-		memcpy_fromfs(p,buf,chars);
-		p += chars;
-		buf += chars;
+		memcpy_fromiovec(p,iov,chars);
 		bh->b_uptodate = 1;
 		bh->b_dirt = 1;
 		brelse(bh);
@@ -57,10 +56,11 @@ int block_write(struct inode * inode, struct file * filp, char * buf, int count)
 	return written;
 }
 
-int block_read(struct inode * inode, struct file * filp, char * buf, int count)
+int block_readv(struct inode * inode, struct file * filp, struct iovec * iov, int nr, off_t * ppos)
 {
-	unsigned int block = filp->f_pos >> BLOCK_SIZE_BITS;
-	unsigned int offset = filp->f_pos & (BLOCK_SIZE-1);
+	int count = iov_length(iov,nr);
+	unsigned int block = *ppos >> BLOCK_SIZE_BITS;
+	unsigned int offset = *ppos & (BLOCK_SIZE-1);
 	unsigned int chars;
 	unsigned int size;
 	unsigned int dev;
@@ -84,13 +84,29 @@ int block_read(struct inode * inode, struct file * filp, char * buf, int count)
 		block++;
 		p = offset + bh->b_data;
 		offset = 0;
-		filp->f_pos += chars;
+		*ppos += chars;
 		read += chars;
 		count -= chars;
-		memcpy_tofs(buf,p,chars);
-		p += chars;
-		buf += chars;
+		memcpy_toiovec(iov,p,chars);
 		brelse(bh);
 	}
 	return read;
 }
+
+int block_write(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return block_writev(inode,filp,&iov,1,&filp->f_pos);
+}
+
+int block_read(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return block_readv(inode,filp,&iov,1,&filp->f_pos);
+}
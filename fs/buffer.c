@@ -94,11 +94,28 @@ void inline invalidate_buffers(int dev)
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev)
+		if (bh->b_dev == dev) {
 			bh->b_uptodate = bh->b_dirt = 0;
+			bh->b_data = bh->b_own;
+		}
 	}
 }
 
+/*
+ * Whether any buffer of the device is in use right now.
+ */
+int buffers_busy(int dev)
+{
+	int i;
+	struct buffer_head * bh;
+
+	bh = start_buffer;
+	for (i=0 ; i<NR_BUFFERS ; i++,bh++)
+		if (bh->b_dev == dev && bh->b_count)
+			return 1;
+	return 0;
+}
+
 /*
  * This routine checks whether a floppy has been changed, and
  * invalidates all buffer-cache-entries in that case. This
@@ -259,6 +276,7 @@ struct buffer_head * get_hash_table(int dev, int block)
 struct buffer_head * getblk(int dev,int block)
 {
 	struct buffer_head * bh, * tmp;
+	char * data;
 	int buffers;
 
 repeat:
@@ -299,6 +317,12 @@ repeat:
 	bh->b_count=1;
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
+	bh->b_data=bh->b_own;
+/* ram disk blocks aren't copied: the buffer just points at them */
+	if (MAJOR(dev) == 1 && (data = rd_map(dev,block))) {
+		bh->b_data=data;
+		bh->b_uptodate=1;
+	}
 	remove_from_queues(bh);
 	bh->b_dev=dev;
 	bh->b_blocknr=block;
@@ -424,7 +448,7 @@ void buffer_init(long buffer_end)
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
-		h->b_data = (char *) b;
+		h->b_data = h->b_own = (char *) b;
 		h->b_reqnext = NULL;
 		h->b_prev_free = h-1;
 		h->b_next_free = h+1;
@@ -0,0 +1,467 @@
+/*
+ *  linux/fs/eventpoll.c
+ *
+ * An event-poll object is a persistent interest set. Descriptors are
+ * added and removed one at a time with epoll_ctl(), and each watched
+ * pipe, socket or tty keeps a list of the items watching it. The places
+ * that wake up sleepers on those objects call epoll_wakeup(), which puts
+ * the items on their ready list. epoll_wait() then only has to look at
+ * the ready list, rechecking each entry with the select() checks, so a
+ * wait costs O(ready) rather than O(descriptors).
+ *
+ * Each item is also linked to the file it watches, so closing the file
+ * can find its items again. The items of one interest set live in a
+ * chain of pages that grows as descriptors are added; the unused ones
+ * are chained through next on ep->free, so adding a descriptor doesn't
+ * have to look through the pages.
+ */
+
+#include <errno.h>
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/tty.h>
+#include <linux/stat.h>
+
+#include <asm/segment.h>
+#include <asm/system.h>
+
+#include <sys/epoll.h>
+
+struct epitem {
+	struct epitem * next;		/* items watching the same object, or free */
+	struct epitem ** list;		/* head of that list */
+	struct epitem * fnext;		/* items watching the same file */
+	struct epitem * rdnext;		/* ready list */
+	struct eventpoll * ep;
+	struct file * file;		/* NULL if the slot is free */
+	int fd;
+	int ready;			/* on (or being handled off) ep->rdlist */
+	unsigned long events;
+	unsigned long data;
+};
+
+struct ep_page {
+	struct ep_page * next;
+	struct epitem items[1];
+};
+
+#define EP_PAGE_ITEMS \
+	((PAGE_SIZE - sizeof(struct ep_page)) / sizeof(struct epitem) + 1)
+
+struct eventpoll {
+	struct task_struct * wait;
+	struct epitem * rdlist;
+	struct epitem * rdtail;
+	int nr;
+	struct ep_page * pages;
+	struct epitem * free;
+};
+
+#define EP(inode) ((struct eventpoll *) (inode)->i_data[0])
+
+static void ep_release(struct inode * inode, struct file * filp);
+
+static struct file_operations eventpoll_fops = {
+	NULL,		/* lseek */
+	NULL,		/* read */
+	NULL,		/* write */
+	NULL,		/* readdir */
+	NULL,		/* select */
+	NULL,		/* ioctl */
+	NULL,		/* open */
+	ep_release,
+	NULL,		/* readv */
+	NULL		/* writev */
+};
+
+/*
+ * The ttys keep their watchers in the tty structure, as the inode may
+ * be /dev/tty or any of several links to the device. /dev/tty depends
+ * on the caller, so this is only looked up when an item is added: the
+ * item remembers the list it went on.
+ */
+static struct epitem ** ep_list(struct inode * inode)
+{
+	int major, minor;
+
+	if (inode->i_pipe || S_ISSOCK(inode->i_mode))
+		return &inode->i_epoll;
+	if (!S_ISCHR(inode->i_mode))
+		return NULL;
+	if ((major = MAJOR(inode->i_rdev)) != 5 && major != 4)
+		return NULL;
+	if (major == 5)
+		minor = current->tty;
+	else
+		minor = MINOR(inode->i_rdev);
+	if (minor < 0)
+		return NULL;
+	return &TTY_TABLE(minor)->epoll;
+}
+
+/* called with interrupts off */
+static inline void ep_queue(struct epitem * epi)
+{
+	struct eventpoll * ep = epi->ep;
+
+	if (epi->ready)
+		return;
+	epi->ready = 1;
+	epi->rdnext = NULL;
+	if (ep->rdlist)
+		ep->rdtail->rdnext = epi;
+	else
+		ep->rdlist = epi;
+	ep->rdtail = epi;
+}
+
+static void ep_unlink(struct epitem * epi)
+{
+	struct epitem ** p, * tmp;
+
+	cli();
+	for (p = epi->list ; (tmp = *p) ; p = &tmp->next)
+		if (tmp == epi) {
+			*p = epi->next;
+			break;
+		}
+	for (p = &epi->file->f_epoll ; (tmp = *p) ; p = &tmp->fnext)
+		if (tmp == epi) {
+			*p = epi->fnext;
+			break;
+		}
+	if (epi->ready) {
+		struct eventpoll * ep = epi->ep;
+		struct epitem * prev = NULL;
+
+		for (tmp = ep->rdlist ; tmp ; prev = tmp, tmp = tmp->rdnext)
+			if (tmp == epi) {
+				if (prev)
+					prev->rdnext = epi->rdnext;
+				else
+					ep->rdlist = epi->rdnext;
+				if (ep->rdtail == epi)
+					ep->rdtail = prev;
+				break;
+			}
+		epi->ready = 0;
+	}
+	sti();
+	epi->file = NULL;
+	epi->next = epi->ep->free;
+	epi->ep->free = epi;
+	epi->ep->nr--;
+}
+
+/*
+ * Called from the wakeup sites of pipes, sockets and ttys, possibly
+ * from an interrupt. It only queues the items: whether they really
+ * are ready is decided by epoll_wait().
+ */
+void epoll_wakeup(struct epitem * list)
+{
+	unsigned long flags;
+
+	if (!list)
+		return;
+	save_flags(flags);
+	cli();
+	for ( ; list ; list = list->next) {
+		ep_queue(list);
+		wake_up(&list->ep->wait);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * The last reference to a file went away: drop it from any interest
+ * set that still watches it.
+ */
+void epoll_release(struct file * filp)
+{
+	while (filp->f_epoll)
+		ep_unlink(filp->f_epoll);
+}
+
+static void ep_release(struct inode * inode, struct file * filp)
+{
+	struct eventpoll * ep = EP(inode);
+	struct ep_page * page;
+	int i;
+
+	if (!ep)
+		return;
+	while ((page = ep->pages)) {
+		for (i = 0 ; i < EP_PAGE_ITEMS ; i++)
+			if (page->items[i].file)
+				ep_unlink(page->items + i);
+		ep->pages = page->next;
+		free_page((unsigned long) page);
+	}
+	wake_up(&ep->wait);
+	free_s(ep, sizeof(*ep));
+	inode->i_data[0] = 0;
+}
+
+/*
+ * Find a free item, adding a page to the set if they are all in use.
+ */
+/*
+ * Returns the first free item, adding a page of them if there is none.
+ * The item stays on the free list: get_free_page() may sleep, so the
+ * caller takes it off once it is sure it wants it.
+ */
+static struct epitem * ep_alloc(struct eventpoll * ep)
+{
+	struct ep_page * page;
+	int i;
+
+	while (!ep->free) {
+		if (!(page = (struct ep_page *) get_free_page()))
+			return NULL;
+		memset(page, 0, PAGE_SIZE);
+		if (ep->free) {
+			free_page((unsigned long) page);
+			break;
+		}
+		for (i = 0 ; i < EP_PAGE_ITEMS ; i++) {
+			page->items[i].next = ep->free;
+			ep->free = page->items + i;
+		}
+		page->next = ep->pages;
+		ep->pages = page;
+	}
+	return ep->free;
+}
+
+static struct eventpoll * ep_lookup(unsigned int epfd)
+{
+	struct file * filp;
+
+	if (epfd >= current->max_fds || !(filp = current->filp[epfd]))
+		return NULL;
+	if (filp->f_op != &eventpoll_fops)
+		return NULL;
+	return EP(filp->f_inode);
+}
+
+int sys_epoll_create(int size)
+{
+	struct inode * inode;
+	struct file * f;
+	struct eventpoll * ep;
+	int fd;
+
+	if (size <= 0)
+		return -EINVAL;
+	if ((fd = get_unused_fd()) < 0)
+		return fd;
+	if (!(ep = (struct eventpoll *) malloc(sizeof(*ep))))
+		return -ENOMEM;
+	if (!(inode = get_empty_inode())) {
+		free_s(ep, sizeof(*ep));
+		return -ENFILE;
+	}
+	if (!(f = get_empty_filp())) {
+		iput(inode);
+		free_s(ep, sizeof(*ep));
+		return -ENFILE;
+	}
+	memset(ep, 0, sizeof(*ep));
+	inode->i_data[0] = (unsigned long) ep;
+	current->filp[fd] = f;
+	f->f_mode = 1;
+	f->f_flags = 0;
+	f->f_pos = 0;
+	f->f_inode = inode;
+	f->f_op = &eventpoll_fops;
+	return fd;
+}
+
+static int do_epoll_ctl(unsigned int epfd, int op, unsigned int fd,
+	struct epoll_event * event)
+{
+	struct eventpoll * ep;
+	struct epitem * epi, * free, ** list;
+	struct file * filp;
+	unsigned long events = 0, data = 0;
+
+	if (!(ep = ep_lookup(epfd)))
+		return -EBADF;
+	if (fd >= current->max_fds || !(filp = current->filp[fd]) || !filp->f_inode)
+		return -EBADF;
+	if (op != EPOLL_CTL_DEL) {
+		if (!event)
+			return -EFAULT;
+		verify_area(event, sizeof(*event));
+		events = get_fs_long(&event->events);
+		data = get_fs_long(&event->data);
+	}
+	for (epi = filp->f_epoll ; epi ; epi = epi->fnext)
+		if (epi->ep == ep && epi->fd == fd)
+			break;
+	switch (op) {
+		case EPOLL_CTL_ADD:
+			if (epi)
+				return -EEXIST;
+			if (!(list = ep_list(filp->f_inode)))
+				return -EPERM;
+			if (!(free = ep_alloc(ep)))
+				return -ENOMEM;
+			/* we may have slept, and the set may be shared */
+			for (epi = filp->f_epoll ; epi ; epi = epi->fnext)
+				if (epi->ep == ep && epi->fd == fd)
+					return -EEXIST;
+			ep->free = free->next;
+			free->ep = ep;
+			free->file = filp;
+			free->fd = fd;
+			free->list = list;
+			free->ready = 0;
+			free->events = events;
+			free->data = data;
+			cli();
+			free->next = *list;
+			*list = free;
+			free->fnext = filp->f_epoll;
+			filp->f_epoll = free;
+			ep_queue(free);
+			sti();
+			ep->nr++;
+			return 0;
+		case EPOLL_CTL_MOD:
+			if (!epi)
+				return -ENOENT;
+			epi->events = events;
+			epi->data = data;
+			cli();
+			ep_queue(epi);
+			sti();
+			return 0;
+		case EPOLL_CTL_DEL:
+			if (!epi)
+				return -ENOENT;
+			ep_unlink(epi);
+			return 0;
+	}
+	return -EINVAL;
+}
+
+/*
+ * epoll_ctl(epfd, op, fd, event)
+ */
+int sys_epoll_ctl(unsigned long * buffer)
+{
+	verify_area(buffer, 4 * sizeof(long));
+	return do_epoll_ctl(get_fs_long(buffer),
+			    get_fs_long(buffer+1),
+			    get_fs_long(buffer+2),
+			    (struct epoll_event *) get_fs_long(buffer+3));
+}
+
+static unsigned long ep_check(struct epitem * epi)
+{
+	struct inode * inode = epi->file->f_inode;
+	unsigned long revents = 0;
+
+	if ((epi->events & EPOLLIN) && select_check(inode, SEL_IN))
+		revents |= EPOLLIN;
+	if ((epi->events & EPOLLOUT) && select_check(inode, SEL_OUT))
+		revents |= EPOLLOUT;
+	if ((epi->events & EPOLLPRI) && select_check(inode, SEL_EX))
+		revents |= EPOLLPRI;
+	return revents;
+}
+
+/*
+ * Take the ready list off the object and go through it. Entries that
+ * turn out not to be ready are dropped; level-triggered ones that are
+ * get queued again, so the next wait looks at them once more.
+ */
+static int ep_scan(struct eventpoll * ep, struct epoll_event * events,
+	int maxevents)
+{
+	struct epitem * epi, * next;
+	unsigned long revents;
+	int count = 0;
+
+	cli();
+	epi = ep->rdlist;
+	ep->rdlist = ep->rdtail = NULL;
+	sti();
+	for ( ; epi && count < maxevents ; epi = next) {
+		cli();
+		next = epi->rdnext;
+		epi->ready = 0;
+		sti();
+		if (!epi->file || !(revents = ep_check(epi)))
+			continue;
+		put_fs_long(revents, &events->events);
+		put_fs_long(epi->data, &events->data);
+		events++;
+		count++;
+		if (!(epi->events & EPOLLET)) {
+			cli();
+			ep_queue(epi);
+			sti();
+		}
+	}
+	cli();
+	for ( ; epi ; epi = next) {
+		next = epi->rdnext;
+		epi->ready = 0;
+		if (epi->file)
+			ep_queue(epi);
+	}
+	sti();
+	return count;
+}
+
+static int do_epoll_wait(unsigned int epfd, struct epoll_event * events,
+	int maxevents, int timeout)
+{
+	struct eventpoll * ep;
+	int count;
+
+	if (maxevents <= 0)
+		return -EINVAL;
+	if (!(ep = ep_lookup(epfd)))
+		return -EBADF;
+	verify_area(events, maxevents * sizeof(*events));
+	if (timeout < 0)
+		current->timeout = 0;
+	else
+		current->timeout = jiffies + (timeout * HZ + 999) / 1000;
+	for (;;) {
+		if ((count = ep_scan(ep, events, maxevents)))
+			break;
+		if (current->signal & ~current->blocked) {
+			count = -EINTR;
+			break;
+		}
+		if (timeout >= 0 && current->timeout <= jiffies)
+			break;
+		cli();
+		if (!ep->rdlist)
+			interruptible_sleep_on(&ep->wait);
+		sti();
+	}
+	current->timeout = 0;
+	return count;
+}
+
+/*
+ * epoll_wait(epfd, events, maxevents, timeout): timeout is in
+ * milliseconds, negative to wait for ever.
+ */
+int sys_epoll_wait(unsigned long * buffer)
+{
+	verify_area(buffer, 4 * sizeof(long));
+	return do_epoll_wait(get_fs_long(buffer),
+			     (struct epoll_event *) get_fs_long(buffer+1),
+			     get_fs_long(buffer+2),
+			     get_fs_long(buffer+3));
+}
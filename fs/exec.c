@@ -551,10 +551,9 @@ restart_interp:
 		if (current->sigaction[i].sa_handler != SIG_IGN)
 			current->sigaction[i].sa_handler = NULL;
 	}
-	for (i=0 ; i<NR_OPEN ; i++)
-		if ((current->close_on_exec>>i)&1)
+	for (i=0 ; i<current->max_fds ; i++)
+		if (FD_CLOEXEC_ISSET(current,i))
 			sys_close(i);
-	current->close_on_exec = 0;
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
 	if (last_task_used_math == current)
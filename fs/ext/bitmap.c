@@ -10,7 +10,12 @@
  *  (C) 1991  Linus Torvalds
  */
 
-/* bitmap.c contains the code that handles the inode and block bitmaps */
+/*
+ * bitmap.c contains the code that handles the inode and block bitmaps,
+ * and the ext_new_xxx()/ext_free_xxx() entry points, which hand the
+ * request to the bitmap or the free list code depending on the layout
+ * of the mounted file system.
+ */
 
 
 #include <linux/string.h>
@@ -18,41 +23,49 @@
 #include <linux/ext_fs.h>
 #include <linux/kernel.h>
 
-#ifdef EXTFS_BITMAP
-
-#define clear_block(addr) \
-__asm__("cld\n\t" \
-	"rep\n\t" \
-	"stosl" \
-	::"a" (0),"c" (BLOCK_SIZE/4),"D" ((long) (addr)):"cx","di")
+#define clear_block(addr) memset((addr),0,BLOCK_SIZE)
 
 #define set_bit(nr,addr) ({\
 char res; \
 __asm__ __volatile__("btsl %1,%2\n\tsetb %0": \
-"=q" (res):"r" (nr),"m" (*(addr))); \
+"=q" (res):"r" ((int) (nr)),"m" (*(addr))); \
 res;})
 
 #define clear_bit(nr,addr) ({\
 char res; \
 __asm__ __volatile__("btrl %1,%2\n\tsetnb %0": \
-"=q" (res):"r" (nr),"m" (*(addr))); \
+"=q" (res):"r" ((int) (nr)),"m" (*(addr))); \
 res;})
 
-#define find_first_zero(addr) ({ \
+#define ffz(word) ({ \
 int __res; \
-__asm__("cld\n" \
-	"1:\tlodsl\n\t" \
-	"notl %%eax\n\t" \
-	"bsfl %%eax,%%edx\n\t" \
-	"jne 2f\n\t" \
-	"addl $32,%%ecx\n\t" \
-	"cmpl $8192,%%ecx\n\t" \
-	"jl 1b\n\t" \
-	"xorl %%edx,%%edx\n" \
-	"2:\taddl %%edx,%%ecx" \
-	:"=c" (__res):"0" (0),"S" (addr):"ax","dx","si"); \
+__asm__("bsfl %1,%0":"=r" (__res):"r" (~(word))); \
 __res;})
 
+/*
+ * find_next_zero() returns the first clear bit at or after 'offset' and
+ * below 'size' in a map block, or 'size' if there is none. Starting the
+ * search at the bit of a "goal" block keeps the blocks of a file close
+ * together. The map is read 32 bits at a time.
+ */
+static int find_next_zero(char * map, int size, int offset)
+{
+	unsigned int * p = (unsigned int *) map;
+	unsigned int word;
+	int i = offset >> 5, bit = size;
+
+	if (offset & 31) {
+		word = p[i] | ((1U << (offset & 31)) - 1);
+		if (word != ~0U)
+			bit = (i << 5) + ffz(word);
+		i++;
+	}
+	for ( ; bit == size && (i << 5) < size ; i++)
+		if (p[i] != ~0U)
+			bit = (i << 5) + ffz(p[i]);
+	return (bit < size) ? bit : size;
+}
+
 static int nibblemap[] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
 
 static unsigned long count_used(struct buffer_head *map[], unsigned numblocks,
@@ -82,7 +95,7 @@ static unsigned long count_used(struct buffer_head *map[], unsigned numblocks,
 	return(sum);
 }
 
-int ext_free_block(int dev, int block)
+int ext_bitmap_free_block(int dev, int block)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
@@ -113,27 +126,41 @@ int ext_free_block(int dev, int block)
 	return 1;
 }
 
-int ext_new_block(int dev)
+/*
+ * The search starts at the zone map bit of 'goal' and walks forward
+ * through the maps, wrapping around to the first one, so a block is
+ * allocated as close after the goal as possible. The last map block
+ * is only searched up to the last zone: the bits after it are padding.
+ */
+int ext_bitmap_new_block(int dev, int goal)
 {
 	struct buffer_head * bh;
 	struct super_block * sb;
-	int i,j;
+	int i,j,k,start,size,bits;
 
 	if (!(sb = get_super(dev)))
 		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if (bh=sb->s_zmap[i])
-			if ((j=find_first_zero(bh->b_data))<8192)
+	if (goal < sb->s_firstdatazone || goal >= sb->s_nzones)
+		goal = sb->s_firstdatazone;
+	bits = sb->s_nzones - sb->s_firstdatazone + 1;
+	start = goal - sb->s_firstdatazone + 1;
+	i = start >> 13;
+	j = size = 8192;
+	for (k=0 ; k<=sb->s_zmap_blocks ; k++) {
+		if ((size = bits - i*8192) > 8192)
+			size = 8192;
+		if ((bh=sb->s_zmap[i]))
+			if ((j=find_next_zero(bh->b_data,size,k ? 0 : start&8191))<size)
 				break;
-	if (i>=8 || !bh || j>=8192)
+		if (++i >= sb->s_zmap_blocks)
+			i = 0;
+	}
+	if (k>sb->s_zmap_blocks || !bh || j>=size)
 		return 0;
 	if (set_bit(j,bh->b_data))
 		panic("new_block: bit already set");
 	bh->b_dirt = 1;
 	j += i*8192 + sb->s_firstdatazone-1;
-	if (j >= sb->s_nzones)
-		return 0;
 	if (!(bh=getblk(dev,j)))
 		panic("new_block: cannot get block");
 	if (bh->b_count != 1)
@@ -148,13 +175,13 @@ printk("ext_new_block: allocating block %d\n", j);
 	return j;
 }
 
-unsigned long ext_count_free_blocks(struct super_block *sb)
+unsigned long ext_bitmap_count_free_blocks(struct super_block *sb)
 {
 	return (sb->s_nzones - count_used(sb->s_zmap,sb->s_zmap_blocks,sb->s_nzones))
 		 << sb->s_log_zone_size;
 }
 
-void ext_free_inode(struct inode * inode)
+void ext_bitmap_free_inode(struct inode * inode)
 {
 	struct buffer_head * bh;
 
@@ -190,7 +217,7 @@ void ext_free_inode(struct inode * inode)
 	memset(inode,0,sizeof(*inode));
 }
 
-struct inode * ext_new_inode(int dev)
+struct inode * ext_bitmap_new_inode(int dev)
 {
 	struct inode * inode;
 	struct buffer_head * bh;
@@ -204,9 +231,9 @@ struct inode * ext_new_inode(int dev)
 		return NULL;
 	}
 	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if (bh=inode->i_sb->s_imap[i])
-			if ((j=find_first_zero(bh->b_data))<8192)
+	for (i=0 ; i<inode->i_sb->s_imap_blocks ; i++)
+		if ((bh=inode->i_sb->s_imap[i]))
+			if ((j=find_next_zero(bh->b_data,8192,0))<8192)
 				break;
 	if (!bh || j >= 8192 || j+i*8192 > inode->i_sb->s_ninodes) {
 		iput(inode);
@@ -233,9 +260,69 @@ struct inode * ext_new_inode(int dev)
 	return inode;
 }
 
-unsigned long ext_count_free_inodes(struct super_block *sb)
+unsigned long ext_bitmap_count_free_inodes(struct super_block *sb)
 {
 	return sb->s_ninodes - count_used(sb->s_imap,sb->s_imap_blocks,sb->s_ninodes);
 }
 
-#endif
+int ext_free_block(int dev, int block)
+{
+	struct super_block * sb;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to free block on nonexistent device");
+	if (EXT_BITMAP(sb))
+		return ext_bitmap_free_block(dev,block);
+	return ext_freelist_free_block(dev,block);
+}
+
+/*
+ * 'goal' is the block the caller would like to get, usually the one
+ * following the previous block of the file. Only the bitmap layout can
+ * honour it: the free list hands out blocks in the order they were freed.
+ */
+int ext_new_block(int dev, int goal)
+{
+	struct super_block * sb;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to get new block from nonexistant device");
+	if (EXT_BITMAP(sb))
+		return ext_bitmap_new_block(dev,goal);
+	return ext_freelist_new_block(dev);
+}
+
+unsigned long ext_count_free_blocks(struct super_block *sb)
+{
+	if (EXT_BITMAP(sb))
+		return ext_bitmap_count_free_blocks(sb);
+	return ext_freelist_count_free_blocks(sb);
+}
+
+void ext_free_inode(struct inode * inode)
+{
+	if (inode && inode->i_dev && inode->i_sb && EXT_BITMAP(inode->i_sb))
+		ext_bitmap_free_inode(inode);
+	else
+		ext_freelist_free_inode(inode);
+}
+
+struct inode * ext_new_inode(int dev)
+{
+	struct super_block * sb;
+
+	if (!(sb = get_super(dev))) {
+		printk("new_inode: unknown device\n");
+		return NULL;
+	}
+	if (EXT_BITMAP(sb))
+		return ext_bitmap_new_inode(dev);
+	return ext_freelist_new_inode(dev);
+}
+
+unsigned long ext_count_free_inodes(struct super_block *sb)
+{
+	if (EXT_BITMAP(sb))
+		return ext_bitmap_count_free_inodes(sb);
+	return ext_freelist_count_free_inodes(sb);
+}
@@ -35,6 +35,8 @@
 
 static int ext_file_read(struct inode *, struct file *, char *, int);
 static int ext_file_write(struct inode *, struct file *, char *, int);
+static int ext_file_readv(struct inode *, struct file *, struct iovec *, int, off_t *);
+static int ext_file_writev(struct inode *, struct file *, struct iovec *, int, off_t *);
 
 /*
  * We have mostly NULL's here: the current defaults are ok for
@@ -48,7 +50,9 @@ static struct file_operations ext_file_operations = {
 	NULL,			/* select - default */
 	NULL,			/* ioctl - default */
 	NULL,			/* no special open is needed */
-	NULL			/* release */
+	NULL,			/* release */
+	ext_file_readv,	/* readv */
+	ext_file_writev	/* writev */
 };
 
 struct inode_operations ext_file_inode_operations = {
@@ -76,32 +80,33 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 	sti();
 }
 
-static int ext_file_read(struct inode * inode, struct file * filp, char * buf, int count)
+static int ext_file_readv(struct inode * inode, struct file * filp, struct iovec * iov, int nr_segs, off_t * ppos)
 {
+	int count = iov_length(iov,nr_segs);
 	int read,left,chars,nr;
 	int block, blocks, offset;
 	struct buffer_head ** bhb, ** bhe;
 	struct buffer_head * buflist[NBUF];
 
 	if (!inode) {
-		printk("ext_file_read: inode = NULL\n");
+		printk("ext_file_readv: inode = NULL\n");
 		return -EINVAL;
 	}
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode))) {
-		printk("ext_file_read: mode = %07o\n",inode->i_mode);
+		printk("ext_file_readv: mode = %07o\n",inode->i_mode);
 		return -EINVAL;
 	}
-	if (filp->f_pos > inode->i_size)
+	if (*ppos > inode->i_size)
 		left = 0;
 	else
-		left = inode->i_size - filp->f_pos;
+		left = inode->i_size - *ppos;
 	if (left > count)
 		left = count;
 	if (left <= 0)
 		return 0;
 	read = 0;
-	block = filp->f_pos >> BLOCK_SIZE_BITS;
-	offset = filp->f_pos & (BLOCK_SIZE-1);
+	block = *ppos >> BLOCK_SIZE_BITS;
+	offset = *ppos & (BLOCK_SIZE-1);
 	blocks = (left + offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
 	bhb = bhe = buflist;
 	do {
@@ -136,17 +141,14 @@ static int ext_file_read(struct inode * inode, struct file * filp, char * buf, i
 			chars = left;
 		else
 			chars = BLOCK_SIZE - offset;
-		filp->f_pos += chars;
+		*ppos += chars;
 		left -= chars;
 		read += chars;
 		if (*bhe) {
-			memcpy_tofs(buf,offset+(*bhe)->b_data,chars);
+			memcpy_toiovec(iov,offset+(*bhe)->b_data,chars);
 			brelse(*bhe);
-			buf += chars;
-		} else {
-			while (chars-->0)
-				put_fs_byte(0,buf++);
-		}
+		} else
+			clear_iovec(iov,chars);
 		offset = 0;
 		if (++bhe == &buflist[NBUF])
 			bhe = buflist;
@@ -158,19 +160,20 @@ static int ext_file_read(struct inode * inode, struct file * filp, char * buf, i
 	return read;
 }
 
-static int ext_file_write(struct inode * inode, struct file * filp, char * buf, int count)
+static int ext_file_writev(struct inode * inode, struct file * filp, struct iovec * iov, int nr_segs, off_t * ppos)
 {
+	int count = iov_length(iov,nr_segs);
 	off_t pos;
 	int written,block,c;
 	struct buffer_head * bh;
 	char * p;
 
 	if (!inode) {
-		printk("ext_file_write: inode = NULL\n");
+		printk("ext_file_writev: inode = NULL\n");
 		return -EINVAL;
 	}
 	if (!S_ISREG(inode->i_mode)) {
-		printk("ext_file_write: mode = %07o\n",inode->i_mode);
+		printk("ext_file_writev: mode = %07o\n",inode->i_mode);
 		return -EINVAL;
 	}
 /*
@@ -180,7 +183,7 @@ static int ext_file_write(struct inode * inode, struct file * filp, char * buf,
 	if (filp->f_flags & O_APPEND)
 		pos = inode->i_size;
 	else
-		pos = filp->f_pos;
+		pos = *ppos;
 	written = 0;
 	while (written<count) {
 		if (!(block = ext_create_block(inode,pos/BLOCK_SIZE))) {
@@ -207,15 +210,32 @@ static int ext_file_write(struct inode * inode, struct file * filp, char * buf,
 			inode->i_dirt = 1;
 		}
 		written += c;
-		memcpy_fromfs(p,buf,c);
-		buf += c;
+		memcpy_fromiovec(p,iov,c);
 		bh->b_uptodate = 1;
 		bh->b_dirt = 1;
 		brelse(bh);
 	}
 	inode->i_mtime = CURRENT_TIME;
 	inode->i_ctime = CURRENT_TIME;
-	filp->f_pos = pos;
+	*ppos = pos;
 	inode->i_dirt = 1;
 	return written;
 }
+
+static int ext_file_read(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return ext_file_readv(inode,filp,&iov,1,&filp->f_pos);
+}
+
+static int ext_file_write(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return ext_file_writev(inode,filp,&iov,1,&filp->f_pos);
+}
@@ -18,6 +18,9 @@
    in s->s_zmap[0] and the block header is stored in s->s_zmap[1]. s_zmap[2]
    contains the count of free blocks.
 
+   This is the layout of file systems with EXT_SUPER_MAGIC, the bitmap
+   layout is handled in bitmap.c.
+
    Currently, it is a hack to allow this kind of management with the super_block
    structure.
    Perhaps, in the future, we may have to change the super_block structure to
@@ -39,15 +42,13 @@
 #include <linux/ext_fs.h>
 #include <linux/kernel.h>
 
-#ifdef EXTFS_FREELIST
-
 #define clear_block(addr) \
 __asm__("cld\n\t" \
         "rep\n\t" \
         "stosl" \
         ::"a" (0),"c" (BLOCK_SIZE/4),"D" ((long) (addr)):"cx","di")
 
-int ext_free_block(int dev, int block)
+int ext_freelist_free_block(int dev, int block)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
@@ -76,8 +77,11 @@ int ext_free_block(int dev, int block)
 printk("ext_free_block: block full, skipping to %d\n", block);
 #endif
 		brelse (sb->s_zmap[1]);
-		if (!(sb->s_zmap[1] = bread (dev, block)))
-			panic ("ext_free_block: unable to read block to free\n");
+		/* the old contents are dead, no need to read them in */
+		if (!(sb->s_zmap[1] = getblk (dev, block)))
+			panic ("ext_free_block: unable to get block to free\n");
+		clear_block(sb->s_zmap[1]->b_data);
+		sb->s_zmap[1]->b_uptodate = 1;
 		efb = (struct ext_free_block *) sb->s_zmap[1]->b_data;
 		efb->next = (unsigned long) sb->s_zmap[0];
 		efb->count = 0;
@@ -92,7 +96,7 @@ printk("ext_free_block: block full, skipping to %d\n", block);
 	return 1;
 }
 
-int ext_new_block(int dev)
+int ext_freelist_new_block(int dev)
 {
 	struct buffer_head * bh;
 	struct super_block * sb;
@@ -144,7 +148,7 @@ printk("ext_new_block: allocating block %d\n", j);
 	return j;
 }
 
-unsigned long ext_count_free_blocks(struct super_block *sb)
+unsigned long ext_freelist_count_free_blocks(struct super_block *sb)
 {
 #ifdef EXTFS_DEBUG
 	struct buffer_head * bh;
@@ -179,7 +183,7 @@ printk("ext_count_free_blocks: stored = %d, computed = %d\n",
 #endif
 }
 
-void ext_free_inode(struct inode * inode)
+void ext_freelist_free_inode(struct inode * inode)
 {
 	struct buffer_head * bh;
 	struct ext_free_inode * efi;
@@ -235,7 +239,7 @@ printk("ext_free_inode: inode full, skipping to %d\n", inode->i_ino);
 	memset(inode,0,sizeof(*inode));
 }
 
-struct inode * ext_new_inode(int dev)
+struct inode * ext_freelist_new_inode(int dev)
 {
 	struct inode * inode;
 	struct ext_free_inode * efi;
@@ -294,7 +298,7 @@ printk("ext_new_inode : allocating inode %d\n", inode->i_ino);
 	return inode;
 }
 
-unsigned long ext_count_free_inodes(struct super_block *sb)
+unsigned long ext_freelist_count_free_inodes(struct super_block *sb)
 {
 #ifdef EXTFS_DEBUG
 	struct buffer_head * bh;
@@ -336,5 +340,3 @@ printk("ext_count_free_inodes: stored = %d, computed = %d\n",
 	return (unsigned long) sb->s_imap[2];
 #endif
 }
-
-#endif
@@ -30,24 +30,21 @@ void ext_put_inode(struct inode *inode)
 
 void ext_put_super(struct super_block *sb)
 {
-#ifdef EXTFS_BITMAP
 	int i;
-#endif
 
 	lock_super(sb);
 	sb->s_dev = 0;
-#ifdef EXTFS_BITMAP
-	for(i = 0 ; i < EXT_I_MAP_SLOTS ; i++)
-		brelse(sb->s_imap[i]);
-	for(i = 0 ; i < EXT_Z_MAP_SLOTS ; i++)
-		brelse(sb->s_zmap[i]);
-#endif
-#ifdef EXTFS_FREELIST
-	if (sb->s_imap[1])
-		brelse (sb->s_imap[1]);
-	if (sb->s_zmap[1])
-		brelse (sb->s_zmap[1]);
-#endif
+	if (EXT_BITMAP(sb)) {
+		for(i = 0 ; i < EXT_I_MAP_SLOTS ; i++)
+			brelse(sb->s_imap[i]);
+		for(i = 0 ; i < EXT_Z_MAP_SLOTS ; i++)
+			brelse(sb->s_zmap[i]);
+	} else {
+		if (sb->s_imap[1])
+			brelse (sb->s_imap[1]);
+		if (sb->s_zmap[1])
+			brelse (sb->s_zmap[1]);
+	}
 	free_super(sb);
 	return;
 }
@@ -66,9 +63,7 @@ struct super_block *ext_read_super(struct super_block *s,void *data)
 	struct buffer_head *bh;
 	struct ext_super_block *es;
 	int dev=s->s_dev,block;
-#ifdef EXTFS_BITMAP
 	int i;
-#endif
 
 	lock_super(s);
 	if (!(bh = bread(dev,1))) {
@@ -82,79 +77,85 @@ struct super_block *ext_read_super(struct super_block *s,void *data)
 	es = (struct ext_super_block *) bh->b_data;
 	s->s_ninodes = es->s_ninodes;
 	s->s_nzones = es->s_nzones;
-#ifdef EXTFS_BITMAP
-	s->s_imap_blocks = es->s_imap_blocks;
-	s->s_zmap_blocks = es->s_zmap_blocks;
-#endif
 	s->s_firstdatazone = es->s_firstdatazone;
 	s->s_log_zone_size = es->s_log_zone_size;
 	s->s_max_size = es->s_max_size;
 	s->s_magic = es->s_magic;
-#ifdef EXTFS_FREELIST
-	s->s_zmap[0] = (struct buffer_head *) es->s_firstfreeblock;
-	s->s_zmap[2] = (struct buffer_head *) es->s_freeblockscount;
-	s->s_imap[0] = (struct buffer_head *) es->s_firstfreeinode;
-	s->s_imap[2] = (struct buffer_head *) es->s_freeinodescount;
-#endif
+	if (EXT_BITMAP(s)) {
+		s->s_imap_blocks = es->s_imap_blocks;
+		s->s_zmap_blocks = es->s_zmap_blocks;
+	} else {
+		s->s_imap_blocks = s->s_zmap_blocks = 0;
+		s->s_zmap[0] = (struct buffer_head *) es->s_firstfreeblock;
+		s->s_zmap[2] = (struct buffer_head *) es->s_freeblockscount;
+		s->s_imap[0] = (struct buffer_head *) es->s_firstfreeinode;
+		s->s_imap[2] = (struct buffer_head *) es->s_freeinodescount;
+	}
 	brelse(bh);
-	if (s->s_magic != EXT_SUPER_MAGIC) {
+	if (s->s_magic != EXT_SUPER_MAGIC && s->s_magic != EXT_BITMAP_SUPER_MAGIC) {
 		s->s_dev = 0;
 		free_super(s);
 		printk("magic match failed\n");
 		return NULL;
 	}
-#ifdef EXTFS_BITMAP
-	for (i=0;i < EXT_I_MAP_SLOTS;i++)
-		s->s_imap[i] = NULL;
-	for (i=0;i < EXT_Z_MAP_SLOTS;i++)
-		s->s_zmap[i] = NULL;
-	block=2;
-	for (i=0 ; i < s->s_imap_blocks ; i++)
-		if (s->s_imap[i]=bread(dev,block))
-			block++;
-		else
-			break;
-	for (i=0 ; i < s->s_zmap_blocks ; i++)
-		if (s->s_zmap[i]=bread(dev,block))
-			block++;
-		else
-			break;
-	if (block != 2+s->s_imap_blocks+s->s_zmap_blocks) {
-		for(i=0;i<EXT_I_MAP_SLOTS;i++)
-			brelse(s->s_imap[i]);
-		for(i=0;i<EXT_Z_MAP_SLOTS;i++)
-			brelse(s->s_zmap[i]);
-		s->s_dev=0;
-		free_super(s);
-		printk("block failed\n");
-		return NULL;
-	}
-	s->s_imap[0]->b_data[0] |= 1;
-	s->s_zmap[0]->b_data[0] |= 1;
-#endif
-#ifdef EXTFS_FREELIST
-	if (!s->s_zmap[0])
-		s->s_zmap[1] = NULL;
-	else
-		if (!(s->s_zmap[1] = bread (dev, (unsigned long) s->s_zmap[0]))) {
-			printk ("ext_read_super: unable to read first free block\n");
+	if (EXT_BITMAP(s)) {
+		if (s->s_imap_blocks > EXT_I_MAP_SLOTS ||
+		    s->s_zmap_blocks > EXT_Z_MAP_SLOTS) {
 			s->s_dev = 0;
 			free_super(s);
+			printk("ext_read_super: too many map blocks\n");
 			return NULL;
 		}
-	if (!s->s_imap[0])
-		s->s_imap[1] = NULL;
-	else {
-		block = 2 + (((unsigned long) s->s_imap[0]) - 1) / EXT_INODES_PER_BLOCK;
-		if (!(s->s_imap[1] = bread (dev, block))) {
-			printk ("ext_read_super: unable to read first free inode block\n");
-			brelse(s->s_zmap[1]);
-			s->s_dev = 0;
-			free_super (s);
+		for (i=0;i < EXT_I_MAP_SLOTS;i++)
+			s->s_imap[i] = NULL;
+		for (i=0;i < EXT_Z_MAP_SLOTS;i++)
+			s->s_zmap[i] = NULL;
+		block=2;
+		for (i=0 ; i < s->s_imap_blocks ; i++)
+			if (s->s_imap[i]=bread(dev,block))
+				block++;
+			else
+				break;
+		for (i=0 ; i < s->s_zmap_blocks ; i++)
+			if (s->s_zmap[i]=bread(dev,block))
+				block++;
+			else
+				break;
+		if (block != 2+s->s_imap_blocks+s->s_zmap_blocks) {
+			for(i=0;i<EXT_I_MAP_SLOTS;i++)
+				brelse(s->s_imap[i]);
+			for(i=0;i<EXT_Z_MAP_SLOTS;i++)
+				brelse(s->s_zmap[i]);
+			s->s_dev=0;
+			free_super(s);
+			printk("block failed\n");
 			return NULL;
 		}
+		s->s_imap[0]->b_data[0] |= 1;
+		s->s_zmap[0]->b_data[0] |= 1;
+	} else {
+		if (!s->s_zmap[0])
+			s->s_zmap[1] = NULL;
+		else
+			if (!(s->s_zmap[1] = bread (dev, (unsigned long) s->s_zmap[0]))) {
+				printk ("ext_read_super: unable to read first free block\n");
+				s->s_dev = 0;
+				free_super(s);
+				return NULL;
+			}
+		if (!s->s_imap[0])
+			s->s_imap[1] = NULL;
+		else {
+			block = 2 + (((unsigned long) s->s_imap[0]) - 1) / EXT_INODES_PER_BLOCK;
+			if (!(s->s_imap[1] = bread (dev, block))) {
+				printk ("ext_read_super: unable to read first free inode block\n");
+				brelse(s->s_zmap[1]);
+				s->s_dev = 0;
+				free_super (s);
+				return NULL;
+			}
+		}
 	}
-#endif
 
 	free_super(s);
 	/* set up enough so that it can read an inode */
@@ -168,15 +169,22 @@ struct super_block *ext_read_super(struct super_block *s,void *data)
 	return s;
 }
 
+/*
+ * The bitmaps live in buffers and are written back with them, only the
+ * free list layout keeps state in the super block.
+ */
 void ext_write_super (struct super_block *sb)
 {
-#ifdef EXTFS_FREELIST
 	struct buffer_head * bh;
 	struct ext_super_block * es;
 
 #ifdef EXTFS_DEBUG
 	printk ("ext_write_super called\n");
 #endif
+	if (EXT_BITMAP(sb)) {
+		sb->s_dirt = 0;
+		return;
+	}
 	if (!(bh = bread (sb->s_dev, 1))) {
 		printk ("ext_write_super: bread failed\n");
 		return;
@@ -189,7 +197,6 @@ void ext_write_super (struct super_block *sb)
 	bh->b_dirt = 1;
 	brelse (bh);
 	sb->s_dirt = 0;
-#endif
 }
 
 void ext_statfs (struct super_block *sb, struct statfs *buf)
@@ -207,6 +214,20 @@ void ext_statfs (struct super_block *sb, struct statfs *buf)
 	/* Don't know what value to put in buf->f_fsid */
 }
 
+/*
+ * ext_goal() picks the block we would like for entry 'nr' of an indirect
+ * block: the one after the previous entry, or after the indirect block
+ * itself for the first entry.
+ */
+static int ext_goal(struct buffer_head * bh, int nr)
+{
+	unsigned long * p = (unsigned long *) bh->b_data;
+
+	if (nr && p[nr-1])
+		return p[nr-1]+1;
+	return bh->b_blocknr+1;
+}
+
 static int _ext_bmap(struct inode * inode,int block,int create)
 {
 	struct buffer_head * bh;
@@ -222,7 +243,8 @@ static int _ext_bmap(struct inode * inode,int block,int create)
 	}
 	if (block<9) {
 		if (create && !inode->i_data[block])
-			if (inode->i_data[block]=ext_new_block(inode->i_dev)) {
+			if (inode->i_data[block]=ext_new_block(inode->i_dev,
+			    block ? inode->i_data[block-1]+1 : 0)) {
 				inode->i_ctime=CURRENT_TIME;
 				inode->i_dirt=1;
 			}
@@ -231,7 +253,8 @@ static int _ext_bmap(struct inode * inode,int block,int create)
 	block -= 9;
 	if (block<256) {
 		if (create && !inode->i_data[9])
-			if (inode->i_data[9]=ext_new_block(inode->i_dev)) {
+			if (inode->i_data[9]=ext_new_block(inode->i_dev,
+			    inode->i_data[8]+1)) {
 				inode->i_dirt=1;
 				inode->i_ctime=CURRENT_TIME;
 			}
@@ -241,7 +264,7 @@ static int _ext_bmap(struct inode * inode,int block,int create)
 			return 0;
 		i = ((unsigned long *) (bh->b_data))[block];
 		if (create && !i)
-			if (i=ext_new_block(inode->i_dev)) {
+			if (i=ext_new_block(inode->i_dev,ext_goal(bh,block))) {
 				((unsigned long *) (bh->b_data))[block]=i;
 				bh->b_dirt=1;
 			}
@@ -251,7 +274,8 @@ static int _ext_bmap(struct inode * inode,int block,int create)
 	block -= 256;
 	if (block<256*256) {
 		if (create && !inode->i_data[10])
-			if (inode->i_data[10]=ext_new_block(inode->i_dev)) {
+			if (inode->i_data[10]=ext_new_block(inode->i_dev,
+			    inode->i_data[9]+1)) {
 				inode->i_dirt=1;
 				inode->i_ctime=CURRENT_TIME;
 			}
@@ -261,7 +285,7 @@ static int _ext_bmap(struct inode * inode,int block,int create)
 			return 0;
 		i = ((unsigned long *)bh->b_data)[block>>8];
 		if (create && !i)
-			if (i=ext_new_block(inode->i_dev)) {
+			if (i=ext_new_block(inode->i_dev,ext_goal(bh,block>>8))) {
 				((unsigned long *) (bh->b_data))[block>>8]=i;
 				bh->b_dirt=1;
 			}
@@ -272,7 +296,7 @@ static int _ext_bmap(struct inode * inode,int block,int create)
 			return 0;
 		i = ((unsigned long *)bh->b_data)[block&255];
 		if (create && !i)
-			if (i=ext_new_block(inode->i_dev)) {
+			if (i=ext_new_block(inode->i_dev,ext_goal(bh,block&255))) {
 				((unsigned long *) (bh->b_data))[block&255]=i;
 				bh->b_dirt=1;
 			}
@@ -299,13 +323,8 @@ void ext_read_inode(struct inode * inode)
 	struct ext_inode * raw_inode;
 	int block;
 
-#ifdef EXTFS_BITMAP
 	block = 2 + inode->i_sb->s_imap_blocks + inode->i_sb->s_zmap_blocks +
 		(inode->i_ino-1)/EXT_INODES_PER_BLOCK;
-#endif
-#ifdef EXTFS_FREELIST
-	block = 2 + (inode->i_ino-1)/EXT_INODES_PER_BLOCK;
-#endif
 	if (!(bh=bread(inode->i_dev,block)))
 		panic("unable to read i-node block");
 	raw_inode = ((struct ext_inode *) bh->b_data) +
@@ -336,8 +355,7 @@ void ext_read_inode(struct inode * inode)
 		inode->i_op = &ext_fifo_inode_operations;
 		inode->i_size = 0;
 		inode->i_pipe = 1;
-		PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
-		PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 0;
+		init_pipe_inode(inode);
 	}
 }
 
@@ -347,13 +365,8 @@ void ext_write_inode(struct inode * inode)
 	struct ext_inode * raw_inode;
 	int block;
 
-#ifdef EXTFS_BITMAP
 	block = 2 + inode->i_sb->s_imap_blocks + inode->i_sb->s_zmap_blocks +
 		(inode->i_ino-1)/EXT_INODES_PER_BLOCK;
-#endif
-#ifdef EXTFS_FREELIST
-	block = 2 + (inode->i_ino-1)/EXT_INODES_PER_BLOCK;
-#endif
 	if (!(bh=bread(inode->i_dev,block)))
 		panic("unable to read i-node block");
 	raw_inode = ((struct ext_inode *)bh->b_data) +
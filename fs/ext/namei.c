@@ -373,8 +373,7 @@ int ext_mknod(struct inode * dir, const char * name, int len, int mode, int rdev
 		inode->i_op = &ext_fifo_inode_operations;
 		inode->i_size = 0;
 		inode->i_pipe = 1;
-		PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
-		PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 0;
+		init_pipe_inode(inode);
 	}
 	if (S_ISBLK(mode) || S_ISCHR(mode))
 		inode->i_rdev = rdev;
@@ -420,7 +419,7 @@ int ext_mkdir(struct inode * dir, const char * name, int len, int mode)
 					- 2 bytes for the name length
 					- 8 bytes for the name */
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_data[0] = ext_new_block(inode->i_dev))) {
+	if (!(inode->i_data[0] = ext_new_block(inode->i_dev,dir->i_data[0]))) {
 		iput(dir);
 		inode->i_nlink--;
 		inode->i_dirt = 1;
@@ -635,7 +634,7 @@ int ext_symlink(struct inode * dir, const char * name, int len, const char * sym
 	}
 	inode->i_mode = S_IFLNK | 0777;
 	inode->i_op = &ext_symlink_inode_operations;
-	if (!(inode->i_data[0] = ext_new_block(inode->i_dev))) {
+	if (!(inode->i_data[0] = ext_new_block(inode->i_dev,dir->i_data[0]))) {
 		iput(dir);
 		inode->i_nlink--;
 		inode->i_dirt = 1;
@@ -18,25 +18,27 @@ extern int sys_close(int fd);
 
 static int dupfd(unsigned int fd, unsigned int arg)
 {
-	if (fd >= NR_OPEN || !current->filp[fd])
+	int error;
+
+	if (fd >= current->max_fds || !current->filp[fd])
 		return -EBADF;
-	if (arg >= NR_OPEN)
+	if (arg >= NR_OPEN_MAX)
 		return -EINVAL;
-	while (arg < NR_OPEN)
+	while (arg < current->max_fds)
 		if (current->filp[arg])
 			arg++;
 		else
 			break;
-	if (arg >= NR_OPEN)
-		return -EMFILE;
-	current->close_on_exec &= ~(1<<arg);
+	if ((error = expand_fd_table(arg)))
+		return error;
+	FD_CLOEXEC_CLR(current,arg);
 	(current->filp[arg] = current->filp[fd])->f_count++;
 	return arg;
 }
 
 int sys_dup2(unsigned int oldfd, unsigned int newfd)
 {
-	if (oldfd >= NR_OPEN || !current->filp[oldfd])
+	if (oldfd >= current->max_fds || !current->filp[oldfd])
 		return -EBADF;
 	if (newfd == oldfd)
 		return newfd;
@@ -53,18 +55,18 @@ int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg)
 {	
 	struct file * filp;
 
-	if (fd >= NR_OPEN || !(filp = current->filp[fd]))
+	if (fd >= current->max_fds || !(filp = current->filp[fd]))
 		return -EBADF;
 	switch (cmd) {
 		case F_DUPFD:
 			return dupfd(fd,arg);
 		case F_GETFD:
-			return (current->close_on_exec>>fd)&1;
+			return FD_CLOEXEC_ISSET(current,fd);
 		case F_SETFD:
 			if (arg&1)
-				current->close_on_exec |= (1<<fd);
+				FD_CLOEXEC_SET(current,fd);
 			else
-				current->close_on_exec &= ~(1<<fd);
+				FD_CLOEXEC_CLR(current,fd);
 			return 0;
 		case F_GETFL:
 			return filp->f_flags;
@@ -74,6 +76,8 @@ int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg)
 			return 0;
 		case F_GETLK:	case F_SETLK:	case F_SETLKW:
 			return -ENOSYS;
+		case F_SETPIPE_SZ:	case F_GETPIPE_SZ:
+			return pipe_fcntl(filp->f_inode,cmd,arg);
 		default:
 			return -EINVAL;
 	}
@@ -17,7 +17,6 @@ extern struct file_operations rdwr_pipe_fops;
 static int fifo_open(struct inode * inode,struct file * filp)
 {
 	int retval = 0;
-	unsigned long page;
 
 	switch( filp->f_mode ) {
 
@@ -31,7 +30,7 @@ static int fifo_open(struct inode * inode,struct file * filp)
 		PIPE_READERS(*inode)++;
 		if (!(filp->f_flags & O_NONBLOCK))
 			while (!PIPE_WRITERS(*inode)) {
-				if (PIPE_HEAD(*inode) != PIPE_TAIL(*inode))
+				if (!PIPE_EMPTY(*inode))
 					break;
 				if (current->signal & ~current->blocked) {
 					retval = -ERESTARTSYS;
@@ -85,17 +84,9 @@ static int fifo_open(struct inode * inode,struct file * filp)
 		wake_up(&PIPE_READ_WAIT(*inode));
 	if (PIPE_READERS(*inode))
 		wake_up(&PIPE_WRITE_WAIT(*inode));
-	if (retval || inode->i_size)
+	if (retval)
 		return retval;
-	page = get_free_page();
-	if (inode->i_size) {
-		free_page(page);
-		return 0;
-	}
-	if (!page)
-		return -ENOMEM;
-	inode->i_size = page;
-	return 0;
+	return alloc_pipe_pages(inode);
 }
 
 /*
@@ -4,6 +4,117 @@
  *  (C) 1991  Linus Torvalds
  */
 
+#include <errno.h>
+
 #include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
 
 struct file file_table[NR_FILE];
+
+/*
+ * When the static table runs out, more file structures are allocated
+ * a page at a time and chained together. They are never given back.
+ */
+struct file_page {
+	struct file_page * next;
+	struct file files[1];
+};
+
+#define FILES_PER_PAGE \
+	((PAGE_SIZE - sizeof(struct file_page)) / sizeof(struct file) + 1)
+
+static struct file_page * file_pages = NULL;
+static int nr_files = NR_FILE;
+
+static struct file * find_empty_filp(void)
+{
+	struct file_page * fp;
+	struct file * f;
+	int i;
+
+	for (f = file_table, i = 0 ; i < NR_FILE ; i++, f++)
+		if (!f->f_count)
+			return f;
+	for (fp = file_pages ; fp ; fp = fp->next)
+		for (f = fp->files, i = 0 ; i < FILES_PER_PAGE ; i++, f++)
+			if (!f->f_count)
+				return f;
+	return NULL;
+}
+
+/*
+ * Returns a file structure with f_count set to 1, the rest is up to
+ * the caller.
+ */
+struct file * get_empty_filp(void)
+{
+	struct file_page * fp;
+	struct file * f;
+
+	while (!(f = find_empty_filp())) {
+		if (nr_files + FILES_PER_PAGE > NR_FILE_MAX)
+			return NULL;
+		if (!(fp = (struct file_page *) get_free_page()))
+			return NULL;
+		if ((f = find_empty_filp())) {	/* we may have slept */
+			free_page((unsigned long) fp);
+			break;
+		}
+		fp->next = file_pages;
+		file_pages = fp;
+		nr_files += FILES_PER_PAGE;
+	}
+	f->f_count = 1;
+	f->f_epoll = NULL;
+	return f;
+}
+
+/*
+ * Make sure descriptor nr fits in the current process' table. The
+ * table starts out as the NR_OPEN slots in the task structure and is
+ * moved to a page (NR_OPEN_MAX slots) the first time it overflows.
+ */
+int expand_fd_table(int nr)
+{
+	unsigned long page;
+	struct file ** filp;
+	unsigned long * cloexec;
+
+	if (nr < current->max_fds)
+		return 0;
+	if (nr >= NR_OPEN_MAX)
+		return -EMFILE;
+	if (!(page = get_free_page()))
+		return -ENOMEM;
+	if (nr < current->max_fds) {
+		free_page(page);
+		return 0;
+	}
+	filp = (struct file **) page;
+	cloexec = (unsigned long *) (filp + NR_OPEN_MAX);
+	memcpy(filp, current->filp, current->max_fds * sizeof(struct file *));
+	memcpy(cloexec, current->close_on_exec, current->max_fds / 8);
+	current->filp = filp;
+	current->close_on_exec = cloexec;
+	current->max_fds = NR_OPEN_MAX;
+	return 0;
+}
+
+/*
+ * Lowest free descriptor, growing the table if they are all taken. The
+ * close-on-exec flag is cleared.
+ */
+int get_unused_fd(void)
+{
+	int fd, error;
+
+	for (fd = 0 ; fd < current->max_fds ; fd++)
+		if (!current->filp[fd])
+			break;
+	if ((error = expand_fd_table(fd)))
+		return error;
+	FD_CLOEXEC_CLR(current,fd);
+	return fd;
+}
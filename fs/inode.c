@@ -125,10 +125,8 @@ repeat:
 		inode->i_count--;
 		return;
 	}
-	if (inode->i_pipe) {
-		free_page(inode->i_size);
-		inode->i_size = 0;
-	}
+	if (inode->i_pipe)
+		free_pipe_pages(inode);
 	if (!inode->i_dev) {
 		inode->i_count--;
 		return;
@@ -188,12 +186,12 @@ struct inode * get_pipe_inode(void)
 
 	if (!(inode = get_empty_inode()))
 		return NULL;
-	if (!(inode->i_size = get_free_page())) {
+	init_pipe_inode(inode);
+	if (alloc_pipe_pages(inode)) {
 		inode->i_count = 0;
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
-	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
 	PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 1;
 	inode->i_pipe = 1;
 	return inode;
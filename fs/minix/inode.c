@@ -248,8 +248,7 @@ void minix_read_inode(struct inode * inode)
 		inode->i_op = &minix_fifo_inode_operations;
 		inode->i_size = 0;
 		inode->i_pipe = 1;
-		PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
-		PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 0;
+		init_pipe_inode(inode);
 	}
 }
 
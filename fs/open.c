@@ -53,7 +53,7 @@ int sys_fstatfs(unsigned int fd, struct statfs * buf)
 	struct file * file;
 
 	verify_area(buf, sizeof(struct statfs));
-	if (fd >= NR_OPEN || !(file = current->filp[fd]))
+	if (fd >= current->max_fds || !(file = current->filp[fd]))
 		return -EBADF;
 	if (!(inode = file->f_inode))
 		return -ENOENT;
@@ -87,7 +87,7 @@ int sys_ftruncate(unsigned int fd, unsigned int length)
 	struct inode * inode;
 	struct file * file;
 
-	if (fd >= NR_OPEN || !(file = current->filp[fd]))
+	if (fd >= current->max_fds || !(file = current->filp[fd]))
 		return -EBADF;
 	if (!(inode = file->f_inode))
 		return -ENOENT;
@@ -209,7 +209,7 @@ int sys_fchmod(unsigned int fd, mode_t mode)
 	struct inode * inode;
 	struct file * file;
 
-	if (fd >= NR_OPEN || !(file = current->filp[fd]))
+	if (fd >= current->max_fds || !(file = current->filp[fd]))
 		return -EBADF;
 	if (!(inode = file->f_inode))
 		return -ENOENT;
@@ -241,7 +241,7 @@ int sys_fchown(unsigned int fd, uid_t user, gid_t group)
 	struct inode * inode;
 	struct file * file;
 
-	if (fd >= NR_OPEN || !(file = current->filp[fd]))
+	if (fd >= current->max_fds || !(file = current->filp[fd]))
 		return -EBADF;
 	if (!(inode = file->f_inode))
 		return -ENOENT;
@@ -281,18 +281,11 @@ int sys_open(const char * filename,int flag,int mode)
 	struct file * f;
 	int i,fd;
 
-	for(fd=0 ; fd<NR_OPEN ; fd++)
-		if (!current->filp[fd])
-			break;
-	if (fd>=NR_OPEN)
-		return -EMFILE;
-	current->close_on_exec &= ~(1<<fd);
-	f=0+file_table;
-	for (i=0 ; i<NR_FILE ; i++,f++)
-		if (!f->f_count) break;
-	if (i>=NR_FILE)
+	if ((fd = get_unused_fd()) < 0)
+		return fd;
+	if (!(f = get_empty_filp()))
 		return -ENFILE;
-	(current->filp[fd] = f)->f_count++;
+	current->filp[fd] = f;
 	if ((i = open_namei(filename,flag,mode,&inode))<0) {
 		current->filp[fd]=NULL;
 		f->f_count=0;
@@ -308,7 +301,7 @@ int sys_open(const char * filename,int flag,int mode)
 	if (inode->i_op)
 		f->f_op = inode->i_op->default_file_ops;
 	if (f->f_op && f->f_op->open)
-		if (i = f->f_op->open(inode,f)) {
+		if ((i = f->f_op->open(inode,f))) {
 			iput(inode);
 			f->f_count=0;
 			current->filp[fd]=NULL;
@@ -322,27 +315,37 @@ int sys_creat(const char * pathname, int mode)
 	return sys_open(pathname, O_CREAT | O_WRONLY | O_TRUNC, mode);
 }
 
-int sys_close(unsigned int fd)
-{	
-	struct file * filp;
-
-	if (fd >= NR_OPEN)
-		return -EINVAL;
-	current->close_on_exec &= ~(1<<fd);
-	if (!(filp = current->filp[fd]))
-		return -EINVAL;
-	current->filp[fd] = NULL;
+/*
+ * Drop a reference to a file that isn't (or is no longer) in any
+ * descriptor table, e.g. one in flight on a unix socket.
+ */
+void close_fp(struct file * filp)
+{
 	if (filp->f_count == 0) {
 		printk("Close: file count is 0\n");
-		return 0;
+		return;
 	}
 	if (filp->f_count > 1) {
 		filp->f_count--;
-		return 0;
+		return;
 	}
+	epoll_release(filp);
 	if (filp->f_op && filp->f_op->release)
 		filp->f_op->release(filp->f_inode,filp);
 	iput(filp->f_inode);
 	filp->f_count--;
+}
+
+int sys_close(unsigned int fd)
+{	
+	struct file * filp;
+
+	if (fd >= current->max_fds)
+		return -EINVAL;
+	FD_CLOEXEC_CLR(current,fd);
+	if (!(filp = current->filp[fd]))
+		return -EINVAL;
+	current->filp[fd] = NULL;
+	close_fp(filp);
 	return 0;
 }
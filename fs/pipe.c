@@ -8,57 +8,103 @@
 #include <errno.h>
 #include <termios.h>
 
+#include <limits.h>
+
 #include <asm/segment.h>
+#include <asm/system.h>
 
 #include <linux/fcntl.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/string.h>
 
-static int pipe_read(struct inode * inode, struct file * filp, char * buf, int count)
+/*
+ * The pipe buffer is a ring of pages. A transfer never crosses a page
+ * boundary in one go, and an emptied pipe is rewound to offset 0, so
+ * page-sized writes on an idle pipe go into a single page with one
+ * copy and come out again the same way.
+ */
+#define PIPE_ADDR(inode,pos) \
+	(PIPE_PAGE(inode,(pos)/PAGE_SIZE) + ((pos) & (PAGE_SIZE-1)))
+
+/*
+ * Copying to or from user space can sleep on a page fault halfway
+ * through. The ring is locked for the whole transfer, so the other
+ * side can't rewind it and pipe_resize() can't free the pages while
+ * a copy is still using them.
+ */
+static inline void lock_pipe(struct inode * inode)
 {
+	cli();
+	while (PIPE_LOCK(*inode))
+		sleep_on(&PIPE_LOCK_WAIT(*inode));
+	PIPE_LOCK(*inode) = 1;
+	sti();
+}
+
+static inline void unlock_pipe(struct inode * inode)
+{
+	PIPE_LOCK(*inode) = 0;
+	wake_up(&PIPE_LOCK_WAIT(*inode));
+}
+
+static int pipe_readv(struct inode * inode, struct file * filp, struct iovec * iov, int nr, off_t * ppos)
+{
+	int count = iov_length(iov,nr);
 	int chars, size, read = 0;
 
+	lock_pipe(inode);
 	if (!(filp->f_flags & O_NONBLOCK))
 		while (!PIPE_SIZE(*inode)) {
 			wake_up(& PIPE_WRITE_WAIT(*inode));
+			unlock_pipe(inode);
 			if (!PIPE_WRITERS(*inode)) /* are there any writers? */
 				return 0;
 			if (current->signal & ~current->blocked)
 				return -ERESTARTSYS;
 			interruptible_sleep_on(& PIPE_READ_WAIT(*inode));
+			lock_pipe(inode);
 		}
 	while (count>0 && (size = PIPE_SIZE(*inode))) {
-		chars = PAGE_SIZE-PIPE_TAIL(*inode);
+		chars = PAGE_SIZE-(PIPE_TAIL(*inode) & (PAGE_SIZE-1));
 		if (chars > count)
 			chars = count;
 		if (chars > size)
 			chars = size;
-		memcpy_tofs(buf, (char *)inode->i_size+PIPE_TAIL(*inode), chars );
+		memcpy_toiovec(iov, (char *) PIPE_ADDR(*inode,PIPE_TAIL(*inode)), chars );
 		read += chars;
 		PIPE_TAIL(*inode) += chars;
-		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
+		if (PIPE_TAIL(*inode) >= PIPE_BUFSIZE(*inode))
+			PIPE_TAIL(*inode) = 0;
+		PIPE_LEN(*inode) -= chars;
 		count -= chars;
-		buf += chars;
 	}
+	if (!PIPE_LEN(*inode))
+		PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
+	unlock_pipe(inode);
 	wake_up(& PIPE_WRITE_WAIT(*inode));
+	epoll_wakeup(inode->i_epoll);
 	return read?read:-EAGAIN;
 }
 	
-static int pipe_write(struct inode * inode, struct file * filp, char * buf, int count)
+static int pipe_writev(struct inode * inode, struct file * filp, struct iovec * iov, int nr, off_t * ppos)
 {
-	int chars, size, written = 0;
+	int count = iov_length(iov,nr);
+	int chars, size, free, written = 0;
 
 	if (!PIPE_READERS(*inode)) { /* no readers */
 		send_sig(SIGPIPE,current,0);
 		return -EPIPE;
 	}
-/* if count < PAGE_SIZE, we have to make it atomic */
-	if (count < PAGE_SIZE)
-		size = PAGE_SIZE-count;
+/* if count <= PIPE_BUF, we have to make it atomic */
+	if (count <= PIPE_BUF)
+		size = count;
 	else
-		size = PAGE_SIZE-1;
+		size = 1;
 	while (count>0) {
-		while (PIPE_SIZE(*inode) >= size) {
+		lock_pipe(inode);
+		while (PIPE_BUFSIZE(*inode) - PIPE_LEN(*inode) < size) {
+			unlock_pipe(inode);
 			if (!PIPE_READERS(*inode)) { /* no readers */
 				send_sig(SIGPIPE,current,0);
 				return written?written:-EPIPE;
@@ -66,29 +112,50 @@ static int pipe_write(struct inode * inode, struct file * filp, char * buf, int
 			if (current->signal & ~current->blocked)
 				return written?written:-ERESTARTSYS;
 			if (filp->f_flags & O_NONBLOCK)
-				return -EAGAIN;
-			else
-				interruptible_sleep_on(&PIPE_WRITE_WAIT(*inode));
+				return written?written:-EAGAIN;
+			interruptible_sleep_on(&PIPE_WRITE_WAIT(*inode));
+			lock_pipe(inode);
 		}
-		while (count>0 && (size = (PAGE_SIZE-1)-PIPE_SIZE(*inode))) {
-			chars = PAGE_SIZE-PIPE_HEAD(*inode);
+		while (count>0 && (free = PIPE_BUFSIZE(*inode)-PIPE_LEN(*inode))) {
+			chars = PAGE_SIZE-(PIPE_HEAD(*inode) & (PAGE_SIZE-1));
 			if (chars > count)
 				chars = count;
-			if (chars > size)
-				chars = size;
-			memcpy_fromfs((char *)inode->i_size+PIPE_HEAD(*inode), buf, chars );
+			if (chars > free)
+				chars = free;
+			memcpy_fromiovec((char *) PIPE_ADDR(*inode,PIPE_HEAD(*inode)), iov, chars );
 			written += chars;
 			PIPE_HEAD(*inode) += chars;
-			PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
+			if (PIPE_HEAD(*inode) >= PIPE_BUFSIZE(*inode))
+				PIPE_HEAD(*inode) = 0;
+			PIPE_LEN(*inode) += chars;
 			count -= chars;
-			buf += chars;
 		}
+		unlock_pipe(inode);
 		wake_up(& PIPE_READ_WAIT(*inode));
-		size = PAGE_SIZE-1;
+		epoll_wakeup(inode->i_epoll);
+		size = 1;
 	}
 	return written;
 }
 
+static int pipe_read(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return pipe_readv(inode,filp,&iov,1,&filp->f_pos);
+}
+
+static int pipe_write(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return pipe_writev(inode,filp,&iov,1,&filp->f_pos);
+}
+
 static int pipe_lseek(struct inode * inode, struct file * file, off_t offset, int orig)
 {
 	return -ESPIPE;
@@ -104,6 +171,11 @@ static int bad_pipe_rw(struct inode * inode, struct file * filp, char * buf, int
 	return -EBADF;
 }
 
+static int bad_pipe_rwv(struct inode * inode, struct file * filp, struct iovec * iov, int nr, off_t * ppos)
+{
+	return -EBADF;
+}
+
 static int pipe_ioctl(struct inode *pino, struct file * filp,
 	unsigned int cmd, unsigned int arg)
 {
@@ -125,12 +197,14 @@ static void pipe_read_release(struct inode * inode, struct file * filp)
 {
 	PIPE_READERS(*inode)--;
 	wake_up(&PIPE_WRITE_WAIT(*inode));
+	epoll_wakeup(inode->i_epoll);
 }
 
 static void pipe_write_release(struct inode * inode, struct file * filp)
 {
 	PIPE_WRITERS(*inode)--;
 	wake_up(&PIPE_READ_WAIT(*inode));
+	epoll_wakeup(inode->i_epoll);
 }
 
 static void pipe_rdwr_release(struct inode * inode, struct file * filp)
@@ -139,6 +213,115 @@ static void pipe_rdwr_release(struct inode * inode, struct file * filp)
 	PIPE_WRITERS(*inode)--;
 	wake_up(&PIPE_READ_WAIT(*inode));
 	wake_up(&PIPE_WRITE_WAIT(*inode));
+	epoll_wakeup(inode->i_epoll);
+}
+
+void init_pipe_inode(struct inode * inode)
+{
+	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = PIPE_LEN(*inode) = 0;
+	PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 0;
+	PIPE_PAGES(*inode) = 0;
+	PIPE_LOCK(*inode) = 0;
+	PIPE_LOCK_WAIT(*inode) = NULL;
+}
+
+/*
+ * Give a pipe its first page if it doesn't have one yet. Fifo's get
+ * theirs on the first open, so we may have slept in between.
+ */
+int alloc_pipe_pages(struct inode * inode)
+{
+	unsigned long page;
+
+	if (PIPE_PAGES(*inode))
+		return 0;
+	page = get_free_page();
+	if (PIPE_PAGES(*inode)) {
+		free_page(page);
+		return 0;
+	}
+	if (!page)
+		return -ENOMEM;
+	PIPE_PAGE(*inode,0) = page;
+	PIPE_PAGES(*inode) = 1;
+	return 0;
+}
+
+void free_pipe_pages(struct inode * inode)
+{
+	while (PIPE_PAGES(*inode))
+		free_page(PIPE_PAGE(*inode,--PIPE_PAGES(*inode)));
+	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = PIPE_LEN(*inode) = 0;
+}
+
+/*
+ * Resize the ring to hold at least arg bytes (rounded up to pages). The
+ * contents are copied over to the start of the new pages, so this can't
+ * shrink the pipe below what it currently holds.
+ */
+static int pipe_resize(struct inode * inode, unsigned long arg)
+{
+	unsigned long pages[PIPE_MAX_PAGES];
+	int nr, i, chars, done;
+
+	if (!arg)
+		arg = 1;
+	nr = (arg + PAGE_SIZE-1) / PAGE_SIZE;
+	if (arg > PIPE_MAX_PAGES*PAGE_SIZE)
+		return -EINVAL;
+	lock_pipe(inode);
+	if (nr == PIPE_PAGES(*inode)) {
+		unlock_pipe(inode);
+		return PIPE_BUFSIZE(*inode);
+	}
+	if (nr*PAGE_SIZE < PIPE_LEN(*inode)) {
+		unlock_pipe(inode);
+		return -EBUSY;
+	}
+	for (i = 0 ; i < nr ; i++)
+		if (!(pages[i] = get_free_page())) {
+			while (i--)
+				free_page(pages[i]);
+			unlock_pipe(inode);
+			return -ENOMEM;
+		}
+	for (done = 0 ; done < PIPE_LEN(*inode) ; done += chars) {
+		chars = PAGE_SIZE-(PIPE_TAIL(*inode) & (PAGE_SIZE-1));
+		if (chars > PIPE_LEN(*inode) - done)
+			chars = PIPE_LEN(*inode) - done;
+		if (chars > PAGE_SIZE - (done & (PAGE_SIZE-1)))
+			chars = PAGE_SIZE - (done & (PAGE_SIZE-1));
+		memcpy((char *) pages[done/PAGE_SIZE] + (done & (PAGE_SIZE-1)),
+			(char *) PIPE_ADDR(*inode,PIPE_TAIL(*inode)), chars);
+		PIPE_TAIL(*inode) += chars;
+		if (PIPE_TAIL(*inode) >= PIPE_BUFSIZE(*inode))
+			PIPE_TAIL(*inode) = 0;
+	}
+	while (PIPE_PAGES(*inode))
+		free_page(PIPE_PAGE(*inode,--PIPE_PAGES(*inode)));
+	for (i = 0 ; i < nr ; i++)
+		PIPE_PAGE(*inode,i) = pages[i];
+	PIPE_PAGES(*inode) = nr;
+	PIPE_TAIL(*inode) = 0;
+	PIPE_HEAD(*inode) = done % PIPE_BUFSIZE(*inode);
+	unlock_pipe(inode);
+	wake_up(&PIPE_WRITE_WAIT(*inode));
+	epoll_wakeup(inode->i_epoll);
+	return PIPE_BUFSIZE(*inode);
+}
+
+int pipe_fcntl(struct inode * inode, unsigned int cmd, unsigned long arg)
+{
+	if (!inode->i_pipe || !PIPE_PAGES(*inode))
+		return -EINVAL;
+	switch (cmd) {
+		case F_GETPIPE_SZ:
+			return PIPE_BUFSIZE(*inode);
+		case F_SETPIPE_SZ:
+			return pipe_resize(inode,arg);
+		default:
+			return -EINVAL;
+	}
 }
 
 /*
@@ -153,7 +336,9 @@ struct file_operations read_pipe_fops = {
 	NULL,		/* pipe_select */
 	pipe_ioctl,
 	NULL,		/* no special open code */
-	pipe_read_release
+	pipe_read_release,
+	pipe_readv,
+	bad_pipe_rwv
 };
 
 struct file_operations write_pipe_fops = {
@@ -164,7 +349,9 @@ struct file_operations write_pipe_fops = {
 	NULL,		/* pipe_select */
 	pipe_ioctl,
 	NULL,		/* no special open code */
-	pipe_write_release
+	pipe_write_release,
+	bad_pipe_rwv,
+	pipe_writev
 };
 
 struct file_operations rdwr_pipe_fops = {
@@ -175,7 +362,9 @@ struct file_operations rdwr_pipe_fops = {
 	NULL,		/* pipe_select */
 	pipe_ioctl,
 	NULL,		/* no special open code */
-	pipe_rdwr_release
+	pipe_rdwr_release,
+	pipe_readv,
+	pipe_writev
 };
 
 int sys_pipe(unsigned long * fildes)
@@ -183,29 +372,25 @@ int sys_pipe(unsigned long * fildes)
 	struct inode * inode;
 	struct file * f[2];
 	int fd[2];
-	int i,j;
 
 	verify_area(fildes,8);
-	j=0;
-	for(i=0;j<2 && i<NR_FILE;i++)
-		if (!file_table[i].f_count)
-			(f[j++]=i+file_table)->f_count++;
-	if (j==1)
+	if (!(f[0] = get_empty_filp()))
+		return -ENFILE;
+	if (!(f[1] = get_empty_filp())) {
 		f[0]->f_count=0;
-	if (j<2)
-		return -1;
-	j=0;
-	for(i=0;j<2 && i<NR_OPEN;i++)
-		if (!current->filp[i]) {
-			current->filp[ fd[j]=i ] = f[j];
-			j++;
-		}
-	if (j==1)
+		return -ENFILE;
+	}
+	if ((fd[0] = get_unused_fd()) < 0) {
+		f[0]->f_count=f[1]->f_count=0;
+		return fd[0];
+	}
+	current->filp[fd[0]] = f[0];
+	if ((fd[1] = get_unused_fd()) < 0) {
 		current->filp[fd[0]]=NULL;
-	if (j<2) {
 		f[0]->f_count=f[1]->f_count=0;
-		return -1;
+		return fd[1];
 	}
+	current->filp[fd[1]] = f[1];
 	if (!(inode=get_pipe_inode())) {
 		current->filp[fd[0]] =
 			current->filp[fd[1]] = NULL;
@@ -13,6 +13,7 @@
 #include <linux/sched.h>
 #include <linux/minix_fs.h>
 #include <asm/segment.h>
+#include <sys/uio.h>
 
 /*
  * Count is not yet used: but we'll probably support reading several entries
@@ -23,7 +24,7 @@ int sys_readdir(unsigned int fd, struct dirent * dirent, unsigned int count)
 	struct file * file;
 	struct inode * inode;
 
-	if (fd >= NR_OPEN || !(file = current->filp[fd]) ||
+	if (fd >= current->max_fds || !(file = current->filp[fd]) ||
 	    !(inode = file->f_inode))
 		return -EBADF;
 	if (file->f_op && file->f_op->readdir) {
@@ -38,7 +39,7 @@ int sys_lseek(unsigned int fd, off_t offset, unsigned int origin)
 	struct file * file;
 	int tmp = -1;
 
-	if (fd >= NR_OPEN || !(file=current->filp[fd]) || !(file->f_inode))
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(file->f_inode))
 		return -EBADF;
 	if (origin > 2)
 		return -EINVAL;
@@ -71,7 +72,7 @@ int sys_read(unsigned int fd,char * buf,unsigned int count)
 	struct file * file;
 	struct inode * inode;
 
-	if (fd>=NR_OPEN || !(file=current->filp[fd]) || !(inode=file->f_inode))
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(inode=file->f_inode))
 		return -EBADF;
 	if (!(file->f_mode & 1))
 		return -EBADF;
@@ -88,7 +89,7 @@ int sys_write(unsigned int fd,char * buf,unsigned int count)
 	struct file * file;
 	struct inode * inode;
 	
-	if (fd>=NR_OPEN || !(file=current->filp[fd]) || !(inode=file->f_inode))
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(inode=file->f_inode))
 		return -EBADF;
 	if (!(file->f_mode&2))
 		return -EBADF;
@@ -98,3 +99,287 @@ int sys_write(unsigned int fd,char * buf,unsigned int count)
 		return file->f_op->write(inode,file,buf,count);
 	return -EINVAL;
 }
+
+/*
+ * Helpers for the readv/writev handlers. They consume the (kernel copy
+ * of the) iovec as they go, so a handler can call them once per chunk
+ * of data it has at hand, just like memcpy_tofs/memcpy_fromfs. The
+ * caller makes sure the segments hold at least 'n' bytes.
+ */
+int iov_length(struct iovec * iov, int nr)
+{
+	int len = 0;
+
+	while (nr-- > 0)
+		len += (iov++)->iov_len;
+	return len;
+}
+
+void memcpy_toiovec(struct iovec * iov, char * from, int n)
+{
+	int chars;
+
+	while (n > 0) {
+		while (!iov->iov_len)
+			iov++;
+		chars = iov->iov_len;
+		if (chars > n)
+			chars = n;
+		memcpy_tofs(iov->iov_base, from, chars);
+		iov->iov_base += chars;
+		iov->iov_len -= chars;
+		from += chars;
+		n -= chars;
+	}
+}
+
+void memcpy_fromiovec(char * to, struct iovec * iov, int n)
+{
+	int chars;
+
+	while (n > 0) {
+		while (!iov->iov_len)
+			iov++;
+		chars = iov->iov_len;
+		if (chars > n)
+			chars = n;
+		memcpy_fromfs(to, iov->iov_base, chars);
+		iov->iov_base += chars;
+		iov->iov_len -= chars;
+		to += chars;
+		n -= chars;
+	}
+}
+
+void clear_iovec(struct iovec * iov, int n)
+{
+	while (n-- > 0) {
+		while (!iov->iov_len)
+			iov++;
+		put_fs_byte(0,iov->iov_base++);
+		iov->iov_len--;
+	}
+}
+
+/*
+ * Copy in and check the user's iovec. Returns the total byte count.
+ */
+int get_iovec(struct iovec * iov, const struct iovec * uiov, int nr,
+	int rw)
+{
+	int i, len = 0;
+
+	if (nr <= 0 || nr > UIO_MAXIOV)
+		return -EINVAL;
+	verify_area((void *) uiov, nr * sizeof(struct iovec));
+	memcpy_fromfs(iov, (void *) uiov, nr * sizeof(struct iovec));
+	for (i = 0 ; i < nr ; i++) {
+		if (iov[i].iov_len < 0)
+			return -EINVAL;
+		if (rw == READ)
+			verify_area(iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+		if (len < 0)
+			return -EINVAL;
+	}
+	return len;
+}
+
+/*
+ * Files without vector operations get one read/write per segment,
+ * stopping at the first short transfer.
+ */
+static int do_readv_writev(int rw, unsigned int fd, const struct iovec * uiov,
+	int nr)
+{
+	struct file * file;
+	struct inode * inode;
+	struct iovec iov[UIO_MAXIOV];
+	int (*fn)(struct inode *, struct file *, char *, int);
+	int i, len, done;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(inode=file->f_inode))
+		return -EBADF;
+	if (!(file->f_mode & (rw == READ ? 1 : 2)))
+		return -EBADF;
+	if ((len = get_iovec(iov, uiov, nr, rw)) <= 0)
+		return len;
+	if (!file->f_op)
+		return -EINVAL;
+	if (rw == READ && file->f_op->readv)
+		return file->f_op->readv(inode,file,iov,nr,&file->f_pos);
+	if (rw == WRITE && file->f_op->writev)
+		return file->f_op->writev(inode,file,iov,nr,&file->f_pos);
+	if (!(fn = (rw == READ) ? file->f_op->read : file->f_op->write))
+		return -EINVAL;
+	for (done = i = 0 ; i < nr ; i++) {
+		if (!iov[i].iov_len)
+			continue;
+		len = fn(inode,file,iov[i].iov_base,iov[i].iov_len);
+		if (len < 0)
+			return done ? done : len;
+		done += len;
+		if (len < iov[i].iov_len)
+			break;
+	}
+	return done;
+}
+
+int sys_readv(unsigned int fd, const struct iovec * iov, int count)
+{
+	return do_readv_writev(READ,fd,iov,count);
+}
+
+int sys_writev(unsigned int fd, const struct iovec * iov, int count)
+{
+	return do_readv_writev(WRITE,fd,iov,count);
+}
+
+/*
+ * pread/pwrite work on a private copy of the position, so processes
+ * sharing a descriptor don't have to serialize around lseek. Only
+ * regular files and block devices have a position to speak of.
+ */
+static int do_pread_pwrite(int rw, unsigned int fd, char * buf,
+	unsigned int count, off_t pos)
+{
+	struct file * file;
+	struct inode * inode;
+	struct iovec iov;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) || !(inode=file->f_inode))
+		return -EBADF;
+	if (!(file->f_mode & (rw == READ ? 1 : 2)))
+		return -EBADF;
+	if (!S_ISREG(inode->i_mode) && !S_ISBLK(inode->i_mode))
+		return -ESPIPE;
+	if (pos < 0 || (int) count < 0)
+		return -EINVAL;
+	if (!count)
+		return 0;
+	if (rw == READ)
+		verify_area(buf,count);
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	if (!file->f_op)
+		return -EINVAL;
+	if (rw == READ && file->f_op->readv)
+		return file->f_op->readv(inode,file,&iov,1,&pos);
+	if (rw == WRITE && file->f_op->writev)
+		return file->f_op->writev(inode,file,&iov,1,&pos);
+	return -EINVAL;
+}
+
+/*
+ * The system call gate only passes three registers, so like mmap and
+ * select these take a pointer to their (fd, buf, count, pos) arguments.
+ */
+int sys_pread(unsigned long * buffer)
+{
+	verify_area(buffer, 4 * sizeof(long));
+	return do_pread_pwrite(READ, get_fs_long(buffer),
+			       (char *) get_fs_long(buffer+1),
+			       get_fs_long(buffer+2),
+			       (off_t) get_fs_long(buffer+3));
+}
+
+int sys_pwrite(unsigned long * buffer)
+{
+	verify_area(buffer, 4 * sizeof(long));
+	return do_pread_pwrite(WRITE, get_fs_long(buffer),
+			       (char *) get_fs_long(buffer+1),
+			       get_fs_long(buffer+2),
+			       (off_t) get_fs_long(buffer+3));
+}
+
+/*
+ * sendfile() copies straight from the buffer cache into whatever the
+ * output descriptor is (normally a pipe or a socket), by handing the
+ * cached block to its write routine with %fs pointing at kernel data.
+ * That saves the trip through a user buffer. The input has to be a
+ * file we can bmap.
+ */
+static int do_sendfile(unsigned int out_fd, unsigned int in_fd,
+	off_t * upos, unsigned int count)
+{
+	struct file * in, * out;
+	struct inode * inode, * out_inode;
+	struct buffer_head * bh;
+	static char zeroes[BLOCK_SIZE];
+	unsigned long old_fs;
+	off_t pos;
+	int block, offset, chars, written, done = 0;
+
+	if (in_fd >= current->max_fds || !(in=current->filp[in_fd]) || !(inode=in->f_inode))
+		return -EBADF;
+	if (out_fd >= current->max_fds || !(out=current->filp[out_fd]) ||
+	    !(out_inode=out->f_inode))
+		return -EBADF;
+	if (!(in->f_mode & 1) || !(out->f_mode & 2))
+		return -EBADF;
+	if (!S_ISREG(inode->i_mode) || !inode->i_op || !inode->i_op->bmap)
+		return -EINVAL;
+	if (!out->f_op || !out->f_op->write)
+		return -EINVAL;
+	if ((int) count < 0)
+		return -EINVAL;
+	if (upos) {
+		verify_area(upos, sizeof(off_t));
+		pos = get_fs_long((unsigned long *) upos);
+		if (pos < 0)
+			return -EINVAL;
+	} else
+		pos = in->f_pos;
+	while (count > 0 && pos < inode->i_size) {
+		block = pos >> BLOCK_SIZE_BITS;
+		offset = pos & (BLOCK_SIZE-1);
+		chars = BLOCK_SIZE - offset;
+		if (chars > count)
+			chars = count;
+		if (chars > inode->i_size - pos)
+			chars = inode->i_size - pos;
+		bh = NULL;
+		if ((block = inode->i_op->bmap(inode,block)) &&
+		    !(bh = bread(inode->i_dev,block))) {
+			if (!done)
+				done = -EIO;
+			break;
+		}
+		old_fs = get_fs();
+		set_fs(get_ds());
+		written = out->f_op->write(out_inode,out,
+			offset + (bh ? bh->b_data : zeroes),chars);
+		set_fs(old_fs);
+		brelse(bh);
+		if (written <= 0) {
+			if (!done)
+				done = written;
+			break;
+		}
+		done += written;
+		pos += written;
+		count -= written;
+		if (written < chars)
+			break;
+	}
+	if (upos)
+		put_fs_long(pos, (unsigned long *) upos);
+	else
+		in->f_pos = pos;
+	if (done > 0)
+		inode->i_atime = CURRENT_TIME;
+	return done;
+}
+
+/*
+ * sendfile(out_fd, in_fd, &offset, count): offset may be NULL, in which
+ * case the file position of in_fd is used and updated.
+ */
+int sys_sendfile(unsigned long * buffer)
+{
+	verify_area(buffer, 4 * sizeof(long));
+	return do_sendfile(get_fs_long(buffer),
+			   get_fs_long(buffer+1),
+			   (off_t *) get_fs_long(buffer+2),
+			   get_fs_long(buffer+3));
+}
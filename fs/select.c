@@ -22,6 +22,9 @@
 #include <errno.h>
 #include <signal.h>
 
+extern int sock_select(struct inode *inode, struct file *file, int which,
+	select_table *seltable);
+
 /*
  * Ok, Peter made a complicated, but straightforward multiple_wait() function.
  * I have rewritten this, taking some shortcuts: This code may not be easy to
@@ -41,11 +44,13 @@ static void add_wait(struct task_struct ** wait_address, select_table * p)
 {
 	int i;
 
-	if (!wait_address)
+	if (!wait_address || !p)
 		return;
 	for (i = 0 ; i < p->nr ; i++)
 		if (p->entry[i].wait_address == wait_address)
 			return;
+	if (p->nr >= MAX_SELECT_WAITS)
+		return;
 	current->next_wait = NULL;
 	p->entry[p->nr].wait_address = wait_address;
 	p->entry[p->nr].old_task = *wait_address;
@@ -117,23 +122,24 @@ static int check_in(select_table * wait, struct inode * inode)
 {
 	struct tty_struct * tty;
 
-	if (tty = get_tty(inode))
+	if ((tty = get_tty(inode))) {
 		if (!EMPTY(tty->secondary))
 			return 1;
 		else if (tty->link && !tty->link->count)
 			return 1;
 		else
 			add_wait(&tty->secondary->proc_list, wait);
-	else if (inode->i_pipe)
+	} else if (inode->i_pipe) {
 		if (!PIPE_EMPTY(*inode) || !PIPE_WRITERS(*inode))
 			return 1;
 		else
 			add_wait(&inode->i_wait, wait);
-	else if (S_ISSOCK(inode->i_mode))
+	} else if (S_ISSOCK(inode->i_mode)) {
 		if (sock_select(inode, NULL, SEL_IN, wait))
 			return 1;
 		else
 			add_wait(&inode->i_wait, wait);
+	}
 	return 0;
 }
 
@@ -141,21 +147,22 @@ static int check_out(select_table * wait, struct inode * inode)
 {
 	struct tty_struct * tty;
 
-	if (tty = get_tty(inode))
+	if ((tty = get_tty(inode))) {
 		if (!FULL(tty->write_q))
 			return 1;
 		else
 			add_wait(&tty->write_q->proc_list, wait);
-	else if (inode->i_pipe)
+	} else if (inode->i_pipe) {
 		if (!PIPE_FULL(*inode))
 			return 1;
 		else
 			add_wait(&inode->i_wait, wait);
-	else if (S_ISSOCK(inode->i_mode))
+	} else if (S_ISSOCK(inode->i_mode)) {
 		if (sock_select(inode, NULL, SEL_OUT, wait))
 			return 1;
 		else
 			add_wait(&inode->i_wait, wait);
+	}
 	return 0;
 }
 
@@ -163,120 +170,180 @@ static int check_ex(select_table * wait, struct inode * inode)
 {
 	struct tty_struct * tty;
 
-	if (tty = get_tty(inode))
+	if ((tty = get_tty(inode))) {
 		if (!FULL(tty->write_q))
 			return 0;
 		else
 			return 0;
-	else if (inode->i_pipe)
+	} else if (inode->i_pipe) {
 		if (!PIPE_READERS(*inode) || !PIPE_WRITERS(*inode))
 			return 1;
 		else
 			add_wait(&inode->i_wait,wait);
-	else if (S_ISSOCK(inode->i_mode))
+	} else if (S_ISSOCK(inode->i_mode)) {
 		if (sock_select(inode, NULL, SEL_EX, wait))
 			return 1;
 		else
 			add_wait(&inode->i_wait, wait);
+	}
+	return 0;
+}
+
+/*
+ * Used by epoll to ask the same questions without queueing up.
+ */
+int select_check(struct inode * inode, int which)
+{
+	switch (which) {
+		case SEL_IN:
+			return check_in(NULL, inode);
+		case SEL_OUT:
+			return check_out(NULL, inode);
+		case SEL_EX:
+			return check_ex(NULL, inode);
+	}
 	return 0;
 }
 
-int do_select(fd_set in, fd_set out, fd_set ex,
-	fd_set *inp, fd_set *outp, fd_set *exp)
+/*
+ * The sets are arrays of (n+31)/32 longs, in kernel space. The wait
+ * table no longer fits on the stack, so it gets a page of its own.
+ */
+int do_select(int n, unsigned long * in, unsigned long * out,
+	unsigned long * ex, unsigned long * inp, unsigned long * outp,
+	unsigned long * exp)
 {
 	int count;
-	select_table wait_table;
-	int i;
-	fd_set mask;
+	select_table * wait_table;
+	int i, j, words = (n + 31) / 32;
+	unsigned long mask, set;
+	struct file * file;
 
-	mask = in | out | ex;
-	for (i = 0 ; i < NR_OPEN ; i++,mask >>= 1) {
-		if (!(mask & 1))
-			continue;
-		if (!current->filp[i])
-			return -EBADF;
-		if (!current->filp[i]->f_inode)
+	for (j = 0 ; j < words ; j++) {
+		set = in[j] | out[j] | ex[j];
+		for (i = j*32 ; set ; i++, set >>= 1) {
+			if (!(set & 1))
+				continue;
+			if (i >= current->max_fds || !(file = current->filp[i]))
+				return -EBADF;
+			if (!file->f_inode)
+				return -EBADF;
+			if (file->f_inode->i_pipe)
+				continue;
+			if (S_ISCHR(file->f_inode->i_mode))
+				continue;
+			if (S_ISFIFO(file->f_inode->i_mode))
+				continue;
+			if (S_ISSOCK(file->f_inode->i_mode))
+				continue;
 			return -EBADF;
-		if (current->filp[i]->f_inode->i_pipe)
-			continue;
-		if (S_ISCHR(current->filp[i]->f_inode->i_mode))
-			continue;
-		if (S_ISFIFO(current->filp[i]->f_inode->i_mode))
-			continue;
-		if (S_ISSOCK(current->filp[i]->f_inode->i_mode))
-			continue;
-		return -EBADF;
+		}
 	}
+	if (!(wait_table = (select_table *) get_free_page()))
+		return -ENOMEM;
 repeat:
-	wait_table.nr = 0;
-	wait_table.woken = 0;
-	wait_table.current = current;
-	wait_table.next_table = sel_tables;
-	sel_tables = &wait_table;
-	*inp = *outp = *exp = 0;
+	wait_table->nr = 0;
+	wait_table->woken = 0;
+	wait_table->current = current;
+	wait_table->next_table = sel_tables;
+	sel_tables = wait_table;
 	count = 0;
 	current->state = TASK_INTERRUPTIBLE;
-	mask = 1;
-	for (i = 0 ; i < NR_OPEN ; i++, mask += mask) {
-		if (mask & in)
-			if (check_in(&wait_table,current->filp[i]->f_inode)) {
-				*inp |= mask;
-				count++;
-			}
-		if (mask & out)
-			if (check_out(&wait_table,current->filp[i]->f_inode)) {
-				*outp |= mask;
-				count++;
-			}
-		if (mask & ex)
-			if (check_ex(&wait_table,current->filp[i]->f_inode)) {
-				*exp |= mask;
-				count++;
-			}
+	for (j = 0 ; j < words ; j++) {
+		inp[j] = outp[j] = exp[j] = 0;
+		if (!(in[j] | out[j] | ex[j]))
+			continue;
+		for (i = j*32, mask = 1 ; mask ; i++, mask += mask) {
+			if (mask & in[j])
+				if (check_in(wait_table,current->filp[i]->f_inode)) {
+					inp[j] |= mask;
+					count++;
+				}
+			if (mask & out[j])
+				if (check_out(wait_table,current->filp[i]->f_inode)) {
+					outp[j] |= mask;
+					count++;
+				}
+			if (mask & ex[j])
+				if (check_ex(wait_table,current->filp[i]->f_inode)) {
+					exp[j] |= mask;
+					count++;
+				}
+		}
 	}
 	if (!(current->signal & ~current->blocked) &&
 	    current->timeout && !count) {
 		schedule();
-		free_wait(&wait_table);
+		free_wait(wait_table);
 		goto repeat;
 	}
-	free_wait(&wait_table);
+	free_wait(wait_table);
+	free_page((unsigned long) wait_table);
 	current->state = TASK_RUNNING;
 	return count;
 }
 
+static void get_fd_set(unsigned long * fdset, unsigned long * res, int n)
+{
+	int words = (n + 31) / 32;
+
+	if (!fdset) {
+		memset(res, 0, words * sizeof(long));
+		return;
+	}
+	verify_area(fdset, words * sizeof(long));
+	while (words--)
+		*res++ = get_fs_long(fdset++);
+	if (n & 31)
+		res[-1] &= ~(~0UL << (n & 31));
+}
+
+static void set_fd_set(unsigned long * fdset, unsigned long * res, int n)
+{
+	int words = (n + 31) / 32;
+
+	if (!fdset)
+		return;
+	verify_area(fdset, words * sizeof(long));
+	while (words--)
+		put_fs_long(*res++, fdset++);
+}
+
+#define FDS_WORDS (NR_OPEN_MAX/32)
+
 /*
  * Note that we cannot return -ERESTARTSYS, as we change our input
  * parameters. Sad, but there you are. We could do some tweaking in
  * the library function ...
+ *
+ * Only the (nd+31)/32 words of each set that are in use are read and
+ * written back, so binaries built with the old one-long fd_set still
+ * work as long as nd <= 32. A bit set for a descriptor past the end of
+ * our table is EBADF, like any other descriptor that isn't open.
  */
 int sys_select( unsigned long *buffer )
 {
 /* Perform the select(nd, in, out, ex, tv) system call. */
-	int i;
-	fd_set res_in, in = 0, *inp;
-	fd_set res_out, out = 0, *outp;
-	fd_set res_ex, ex = 0, *exp;
-	fd_set mask;
+	int i, n;
+	unsigned long in[FDS_WORDS], out[FDS_WORDS], ex[FDS_WORDS];
+	unsigned long res_in[FDS_WORDS], res_out[FDS_WORDS], res_ex[FDS_WORDS];
+	unsigned long *inp, *outp, *exp;
 	struct timeval *tvp;
 	unsigned long timeout;
 
-	mask = get_fs_long(buffer++);
-	if (mask >= 32)
-		mask = ~0;
-	else
-		mask = ~((~0) << mask);
-	inp = (fd_set *) get_fs_long(buffer++);
-	outp = (fd_set *) get_fs_long(buffer++);
-	exp = (fd_set *) get_fs_long(buffer++);
+	n = get_fs_long(buffer++);
+	if (n < 0)
+		return -EINVAL;
+	if (n > NR_OPEN_MAX)
+		n = NR_OPEN_MAX;
+	inp = (unsigned long *) get_fs_long(buffer++);
+	outp = (unsigned long *) get_fs_long(buffer++);
+	exp = (unsigned long *) get_fs_long(buffer++);
 	tvp = (struct timeval *) get_fs_long(buffer);
 
-	if (inp)
-		in = mask & get_fs_long(inp);
-	if (outp)
-		out = mask & get_fs_long(outp);
-	if (exp)
-		ex = mask & get_fs_long(exp);
+	get_fd_set(inp, in, n);
+	get_fd_set(outp, out, n);
+	get_fd_set(exp, ex, n);
 	timeout = 0xffffffff;
 	if (tvp) {
 		timeout = get_fs_long((unsigned long *)&tvp->tv_usec)/(1000000/HZ);
@@ -284,7 +351,7 @@ int sys_select( unsigned long *buffer )
 		timeout += jiffies;
 	}
 	current->timeout = timeout;
-	i = do_select(in, out, ex, &res_in, &res_out, &res_ex);
+	i = do_select(n, in, out, ex, res_in, res_out, res_ex);
 	if (current->timeout > jiffies)
 		timeout = current->timeout - jiffies;
 	else
@@ -292,18 +359,9 @@ int sys_select( unsigned long *buffer )
 	current->timeout = 0;
 	if (i < 0)
 		return i;
-	if (inp) {
-		verify_area(inp, 4);
-		put_fs_long(res_in,inp);
-	}
-	if (outp) {
-		verify_area(outp,4);
-		put_fs_long(res_out,outp);
-	}
-	if (exp) {
-		verify_area(exp,4);
-		put_fs_long(res_ex,exp);
-	}
+	set_fd_set(inp, res_in, n);
+	set_fd_set(outp, res_out, n);
+	set_fd_set(exp, res_ex, n);
 	if (tvp) {
 		verify_area(tvp, sizeof(*tvp));
 		put_fs_long(timeout/HZ, (unsigned long *) &tvp->tv_sec);
@@ -129,7 +129,7 @@ int sys_fstat(unsigned int fd, struct old_stat * statbuf)
 	struct file * f;
 	struct inode * inode;
 
-	if (fd >= NR_OPEN || !(f=current->filp[fd]) || !(inode=f->f_inode))
+	if (fd >= current->max_fds || !(f=current->filp[fd]) || !(inode=f->f_inode))
 		return -EBADF;
 	cp_old_stat(inode,statbuf);
 	return 0;
@@ -140,7 +140,7 @@ int sys_newfstat(unsigned int fd, struct new_stat * statbuf)
 	struct file * f;
 	struct inode * inode;
 
-	if (fd >= NR_OPEN || !(f=current->filp[fd]) || !(inode=f->f_inode))
+	if (fd >= current->max_fds || !(f=current->filp[fd]) || !(inode=f->f_inode))
 		return -EBADF;
 	cp_new_stat(inode,statbuf);
 	return 0;
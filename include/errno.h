@@ -57,6 +57,23 @@ extern int errno;
 #define ENOTEMPTY	39
 #define ELOOP		40
 
+/* socket errors */
+#define EDESTADDRREQ	89
+#define EMSGSIZE	90
+#define EPROTOTYPE	91
+#define ENOPROTOOPT	92
+#define EPROTONOSUPPORT	93
+#define ESOCKTNOSUPPORT	94
+#define EOPNOTSUPP	95
+#define EAFNOSUPPORT	97
+#define EADDRINUSE	98
+#define EADDRNOTAVAIL	99
+#define ENETUNREACH	101
+#define EISCONN		106
+#define ENOTCONN	107
+#define ETOOMANYREFS	109
+#define ECONNREFUSED	111
+
 /* Should never be seen by user programs */
 #define ERESTARTSYS	512
 #define ERESTARTNOINTR	513
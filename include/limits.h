@@ -51,12 +51,12 @@
 #define NGROUPS_MAX       32	/* supplemental group IDs are available */
 #define ARG_MAX        40960	/* # bytes of args + environ for exec() */
 #define CHILD_MAX        999    /* no limit :-) */
-#define OPEN_MAX          20	/* # open files a process may have */
+#define OPEN_MAX         512	/* # open files a process may have */
 #define LINK_MAX         127	/* # links a file may have */
 #define MAX_CANON        255	/* size of the canonical input queue */
 #define MAX_INPUT        255	/* size of the type-ahead buffer */
 #define NAME_MAX         255	/* # chars in a file name */
 #define PATH_MAX        1024	/* # chars in a path name */
-#define PIPE_BUF        4095	/* # bytes in atomic write to a pipe */
+#define PIPE_BUF        4096	/* # bytes in atomic write to a pipe */
 
 #endif
@@ -10,11 +10,16 @@
 /*
  * Free blocks/inodes management style
  *
- * One of these two constants must be defined
+ * Both layouts are supported, the magic number in the super block tells
+ * which one a file system uses:
  *
+ * EXT_SUPER_MAGIC: free blocks and inodes are kept in linked lists
+ *	(see freelists.c). Blocks 2.. hold the inode table.
+ * EXT_BITMAP_SUPER_MAGIC: free blocks and inodes are kept in bitmaps
+ *	(see bitmap.c). Blocks 2.. hold s_imap_blocks inode map blocks,
+ *	then s_zmap_blocks zone map blocks, then the inode table. Bit 0
+ *	of each map is reserved, as in minix.
  */
-/* #define EXTFS_BITMAP	*/	/* use a bitmap */
-#define EXTFS_FREELIST		/* use a linked list */
 
 #define EXT_NAME_LEN 255
 #define EXT_ROOT_INO 1
@@ -22,6 +27,9 @@
 #define EXT_I_MAP_SLOTS 8
 #define EXT_Z_MAP_SLOTS 8
 #define EXT_SUPER_MAGIC 0x137D
+#define EXT_BITMAP_SUPER_MAGIC 0x137E
+
+#define EXT_BITMAP(sb) ((sb)->s_magic == EXT_BITMAP_SUPER_MAGIC)
 
 #define EXT_INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct ext_inode)))
 /* #define EXT_DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct ext_dir_entry))) */
@@ -51,21 +59,15 @@ struct ext_free_block {
 struct ext_super_block {
 	unsigned long s_ninodes;
 	unsigned long s_nzones;
-#ifdef EXTFS_BITMAP
-	unsigned long s_imap_blocks;
-	unsigned long s_zmap_blocks;
-#endif
-#ifdef EXTFS_FREELIST
-	unsigned long s_firstfreeblock;
+	unsigned long s_firstfreeblock;		/* free list layout only */
 	unsigned long s_freeblockscount;
 	unsigned long s_firstfreeinode;
 	unsigned long s_freeinodescount;
-#endif
 	unsigned long s_firstdatazone;
 	unsigned long s_log_zone_size;
 	unsigned long s_max_size;
-	unsigned long s_reserved1;
-	unsigned long s_reserved2;
+	unsigned long s_imap_blocks;		/* bitmap layout only */
+	unsigned long s_zmap_blocks;
 	unsigned long s_reserved3;
 	unsigned long s_reserved4;
 	unsigned long s_reserved5;
@@ -97,10 +99,24 @@ extern int ext_rename(struct inode * old_dir, const char * old_name, int old_len
 extern struct inode * ext_new_inode(int dev);
 extern void ext_free_inode(struct inode * inode);
 extern unsigned long ext_count_free_inodes(struct super_block *sb);
-extern int ext_new_block(int dev);
+extern int ext_new_block(int dev, int goal);
 extern int ext_free_block(int dev, int block);
 extern unsigned long ext_count_free_blocks(struct super_block *sb);
 
+extern struct inode * ext_bitmap_new_inode(int dev);
+extern void ext_bitmap_free_inode(struct inode * inode);
+extern unsigned long ext_bitmap_count_free_inodes(struct super_block *sb);
+extern int ext_bitmap_new_block(int dev, int goal);
+extern int ext_bitmap_free_block(int dev, int block);
+extern unsigned long ext_bitmap_count_free_blocks(struct super_block *sb);
+
+extern struct inode * ext_freelist_new_inode(int dev);
+extern void ext_freelist_free_inode(struct inode * inode);
+extern unsigned long ext_freelist_count_free_inodes(struct super_block *sb);
+extern int ext_freelist_new_block(int dev);
+extern int ext_freelist_free_block(int dev, int block);
+extern unsigned long ext_freelist_count_free_blocks(struct super_block *sb);
+
 extern int ext_create_block(struct inode *, int);
 extern int ext_bmap(struct inode *,int);
 
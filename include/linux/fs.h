@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <sys/dirent.h>
 #include <sys/vfs.h>
+#include <sys/uio.h>
 
 /* devices are as follows: (same as minix, so we can use the minix
  * file system. These are major numbers.)
@@ -41,9 +42,11 @@ void buffer_init(long buffer_end);
 #define MAJOR(a) (((unsigned)(a))>>8)
 #define MINOR(a) ((a)&0xff)
 
-#define NR_OPEN 32
+#define NR_OPEN 32		/* fds kept in the task structure */
+#define NR_OPEN_MAX 512		/* fds once the table has grown to a page */
 #define NR_INODE 128
-#define NR_FILE 64
+#define NR_FILE 64		/* static part of the file table */
+#define NR_FILE_MAX 1024
 #define NR_SUPER 8
 #define NR_HASH 307
 #define NR_BUFFERS nr_buffers
@@ -56,15 +59,28 @@ void buffer_init(long buffer_end);
 #define NULL ((void *) 0)
 #endif
 
+/*
+ * A pipe is a ring of up to PIPE_MAX_PAGES pages, kept in i_data past
+ * the head/tail and reader/writer counts. It starts out with one page
+ * and can be grown with fcntl(F_SETPIPE_SZ). The last two words hold
+ * the ring lock and its wait queue.
+ */
+#define PIPE_MAX_PAGES 8
 #define PIPE_READ_WAIT(inode) ((inode).i_wait)
 #define PIPE_WRITE_WAIT(inode) ((inode).i_wait2)
 #define PIPE_HEAD(inode) ((inode).i_data[0])
 #define PIPE_TAIL(inode) ((inode).i_data[1])
 #define PIPE_READERS(inode) ((inode).i_data[2])
 #define PIPE_WRITERS(inode) ((inode).i_data[3])
-#define PIPE_SIZE(inode) ((PIPE_HEAD(inode)-PIPE_TAIL(inode))&(PAGE_SIZE-1))
-#define PIPE_EMPTY(inode) (PIPE_HEAD(inode)==PIPE_TAIL(inode))
-#define PIPE_FULL(inode) (PIPE_SIZE(inode)==(PAGE_SIZE-1))
+#define PIPE_LEN(inode) ((inode).i_data[4])
+#define PIPE_PAGES(inode) ((inode).i_data[5])
+#define PIPE_PAGE(inode,nr) ((inode).i_data[6+(nr)])
+#define PIPE_LOCK(inode) ((inode).i_data[14])
+#define PIPE_LOCK_WAIT(inode) (*(struct task_struct **) &(inode).i_data[15])
+#define PIPE_BUFSIZE(inode) (PIPE_PAGES(inode)*PAGE_SIZE)
+#define PIPE_SIZE(inode) PIPE_LEN(inode)
+#define PIPE_EMPTY(inode) (!PIPE_LEN(inode))
+#define PIPE_FULL(inode) (PIPE_LEN(inode)==PIPE_BUFSIZE(inode))
 
 #define NIL_FILP	((struct file *)0)
 #define SEL_IN		1
@@ -75,6 +91,8 @@ typedef char buffer_block[BLOCK_SIZE];
 
 struct buffer_head {
 	char * b_data;			/* pointer to data block (1024 bytes) */
+	char * b_own;			/* the buffer's own block, b_data may
+					   point into a ram disk instead */
 	unsigned long b_blocknr;	/* block number */
 	unsigned short b_dev;		/* device (0 = free) */
 	unsigned char b_uptodate;
@@ -89,6 +107,8 @@ struct buffer_head {
 	struct buffer_head * b_reqnext;
 };
 
+struct epitem;
+
 struct inode {
 	dev_t		i_dev;
 	unsigned long	i_ino;
@@ -110,9 +130,11 @@ struct inode {
 	unsigned char i_lock;
 	unsigned char i_dirt;
 	unsigned char i_pipe;
+	unsigned char i_sock;
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	struct epitem * i_epoll;	/* pipes and sockets: epoll watchers */
 };
 
 struct file {
@@ -123,6 +145,7 @@ struct file {
 	struct inode * f_inode;
 	struct file_operations * f_op;
 	off_t f_pos;
+	struct epitem * f_epoll;	/* epoll items watching this file */
 };
 
 typedef struct {
@@ -130,11 +153,16 @@ typedef struct {
 	struct task_struct ** wait_address;
 } wait_entry;
 
+/*
+ * select tables are allocated a page at a time
+ */
+#define MAX_SELECT_WAITS ((4096 - 4*sizeof(long)) / sizeof(wait_entry))
+
 typedef struct select_table_struct {
 	int nr, woken;
 	struct task_struct * current;
 	struct select_table_struct * next_table;
-	wait_entry entry[NR_OPEN*3];
+	wait_entry entry[MAX_SELECT_WAITS];
 } select_table;
 
 struct super_block {
@@ -170,6 +198,8 @@ struct file_operations {
 	int (*ioctl) (struct inode *, struct file *, unsigned int, unsigned int);
 	int (*open) (struct inode *, struct file *);
 	void (*release) (struct inode *, struct file *);
+	int (*readv) (struct inode *, struct file *, struct iovec *, int, off_t *);
+	int (*writev) (struct inode *, struct file *, struct iovec *, int, off_t *);
 };
 
 struct inode_operations {
@@ -210,13 +240,20 @@ extern struct file_system_type *get_fs_type(char *name);
 
 extern struct inode inode_table[NR_INODE];
 extern struct file file_table[NR_FILE];
+extern struct file * get_empty_filp(void);
+extern int get_unused_fd(void);
+extern void close_fp(struct file * filp);
+extern int expand_fd_table(int nr);
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
 
 extern void check_disk_change(int dev);
 extern void invalidate_inodes(int dev);
+extern void invalidate_buffers(int dev);
+extern int buffers_busy(int dev);
 extern int floppy_change(struct buffer_head * first_block);
+extern char * rd_map(int dev, int block);
 extern int ticks_to_floppy_on(unsigned int dev);
 extern void floppy_on(unsigned int dev);
 extern void floppy_off(unsigned int dev);
@@ -235,6 +272,13 @@ extern void iput(struct inode * inode);
 extern struct inode * iget(int dev,int nr);
 extern struct inode * get_empty_inode(void);
 extern struct inode * get_pipe_inode(void);
+extern int select_check(struct inode * inode, int which);
+extern void epoll_wakeup(struct epitem * list);
+extern void epoll_release(struct file * filp);
+extern void init_pipe_inode(struct inode * inode);
+extern int alloc_pipe_pages(struct inode * inode);
+extern void free_pipe_pages(struct inode * inode);
+extern int pipe_fcntl(struct inode * inode, unsigned int cmd, unsigned long arg);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
@@ -259,4 +303,14 @@ extern int block_read(struct inode *, struct file *, char *, int);
 extern int char_write(struct inode *, struct file *, char *, int);
 extern int block_write(struct inode *, struct file *, char *, int);
 
+extern int block_readv(struct inode *, struct file *, struct iovec *, int, off_t *);
+extern int block_writev(struct inode *, struct file *, struct iovec *, int, off_t *);
+
+extern int iov_length(struct iovec * iov, int nr);
+extern void memcpy_toiovec(struct iovec * iov, char * from, int n);
+extern void memcpy_fromiovec(char * to, struct iovec * iov, int n);
+extern void clear_iovec(struct iovec * iov, int n);
+extern int get_iovec(struct iovec * iov, const struct iovec * uiov, int nr,
+	int rw);
+
 #endif
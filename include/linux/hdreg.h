@@ -40,6 +40,10 @@
 #define WIN_SEEK 		0x70
 #define WIN_DIAGNOSE		0x90
 #define WIN_SPECIFY		0x91
+#define WIN_MULTREAD		0xC4	/* read/write several sectors */
+#define WIN_MULTWRITE		0xC5	/* per interrupt */
+#define WIN_SETMULT		0xC6	/* set sectors per interrupt */
+#define WIN_IDENTIFY		0xEC	/* ask the drive about itself */
 
 /* Bits for HD_ERROR */
 #define MARK_ERR	0x01	/* Bad address mark ? */
@@ -64,7 +68,54 @@ struct partition {
 	unsigned int nr_sects;		/* nr of sectors in partition */
 };
 
+/*
+ * What WIN_IDENTIFY returns, as far as we use it.
+ */
+struct hd_driveid {
+	unsigned short	config;		/* general configuration */
+	unsigned short	cyls;		/* default cylinders */
+	unsigned short	reserved2;
+	unsigned short	heads;		/* default heads */
+	unsigned short	track_bytes;
+	unsigned short	sector_bytes;
+	unsigned short	sectors;	/* default sectors per track */
+	unsigned short	vendor0[3];
+	unsigned char	serial_no[20];
+	unsigned short	buf_type;
+	unsigned short	buf_size;	/* in 512-byte units */
+	unsigned short	ecc_bytes;
+	unsigned char	fw_rev[8];
+	unsigned char	model[40];
+	unsigned char	max_multsect;	/* 0 if READ/WRITE MULTIPLE not there */
+	unsigned char	vendor3;
+	unsigned short	dword_io;	/* 1 if 32-bit i/o can be used */
+	unsigned char	vendor4;
+	unsigned char	capability;	/* bit 1: LBA supported */
+	unsigned short	reserved50;
+	unsigned char	vendor5;
+	unsigned char	tPIO;
+	unsigned char	vendor6;
+	unsigned char	tDMA;
+	unsigned short	field_valid;
+	unsigned short	cur_cyls;
+	unsigned short	cur_heads;
+	unsigned short	cur_sectors;
+	unsigned short	cur_capacity0;
+	unsigned short	cur_capacity1;
+	unsigned char	multsect;	/* current multiple sector count */
+	unsigned char	multsect_valid;
+	unsigned int	lba_capacity;	/* total number of sectors */
+	unsigned short	reserved[194];
+};
+
 #define HDIO_REQ 0x301
+/*
+ * 32-bit data port access is off until turned on with HDIO_SET_32BIT
+ * (arg 1 on, 0 off). The drive may claim to do it, but whether it
+ * works depends on the controller: a plain ISA one garbles transfers.
+ */
+#define HDIO_SET_32BIT 0x302
+#define HDIO_GET_32BIT 0x303	/* arg points to an unsigned long */
 struct hd_geometry {
       unsigned char heads;
       unsigned char sectors;
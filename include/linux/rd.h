@@ -0,0 +1,13 @@
+#ifndef _RD_H
+#define _RD_H
+
+/*
+ * Ram disk ioctls. Sizes are in kilobytes. Any minor except a ram disk
+ * loaded at boot can be resized, as long as it isn't mounted or open
+ * anywhere else (EBUSY): growing keeps the contents, shrinking loses
+ * what's past the new end. If memory runs out the size is unchanged.
+ */
+#define RDSETSIZE 0x101
+#define RDGETSIZE 0x102
+
+#endif
@@ -44,10 +44,6 @@
 #include <sys/resource.h>
 #include <signal.h>
 
-#if (NR_OPEN > 32)
-#error "Currently the close-on-exec-flags and select masks are in one long, max 32 files/proc"
-#endif
-
 #define TASK_RUNNING		0
 #define TASK_INTERRUPTIBLE	1
 #define TASK_UNINTERRUPTIBLE	2
@@ -157,8 +153,16 @@ struct task_struct {
 		unsigned long length;
 	} libraries[MAX_SHARED_LIBS];
 	int numlibraries;
-	struct file * filp[NR_OPEN];
-	unsigned long close_on_exec;
+/*
+ * filp and close_on_exec point into the task structure until the
+ * process needs more than NR_OPEN descriptors; then they move to a
+ * page of their own, see expand_fd_table().
+ */
+	struct file ** filp;
+	unsigned long * close_on_exec;
+	int max_fds;
+	struct file * fd_array[NR_OPEN];
+	unsigned long fd_cloexec[NR_OPEN/32];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3];
 /* tss for this task */
@@ -175,6 +179,10 @@ struct task_struct {
 					/* task. */
                                         /* not impelmented. */
 
+#define FD_CLOEXEC_SET(p,fd) ((p)->close_on_exec[(fd)>>5] |= 1 << ((fd)&31))
+#define FD_CLOEXEC_CLR(p,fd) ((p)->close_on_exec[(fd)>>5] &= ~(1 << ((fd)&31)))
+#define FD_CLOEXEC_ISSET(p,fd) (((p)->close_on_exec[(fd)>>5] >> ((fd)&31)) & 1)
+
 /*
  *  INIT_TASK is used to set up the first task table, touch at
  * your own risk!. Base=0, limit=0x9ffff (=640kB)
@@ -198,7 +206,8 @@ struct task_struct {
 /* comm */	"swapper", \
 /* fs info */	0,-1,0022,NULL,NULL,NULL, \
 /* libraries */	{ { NULL, 0, 0}, }, 0, \
-/* filp */	{NULL,}, 0, \
+/* filp */	init_task.task.fd_array, init_task.task.fd_cloexec, NR_OPEN, \
+		{NULL,}, {0,}, \
 		{ \
 			{0,0}, \
 /* ldt */		{0x9f,0xc0fa00}, \
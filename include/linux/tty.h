@@ -24,7 +24,7 @@
 
 #include <termios.h>
 
-#define TTY_BUF_SIZE 2048
+#define TTY_BUF_SIZE 4096
 
 struct tty_queue {
 	unsigned long data;
@@ -42,6 +42,18 @@ struct serial_struct {
 	struct tty_struct * tty;
 };
 
+/*
+ * Per-port counters, as returned by TIOCGICOUNT. buf_overrun counts
+ * characters lost because the read queue was full, overrun those the
+ * UART itself dropped.
+ */
+struct serial_icounter {
+	unsigned long rx, tx;
+	unsigned long frame, parity, brk;
+	unsigned long overrun, buf_overrun;
+	unsigned long interrupts;
+};
+
 /*
  * These are the supported serial types.
  */
@@ -68,6 +80,8 @@ struct serial_struct {
 
 extern void put_tty_queue(char c, struct tty_queue * queue);
 extern int get_tty_queue(struct tty_queue * queue);
+extern int put_tty_queue_buf(struct tty_queue * queue, const unsigned char * buf, int nr);
+extern int get_tty_queue_buf(struct tty_queue * queue, unsigned char * buf, int nr);
 
 #define PUTCH(c,queue) put_tty_queue((c),(queue))
 #define GETCH(queue) get_tty_queue(queue)
@@ -80,9 +94,9 @@ extern int get_tty_queue(struct tty_queue * queue);
 #define STOP_CHAR(tty) ((tty)->termios.c_cc[VSTOP])
 #define SUSPEND_CHAR(tty) ((tty)->termios.c_cc[VSUSP])
 
-#define _L_FLAG(tty,f)	((tty)->termios.c_lflag & f)
-#define _I_FLAG(tty,f)	((tty)->termios.c_iflag & f)
-#define _O_FLAG(tty,f)	((tty)->termios.c_oflag & f)
+#define _L_FLAG(tty,f)	((tty)->termios.c_lflag & (f))
+#define _I_FLAG(tty,f)	((tty)->termios.c_iflag & (f))
+#define _O_FLAG(tty,f)	((tty)->termios.c_oflag & (f))
 
 #define L_CANON(tty)	_L_FLAG((tty),ICANON)
 #define L_ISIG(tty)	_L_FLAG((tty),ISIG)
@@ -110,6 +124,14 @@ extern int get_tty_queue(struct tty_queue * queue);
 #define C_SPEED(tty)	((tty)->termios.c_cflag & CBAUD)
 #define C_HUP(tty)	(C_SPEED((tty)) == B0)
 
+/*
+ * Input that needs no cooking at all: no character mapping, no line
+ * editing, no flow control, signals or echo.
+ */
+#define TTY_RAW_INPUT(tty) \
+	(!_I_FLAG((tty),ISTRIP|INLCR|IGNCR|ICRNL|IUCLC|IXON) && \
+	 !_L_FLAG((tty),ICANON|ISIG|ECHO))
+
 struct tty_struct {
 	struct termios termios;
 	int pgrp;
@@ -123,6 +145,7 @@ struct tty_struct {
 	struct tty_queue *read_q;
 	struct tty_queue *write_q;
 	struct tty_queue *secondary;
+	struct epitem *epoll;		/* epoll watchers */
 	};
 
 /*
@@ -167,6 +190,7 @@ extern long tty_init(long);
 extern void flush_input(struct tty_struct * tty);
 extern void flush_output(struct tty_struct * tty);
 extern void copy_to_cooked(struct tty_struct * tty);
+extern int copy_to_raw(struct tty_queue * from, struct tty_struct * tty);
 
 extern int tty_ioctl(struct inode *, struct file *, unsigned int, unsigned int);
 extern int is_orphaned_pgrp(int pgrp);
@@ -189,6 +213,7 @@ extern void change_speed(unsigned int line);
 extern void send_break(unsigned int line);
 extern int get_serial_info(unsigned int, struct serial_struct *);
 extern int set_serial_info(unsigned int, struct serial_struct *);
+extern int get_serial_icount(unsigned int, struct serial_icounter *);
 
 /* pty.c */
 
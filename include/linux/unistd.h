@@ -116,6 +116,14 @@
 #define __NR_lstat		107
 #define __NR_fstat		108
 #define __NR_uname		109
+#define __NR_readv		110
+#define __NR_writev		111
+#define __NR_pread		112
+#define __NR_pwrite		113
+#define __NR_sendfile		114
+#define __NR_epoll_create	115
+#define __NR_epoll_ctl		116
+#define __NR_epoll_wait		117
 
 extern int errno;
 
@@ -0,0 +1,39 @@
+#ifndef _IN_H
+#define _IN_H
+
+#include <sys/types.h>
+
+/*
+ * internet addresses and ports are kept in network byte order
+ */
+struct in_addr {
+	u_long s_addr;
+};
+
+struct sockaddr_in {
+	u_short sin_family;		/* AF_INET */
+	u_short sin_port;		/* port number */
+	struct in_addr sin_addr;	/* internet address */
+	char sin_zero[8];		/* pad to sizeof(struct sockaddr) */
+};
+
+#define IPPROTO_IP	0
+#define IPPROTO_TCP	6
+
+#define INADDR_ANY		((u_long) 0x00000000)
+#define INADDR_LOOPBACK		((u_long) 0x7f000001)	/* 127.0.0.1 */
+
+#define IN_LOOPBACKNET		127
+
+#define IPPORT_RESERVED		1024
+
+/*
+ * byte order: the 386 is little-endian
+ */
+#define ntohs(x) ((u_short) ((((x) & 0xff) << 8) | (((x) >> 8) & 0xff)))
+#define htons(x) ntohs(x)
+#define ntohl(x) ((u_long) ((((x) & 0xff) << 24) | (((x) & 0xff00) << 8) | \
+			    (((x) >> 8) & 0xff00) | (((x) >> 24) & 0xff)))
+#define htonl(x) ntohl(x)
+
+#endif /* _IN_H */
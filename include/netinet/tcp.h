@@ -0,0 +1,9 @@
+#ifndef _TCP_H
+#define _TCP_H
+
+/*
+ * options for level IPPROTO_TCP
+ */
+#define TCP_NODELAY	1		/* don't delay small writes */
+
+#endif /* _TCP_H */
@@ -0,0 +1,27 @@
+#ifndef _SYS_EPOLL_H
+#define _SYS_EPOLL_H
+
+/*
+ * event notification: an interest set that is built once and then
+ * waited on, returning only the descriptors that are ready.
+ */
+struct epoll_event {
+	unsigned long events;		/* EPOLLIN etc */
+	unsigned long data;		/* handed back untouched */
+};
+
+#define EPOLLIN		0x0001		/* readable, or eof */
+#define EPOLLPRI	0x0002		/* exceptional condition */
+#define EPOLLOUT	0x0004		/* writable */
+#define EPOLLET		0x80000000	/* report each wakeup only once */
+
+#define EPOLL_CTL_ADD	1
+#define EPOLL_CTL_DEL	2
+#define EPOLL_CTL_MOD	3
+
+int epoll_create(int size);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event * event);
+int epoll_wait(int epfd, struct epoll_event * events, int maxevents,
+	int timeout);
+
+#endif /* _SYS_EPOLL_H */
@@ -1,6 +1,8 @@
 #ifndef _SOCKET_H
 #define _SOCKET_H
 
+#include <sys/uio.h>
+
 struct sockaddr {
 	u_short sa_family;		/* address family, AF_xxx */
 	char sa_data[14];		/* 14 bytes of protocol address */
@@ -27,6 +29,61 @@ struct sockaddr {
 #define PF_UNIX		AF_UNIX
 #define PF_INET		AF_INET
 
+/*
+ * message header for sendmsg/recvmsg. datagram and seqpacket sockets
+ * keep message boundaries: one send is one receive.
+ */
+struct msghdr {
+	void *msg_name;			/* peer address, or NULL */
+	int msg_namelen;
+	struct iovec *msg_iov;		/* data segments */
+	int msg_iovlen;
+	void *msg_control;		/* ancillary data */
+	int msg_controllen;
+	int msg_flags;			/* flags on received message */
+};
+
+#define SOMAXCONN	32		/* most a listen backlog can be */
+
+/*
+ * socket level options for setsockopt/getsockopt
+ */
+#define SOL_SOCKET	0xffff
+
+#define SO_SNDBUF	0x1001		/* send buffer size */
+#define SO_RCVBUF	0x1002		/* receive buffer size */
+#define SO_RCVLOWAT	0x1004		/* receive low-water mark */
+
+/*
+ * ancillary data. SCM_RIGHTS carries an array of open descriptors,
+ * which arrive as new descriptors in the receiving process.
+ */
+struct cmsghdr {
+	int cmsg_len;			/* header and data, unaligned */
+	int cmsg_level;			/* SOL_SOCKET */
+	int cmsg_type;			/* SCM_RIGHTS */
+};
+
+#define SCM_RIGHTS	1
+
+#define CMSG_ALIGN(len) (((len) + sizeof(int) - 1) & ~(sizeof(int) - 1))
+#define CMSG_DATA(cmsg) ((unsigned char *)((struct cmsghdr *)(cmsg) + 1))
+#define CMSG_LEN(len) (sizeof(struct cmsghdr) + (len))
+#define CMSG_SPACE(len) (sizeof(struct cmsghdr) + CMSG_ALIGN(len))
+#define CMSG_FIRSTHDR(mhdr) \
+	((mhdr)->msg_controllen >= sizeof(struct cmsghdr) ? \
+	 (struct cmsghdr *)(mhdr)->msg_control : (struct cmsghdr *)0)
+#define CMSG_NXTHDR(mhdr, cmsg) \
+	((char *)(cmsg) + CMSG_ALIGN((cmsg)->cmsg_len) + \
+	 sizeof(struct cmsghdr) > \
+	 (char *)(mhdr)->msg_control + (mhdr)->msg_controllen ? \
+	 (struct cmsghdr *)0 : \
+	 (struct cmsghdr *)((char *)(cmsg) + CMSG_ALIGN((cmsg)->cmsg_len)))
+
+#define MSG_CTRUNC	0x08		/* ancillary data didn't fit */
+#define MSG_TRUNC	0x20		/* datagram didn't fit */
+#define MSG_DONTWAIT	0x40		/* nonblocking for this call only */
+
 int socket(int family, int type, int protocol);
 int socketpair(int family, int type, int protocol, int sockvec[2]);
 int bind(int sockfd, struct sockaddr *my_addr, int addrlen);
@@ -35,5 +92,17 @@ int listen(int sockfd, int backlog);
 int accept(int sockfd, struct sockaddr *peer, int *paddrlen);
 int getsockname(int sockfd, struct sockaddr *addr, int *paddrlen);
 int getpeername(int sockfd, struct sockaddr *peer, int *paddrlen);
+int send(int sockfd, const void *buf, int len, int flags);
+int recv(int sockfd, void *buf, int len, int flags);
+int sendto(int sockfd, const void *buf, int len, int flags,
+	   struct sockaddr *to, int tolen);
+int recvfrom(int sockfd, void *buf, int len, int flags,
+	     struct sockaddr *from, int *fromlen);
+int sendmsg(int sockfd, const struct msghdr *msg, int flags);
+int recvmsg(int sockfd, struct msghdr *msg, int flags);
+int setsockopt(int sockfd, int level, int optname, const void *optval,
+	       int optlen);
+int getsockopt(int sockfd, int level, int optname, void *optval,
+	       int *optlen);
 
 #endif /* _SOCKET_H */
@@ -24,11 +24,14 @@ struct timezone {
 #define	DST_TUR		9	/* Turkey */
 #define	DST_AUSTALT	10	/* Australian style with shift in 1986 */
 
-#define FD_SETSIZE		(8*sizeof(fd_set))
-#define FD_SET(fd,fdsetp)	(*(fdsetp) |= (1 << (fd)))
-#define FD_CLR(fd,fdsetp)	(*(fdsetp) &= ~(1 << (fd)))
-#define FD_ISSET(fd,fdsetp)	((*(fdsetp) >> fd) & 1)
-#define FD_ZERO(fdsetp)		(*(fdsetp) = 0)
+#define FD_SET(fd,fdsetp) \
+	((fdsetp)->fds_bits[(fd)/__NFDBITS] |= 1UL << ((fd)%__NFDBITS))
+#define FD_CLR(fd,fdsetp) \
+	((fdsetp)->fds_bits[(fd)/__NFDBITS] &= ~(1UL << ((fd)%__NFDBITS)))
+#define FD_ISSET(fd,fdsetp) \
+	(((fdsetp)->fds_bits[(fd)/__NFDBITS] >> ((fd)%__NFDBITS)) & 1)
+#define FD_ZERO(fdsetp) \
+	memset((fdsetp), 0, sizeof(fd_set))
 
 /*
  * Operations on timevals.
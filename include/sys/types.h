@@ -65,7 +65,12 @@ typedef unsigned char cc_t;
 typedef unsigned int speed_t;
 typedef unsigned long tcflag_t;
 
-typedef unsigned long fd_set;
+#define FD_SETSIZE		512
+#define __NFDBITS		(8*sizeof(unsigned long))
+
+typedef struct fd_set {
+	unsigned long fds_bits[FD_SETSIZE/__NFDBITS];
+} fd_set;
 
 typedef struct { int quot,rem; } div_t;
 typedef struct { long quot,rem; } ldiv_t;
@@ -0,0 +1,19 @@
+#ifndef _SYS_UIO_H
+#define _SYS_UIO_H
+
+#include <sys/types.h>
+
+/*
+ * scatter/gather segments for readv/writev
+ */
+struct iovec {
+	char * iov_base;		/* start of the segment */
+	int iov_len;			/* bytes in the segment */
+};
+
+#define UIO_MAXIOV	16		/* max segments per call */
+
+int readv(int fildes, const struct iovec * iov, int iovcnt);
+int writev(int fildes, const struct iovec * iov, int iovcnt);
+
+#endif /* _SYS_UIO_H */
@@ -37,6 +37,7 @@
 #define TIOCCONS	0x541D
 #define TIOCGSERIAL	0x541E
 #define TIOCSSERIAL	0x541F
+#define TIOCGICOUNT	0x5420
 
 struct winsize {
 	unsigned short ws_row;
@@ -156,6 +156,9 @@ int setgroups(int gidsetlen, gid_t *gidset);
 int select(int width, fd_set * readfds, fd_set * writefds,
 	fd_set * exceptfds, struct timeval * timeout);
 int swapon(const char * specialfile);
+int pread(int fildes, char * buf, unsigned int count, off_t offset);
+int pwrite(int fildes, const char * buf, unsigned int count, off_t offset);
+int sendfile(int out_fd, int in_fd, off_t * offset, unsigned int count);
 
 #ifdef __cplusplus
 }
@@ -234,6 +234,17 @@ static unsigned char command = 0;
 unsigned char selected = 0;
 struct task_struct * wait_on_floppy_select = NULL;
 
+/*
+ * The track buffer is only good as long as the same disk, with the same
+ * parameters, is in the drive, and as long as what's in it got to the
+ * disk. Anything that changes that throws the buffer away.
+ */
+static inline void invalidate_track_buffer(int drive)
+{
+	if (buffer_drive == drive)
+		buffer_drive = buffer_track = -1;
+}
+
 void floppy_deselect(unsigned int nr)
 {
 	if (nr != (current_DOR & 3))
@@ -270,11 +281,13 @@ int floppy_change(struct buffer_head * bh)
 		fake_change &= ~mask;
 /* omitting the next line breaks formatting in a horrible way ... */
 		changed_floppies &= ~mask;
+		invalidate_track_buffer(bh->b_dev & 0x03);
 		return 1;
 	}
 	if (changed_floppies & mask) {
 		changed_floppies &= ~mask;
 		recalibrate = 1;
+		invalidate_track_buffer(bh->b_dev & 0x03);
 		return 1;
 	}
 	if (!bh)
@@ -293,6 +306,7 @@ int floppy_change(struct buffer_head * bh)
 	if (changed_floppies & mask) {
 		changed_floppies &= ~mask;
 		recalibrate = 1;
+		invalidate_track_buffer(bh->b_dev & 0x03);
 		return 1;
 	}
 	return 0;
@@ -416,6 +430,9 @@ static void rw_interrupt(void)
 	char * buffer_area;
 
 	if (result() != 7 || (ST0 & 0xf8) || (ST1 & 0xbf) || (ST2 & 0x73)) {
+/* a write hitting the track buffer has already been copied into it */
+		if (command == FD_WRITE)
+			invalidate_track_buffer(current_drive);
 		if (ST1 & 0x02) {
 			printk("Drive %d is write protected\n\r",current_drive);
 			floppy_deselect(current_drive);
@@ -661,7 +678,7 @@ static void floppy_on_interrupt(void)
 {
 	if (inb(FD_DIR) & 0x80) {
 		changed_floppies |= 1<<current_drive;
-		buffer_track = -1;
+		invalidate_track_buffer(current_drive);
 		if (keep_data[current_drive]) {
 			if (keep_data[current_drive] > 0)
 				keep_data[current_drive]--;
@@ -880,6 +897,11 @@ static int fd_ioctl(struct inode *inode, struct file *filp, unsigned int cmd,
 			return okay ? 0 : -EIO;
  	}
 	if (drive < 0 || drive > 3) return -EINVAL;
+	if (cmd == FDCLRPRM || cmd == FDSETPRM || cmd == FDDEFPRM) {
+		cli();
+		invalidate_track_buffer(drive);
+		sti();
+	}
 	switch (cmd) {
 		case FDCLRPRM:
 			current_type[drive] = NULL;
@@ -972,7 +994,9 @@ static struct file_operations floppy_fops = {
 	NULL,			/* select */
 	fd_ioctl,		/* ioctl */
 	floppy_open,		/* open */
-	floppy_release		/* release */
+	floppy_release,		/* release */
+	block_readv,		/* readv */
+	block_writev		/* writev */
 };
 
 void floppy_init(void)
@@ -56,16 +56,22 @@ unsigned long last_req, read_timer();
 #endif
 
 /*
- *  This struct defines the HD's and their types.
+ *  This struct defines the HD's and their types. The rest is filled
+ *  in from WIN_IDENTIFY at setup: the number of sectors moved per
+ *  interrupt with READ/WRITE MULTIPLE (0 if not used), whether the data
+ *  port is read 32 bits at a time (only if set with HDIO_SET_32BIT), and
+ *  the size of the drive in
+ *  sectors if it is addressed by LBA rather than CHS (0 if not).
  */
 struct hd_i_struct {
 	unsigned int head,sect,cyl,wpcom,lzone,ctl;
+	unsigned int mult,io32,lba_sects;
 	};
 #ifdef HD_TYPE
 struct hd_i_struct hd_info[] = { HD_TYPE };
 #define NR_HD ((sizeof (hd_info))/(sizeof (struct hd_i_struct)))
 #else
-struct hd_i_struct hd_info[] = { {0,0,0,0,0,0},{0,0,0,0,0,0} };
+struct hd_i_struct hd_info[] = { {0,0,0,0,0,0,0,0,0},{0,0,0,0,0,0,0,0,0} };
 static int NR_HD = 0;
 #endif
 
@@ -82,11 +88,57 @@ __asm__("cld;rep;insw"::"d" (port),"D" (buf),"c" (nr):"cx","di")
 #define port_write(port,buf,nr) \
 __asm__("cld;rep;outsw"::"d" (port),"S" (buf),"c" (nr):"cx","si")
 
+#define port_read32(port,buf,nr) \
+__asm__("cld;rep;insl"::"d" (port),"D" (buf),"c" (nr):"cx","di")
+
+#define port_write32(port,buf,nr) \
+__asm__("cld;rep;outsl"::"d" (port),"S" (buf),"c" (nr):"cx","si")
+
+#define HD_MULT(drive) (hd_info[drive].mult ? hd_info[drive].mult : 1)
+
+/* or'ed into the head of hd_out(): sect/cyl/head hold a 28-bit LBA */
+#define HD_LBA		0x40
+#define HD_LBA_MAX	0x0fffffff
+
+static inline void hd_read_sector(unsigned int drive, char * buf)
+{
+	if (hd_info[drive].io32)
+		port_read32(HD_DATA,buf,128);
+	else
+		port_read(HD_DATA,buf,256);
+}
+
+static inline void hd_write_sector(unsigned int drive, char * buf)
+{
+	if (hd_info[drive].io32)
+		port_write32(HD_DATA,buf,128);
+	else
+		port_write(HD_DATA,buf,256);
+}
+
 extern void hd_interrupt(void);
 extern void rd_load(void);
 
 static unsigned int current_minor;
 
+/*
+ * Partition tables are in absolute sector numbers, so they work the
+ * same for LBA drives: but don't believe entries that go past the end
+ * of the drive.
+ */
+static void check_size(unsigned int minor)
+{
+	unsigned long size = hd[minor & ~0x3f].nr_sects;
+
+	if (hd[minor].start_sect >= size) {
+		printk("  part %d starts past end of drive\n\r",minor);
+		hd[minor].start_sect = hd[minor].nr_sects = 0;
+	} else if (hd[minor].nr_sects > size - hd[minor].start_sect) {
+		printk("  part %d truncated to end of drive\n\r",minor);
+		hd[minor].nr_sects = size - hd[minor].start_sect;
+	}
+}
+
 /*
  * Create devices for each logical partition in an extended partition.
  * The logical partitions form a linked list, with each entry being
@@ -129,6 +181,9 @@ static void extended_partition(unsigned int dev)
 			    !(hd[current_minor].nr_sects = p->nr_sects))
 				goto done;  /* shouldn't happen */
 			hd[current_minor].start_sect = this_sector + p->start_sect;
+			check_size(current_minor);
+			if (!hd[current_minor].nr_sects)
+				goto done;
 			printk("  Logical part %d start %d size %d end %d\n\r", 
 			       current_minor, hd[current_minor].start_sect, 
 			       hd[current_minor].nr_sects,
@@ -177,6 +232,9 @@ static void check_partition(unsigned int dev)
 			if (!(hd[minor].nr_sects = p->nr_sects))
 				continue;
 			hd[minor].start_sect = first_sector + p->start_sect;
+			check_size(minor);
+			if (!hd[minor].nr_sects)
+				continue;
 			printk(" part %d start %d size %d end %d \n\r", i, 
 			       hd[minor].start_sect, hd[minor].nr_sects, 
 			       hd[minor].start_sect + hd[minor].nr_sects - 1);
@@ -199,6 +257,7 @@ static void check_partition(unsigned int dev)
 					continue;
 				hd[current_minor].start_sect = p->start_sect;
 				hd[current_minor].nr_sects = p->nr_sects;
+				check_size(current_minor);
 				printk(" DM part %d start %d size %d end %d\n\r",
 				       current_minor,
 				       hd[current_minor].start_sect, 
@@ -212,6 +271,68 @@ static void check_partition(unsigned int dev)
 	brelse(bh);
 }
 
+/*
+ * Issue a command to the drive with its interrupt masked (nIEN), and
+ * poll until it is done. Only used at setup, before any requests.
+ */
+static int hd_poll_cmd(unsigned int drive, unsigned int nsect, unsigned int cmd)
+{
+	int i;
+	unsigned char c = BUSY_STAT;
+
+	outb_p(hd_info[drive].ctl | 2,HD_CMD);
+	outb_p(nsect,HD_NSECTOR);
+	outb_p(0xA0|(drive<<4),HD_CURRENT);
+	outb_p(cmd,HD_COMMAND);
+	for (i = 0 ; i < 500000 && ((c = inb_p(HD_STATUS)) & BUSY_STAT) ; i++)
+		/* nothing */;
+	return c;
+}
+
+/*
+ * Ask the drive what it can do, and turn on READ/WRITE MULTIPLE with
+ * the largest block it allows. The drive data is read a word at a
+ * time, as 32-bit i/o is off until asked for. Drives that do LBA are
+ * addressed that way, which also gets past the BIOS geometry limits;
+ * a drive the BIOS has no geometry for gets the drive's own.
+ */
+static void hd_identify(unsigned int drive)
+{
+	struct hd_driveid * id;
+	unsigned char c;
+
+	hd_info[drive].mult = hd_info[drive].io32 = 0;
+	hd_info[drive].lba_sects = 0;
+	if (!(id = (struct hd_driveid *) get_free_page()))
+		return;
+	c = hd_poll_cmd(drive,0,WIN_IDENTIFY);
+	if ((c & (BUSY_STAT | ERR_STAT | DRQ_STAT)) != DRQ_STAT)
+		goto out;
+	port_read(HD_DATA,id,256);
+	if (!hd_info[drive].head || !hd_info[drive].sect) {
+		hd_info[drive].cyl = id->cyls;
+		hd_info[drive].head = id->heads;
+		hd_info[drive].sect = id->sectors;
+	}
+	if ((id->capability & 2) && id->lba_capacity) {
+		hd_info[drive].lba_sects = id->lba_capacity;
+		if (hd_info[drive].lba_sects > HD_LBA_MAX)
+			hd_info[drive].lba_sects = HD_LBA_MAX;
+	}
+	if (id->max_multsect > 1) {
+		c = hd_poll_cmd(drive,id->max_multsect,WIN_SETMULT);
+		if (!(c & (BUSY_STAT | ERR_STAT)))
+			hd_info[drive].mult = id->max_multsect;
+	}
+	printk("hd%c: %s, %d sectors per interrupt%s\n\r",'a'+drive,
+		hd_info[drive].lba_sects ? "LBA" : "CHS", HD_MULT(drive),
+		(id->dword_io & 1) ? ", can do 32-bit i/o" : "");
+out:
+	outb_p(hd_info[drive].ctl,HD_CMD);
+	(void) inb_p(HD_STATUS);
+	free_page((unsigned long) id);
+}
+
 /* This may be used only once, enforced by 'static int callable' */
 int sys_setup(void * BIOS)
 {
@@ -263,12 +384,17 @@ int sys_setup(void * BIOS)
 	else
 		NR_HD = 0;
 #endif
+	for (drive=0 ; drive<NR_HD ; drive++)
+		hd_identify(drive);
 	for (i = 0 ; i < (MAX_HD<<6) ; i++) {
 		hd[i].start_sect = 0;
 		hd[i].nr_sects = 0;
 	}
 	for (i = 0 ; i < NR_HD ; i++)
-		hd[i<<6].nr_sects = hd_info[i].head*
+		if (hd_info[i].lba_sects)
+			hd[i<<6].nr_sects = hd_info[i].lba_sects;
+		else
+			hd[i<<6].nr_sects = hd_info[i].head*
 				hd_info[i].sect*hd_info[i].cyl;
 	for (drive=0 ; drive<NR_HD ; drive++) {
 		current_minor = 1+(drive<<6);
@@ -330,7 +456,7 @@ static void hd_out(unsigned int drive,unsigned int nsect,unsigned int sect,
 {
 	unsigned short port;
 
-	if (drive>1 || head>15)
+	if (drive>1 || (head & ~HD_LBA)>15)
 		panic("Trying to write bad sector");
 #if (HD_DELAY > 0)
 	while (read_timer() - last_req < HD_DELAY)
@@ -381,24 +507,37 @@ static void reset_controller(void)
 		printk("HD-controller reset failed: %02x\n\r",i);
 }
 
+/*
+ * After a reset each drive gets WIN_SPECIFY and, if it was using
+ * READ/WRITE MULTIPLE, WIN_SETMULT again: a reset may turn it off.
+ */
 static void reset_hd(void)
 {
-	static int i;
+	static int i, setmult;
 
 repeat:
 	if (reset) {
 		reset = 0;
 		i = -1;
+		setmult = 0;
 		reset_controller();
 	} else if (win_result()) {
 		bad_rw_intr();
 		if (reset)
 			goto repeat;
 	}
+	if (setmult) {
+		setmult = 0;
+		hd_out(i,hd_info[i].mult,0,0,0,WIN_SETMULT,&reset_hd);
+		if (reset)
+			goto repeat;
+		return;
+	}
 	i++;
 	if (i < NR_HD) {
 		hd_out(i,hd_info[i].sect,hd_info[i].sect,hd_info[i].head-1,
 			hd_info[i].cyl,WIN_SPECIFY,&reset_hd);
+		setmult = hd_info[i].mult != 0;
 		if (reset)
 			goto repeat;
 	} else
@@ -435,26 +574,38 @@ static void bad_rw_intr(void)
 #define STAT_MASK (BUSY_STAT | READY_STAT | WRERR_STAT | SEEK_STAT | ERR_STAT)
 #define STAT_OK (READY_STAT | SEEK_STAT)
 
+/*
+ * Each read interrupt has a block of up to HD_MULT() sectors ready,
+ * which may span several buffers of the request.
+ */
 static void read_intr(void)
 {
 	int i;
+	unsigned int drive = CURRENT_DEV, nsect;
 
 	i = (unsigned) inb_p(HD_STATUS);
 	if (!(i & DRQ_STAT))
 		goto bad_read;
 	if ((i & STAT_MASK) != STAT_OK)
 		goto bad_read;
-	port_read(HD_DATA,CURRENT->buffer,256);
-	i = (unsigned) inb_p(HD_STATUS);
-	if (!(i & BUSY_STAT))
-		if ((i & STAT_MASK) != STAT_OK)
-			goto bad_read;
-	CURRENT->errors = 0;
-	CURRENT->buffer += 512;
-	CURRENT->sector++;
-	i = --CURRENT->nr_sectors;
-	if (!i || (CURRENT->bh && !(i&1)))
-		end_request(1);
+	nsect = HD_MULT(drive);
+	if (nsect > CURRENT->nr_sectors)
+		nsect = CURRENT->nr_sectors;
+	do {
+		hd_read_sector(drive,CURRENT->buffer);
+		if (!--nsect) {
+			i = (unsigned) inb_p(HD_STATUS);
+			if (!(i & BUSY_STAT))
+				if ((i & STAT_MASK) != STAT_OK)
+					goto bad_read;
+		}
+		CURRENT->errors = 0;
+		CURRENT->buffer += 512;
+		CURRENT->sector++;
+		i = --CURRENT->nr_sectors;
+		if (!i || (CURRENT->bh && !(i&1)))
+			end_request(1);
+	} while (nsect);
 	if (i > 0) {
 		SET_INTR(&read_intr);
 		return;
@@ -472,23 +623,54 @@ bad_read:
 	return;
 }
 
+/*
+ * Sectors sent with the last write block: they are only done when the
+ * next interrupt comes in.
+ */
+static unsigned int write_count;
+
+/*
+ * Send the next block of up to HD_MULT() sectors, following the buffer
+ * list of the request without ending any of them.
+ */
+static void hd_write_block(unsigned int drive)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	char * buf = CURRENT->buffer;
+	unsigned int left = CURRENT->nr_sectors;
+	unsigned int nsect = HD_MULT(drive);
+
+	if (nsect > left)
+		nsect = left;
+	write_count = nsect;
+	while (nsect--) {
+		hd_write_sector(drive,buf);
+		buf += 512;
+		if (!(--left & 1) && bh && (bh = bh->b_reqnext))
+			buf = bh->b_data;
+	}
+}
+
 static void write_intr(void)
 {
 	int i;
+	unsigned int nsect = write_count;
 
 	i = (unsigned) inb_p(HD_STATUS);
 	if ((i & STAT_MASK) != STAT_OK)
 		goto bad_write;
-	if (CURRENT->nr_sectors > 1 && !(i & DRQ_STAT))
+	if (CURRENT->nr_sectors > nsect && !(i & DRQ_STAT))
 		goto bad_write;
-	CURRENT->sector++;
-	i = --CURRENT->nr_sectors;
-	CURRENT->buffer += 512;
-	if (!i || (CURRENT->bh && !(i & 1)))
-		end_request(1);
+	while (nsect--) {
+		CURRENT->sector++;
+		i = --CURRENT->nr_sectors;
+		CURRENT->buffer += 512;
+		if (!i || (CURRENT->bh && !(i & 1)))
+			end_request(1);
+	}
 	if (i > 0) {
 		SET_INTR(&write_intr);
-		port_write(HD_DATA,CURRENT->buffer,256);
+		hd_write_block(CURRENT_DEV);
 	} else {
 #if (HD_DELAY > 0)
 		last_req = read_timer();
@@ -545,11 +727,17 @@ static void do_hd_request(void)
 	}
 	block += hd[dev].start_sect;
 	dev >>= 6;
-	sec = block % hd_info[dev].sect;
-	block /= hd_info[dev].sect;
-	head = block % hd_info[dev].head;
-	cyl = block / hd_info[dev].head;
-	sec++;
+	if (hd_info[dev].lba_sects) {
+		sec = block & 0xff;
+		cyl = (block >> 8) & 0xffff;
+		head = ((block >> 24) & 0x0f) | HD_LBA;
+	} else {
+		sec = block % hd_info[dev].sect;
+		block /= hd_info[dev].sect;
+		head = block % hd_info[dev].head;
+		cyl = block / hd_info[dev].head;
+		sec++;
+	}
 	if (reset) {
 		recalibrate = 1;
 		reset_hd();
@@ -563,7 +751,8 @@ static void do_hd_request(void)
 		return;
 	}	
 	if (CURRENT->cmd == WRITE) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
+		hd_out(dev,nsect,sec,head,cyl,
+			hd_info[dev].mult ? WIN_MULTWRITE : WIN_WRITE,&write_intr);
 		if (reset)
 			goto repeat;
 		for(i=0 ; i<10000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
@@ -572,9 +761,10 @@ static void do_hd_request(void)
 			bad_rw_intr();
 			goto repeat;
 		}
-		port_write(HD_DATA,CURRENT->buffer,256);
+		hd_write_block(dev);
 	} else if (CURRENT->cmd == READ) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
+		hd_out(dev,nsect,sec,head,cyl,
+			hd_info[dev].mult ? WIN_MULTREAD : WIN_READ,&read_intr);
 		if (reset)
 			goto repeat;
 	} else
@@ -587,13 +777,28 @@ static int hd_ioctl(struct inode * inode, struct file * file,
 	struct hd_geometry *loc = (void *) arg;
 	int dev;
 
-	if (!loc || !inode)
+	if (!inode)
 		return -EINVAL;
 	dev = MINOR(inode->i_rdev) >> 6;
 	if (dev >= NR_HD)
 		return -EINVAL;
 	switch (cmd) {
+		case HDIO_SET_32BIT:
+			if (!suser())
+				return -EPERM;
+			if (arg > 1)
+				return -EINVAL;
+			hd_info[dev].io32 = arg;
+			return 0;
+		case HDIO_GET_32BIT:
+			if (!arg)
+				return -EINVAL;
+			verify_area((void *) arg, 4);
+			put_fs_long(hd_info[dev].io32, (unsigned long *) arg);
+			return 0;
 		case HDIO_REQ:
+			if (!loc)
+				return -EINVAL;
 			verify_area(loc, sizeof(*loc));
 			put_fs_byte(hd_info[dev].head,
 				(char *) &loc->heads);
@@ -624,7 +829,9 @@ static struct file_operations hd_fops = {
 	NULL,			/* select */
 	hd_ioctl,		/* ioctl */
 	NULL,			/* no special open code */
-	hd_release		/* release */
+	hd_release,		/* release */
+	block_readv,		/* readv */
+	block_writev		/* writev */
 };
 
 void hd_init(void)
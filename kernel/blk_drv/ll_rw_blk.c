@@ -139,7 +139,7 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 	}
 repeat:
 	cli();
-	if (major == 3 && (req = blk_dev[major].current_request)) {
+	if ((major == 3 || major == 8) && (req = blk_dev[major].current_request)) {
 		while (req = req->next) {
 			if (req->dev == bh->b_dev &&
 			    !req->waiting &&
@@ -253,6 +253,8 @@ long blk_dev_init(long mem_start, long mem_end)
 	}
 #ifdef RAMDISK
 	mem_start += rd_init(mem_start, RAMDISK*1024);
+#else
+	rd_init(mem_start, 0);
 #endif
 	return mem_start;
 }
@@ -4,6 +4,7 @@
  *  Written by Theodore Ts'o, 12/2/91
  */
 
+#include <errno.h>
 #include <linux/string.h>
 
 #include <linux/config.h>
@@ -11,6 +12,8 @@
 #include <linux/minix_fs.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/rd.h>
 #include <asm/system.h>
 #include <asm/segment.h>
 #include <asm/memory.h>
@@ -18,48 +21,205 @@
 #define MAJOR_NR 1
 #include "blk.h"
 
+/*
+ * There can be a ram disk on each minor. The one loaded at
+ * boot (minor 1) is a contiguous area reserved by rd_init(), the others
+ * are pages handed out by get_free_page() when they are sized with the
+ * RDSETSIZE ioctl. getblk() points buffers for ram disk blocks straight
+ * at the ram disk memory with rd_map(), so for those the request below
+ * has nothing to copy.
+ */
+#define NR_RD		8
+#define RD_MAX_PAGES	(PAGE_SIZE / sizeof(char *))
+
 char	*rd_start;
 int	rd_length = 0;
 
+static char	**rd_pages[NR_RD];
+static int	rd_sizes[NR_RD];	/* in blocks */
+static int	rd_opens[NR_RD];
+static char	rd_resizing[NR_RD];
+
+static inline char * rd_address(int minor, unsigned long sector)
+{
+	if (minor == 1 && rd_length)
+		return rd_start + (sector << 9);
+	return rd_pages[minor][sector >> 3] + ((sector & 7) << 9);
+}
+
+/*
+ * Where block 'block' of ram disk 'dev' lives, or NULL if there is no
+ * such block.
+ */
+char * rd_map(int dev, int block)
+{
+	int minor = MINOR(dev);
+
+	if (minor >= NR_RD || block >= rd_sizes[minor])
+		return NULL;
+	return rd_address(minor, block << 1);
+}
+
 void do_rd_request(void)
 {
-	int	len;
-	char	*addr;
+	int	minor;
+	unsigned long sector, len, chunk;
+	char	*addr, *buf;
 
 	INIT_REQUEST;
-	addr = rd_start + (CURRENT->sector << 9);
-	len = CURRENT->nr_sectors << 9;
-	if ((MINOR(CURRENT->dev) != 1) || (addr+len > rd_start+rd_length)) {
+	minor = MINOR(CURRENT->dev);
+	sector = CURRENT->sector;
+	len = CURRENT->nr_sectors;
+	if (minor >= NR_RD || sector + len > (rd_sizes[minor] << 1)) {
 		end_request(0);
 		goto repeat;
 	}
-	if (CURRENT-> cmd == WRITE) {
-		(void ) memcpy(addr,
-			      CURRENT->buffer,
-			      len);
-	} else if (CURRENT->cmd == READ) {
-		(void) memcpy(CURRENT->buffer, 
-			      addr,
-			      len);
-	} else
+	if (CURRENT->cmd != WRITE && CURRENT->cmd != READ)
 		panic("unknown ramdisk-command");
+	buf = CURRENT->buffer;
+	while (len) {
+		addr = rd_address(minor, sector);
+		chunk = 8 - (sector & 7);
+		if (chunk > len)
+			chunk = len;
+		if (addr == buf)
+			;	/* mapped buffer: the data is already there */
+		else if (CURRENT->cmd == WRITE)
+			(void) memcpy(addr, buf, chunk << 9);
+		else
+			(void) memcpy(buf, addr, chunk << 9);
+		buf += chunk << 9;
+		sector += chunk;
+		len -= chunk;
+	}
 	end_request(1);
 	goto repeat;
 }
 
+/*
+ * Grow or shrink a page-backed ram disk to 'pages' pages. The pointer
+ * table is a page of its own, allocated with the first data page. All
+ * the new pages are got before the size changes, so running out of
+ * memory leaves the disk as it was.
+ */
+static int rd_resize(int minor, unsigned long pages)
+{
+	char	**table = rd_pages[minor];
+	unsigned long old = (rd_sizes[minor] * BLOCK_SIZE) / PAGE_SIZE;
+	unsigned long nr = old, page;
+
+	if (pages > nr && !table && !(table = (char **) get_free_page()))
+		return -ENOMEM;
+	while (nr < pages) {
+		if (!(page = get_free_page())) {
+			while (nr > old)
+				free_page((unsigned long) table[--nr]);
+			if (!rd_pages[minor])
+				free_page((unsigned long) table);
+			return -ENOMEM;
+		}
+		table[nr++] = (char *) page;
+	}
+	while (nr > pages)
+		free_page((unsigned long) table[--nr]);
+	rd_sizes[minor] = (nr * PAGE_SIZE) / BLOCK_SIZE;
+	if (!nr && table) {
+		free_page((unsigned long) table);
+		table = NULL;
+	}
+	rd_pages[minor] = table;
+	return 0;
+}
+
+/*
+ * Buffers of a ram disk point into its pages, so it is only resized
+ * when nobody else has it open and no buffer of it is in use. New
+ * opens are turned away until we are done.
+ */
+static int rd_setsize(int dev, unsigned long pages)
+{
+	int	minor = MINOR(dev), error;
+
+	if (get_super(dev) || rd_opens[minor] > 1 || rd_resizing[minor])
+		return -EBUSY;
+	rd_resizing[minor] = 1;
+	sync_dev(dev);
+	if (buffers_busy(dev))
+		error = -EBUSY;
+	else {
+		invalidate_buffers(dev);
+		error = rd_resize(minor,pages);
+	}
+	rd_resizing[minor] = 0;
+	return error;
+}
+
+static int rd_ioctl(struct inode * inode, struct file * file,
+	unsigned int cmd, unsigned int arg)
+{
+	int	dev, minor;
+
+	if (!inode)
+		return -EINVAL;
+	dev = inode->i_rdev;
+	if ((minor = MINOR(dev)) >= NR_RD)
+		return -ENODEV;
+	switch (cmd) {
+		case RDGETSIZE:
+			verify_area((void *) arg, sizeof(long));
+			put_fs_long(rd_sizes[minor] * (BLOCK_SIZE / 1024),
+				(unsigned long *) arg);
+			return 0;
+		case RDSETSIZE:
+			if (!suser())
+				return -EPERM;
+			if (minor == 1 && rd_length)
+				return -EBUSY;
+			if (arg > RD_MAX_PAGES * (PAGE_SIZE / 1024))
+				return -EINVAL;
+			return rd_setsize(dev,
+				(arg + PAGE_SIZE / 1024 - 1) / (PAGE_SIZE / 1024));
+		default:
+			return -EINVAL;
+	}
+}
+
+static int rd_open(struct inode * inode, struct file * filp)
+{
+	int	minor = MINOR(inode->i_rdev);
+
+	if (minor < NR_RD) {
+		if (rd_resizing[minor])
+			return -EBUSY;
+		rd_opens[minor]++;
+	}
+	return 0;
+}
+
+static void rd_release(struct inode * inode, struct file * filp)
+{
+	int	minor = MINOR(inode->i_rdev);
+
+	if (minor < NR_RD)
+		rd_opens[minor]--;
+}
+
 static struct file_operations rd_fops = {
 	NULL,			/* lseek - default */
 	block_read,		/* read - general block-dev read */
 	block_write,		/* write - general block-dev write */
 	NULL,			/* readdir - bad */
 	NULL,			/* select */
-	NULL,			/* ioctl */
-	NULL,			/* no special open code */
-	NULL			/* no special release code */
+	rd_ioctl,		/* ioctl */
+	rd_open,		/* open */
+	rd_release,		/* release */
+	block_readv,		/* readv */
+	block_writev		/* writev */
 };
 
 /*
- * Returns amount of memory which needs to be reserved.
+ * Returns amount of memory which needs to be reserved. A zero length
+ * only sets up the driver, for ram disks sized later on.
  */
 long rd_init(long mem_start, int length)
 {
@@ -68,8 +228,10 @@ long rd_init(long mem_start, int length)
 
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
 	blkdev_fops[MAJOR_NR] = &rd_fops;
+	blk_size[MAJOR_NR] = rd_sizes;
 	rd_start = (char *) mem_start;
 	rd_length = length;
+	rd_sizes[1] = length >> BLOCK_SIZE_BITS;
 	cp = rd_start;
 	for (i=0; i < length; i++)
 		*cp++ = '\0';
@@ -28,12 +28,22 @@ static const char RCSid[] = "$Header: /usr/src/linux/kernel/blk_drv/scsi/RCS/aha
 #define base 0x330
 #define intr_chan 11
 
-static struct mailbox mb[2];
-static struct ccb ccb;
+/*
+ * The outgoing mailboxes are mb[0 .. AHA1542_MAILBOXES-1], the incoming
+ * ones follow.  Outgoing mailbox i always points at ccb[i], and SCint[i]
+ * is the command using it.  The adapter goes round both sets in order,
+ * so we hand them out and look at them in the same order.
+ */
+static struct mailbox mb[2*AHA1542_MAILBOXES];
+static struct ccb ccb[AHA1542_MAILBOXES];
+static struct chain chain[AHA1542_MAILBOXES][AHA1542_SG];
+static Scsi_Cmnd *SCint[AHA1542_MAILBOXES];
+static void (*do_done[AHA1542_MAILBOXES])(Scsi_Cmnd *);
+static int last_mbo = AHA1542_MAILBOXES - 1;
+static int last_mbi = AHA1542_MAILBOXES - 1;
 
 long WAITtimeout, WAITnexttimeout = 3000000;
 
-void (*do_done)() = NULL;
 extern void aha1542_interrupt();
 
 #define aha1542_intr_reset()  outb(IRST, CONTROL)
@@ -195,10 +205,10 @@ char *aha1542_info(void)
 void aha1542_intr_handle(void)
 {
     int flag = inb(INTRFLAGS);
-    void (*my_done)() = do_done;
-    int errstatus;
+    void (*my_done)(Scsi_Cmnd *);
+    Scsi_Cmnd *SCtmp;
+    int errstatus, mbi, mbo, status, i;
 
-    do_done = NULL;
 #ifdef DEBUG
     printk("aha1542_intr_handle: ");
     if (!(flag&ANYINTR)) printk("no interrupt?");
@@ -207,57 +217,70 @@ void aha1542_intr_handle(void)
     if (flag&HACC) printk("HACC ");
     if (flag&SCRD) printk("SCRD ");
     printk("status %02x\n", inb(STATUS));
-    if (ccb.tarstat|ccb.hastat)
-      printk("aha1542_command: returning %x (status %d)\n", ccb.tarstat + ((int) ccb.hastat << 16), mb[1].status);
 #endif
     aha1542_intr_reset();
-    if (!my_done) {
-	printk("aha1542_intr_handle: Unexpected interrupt\n");
-	return;
-    }
 
-    /* is there mail :-) */
-	
-    if (!mb[1].status) {
-	DEB(printk("aha1542_intr_handle: strange: mbif but no mail!\n"));
-	my_done(DID_TIME_OUT << 16);
-	return;
-    }
+    /* is there mail :-)  There may be several letters by now. */
 
-    /* more error checking left out here */
-    if (mb[1].status != 1)
-      /* This is surely wrong, but I don't know what's right */
-      errstatus = makecode(ccb.hastat, ccb.tarstat);
-    else
-      errstatus = 0;
+    while (1) {
+	mbi = last_mbi;
+	for (i = 0; i < AHA1542_MAILBOXES; i++) {
+	    if (++mbi >= 2*AHA1542_MAILBOXES || mbi < AHA1542_MAILBOXES)
+	      mbi = AHA1542_MAILBOXES;
+	    if (mb[mbi].status)
+	      break;
+	}
+	if (!mb[mbi].status) {
+	    DEB(if (flag&MBIF) printk("aha1542_intr_handle: strange: mbif but no mail!\n"));
+	    return;
+	}
+	last_mbi = mbi;
+	status = mb[mbi].status;
+	mbo = (scsi2int(mb[mbi].ccbptr) - (long) ccb) / sizeof(struct ccb);
+	mb[mbi].status = 0;
+
+	if (mbo < 0 || mbo >= AHA1542_MAILBOXES || !(SCtmp = SCint[mbo])) {
+	    printk("aha1542_intr_handle: Unexpected interrupt\n");
+	    continue;
+	}
+	my_done = do_done[mbo];
+	SCint[mbo] = NULL;
 
-    mb[1].status = 0;
+#ifdef DEBUG
+	if (ccb[mbo].tarstat|ccb[mbo].hastat)
+	  printk("aha1542_command: returning %x (status %d)\n", ccb[mbo].tarstat + ((int) ccb[mbo].hastat << 16), status);
+#endif
 
-    if (ccb.tarstat == 2) {
-	int i;
-	DEB(printk("aha1542_intr_handle: sense:"));
-	for (i = 0; i < 12; i++)
-	  printk("%02x ", ccb.cdb[ccb.cdblen+i]);
-	printk("\n");
-/*
-	DEB(printk("aha1542_intr_handle: buf:"));
-	for (i = 0; i < bufflen; i++)
-	  printk("%02x ", ((unchar *)buff)[i]);
-	printk("\n");
-*/
+	/* more error checking left out here */
+	if (status != 1)
+	  /* This is surely wrong, but I don't know what's right */
+	  errstatus = makecode(ccb[mbo].hastat, ccb[mbo].tarstat);
+	else
+	  errstatus = 0;
+
+	if (ccb[mbo].tarstat == 2) {
+	    DEB(printk("aha1542_intr_handle: sense:"));
+	    for (i = 0; i < 12; i++)
+	      printk("%02x ", ccb[mbo].cdb[ccb[mbo].cdblen+i]);
+	    printk("\n");
+	}
+	DEB(if (errstatus) printk("aha1542_intr_handle: returning %6x\n", errstatus));
+	SCtmp->result = errstatus;
+	my_done(SCtmp);
     }
-    DEB(if (errstatus) printk("aha1542_intr_handle: returning %6x\n", errstatus));
-    my_done(errstatus);
-    return;
 }
 
-int aha1542_queuecommand(unchar target, const void *cmnd, void *buff, int bufflen, void (*done)(int))
+int aha1542_queuecommand(Scsi_Cmnd *SCpnt, void (*done)(Scsi_Cmnd *))
 {
     unchar ahacmd = CMD_START_SCSI;
-    int i;
-    unchar *cmd = (unchar *) cmnd;
-
-    DEB(if (target > 1) {done(DID_TIME_OUT << 16); return 0;});
+    unchar target = SCpnt->target;
+    unchar *cmd = (unchar *) SCpnt->cmnd;
+    void *buff = SCpnt->buffer;
+    int bufflen = SCpnt->bufflen;
+    unsigned long flags;
+    int i, mbo;
+
+    DEB(if (target > 1) {SCpnt->result = DID_TIME_OUT << 16; done(SCpnt); return 0;});
     
 #ifdef DEBUG
     if (*cmd == READ_10 || *cmd == WRITE_10)
@@ -266,10 +289,7 @@ int aha1542_queuecommand(unchar target, const void *cmnd, void *buff, int buffle
       i = scsi2int(cmd+2);
     else
       i = -1;
-    if (done)
-      printk("aha1542_queuecommand: dev %d cmd %02x pos %d len %d ", target, *cmd, i, bufflen);
-    else
-      printk("aha1542_command: dev %d cmd %02x pos %d len %d ", target, *cmd, i, bufflen);
+    printk("aha1542_queuecommand: dev %d cmd %02x pos %d len %d ", target, *cmd, i, bufflen);
     aha1542_stat();
     printk("aha1542_queuecommand: dumping scsi cmd:");
     for (i = 0; i < (*cmd<=0x1f?6:10); i++) printk("%02x ", cmd[i]);
@@ -277,71 +297,113 @@ int aha1542_queuecommand(unchar target, const void *cmnd, void *buff, int buffle
     if (*cmd == WRITE_10 || *cmd == WRITE_6)
       return 0; /* we are still testing, so *don't* write */
 #endif
-    memset(&ccb, 0, sizeof ccb);
-    
-    ccb.cdblen = (*cmd<=0x1f)?6:10;	/* SCSI Command Descriptor Block Length */
+    if (!done) {
+	printk("aha1542_queuecommand: done can't be NULL\n");
+	return 0;
+    }
+
+    /* Take the next free mailbox after the last one we used */
+
+    save_flags(flags);
+    cli();
+    mbo = last_mbo;
+    for (i = 0; i < AHA1542_MAILBOXES; i++) {
+	if (++mbo >= AHA1542_MAILBOXES)
+	  mbo = 0;
+	if (!mb[mbo].status && !SCint[mbo])
+	  break;
+    }
+    if (mb[mbo].status || SCint[mbo]) 
+      panic("aha1542_queuecommand: no free mailbox\n");
+    SCint[mbo] = SCpnt;
+    do_done[mbo] = done;
+    last_mbo = mbo;
+    restore_flags(flags);
+
+    memset(&ccb[mbo], 0, sizeof(struct ccb));
     
-    memcpy(ccb.cdb, cmd, ccb.cdblen);
-    ccb.op = 0;				/* SCSI Initiator Command */
-    ccb.idlun = (target&7)<<5;		/* SCSI Target Id */
-    ccb.rsalen = 12;
-    any2scsi(ccb.datalen, bufflen);
-    any2scsi(ccb.dataptr, buff);
-    ccb.linkptr[0] = ccb.linkptr[1] = ccb.linkptr[2] = 0;
-    ccb.commlinkid = 0;
+    ccb[mbo].cdblen = (*cmd<=0x1f)?6:10;	/* SCSI Command Descriptor Block Length */
     
-    mb[0].status = 1;
-    mb[1].status = 0;
+    memcpy(ccb[mbo].cdb, cmd, ccb[mbo].cdblen);
+    ccb[mbo].idlun = (target&7)<<5;		/* SCSI Target Id */
+    ccb[mbo].rsalen = 12;
+    if (SCpnt->use_sg) {
+	struct scatterlist *sgpnt = (struct scatterlist *) buff;
+
+	if (SCpnt->use_sg > AHA1542_SG)
+	  panic("aha1542_queuecommand: too many segments\n");
+	for (i = 0; i < SCpnt->use_sg; i++) {
+	    any2scsi(chain[mbo][i].datalen, sgpnt[i].length);
+	    any2scsi(chain[mbo][i].dataptr, sgpnt[i].address);
+	}
+	ccb[mbo].op = 2;			/* SCSI Initiator Command w/scatter-gather */
+	any2scsi(ccb[mbo].datalen, SCpnt->use_sg * sizeof(struct chain));
+	any2scsi(ccb[mbo].dataptr, chain[mbo]);
+    } else {
+	ccb[mbo].op = 0;			/* SCSI Initiator Command */
+	any2scsi(ccb[mbo].datalen, bufflen);
+	any2scsi(ccb[mbo].dataptr, buff);
+    }
+    ccb[mbo].linkptr[0] = ccb[mbo].linkptr[1] = ccb[mbo].linkptr[2] = 0;
+    ccb[mbo].commlinkid = 0;
     
 #ifdef DEBUGd
     printk("aha1542_command: sending.. ");
-    for (i = 0; i < sizeof(ccb)-10; i++)
-      printk("%02x ", ((unchar *)&ccb)[i]);
+    for (i = 0; i < sizeof(struct ccb)-10; i++)
+      printk("%02x ", ((unchar *)&ccb[mbo])[i]);
 #endif
     
-    if (done) {
-	DEB(printk("aha1542_queuecommand: now waiting for interrupt "); aha1542_stat());
-	if (do_done)
-	  printk("aha1542_queuecommand: Two concurrent queuecommand?\n");
-	else
-	  do_done = done;
-	aha1542_out(&ahacmd, 1);		/* start scsi command */
-	DEB(aha1542_stat());
-	aha1542_enable_intr();
-    }
-    else
-      printk("aha1542_queuecommand: done can't be NULL\n");
+    DEB(printk("aha1542_queuecommand: now waiting for interrupt "); aha1542_stat());
+    save_flags(flags);
+    cli();
+    any2scsi(mb[mbo].ccbptr, &ccb[mbo]);
+    mb[mbo].status = 1;
+    aha1542_out(&ahacmd, 1);		/* start scsi command */
+    restore_flags(flags);
+    DEB(aha1542_stat());
+    aha1542_enable_intr();
     
     return 0;
 }
 
 volatile static int internal_done_flag = 0;
-volatile static int internal_done_errcode = 0;
-static void internal_done(int errcode)
+static void internal_done(Scsi_Cmnd *SCpnt)
 {
-    internal_done_errcode = errcode;
     ++internal_done_flag;
 }
 
 int aha1542_command(unchar target, const void *cmnd, void *buff, int bufflen)
 {
+    Scsi_Cmnd SCtmp;
+
     DEB(printk("aha1542_command: ..calling aha1542_queuecommand\n"));
-    aha1542_queuecommand(target, cmnd, buff, bufflen, internal_done);
+    SCtmp.target = target;
+    SCtmp.lun = 0;
+    memcpy(SCtmp.cmnd, cmnd, (*(unchar *) cmnd<=0x1f)?6:10);
+    SCtmp.buffer = buff;
+    SCtmp.bufflen = bufflen;
+    SCtmp.use_sg = 0;
+    internal_done_flag = 0;
+    aha1542_queuecommand(&SCtmp, internal_done);
 
     while (!internal_done_flag);
-    internal_done_flag = 0;
-    return internal_done_errcode;
+    return SCtmp.result;
 }
 
 /* Initialize mailboxes */
 static void setup_mailboxes()
 {
-    static unchar cmd[5] = {CMD_MBINIT, 1};
+    static unchar cmd[5] = {CMD_MBINIT, AHA1542_MAILBOXES};
+    int i;
     
-    mb[0].status = mb[1].status = 0;
+    for (i = 0; i < AHA1542_MAILBOXES; i++) {
+	mb[i].status = mb[AHA1542_MAILBOXES+i].status = 0;
+	any2scsi(mb[i].ccbptr, &ccb[i]);
+	SCint[i] = NULL;
+    }
+    last_mbo = last_mbi = AHA1542_MAILBOXES - 1;
     aha1542_intr_reset();		/* reset interrupts, so they don't block */	
     any2scsi((cmd+2), mb);
-    any2scsi(mb[0].ccbptr, &ccb);
     aha1542_out(cmd, 5);
     WAIT(INTRFLAGS, INTRMASK, HACC, 0);
     while (0) {
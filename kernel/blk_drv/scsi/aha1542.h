@@ -83,6 +83,11 @@ struct mailbox {
 #define MAX_CDB 12
 #define MAX_SENSE 14
 
+struct chain {			/* Scatter/Gather Segment 5.3.2 */
+  unchar datalen[3];		/* Segment Length (msb, .., lsb) */
+  unchar dataptr[3];		/* Segment Pointer */
+};
+
 struct ccb {			/* Command Control Block 5.3 */
   unchar op;			/* Command Control Block Operation Code */
   unchar idlun;			/* op=0,2:Target Id, op=1:Initiator Id */
@@ -102,9 +107,14 @@ struct ccb {			/* Command Control Block 5.3 */
 				/* REQUEST SENSE */
 };
 
+/* Number of outgoing (and incoming) mailboxes, the commands we can have out */
+#define AHA1542_MAILBOXES 8
+/* Scatter/gather segments per command */
+#define AHA1542_SG 16
+
 int aha1542_detect(int);
 int aha1542_command(unsigned char target, const void *cmnd, void *buff, int bufflen);
-/*int aha1542_queuecommand(unchar target, const void *cmnd, void *buff, int bufflen, void (*done)(int));*/
+int aha1542_queuecommand(Scsi_Cmnd *SCpnt, void (*done)(Scsi_Cmnd *));
 int aha1542_abort(int);
 char *aha1542_info(void);
 int aha1542_reset(void);
@@ -115,8 +125,8 @@ int aha1542_reset(void);
 
 #define AHA1542 {"Adaptec 1542", aha1542_detect,	\
 		aha1542_info, aha1542_command,		\
-		/*aha1542_queuecommand*/ NULL,		\
+		aha1542_queuecommand,			\
 		aha1542_abort,				\
 		aha1542_reset,				\
-		0, 7, 0}
+		AHA1542_MAILBOXES, 7, 0, AHA1542_SG}
 #endif
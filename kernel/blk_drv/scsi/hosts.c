@@ -101,7 +101,6 @@ void main (void)
 */
 
 volatile unsigned char host_busy[MAX_SCSI_HOSTS];
-volatile int host_timeout[MAX_SCSI_HOSTS];
 volatile Scsi_Cmnd *host_queue[MAX_SCSI_HOSTS]; 
 /*
 	scsi_init initializes the scsi hosts. 
@@ -122,7 +121,6 @@ void scsi_init(void)
 			*/ 
 
 			host_busy[i] = 0;
-			host_timeout[i] = 0;
 			host_queue[i] = NULL;	
 			
 			if ((scsi_hosts[i].detect) &&  (scsi_hosts[i].present = scsi_hosts[i].detect(i)))
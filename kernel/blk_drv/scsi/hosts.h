@@ -19,26 +19,72 @@
 
 /*
 	The Scsi_Cmnd structure is used by scsi.c internally, and for communication with
-	low level drivers that support multiple outstanding commands.
+	low level drivers that support multiple outstanding commands.  Each host
+	has a pool of them, one per command it can have outstanding; slot is the
+	index in that pool, which the low level driver may use to match
+	completions to commands.
 */
 
+#define SENSE_LENGTH	32
+#define SCSI_MAX_QUEUE	8
+#define SCSI_MAX_SG	16
+
+/*
+	A scatterlist entry : a piece of a data transfer that is contiguous 
+	in memory.  When a command's use_sg is non zero, its buffer points 
+	to use_sg of these rather than at the data, and bufflen is the sum 
+	of their lengths.
+*/
+
+struct scatterlist {
+	char *address;
+	unsigned length;
+	};
+
 typedef struct scsi_cmnd {
 	int host;
+	int slot;
 	unsigned char target, lun;
 	unsigned char cmnd[10];
 	unsigned bufflen;
 	void *buffer;
+	unsigned short use_sg;
+
+	/*
+		What the high level driver asked for.  cmnd, buffer and 
+		bufflen are what goes to the host now, which is this or 
+		a REQUEST SENSE.  request_use_sg is zero when the block 
+		is allocated; the high level driver sets it before 
+		scsi_do_cmd() to send a scatterlist, which it may build in 
+		sglist.
+	*/
+
+	unsigned char data_cmnd[10];
+	unsigned request_bufflen;
+	void *request_buffer;
+	unsigned short request_use_sg;
+	struct scatterlist sglist[SCSI_MAX_SG];
 	
 	unsigned char sense_cmnd[6];
-	unsigned char *sense_buffer;	
+	unsigned char sense_buffer[SENSE_LENGTH];
 
 	unsigned flags;
+	unsigned char internal_timeout;
 		
 	int retries;
 	int allowed;
 	int timeout_per_command, timeout_total, timeout;
+
+	/*
+		result is filled in by the low level driver before it calls
+		done(), and by the mid level before the high level done().
+		request belongs to the high level driver.
+	*/
+
+	int result;
+	void *request;
 	
-	void (*done)(int,int);
+	void (*done)(struct scsi_cmnd *);
 	struct scsi_cmnd *next, *prev;	
 	} Scsi_Cmnd;		 
 
@@ -88,16 +134,15 @@ typedef struct
 			     void *buff, int bufflen);
 
         /*
-                The QueueCommand function works in a similar manner
-                to the command function.  It takes an additional parameter,
-                void (* done)(int host, int code) which is passed the host 
-		# and exit result when the command is complete.  
-		Host number is the POSITION IN THE hosts array of THIS
-		host adapter.
+                The QueueCommand function starts the command described by
+		the Scsi_Cmnd (target, lun, cmnd, buffer, bufflen, use_sg) 
+		and returns at once.  When the command is complete, the driver puts the
+		status in SCpnt->result, bit fielded as for command(), and
+		calls done(SCpnt), usually from its interrupt handler.  Up to
+		can_queue commands may be outstanding at a time.
         */
 
-        int (* queuecommand)(unsigned char target, const void *cmnd,
-                             void *buff, int bufflen, void (*done)(int,int));
+        int (* queuecommand)(Scsi_Cmnd *SCpnt, void (*done)(Scsi_Cmnd *));
 
 	
 	/*
@@ -124,6 +169,7 @@ typedef struct
 		This determines if we will use a non-interrupt driven
 		or an interrupt driven scheme,  It is set to the maximum number
 		of simulataneous commands a given host adapter will accept.
+		The mid level uses at most SCSI_MAX_QUEUE.
 	*/
 
 	int can_queue;
@@ -143,6 +189,14 @@ typedef struct
 	*/
 
 	unsigned present:1;	
+
+	/*
+		sg_tablesize is the number of scatterlist entries the host 
+		can take in one command, 0 if it can't do scatter-gather.  
+		Only queuecommand() is given scatterlists.
+	*/
+
+	unsigned short sg_tablesize;
 	} Scsi_Host;
 
 /*
@@ -153,13 +207,12 @@ typedef struct
 extern Scsi_Host scsi_hosts[];
 
 /*
-	This is our semaphore array, used by scsi.c, sd.c, st.c.
-	Other routines SHOULD NOT mess with it.  Your driver should NOT mess with it.
-	This is used to protect against contention by disk and tape drivers.
+	This is the number of commands outstanding on each host, used by
+	scsi.c.  Other routines SHOULD NOT mess with it.  Your driver should
+	NOT mess with it.
 */
 
 extern volatile unsigned char host_busy[];
-extern volatile int host_timeout[];
 
 /*
 	This is the queue of currently pending commands for a given
@@ -30,7 +30,7 @@ static const char RCSid[] = "$Header: /usr/src/linux/kernel/blk_drv/scsi/RCS/scs
 
 #define INTERNAL_ERROR (printk ("Internal error in file %s, line %s.\n", __FILE__, __LINE__), panic(""))
 
-static void scsi_done (int host, int result);
+static void scsi_done (Scsi_Cmnd *SCpnt);
 static void update_timeout (void);
 
 static int time_start;
@@ -46,21 +46,33 @@ static int time_elapsed;
 int NR_SCSI_DEVICES=0;
 Scsi_Device scsi_devices[MAX_SCSI_DEVICE];
 
-#define SENSE_LENGTH 255
 /*
 	As the scsi do command functions are inteligent, and may need to 
-	redo a command, we need to keep track of the last command 
-	executed on each one.
+	redo a command, we need to keep track of each command until it 
+	is finished.  The command blocks come from a pool with one entry
+	for each command a host may have outstanding : can_queue of them,
+	at most SCSI_MAX_QUEUE, or one for hosts that can't queue.  Free 
+	blocks are chained through next on free_cmnds[host], the ones
+	that are out are on host_queue[host].
 */
 
 #define WAS_RESET 	0x01
 #define WAS_TIMEDOUT 	0x02
 #define WAS_SENSE	0x04
 #define IS_RESETTING	0x08
+#define IS_DELAYED	0x10
 
-static Scsi_Cmnd last_cmnd[MAX_SCSI_HOSTS];
+static Scsi_Cmnd scsi_cmnd_pool[MAX_SCSI_HOSTS][SCSI_MAX_QUEUE];
+static Scsi_Cmnd * volatile free_cmnds[MAX_SCSI_HOSTS];
 static int last_reset[MAX_SCSI_HOSTS];
 
+/*
+	host_timeout is the timer for the abort and reset of each host,
+	commands keep their own in the Scsi_Cmnd.
+*/
+
+static int host_timeout[MAX_SCSI_HOSTS];
+
 /*
 	This is the number  of clock ticks we should wait before we time out 
 	and abort the command.  This is for  where the scsi.c module generates 
@@ -80,6 +92,7 @@ static int last_reset[MAX_SCSI_HOSTS];
 	#define SENSE_TIMEOUT SCSI_TIMEOUT
 	#define ABORT_TIMEOUT SCSI_TIMEOUT
 	#define RESET_TIMEOUT SCSI_TIMEOUT
+	#define MIN_RESET_DELAY 25
 #else
 
 	#define SENSE_TIMEOUT 50
@@ -89,24 +102,70 @@ static int last_reset[MAX_SCSI_HOSTS];
 
 #endif
 /*
-	As the actual SCSI command runs in the background, we must set up a 
-	flag that tells scan_scsis() when the result it has is valid.  
-	scan_scsis can set the_result to -1, and watch for it to become the 
-	actual return code for that call.  the scan_scsis_done function() is 
-	our user specified completion function that is passed on to the  
-	scsi_do_cmd() function.
+	The bus scan sends an INQUIRY to every target on every host at 
+	once, and the completions come back in whatever order the devices 
+	answer them.  Each probe has its own buffer and result; the result
+	stays -1 until scan_scsis_done() fills it in.  A probe that hasn't
+	completed SCAN_TIMEOUT ticks after it went out is taken to have no
+	device behind it, so the scan takes as long as the slowest device 
+	rather than the sum of all of them.
 */
 
-static int the_result;
-static unsigned char sense_buffer[SENSE_LENGTH];
-static void scan_scsis_done (int host, int result)
+#ifdef MULTI_LUN
+	#define SCAN_LUNS 8
+#else
+	#define SCAN_LUNS 1
+#endif
+
+#define SCAN_TIMEOUT (SCSI_TIMEOUT * 4)
+#define INQUIRY_LENGTH 36
+
+static struct scan_probe {
+	volatile int result;
+	int expires;
+	unsigned char inquiry[INQUIRY_LENGTH];
+	} scan_probes[MAX_SCSI_HOSTS][7][SCAN_LUNS];
+
+static void scan_scsis_done (Scsi_Cmnd *SCpnt)
 	{
 	
 #ifdef DEBUG
-	printk ("scan_scsis_done(%d, %06x\n\r", host, result);
+	printk ("scan_scsis_done(%d, %06x\n\r", SCpnt->host, SCpnt->result);
 #endif	
-	the_result = result;
+	((struct scan_probe *) SCpnt->request)->result = SCpnt->result;
+	scsi_release_cmnd (SCpnt);
+	}
+
+/*
+	Start the INQUIRY for one (host, ID, lun).  For hosts that can't 
+	queue, this only returns once the command is done.
+*/
+
+static void scan_probe_start (int host_nr, int dev, int lun)
+	{
+	struct scan_probe *probe = &scan_probes[host_nr][dev][lun];
+	unsigned char scsi_cmd [6];
+	Scsi_Cmnd * SCpnt;
+
+	/* Build an INQUIRY command block.  */
+
+	scsi_cmd[0] = INQUIRY;
+	scsi_cmd[1] = (lun << 5) & 0xe0;
+	scsi_cmd[2] = 0;
+	scsi_cmd[3] = 0;
+	scsi_cmd[4] = INQUIRY_LENGTH;
+	scsi_cmd[5] = 0;
+	probe->result = -1;	
+#ifdef DEBUG
+	memset ((void *) probe->inquiry , 0, INQUIRY_LENGTH);
+#endif 
+	SCpnt = scsi_allocate_cmnd (host_nr, 1);
+	SCpnt->request = probe;
+	probe->expires = jiffies + SCAN_TIMEOUT;
+	scsi_do_cmd (SCpnt, dev, (void *)  scsi_cmd, (void *) probe->inquiry,
+		     INQUIRY_LENGTH,  scan_scsis_done, SCSI_TIMEOUT, 3);
 	}
+
 /*
 	Detecting SCSI devices :	
 	We scan all present host adapter's busses,  from ID 0 to ID 6.  
@@ -118,43 +177,47 @@ static void scan_scsis_done (int host, int result)
 static void scan_scsis (void)
 	{
         int host_nr , dev, lun, type, maxed;
-	static unsigned char scsi_cmd [12];
-	static unsigned char scsi_result [256];
+	struct scan_probe *probe;
+	unsigned char *scsi_result;
+
+/*
+	Start all the probes, going across the hosts for each ID so that a 
+	host that can't queue doesn't hold up the others more than it must.
+*/
+
+	for (dev = 0; dev < 7; ++dev)
+		for (lun = 0; lun < SCAN_LUNS; ++lun)
+			for (host_nr = 0; host_nr < MAX_SCSI_HOSTS; ++host_nr)
+				if (scsi_hosts[host_nr].present && 
+				    scsi_hosts[host_nr].this_id != dev)
+					scan_probe_start (host_nr, dev, lun);
+
+/*
+	Now collect the results in the usual order, so the devices are 
+	numbered as they always were.
+*/
 
         for (host_nr = 0; host_nr < MAX_SCSI_HOSTS; ++host_nr)
                 if (scsi_hosts[host_nr].present)
 			{
 			for (dev = 0; dev < 7; ++dev)
 				if (scsi_hosts[host_nr].this_id != dev)
-                                #ifdef MULTI_LUN
-				for (lun = 0; lun < 8; ++lun)
-					{
-				#else
+				for (lun = 0; lun < SCAN_LUNS; ++lun)
 					{
-					lun = 0;
-				#endif
-					/* Build an INQUIRY command block.  */
-
-					scsi_cmd[0] = INQUIRY;
-					scsi_cmd[1] = (lun << 5) & 0xe0;
-					scsi_cmd[2] = 0;
-					scsi_cmd[3] = 0;
-					scsi_cmd[4] = 255;
-					scsi_cmd[5] = 0;
-					the_result = -1;	
-#ifdef DEBUG
-	memset ((void *) scsi_result , 0, 255);
-#endif 
-					scsi_do_cmd (host_nr, dev, (void *)  scsi_cmd, (void *) 							    
-						 scsi_result, 256,  scan_scsis_done, 
-						 SCSI_TIMEOUT, sense_buffer, 3);
-					
+					probe = &scan_probes[host_nr][dev][lun];
+					scsi_result = probe->inquiry;
+
 					/* Wait for valid result */
 
-					while (the_result < 0);
-	
+					while (probe->result < 0 && jiffies < probe->expires);
+					if (probe->result < 0)
+						{
+						printk("scsi : host %d id %d lun %d did not answer INQUIRY\n",
+						       host_nr, dev, lun);
+						continue;
+						}
 
-                                        if (!the_result)
+                                        if (!probe->result)
 						{
                                                 scsi_devices[NR_SCSI_DEVICES].
 							host_no = host_nr;
@@ -278,8 +341,9 @@ static unsigned char internal_timeout[MAX_SCSI_HOSTS];
 #define IN_RESET 2
 /*
 	This is our time out function, called when the timer expires for a 
-	given host adapter.  It will attempt to abort the currently executing 
-	command, that failing perform a kernel panic.
+	given host adapter or for one of its commands.  It will attempt to 
+	abort the commands executing on the host, that failing perform a 
+	kernel panic.
 */ 
 
 static void scsi_times_out (int host)
@@ -308,14 +372,68 @@ static void scsi_times_out (int host)
 					
 	}
 
+/*
+	scsi_allocate_cmnd takes a free command block for host off the pool.
+	If there is none, it returns NULL, or with wait set, waits until 
+	a command on that host completes.  This is also what prevents more
+	than can_queue commands going to a host at a time.  The block 
+	belongs to the caller until it is given back with 
+	scsi_release_cmnd(), which is normally done from the completion 
+	function - unless that reuses the block for its next command.
+*/
+
+Scsi_Cmnd * scsi_allocate_cmnd (int host, int wait)
+	{
+	Scsi_Cmnd * SCpnt;
+	unsigned long flags;
+
+	if ((host  >= MAX_SCSI_HOSTS) || !scsi_hosts[host].present)
+		{
+		printk ("Invalid or not present host number. %d\n", host);
+		panic("");
+		}
+
+	while (1)
+		{
+		save_flags(flags);
+		cli();
+		if ((SCpnt = free_cmnds[host]))
+			{
+			free_cmnds[host] = SCpnt->next;
+			SCpnt->request_use_sg = 0;
+			++host_busy[host];
+			}
+		restore_flags(flags);
+		if (SCpnt || !wait)
+			return SCpnt;
+#ifdef DEBUG
+		printk("Host %d is busy.\n", host);
+#endif
+		while (!free_cmnds[host]);
+		}
+	}
+
+void scsi_release_cmnd (Scsi_Cmnd * SCpnt)
+	{
+	unsigned long flags;
+	int host = SCpnt->host;
+
+	save_flags(flags);
+	cli();
+	SCpnt->next = free_cmnds[host];
+	free_cmnds[host] = SCpnt;
+	--host_busy[host];
+	restore_flags(flags);
+	}
+
 /*
 	This is inline because we have stack problemes if we recurse to deeply.
 */
 			 
-static void internal_cmnd (int host,  unsigned char target, const void *cmnd , 
-		  void *buffer, unsigned bufflen, void (*done)(int,int))
+static void internal_cmnd (Scsi_Cmnd * SCpnt, const void *cmnd , 
+		  void *buffer, unsigned bufflen, unsigned short use_sg)
 	{
-	int temp;
+	int temp, host = SCpnt->host;
 
 #ifdef DEBUG_DELAY	
 	int clock;
@@ -327,13 +445,31 @@ static void internal_cmnd (int host,  unsigned char target, const void *cmnd ,
 
 /*
 	We will wait MIN_RESET_DELAY clock ticks after the last reset so 
-	we can avoid the drive not being ready.
+	we can avoid the drive not being ready.  Rather than spin, we 
+	park the command with the time left as its timeout, and 
+	scsi_main_timeout() sends it when that runs out.
 */ 
-temp = last_reset[host];
-while (jiffies < temp);
+temp = last_reset[host] + MIN_RESET_DELAY - jiffies;
+if (temp > 0)
+	{
+	if (cmnd != SCpnt->cmnd)
+		memcpy ((void *) SCpnt->cmnd, cmnd, 10);
+	SCpnt->buffer = buffer;
+	SCpnt->bufflen = bufflen;
+	SCpnt->use_sg = use_sg;
+	cli();
+	SCpnt->flags |= IS_DELAYED;
+	SCpnt->timeout = temp;
+	update_timeout();
+	sti();
+	return;
+	}
 
-host_timeout[host] = last_cmnd[host].timeout_per_command;
+cli();
+SCpnt->timeout = (SCpnt->flags & WAS_SENSE) ? SENSE_TIMEOUT : 
+	SCpnt->timeout_per_command;
 update_timeout();
+sti();
 
 /*
 	We will use a queued command if possible, otherwise we will emulate the
@@ -341,7 +477,7 @@ update_timeout();
 */
 #ifdef DEBUG
 	printk("internal_cmnd (host = %d, target = %d, command = %08x, buffer =  %08x, \n"
-		"bufflen = %d, done = %08x)\n", host, target, cmnd, buffer, bufflen, done);
+		"bufflen = %d)\n", host, SCpnt->target, cmnd, buffer, bufflen);
 #endif
 
 	
@@ -351,8 +487,12 @@ update_timeout();
 	printk("queuecommand : routine at %08x\n", 
 		scsi_hosts[host].queuecommand);
 #endif
-                scsi_hosts[host].queuecommand (target, cmnd, buffer, bufflen, 
-					       done);
+		if (cmnd != SCpnt->cmnd)
+			memcpy ((void *) SCpnt->cmnd, cmnd, 10);
+		SCpnt->buffer = buffer;
+		SCpnt->bufflen = bufflen;
+		SCpnt->use_sg = use_sg;
+                scsi_hosts[host].queuecommand (SCpnt, scsi_done);
 		}
 	else
 		{
@@ -360,34 +500,31 @@ update_timeout();
 #ifdef DEBUG
 	printk("command() :  routine at %08x\n", scsi_hosts[host].command);
 #endif
-		temp=scsi_hosts[host].command (target, cmnd, buffer, bufflen);
+		temp=scsi_hosts[host].command (SCpnt->target, cmnd, buffer, bufflen);
 
 #ifdef DEBUG_DELAY
 	clock = jiffies + 400;
 	while (jiffies < clock);
-	printk("done(host = %d, result = %04x) : routine at %08x\n", host, temp, done);
+	printk("done(host = %d, result = %04x)\n", host, temp);
 #endif
-		done(host, temp);
+		SCpnt->result = temp;
+		scsi_done(SCpnt);
 		}	
 #ifdef DEBUG
 	printk("leaving internal_cmnd()\n");
 #endif
 	}	
 
-static void scsi_request_sense (int host, unsigned char target, 
-					unsigned char lun)
+static void scsi_request_sense (Scsi_Cmnd * SCpnt)
 	{
 	cli();
-	host_timeout[host] = SENSE_TIMEOUT;
-	update_timeout();
-	last_cmnd[host].flags |= WAS_SENSE;
+	SCpnt->flags |= WAS_SENSE;
 	sti();
 	
-	last_cmnd[host].sense_cmnd[1] = lun << 5;	
+	SCpnt->sense_cmnd[1] = SCpnt->lun << 5;	
 
-	internal_cmnd (host, target, (void *) last_cmnd[host].sense_cmnd, 
-		       (void *) last_cmnd[host].sense_buffer, SENSE_LENGTH,
-		       scsi_done);
+	internal_cmnd (SCpnt, (void *) SCpnt->sense_cmnd, 
+		       (void *) SCpnt->sense_buffer, SENSE_LENGTH, 0);
 	}
 
 
@@ -397,16 +534,17 @@ static void scsi_request_sense (int host, unsigned char target,
 /*
 	scsi_do_cmd sends all the commands out to the low-level driver.  It 
 	handles the specifics required for each low level driver - ie queued 
-	or non queud.  It also prevents conflicts when different high level 
-	drivers go for the same host at the same time.
+	or non queud.  SCpnt comes from scsi_allocate_cmnd(), which keeps
+	the host from getting more commands than it can take.  done() is 
+	called with SCpnt when the command is finished, with the result in 
+	SCpnt->result and the sense data, if any, in SCpnt->sense_buffer.
 */
 
-void scsi_do_cmd (int host,  unsigned char target, const void *cmnd , 
-		  void *buffer, unsigned bufflen, void (*done)(int,int),
-		  int timeout, unsigned  char *sense_buffer, int retries 
-		   )
+void scsi_do_cmd (Scsi_Cmnd * SCpnt, unsigned char target, const void *cmnd , 
+		  void *buffer, unsigned bufflen, void (*done)(Scsi_Cmnd *),
+		  int timeout, int retries)
         {
-	int ok = 0;
+	int host = SCpnt->host;
 
 #ifdef DEBUG
 	int i;	
@@ -417,69 +555,36 @@ void scsi_do_cmd (int host,  unsigned char target, const void *cmnd ,
 		printk ("%02x  ", ((unsigned char *) cmnd)[i]); 
 	printk("\n");
 #endif
-	
-	if ((host  >= MAX_SCSI_HOSTS) || !scsi_hosts[host].present)
-		{
-		printk ("Invalid or not present host number. %d\n", host);
-		panic("");
-		}
 
-	
 /*
-	We must prevent reentrancy to the lowlevel host driver.  This prevents 
-	it - we enter a loop until the host we want to talk to is not busy.   
-	Race conditions are prevented, as interrupts are disabled inbetween the
-	time we check for the host being not busy, and the time we mark it busy
-	ourselves.
+	Our own function scsi_done (which takes the command off the host's 
+	queue, disables its timeout counter, etc) will be called by us or by 
+	the scsi_hosts[host].queuecommand() function, and calls the 
+	completion function for the high level driver.
 */
 
-	do 	{
-		cli();
-		if (host_busy[host])
-			{
-			sti();
-#ifdef DEBUG
-			printk("Host %d is busy.\n"	);
-#endif
-			while (host_busy[host]);
-#ifdef DEBUG
-			printk("Host %d is no longer busy.");
-#endif
-			}
-		else
-			{
-			host_busy[host] = 1;
-			ok = 1;
-			sti();
-			}
-		} while (!ok);
-		
-
-/*
-	Our own function scsi_done (which marks the host as not busy, disables 
-	the timeout counter, etc) will be called by us or by the 
-	scsi_hosts[host].queuecommand() function needs to also call
-	the completion function for the high level driver.
-
-*/
+	memcpy ((void *) SCpnt->data_cmnd , (void *) cmnd, 10);
+	SCpnt->target = target;
+	SCpnt->lun = (SCpnt->data_cmnd[1] >> 5);
+	SCpnt->request_bufflen = bufflen;
+	SCpnt->request_buffer = buffer;
+	SCpnt->flags=0;
+	SCpnt->retries=0;
+	SCpnt->allowed=retries;
+	SCpnt->done = done;
+	SCpnt->timeout_per_command = timeout;
+	SCpnt->result = 0;
 
-	memcpy ((void *) last_cmnd[host].cmnd , (void *) cmnd, 10);
-	last_cmnd[host].host = host;
-	last_cmnd[host].target = target;
-	last_cmnd[host].lun = (last_cmnd[host].cmnd[1] >> 5);
-	last_cmnd[host].bufflen = bufflen;
-	last_cmnd[host].buffer = buffer;
-	last_cmnd[host].sense_buffer = sense_buffer;
-	last_cmnd[host].flags=0;
-	last_cmnd[host].retries=0;
-	last_cmnd[host].allowed=retries;
-	last_cmnd[host].done = done;
-	last_cmnd[host].timeout_per_command = timeout;
+	cli();
+	SCpnt->prev = NULL;
+	if ((SCpnt->next = (Scsi_Cmnd *) host_queue[host]))
+		SCpnt->next->prev = SCpnt;
+	host_queue[host] = SCpnt;
+	sti();
 				
 	/* Start the timer ticking.  */
 
-	internal_timeout[host] = 0;
-	internal_cmnd (host,  target, cmnd , buffer, bufflen, scsi_done);
+	internal_cmnd (SCpnt, cmnd , buffer, bufflen, SCpnt->request_use_sg);
 
 #ifdef DEBUG
 	printk ("Leaving scsi_do_cmd()\n");
@@ -488,33 +593,33 @@ void scsi_do_cmd (int host,  unsigned char target, const void *cmnd ,
 
 
 /*
-	The scsi_done() function disables the timeout timer for the scsi host, 
-	marks the host as not busy, and calls the user specified completion 
-	function for that host's current command.
+	The scsi_done() function disables the timeout timer for the command, 
+	takes it off the host's queue, and calls the user specified completion 
+	function for it.
 */
 
-static void reset (int host)
+static void reset (Scsi_Cmnd * SCpnt)
 	{
 	#ifdef DEBUG
-		printk("reset(%d)\n", host);
+		printk("reset(%d)\n", SCpnt->host);
 	#endif
 
-	last_cmnd[host].flags |= (WAS_RESET | IS_RESETTING);
-	scsi_reset(host);
+	SCpnt->flags |= (WAS_RESET | IS_RESETTING);
+	scsi_reset(SCpnt->host);
 
 	#ifdef DEBUG
 		printk("performing request sense\n");
 	#endif
 
-	scsi_request_sense (host, last_cmnd[host].target, last_cmnd[host].lun);
+	scsi_request_sense (SCpnt);
 	}
 	
 	
 
-static int check_sense (int host)
+static int check_sense (Scsi_Cmnd * SCpnt)
 	{
-	if (((sense_buffer[0] & 0x70) >> 4) == 7)
-		switch (sense_buffer[2] & 0xf)
+	if (((SCpnt->sense_buffer[0] & 0x70) >> 4) == 7)
+		switch (SCpnt->sense_buffer[2] & 0xf)
 		{
 		case NO_SENSE:
 		case RECOVERED_ERROR:
@@ -543,15 +648,18 @@ static int check_sense (int host)
 		return SUGGEST_RETRY;	
 	}	
 
-static void scsi_done (int host, int result)
+static void scsi_done (Scsi_Cmnd * SCpnt)
 	{
 	int status=0;
 	int exit=0;
 	int checked;
-	int oldto;
-	oldto = host_timeout[host];
-	host_timeout[host] = 0;
+	int host = SCpnt->host;
+	int result = SCpnt->result;
+
+	cli();
+	SCpnt->timeout = 0;
 	update_timeout();
+	sti();
 
 #define FINISHED 0
 #define MAYREDO  1
@@ -562,31 +670,29 @@ static void scsi_done (int host, int result)
 #endif
 	if (host > MAX_SCSI_HOSTS || host  < 0) 
 		{
-		host_timeout[host] = 0;
-		update_timeout();
 		panic("scsi_done() called with invalid host number.\n");
 		}
 
 	switch (host_byte(result))	
 	{
 	case DID_OK:
-		if (last_cmnd[host].flags & IS_RESETTING)
+		if (SCpnt->flags & IS_RESETTING)
 			{
-			last_cmnd[host].flags &= ~IS_RESETTING;
+			SCpnt->flags &= ~IS_RESETTING;
 			status = REDO;
 			break;
 			}
 
-		if (status_byte(result) && (last_cmnd[host].flags & 
+		if (status_byte(result) && (SCpnt->flags & 
 		    WAS_SENSE))	
 			{
-			last_cmnd[host].flags &= ~WAS_SENSE;
+			SCpnt->flags &= ~WAS_SENSE;
 			cli();
 			internal_timeout[host] &= ~SENSE_TIMEOUT;
 			sti();
 
-			if (!(last_cmnd[host].flags & WAS_RESET)) 
-				reset(host);
+			if (!(SCpnt->flags & WAS_RESET)) 
+				reset(SCpnt);
 			else
 				{
 				exit = (DRIVER_HARD | SUGGEST_ABORT);
@@ -599,26 +705,24 @@ static void scsi_done (int host, int result)
 			switch (status_byte(result))
 			{
 			case GOOD:
-				if (last_cmnd[host].flags & WAS_SENSE)
+				if (SCpnt->flags & WAS_SENSE)
 					{
 #ifdef DEBUG
 	printk ("In scsi_done, GOOD status, COMMAND COMPLETE, parsing sense information.\n");
 #endif
 
-					last_cmnd[host].flags &= ~WAS_SENSE;
+					SCpnt->flags &= ~WAS_SENSE;
 					cli();
 					internal_timeout[host] &= ~SENSE_TIMEOUT;
 					sti();
 	
-					switch (checked = check_sense(host))
+					switch (checked = check_sense(SCpnt))
 					{
 					case 0: 
 #ifdef DEBUG
 	printk("NO SENSE.  status = REDO\n");
 #endif
 
-						host_timeout[host] = oldto;
-						update_timeout();
 						status = REDO;
 						break;
 					case SUGGEST_REMAP:			
@@ -660,7 +764,7 @@ static void scsi_done (int host, int result)
 	printk("CHECK CONDITION message returned, performing request sense.\n");
 #endif
 
-				scsi_request_sense (host, last_cmnd[host].target, last_cmnd[host].lun);
+				scsi_request_sense (SCpnt);
 				break;       	
 			
 			case CONDITION_GOOD:
@@ -675,13 +779,11 @@ static void scsi_done (int host, int result)
 #ifdef DEBUG
 	printk("BUSY message returned, performing REDO");
 #endif
-				host_timeout[host] = oldto;
-				update_timeout();
 				status = REDO;
 				break;
 
 			case RESERVATION_CONFLICT:
-				reset(host);
+				reset(SCpnt);
 				exit = DRIVER_SOFT | SUGGEST_ABORT;
 				status = MAYREDO;
 				break;
@@ -701,7 +803,7 @@ static void scsi_done (int host, int result)
 	printk("Host returned DID_TIME_OUT - ");
 #endif
 
-		if (last_cmnd[host].flags & WAS_TIMEDOUT)	
+		if (SCpnt->flags & WAS_TIMEDOUT)	
 			{
 #ifdef DEBUG
 	printk("Aborting\n");
@@ -713,7 +815,7 @@ static void scsi_done (int host, int result)
 #ifdef DEBUG
 			printk ("Retrying.\n");
 #endif
-			last_cmnd[host].flags  |= WAS_TIMEDOUT;
+			SCpnt->flags  |= WAS_TIMEDOUT;
 			status = REDO;
 			}
 		break;
@@ -747,14 +849,14 @@ static void scsi_done (int host, int result)
 
 #ifdef DEBUG
 	printk("In MAYREDO, allowing %d retries, have %d\n\r",
-	       last_cmnd[host].allowed, last_cmnd[host].retries);
+	       SCpnt->allowed, SCpnt->retries);
 #endif
 
-			if ((++last_cmnd[host].retries) < last_cmnd[host].allowed)
+			if ((++SCpnt->retries) < SCpnt->allowed)
 			{
-			if ((last_cmnd[host].retries >= (last_cmnd[host].allowed >> 1)) 
-			    && !(last_cmnd[host].flags & WAS_RESET))
-				reset(host);
+			if ((SCpnt->retries >= (SCpnt->allowed >> 1)) 
+			    && !(SCpnt->flags & WAS_RESET))
+				reset(SCpnt);
 				break;
 			
 			}
@@ -766,14 +868,13 @@ static void scsi_done (int host, int result)
 			/* fall through to REDO */
 
 		case REDO:
-			if (last_cmnd[host].flags & WAS_SENSE)			
-				scsi_request_sense (host, last_cmnd[host].target,	
-			       last_cmnd[host].lun); 	
+			if (SCpnt->flags & WAS_SENSE)			
+				scsi_request_sense (SCpnt); 	
 			else	
-				internal_cmnd (host, last_cmnd[host].target,	
-			        last_cmnd[host].cmnd,  
-				last_cmnd[host].buffer,   
-				last_cmnd[host].bufflen, scsi_done);			
+				internal_cmnd (SCpnt, SCpnt->data_cmnd,  
+				SCpnt->request_buffer,   
+				SCpnt->request_bufflen, 
+				SCpnt->request_use_sg);			
 			break;	
 		default: 
 			INTERNAL_ERROR;
@@ -782,10 +883,18 @@ static void scsi_done (int host, int result)
 	if (status == FINISHED) 
 		{
 		#ifdef DEBUG
-			printk("Calling done function - at address %08x\n", last_cmnd[host].done);
+			printk("Calling done function - at address %08x\n", SCpnt->done);
 		#endif
-		last_cmnd[host].done (host, (result | ((exit & 0xff) << 24)));
-		host_busy[host] = 0;
+		cli();
+		if (SCpnt->prev)
+			SCpnt->prev->next = SCpnt->next;
+		else
+			host_queue[host] = SCpnt->next;
+		if (SCpnt->next)
+			SCpnt->next->prev = SCpnt->prev;
+		sti();
+		SCpnt->result = result | ((exit & 0xff) << 24);
+		SCpnt->done (SCpnt);
 		}
 
 
@@ -849,7 +958,8 @@ int scsi_abort (int host, int why)
 
 int scsi_reset (int host)
 	{
-	int temp, oldto;
+	int temp, oldto, abort;
+	Scsi_Cmnd * SCpnt;
 	
 	while (1) {
 		cli();	
@@ -865,22 +975,23 @@ int scsi_reset (int host)
 			update_timeout();	
 			internal_timeout[host] |= IN_RESET;
 					
-			if (host_busy[host])
+			if (host_queue[host])
 				{	
+				for (abort = 0, SCpnt = (Scsi_Cmnd *) host_queue[host];
+				     SCpnt; SCpnt = SCpnt->next)
+					if (!(SCpnt->flags & IS_RESETTING))
+						abort = 1;
 				sti();
-				if (!(last_cmnd[host].flags & IS_RESETTING) && !(internal_timeout[host] & IN_ABORT))
+				if (abort && !(internal_timeout[host] & IN_ABORT))
 					scsi_abort(host, DID_RESET);
 
 				temp = scsi_hosts[host].reset();			
 				}				
 			else
 				{
-				host_busy[host]=1;
-	
 				sti();
 				temp = scsi_hosts[host].reset();
 				last_reset[host] = jiffies;
-				host_busy[host]=0;
 				}
 	
 			cli();
@@ -901,16 +1012,19 @@ static void scsi_main_timeout(void)
 	*/
 
 	int i, timed_out;
+	Scsi_Cmnd * SCpnt;
 
 	do 	{	
 		cli();
 
 	/*
 		Find all timers such that they have 0 or negative (shouldn't happen)
-		time remaining on them.
+		time remaining on them.  Once a command has timed out, the
+		queue may have changed under us, so we start over.
 	*/
 			
 		for (i = timed_out = 0; i < MAX_SCSI_HOSTS; ++i)
+			{
 			if (host_timeout[i] != 0 && host_timeout[i] <= time_elapsed)
 				{
 				sti();
@@ -918,6 +1032,28 @@ static void scsi_main_timeout(void)
 				scsi_times_out(i);
 				++timed_out; 
 				}
+			cli();
+			for (SCpnt = (Scsi_Cmnd *) host_queue[i]; SCpnt; SCpnt = SCpnt->next)
+				if (SCpnt->timeout != 0 && SCpnt->timeout <= time_elapsed)
+					{
+					SCpnt->timeout = 0;
+					if (SCpnt->flags & IS_DELAYED)
+						{
+						SCpnt->flags &= ~IS_DELAYED;
+						sti();
+						internal_cmnd (SCpnt, SCpnt->cmnd, 
+							SCpnt->buffer, SCpnt->bufflen,
+							SCpnt->use_sg);
+						}
+					else
+						{
+						sti();
+						scsi_times_out(i);
+						}
+					++timed_out;
+					break;
+					}
+			}
 
 		update_timeout();				
 	   	} while (timed_out);	
@@ -938,6 +1074,7 @@ static int time_start, time_elapsed;
 static void update_timeout(void)
 	{
 	int i, least, used;
+	Scsi_Cmnd * SCpnt;
 
 	cli();
 
@@ -954,8 +1091,13 @@ static void update_timeout(void)
 */
 	
 	for (i = 0, least = 0xffffffff; i < MAX_SCSI_HOSTS; ++i)	
+		{
 		if (host_timeout[i] > 0 && (host_timeout[i] -= used) < least)
 			least = host_timeout[i]; 
+		for (SCpnt = (Scsi_Cmnd *) host_queue[i]; SCpnt; SCpnt = SCpnt->next)
+			if (SCpnt->timeout > 0 && (SCpnt->timeout -= used) < least)
+				least = SCpnt->timeout;
+		}
 
 /*
 	If something is due to timeout again, then we will set the next timeout 
@@ -981,10 +1123,11 @@ static void update_timeout(void)
 	should be called from main().
 */
 
-static unsigned char generic_sense[6] = {REQUEST_SENSE, 0,0,0, 255, 0};		
+static unsigned char generic_sense[6] = {REQUEST_SENSE, 0,0,0, SENSE_LENGTH, 0};		
 void scsi_dev_init (void)
 	{
-	int i;
+	int i, j, depth;
+	Scsi_Cmnd * SCpnt;
 #ifdef FOO_ON_YOU
 	return;
 #endif	
@@ -993,14 +1136,29 @@ void scsi_dev_init (void)
 
 	scsi_init();            /* initialize all hosts */
 	/*
-		Set up sense command in each host structure.
+		Fill each host's command pool, and set up the sense command 
+		in each command block.
 	*/
 
 	for (i = 0; i < MAX_SCSI_HOSTS; ++i)
 		{
-		memcpy ((void *) last_cmnd[i].sense_cmnd, (void *) generic_sense,
-			6);
 		last_reset[i] = 0;
+		free_cmnds[i] = NULL;
+		if (!scsi_hosts[i].present)
+			continue;
+		depth = scsi_hosts[i].can_queue ? scsi_hosts[i].can_queue : 1;
+		if (depth > SCSI_MAX_QUEUE)
+			depth = SCSI_MAX_QUEUE;
+		for (j = 0; j < depth; ++j)
+			{
+			SCpnt = &scsi_cmnd_pool[i][j];
+			SCpnt->host = i;
+			SCpnt->slot = j;
+			memcpy ((void *) SCpnt->sense_cmnd, (void *) generic_sense,
+				6);
+			SCpnt->next = free_cmnds[i];
+			free_cmnds[i] = SCpnt;
+			}
 		}
 				
         scan_scsis();           /* scan for scsi devices */
@@ -249,9 +249,20 @@ extern void scsi_dev_init (void);
 
 
 
-extern void scsi_do_cmd (int host,  unsigned char target, const void *cmnd ,
-                  void *buffer, unsigned bufflen, void (*done)(int,int),
-                  int timeout, unsigned  char *sense_buffer, int retries);
+struct scsi_cmnd;
+
+extern void scsi_do_cmd (struct scsi_cmnd *SCpnt, unsigned char target, 
+		  const void *cmnd , void *buffer, unsigned bufflen, 
+		  void (*done)(struct scsi_cmnd *), int timeout, int retries);
+
+/*
+	Command blocks for scsi_do_cmd() come from scsi_allocate_cmnd, 
+	which returns NULL when all of the host's are out unless told to 
+	wait for one.  scsi_release_cmnd gives one back.
+*/
+
+extern struct scsi_cmnd * scsi_allocate_cmnd (int host, int wait);
+extern void scsi_release_cmnd (struct scsi_cmnd *SCpnt);
 
 int scsi_reset (int host);
 #endif
@@ -61,11 +61,11 @@ static int ioctl_probe(int dev, void *buffer)
  * The area is then filled in from the byte at offset 0. 
  */
 
-static int the_result[MAX_SCSI_HOSTS];
+static volatile int the_result[MAX_SCSI_HOSTS];
 
-static void scsi_ioctl_done (int host, int result)
+static void scsi_ioctl_done (Scsi_Cmnd * SCpnt)
 {
-	the_result[host] = result;	
+	the_result[SCpnt->host] = SCpnt->result;	
 }	
 	
 static int ioctl_command(Scsi_Device *dev, void *buffer)
@@ -75,6 +75,7 @@ static int ioctl_command(Scsi_Device *dev, void *buffer)
 	char * cmd_in;
 	unsigned char opcode;
 	int inlen, outlen, cmdlen, temp, host;
+	Scsi_Cmnd * SCpnt;
 
 	if (!buffer)
 		return -EINVAL;
@@ -103,13 +104,17 @@ static int ioctl_command(Scsi_Device *dev, void *buffer)
 		}
 	} while (1);
 	
-	scsi_do_cmd(host,  dev->id, cmd, buf, ((outlen > MAX_BUF) ? 
+	SCpnt = scsi_allocate_cmnd(host, 1);
+	scsi_do_cmd(SCpnt,  dev->id, cmd, buf, ((outlen > MAX_BUF) ? 
 			MAX_BUF : outlen),  scsi_ioctl_done, MAX_TIMEOUT, 
-			buf, MAX_RETRIES);
+			MAX_RETRIES);
 
 	while (the_result[host] == -1)
 		/* nothing */;
 	temp = the_result[host];
+	if (driver_byte(temp) & DRIVER_SENSE)
+		memcpy ((void *) buf, (void *) SCpnt->sense_buffer, SENSE_LENGTH);
+	scsi_release_cmnd(SCpnt);
 	the_result[host]=0;
 	memcpy_tofs (buffer, buf, (outlen > MAX_BUF) ? MAX_BUF  : outlen);
 	return temp;
@@ -13,7 +13,9 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <asm/system.h>
 #include "scsi.h"
+#include "hosts.h"
 #include "sd.h"
 
 #define MAJOR_NR 8
@@ -36,8 +38,9 @@ Partition scsi_disks[MAX_SD << 4];
 int NR_SD=0;
 Scsi_Disk rscsi_disks[MAX_SD];
 static int sd_sizes[MAX_SD << 4];
-static int this_count;
-static int the_result;
+static volatile int the_result;
+
+static void rw_intr (Scsi_Cmnd * SCpnt);
 
 extern int sd_ioctl(struct inode *, struct file *, unsigned long, unsigned long);
 
@@ -54,15 +57,150 @@ static struct file_operations sd_fops = {
 	NULL,			/* select */
 	sd_ioctl,		/* ioctl */
 	NULL,			/* no special open code */
-	sd_release		/* release */
+	sd_release,		/* release */
+	block_readv,		/* readv */
+	block_writev		/* writev */
 };
 
 /*
-	The sense_buffer is where we put data for all mode sense commands 
-	performed.
+	Requests are taken off the queue as they go out to the host, so that
+	several of them can be in flight at once, each with a command block
+	of its own; SCpnt->request is the request a command is working on.
+	sd_end_request() is end_request() for such a request : it finishes
+	the first count sectors, and returns 0 once the request is done.
+*/
+
+static int sd_end_request (struct request * req, int count, int uptodate)
+{
+	struct buffer_head * bh;
+	int n;
+
+	req->errors = 0;
+	if (!uptodate) {
+		printk(DEVICE_NAME " I/O error\n\r");
+		printk("dev %04x, sector %d\n\r",req->dev,req->sector);
+	}
+	while (count > 0 && req->nr_sectors) {
+		if (!(bh = req->bh)) {
+			n = (count < req->nr_sectors) ? count : req->nr_sectors;
+			req->sector += n;
+			req->nr_sectors -= n;
+			req->buffer += n << 9;
+			count -= n;
+			continue;
+		}
+		req->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
+		req->sector += 2;
+		req->nr_sectors -= 2;
+		count -= 2;
+		if (bh = req->bh)
+			req->buffer = bh->b_data;
+	}
+	if (req->nr_sectors && (uptodate || req->bh))
+		return 1;
+	wake_up(&req->waiting);
+	req->dev = -1;
+	wake_up(&wait_for_request);
+	return 0;
+}
+
+/*
+	sd_issue() sends out the next part of SCpnt->request.  This is as 
+	much of it as is contiguous in memory or, if the host can do 
+	scatter-gather, as many buffers as fit in its scatterlist, which 
+	then go out as one ten byte READ or WRITE.
 */
 
-static unsigned char sense_buffer[255];
+static void sd_issue (Scsi_Cmnd * SCpnt)
+{
+	struct request * req = (struct request *) SCpnt->request;
+	struct buffer_head * bh;
+	struct scatterlist * sg;
+	int dev, block, this_count, max;
+	void * buffer;
+	unsigned char cmd[10];
+
+	dev = DEVICE_NR(req->dev);
+	block = req->sector + scsi_disks[MINOR(req->dev)].start_sect;
+
+#ifdef DEBUG
+	printk("Real dev = %d, block = %d\n", dev, block);
+#endif
+
+	buffer = req->buffer;
+	SCpnt->request_use_sg = 0;
+	if (bh = req->bh)
+		for (this_count = 2; bh->b_reqnext && 
+		     bh->b_reqnext->b_data == bh->b_data + BLOCK_SIZE;
+		     bh = bh->b_reqnext)
+			this_count += 2;
+	else
+		this_count = req->nr_sectors;
+
+	max = scsi_hosts[rscsi_disks[dev].device->host_no].sg_tablesize;
+	if (max > SCSI_MAX_SG)
+		max = SCSI_MAX_SG;
+	if (bh && bh->b_reqnext && max > 1 && rscsi_disks[dev].ten)
+		{
+		sg = SCpnt->sglist;
+		sg->address = req->buffer;
+		sg->length = this_count << 9;
+		SCpnt->request_use_sg = 1;
+		while ((bh = bh->b_reqnext) && this_count < 0xfffe)
+			{
+			if (bh->b_data == sg->address + sg->length)
+				sg->length += BLOCK_SIZE;
+			else if (SCpnt->request_use_sg == max)
+				break;
+			else
+				{
+				++sg;
+				sg->address = bh->b_data;
+				sg->length = BLOCK_SIZE;
+				++SCpnt->request_use_sg;
+				}
+			this_count += 2;
+			}
+		buffer = (void *) SCpnt->sglist;
+		}
+
+	cmd[0] = (req->cmd == WRITE) ? WRITE_6 : READ_6;
+	cmd[1] = (rscsi_disks[dev].device->lun << 5) & 0xe0;
+
+	if (((this_count > 0xff) ||  (block > 0x1fffff) || SCpnt->request_use_sg) && 
+	    rscsi_disks[dev].ten) 
+		{
+		if (this_count > 0xffff)
+			this_count = 0xffff;
+
+		cmd[0] += READ_10 - READ_6 ;
+		cmd[2] = (unsigned char) (block >> 24) & 0xff;
+		cmd[3] = (unsigned char) (block >> 16) & 0xff;
+		cmd[4] = (unsigned char) (block >> 8) & 0xff;
+		cmd[5] = (unsigned char) block & 0xff;
+		cmd[6] = cmd[9] = 0;
+		cmd[7] = (unsigned char) (this_count >> 8) & 0xff;
+		cmd[8] = (unsigned char) this_count & 0xff;
+		}
+	else
+		{
+		if (this_count > 0xff)
+			this_count = 0xff;
+	
+		cmd[1] |= (unsigned char) ((block >> 16) & 0x1f);
+		cmd[2] = (unsigned char) ((block >> 8) & 0xff);
+		cmd[3] = (unsigned char) block & 0xff;
+		cmd[4] = (unsigned char) this_count;
+		cmd[5] = 0;
+		}
+			
+	scsi_do_cmd (SCpnt, rscsi_disks[dev].device->id, (void *) cmd, 
+		     buffer, this_count << 9, rw_intr, SD_TIMEOUT, 
+		     MAX_RETRIES);
+}
 
 /*
 	rw_intr is the interrupt routine for the device driver.  It will
@@ -70,10 +208,11 @@ static unsigned char sense_buffer[255];
 	will take on of several actions based on success or failure.
 */
 
-static void rw_intr (int host, int result)
+static void rw_intr (Scsi_Cmnd * SCpnt)
 {
-	if (HOST != host)
-		panic ("sd.o : rw_intr() recieving interrupt for different host.");
+	struct request * req = (struct request *) SCpnt->request;
+	int result = SCpnt->result;
+	int this_count = SCpnt->request_bufflen >> 9;
 
 /*
 	First case : we assume that the command succeeded.  One of two things will
@@ -81,22 +220,12 @@ static void rw_intr (int host, int result)
 	sectors that we were unable to read last time.
 */
 
-	if (!result)
-		if (!(CURRENT->nr_sectors -= this_count)) {
-			end_request(1);
-			do_sd_request();
-		} else {			
-			CURRENT->nr_sectors -= this_count;
-/*
-	The CURRENT->nr_sectors field is always done in 512 byte sectors,
-	even if this really isn't the case.
-*/
-	
-			(char *) CURRENT->buffer += this_count << 9;
-			CURRENT->sector += this_count;
-			CURRENT->errors = 0;
-			do_sd_request();			 
+	if (!result) {
+		if (sd_end_request(req, this_count, 1)) {
+			sd_issue(SCpnt);
+			return;
 		}
+	}
 
 /*
 	Now, if we were good little boys and girls, Santa left us a request 
@@ -112,7 +241,7 @@ static void rw_intr (int host, int result)
 	a write will call the strategy routine again.
 */
 
-			if rscsi_disks[DEVICE_NR(CURRENT->dev)].remap
+			if rscsi_disks[DEVICE_NR(req->dev)].remap
 				{
 				result = 0;
 				}
@@ -128,41 +257,48 @@ static void rw_intr (int host, int result)
 	disk.
 */
 	
-		else if (sense_buffer[7] == ILLEGAL_REQUEST) {
-			if (rscsi_disks[DEVICE_NR(CURRENT->dev)].ten) {
-				rscsi_disks[DEVICE_NR(CURRENT->dev)].ten = 0;
-				do_sd_request();
-				result = 0;
-			} else {
+		else if ((SCpnt->sense_buffer[2] & 0xf) == ILLEGAL_REQUEST) {
+			if (rscsi_disks[DEVICE_NR(req->dev)].ten) {
+				rscsi_disks[DEVICE_NR(req->dev)].ten = 0;
+				sd_issue(SCpnt);
+				return;
 			}
 		}
 	}
 	if (result) {
 		printk("SCSI disk error : host %d id %d lun %d return code = %03x\n", 
-		       rscsi_disks[DEVICE_NR(CURRENT->dev)].device->host_no, 
-		       rscsi_disks[DEVICE_NR(CURRENT->dev)].device->id,
-		       rscsi_disks[DEVICE_NR(CURRENT->dev)].device->lun);
+		       rscsi_disks[DEVICE_NR(req->dev)].device->host_no, 
+		       rscsi_disks[DEVICE_NR(req->dev)].device->id,
+		       rscsi_disks[DEVICE_NR(req->dev)].device->lun,
+		       result);
 
 		if (driver_byte(result) & DRIVER_SENSE) 
 			printk("\tSense class %x, sense error %x, extended sense %x\n",
-				sense_class(sense_buffer[0]), 
-				sense_error(sense_buffer[0]),
-				sense_buffer[2] & 0xf);
+				sense_class(SCpnt->sense_buffer[0]), 
+				sense_error(SCpnt->sense_buffer[0]),
+				SCpnt->sense_buffer[2] & 0xf);
 	
-		end_request(0);
+		if (sd_end_request(req, this_count, 0)) {
+			sd_issue(SCpnt);
+			return;
+		}
 	}
+	scsi_release_cmnd(SCpnt);
+	do_sd_request();
 }
 
 /*
-	do_sd_request() is the request handler function for the sd driver.  
-	Its function in life is to take block device requests, and translate 
-	them to SCSI commands.
+	sd_start_requests() takes block device requests, and translates 
+	them to SCSI commands, for as long as there are requests and the 
+	host has a free command block.  Anything left is started when a
+	command completes.
 */
 	
-void do_sd_request (void)
+static void sd_start_requests (void)
 {
 	int dev, block;
-	unsigned char cmd[10];
+	struct request * req;
+	Scsi_Cmnd * SCpnt;
 
 	INIT_REQUEST;
 	dev =  MINOR(CURRENT->dev);
@@ -179,20 +315,14 @@ void do_sd_request (void)
 		goto repeat;
 		}
 	
-	block += scsi_disks[dev].start_sect;
 	dev = DEVICE_NR(dev);
 
-#ifdef DEBUG
-	printk("Real dev = %d, block = %d\n", dev, block);
-#endif
-
 	if (!rscsi_disks[dev].use)
 		{
 		end_request(0);
 		goto repeat;
 		}
 	
-	this_count = CURRENT->nr_sectors;
 	switch (CURRENT->cmd)
 		{
 		case WRITE : 
@@ -201,51 +331,58 @@ void do_sd_request (void)
 				end_request(0);
 				goto repeat;
 				} 
-			cmd[0] = WRITE_6;
 			break;
 		case READ : 
-			cmd[0] = READ_6;
 			break;
 		default : 
 			printk ("Unknown sd command %d\r\n", CURRENT->cmd);
 			panic("");
 		}
-	
-	cmd[1] = (LUN << 5) & 0xe0;
 
-	if (((this_count > 0xff) ||  (block > 0x1fffff)) && rscsi_disks[dev].ten) 
-		{
-		if (this_count > 0xffff)
-			this_count = 0xffff;
+	if (!(SCpnt = scsi_allocate_cmnd (HOST, 0)))
+		return;
 
-		cmd[0] += READ_10 - READ_6 ;
-		cmd[2] = (unsigned char) (block >> 24) & 0xff;
-		cmd[3] = (unsigned char) (block >> 16) & 0xff;
-		cmd[4] = (unsigned char) (block >> 8) & 0xff;
-		cmd[5] = (unsigned char) block & 0xff;
-		cmd[6] = cmd[9] = 0;
-		cmd[7] = (unsigned char) (this_count >> 8) & 0xff;
-		cmd[8] = (unsigned char) this_count & 0xff;
-		}
-	else
-		{
-		if (this_count > 0xff)
-			this_count = 0xff;
-	
-		cmd[1] |= (unsigned char) ((block >> 16) & 0x1f);
-		cmd[2] = (unsigned char) ((block >> 8) & 0xff);
-		cmd[3] = (unsigned char) block & 0xff;
-		cmd[4] = (unsigned char) this_count;
-		cmd[5] = 0;
-		}
-			
-	scsi_do_cmd (HOST, ID, (void *) cmd, CURRENT->buffer, this_count << 9, 
-		     rw_intr, SD_TIMEOUT, sense_buffer, MAX_RETRIES);
+	cli();
+	req = CURRENT;
+	CURRENT = req->next;
+	sti();
+	SCpnt->request = req;
+	sd_issue(SCpnt);
+	goto repeat;
+}
+
+/*
+	do_sd_request() is the request handler function for the sd driver.  
+	It is called both from ll_rw_blk and from command completion, so it 
+	may be entered again while it is running, even from the very 
+	command it is sending out if the host can't queue.  Such calls just 
+	make the running one look at the queue again.
+*/
+
+void do_sd_request (void)
+{
+	static volatile int running = 0, again = 0;
+
+	cli();
+	if (running) {
+		again = 1;
+		sti();
+		return;
+	}
+	running = 1;
+	do {
+		again = 0;
+		sti();
+		sd_start_requests();
+		cli();
+	} while (again);
+	running = 0;
+	sti();
 }
 
-static void sd_init_done (int host, int result)
+static void sd_init_done (Scsi_Cmnd * SCpnt)
 {
-	the_result = result;
+	the_result = SCpnt->result;
 }
 
 /*
@@ -258,6 +395,7 @@ void sd_init(void)
 	int i,j,k;
 	unsigned char cmd[10];
 	unsigned char buffer[513];
+	Scsi_Cmnd * SCpnt;
 
 	Partition *p;
 
@@ -273,10 +411,10 @@ void sd_init(void)
 	printk("Read capacity, disk %d at host = %d, id = %d\n", i, 
 		rscsi_disks[i].device->host_no, rscsi_disks[i].device->id);
 #endif
-		scsi_do_cmd (rscsi_disks[i].device->host_no , 
-				rscsi_disks[i].device->id, 
+		SCpnt = scsi_allocate_cmnd (rscsi_disks[i].device->host_no, 1);
+		scsi_do_cmd (SCpnt, rscsi_disks[i].device->id, 
 				(void *) cmd, (void *) buffer,
-				 512, sd_init_done,  SD_TIMEOUT, sense_buffer,
+				 512, sd_init_done,  SD_TIMEOUT,
 				 MAX_RETRIES);
 
 		while(the_result < 0);
@@ -306,7 +444,7 @@ void sd_init(void)
 			        driver_byte(the_result)
 			        );
 			if (driver_byte(the_result)  & DRIVER_SENSE)  
-				printk("Extended sense code = %1x \n", sense_buffer[2] & 0xf);
+				printk("Extended sense code = %1x \n", SCpnt->sense_buffer[2] & 0xf);
 			else
 				printk("Sense not available. \n");
 
@@ -345,9 +483,9 @@ void sd_init(void)
 			cmd[4] = 1;
  			the_result = -1;
 	
-			scsi_do_cmd (rscsi_disks[i].device->host_no ,  rscsi_disks[i].device->id, 
+			scsi_do_cmd (SCpnt,  rscsi_disks[i].device->id, 
 			     	(void *) cmd, (void *) buffer, 512, sd_init_done,  SD_TIMEOUT, 
-			     	sense_buffer, MAX_RETRIES);
+			     	MAX_RETRIES);
 					
 			while (the_result < 0);
 
@@ -371,6 +509,7 @@ void sd_init(void)
 			rscsi_disks[i].ten = 1;
 			rscsi_disks[i].remap = 1;
 			}
+		scsi_release_cmnd (SCpnt);
 		}
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
 	blk_size[MAJOR_NR] = sd_sizes;	
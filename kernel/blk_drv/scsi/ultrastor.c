@@ -28,11 +28,11 @@
  *    commands to complete.  I hope to go back and beat it into shape, but
  *    PLEASE, anyone else who would like to, please make improvements!
  *
- *    By defining USE_QUEUECOMMAND as TRUE in ultrastor.h, you enable the
- *    queueing feature of the mid-level SCSI driver.  This should improve
- *    performance somewhat.  However, it does not seem to work.  I believe
- *    this is due to a bug in the mid-level driver, but I haven't looked
- *    too closely.
+ *    With USE_QUEUECOMMAND TRUE in ultrastor.h (the default), we use the
+ *    queueing feature of the mid-level SCSI driver, and the controller's
+ *    command queueing: up to ULTRASTOR_MAX_CMDS commands are outstanding,
+ *    each with its own mscp.  The ICM tells us which mscp completed.
+ *    Setting it FALSE gets the old sit-and-spin driver.
  */
 
 #include <linux/config.h>
@@ -47,10 +47,10 @@
 #include <asm/io.h>
 #include <asm/system.h>
 
-#define ULTRASTOR_PRIVATE	/* Get the private stuff from ultrastor.h */
-#include "ultrastor.h"
 #include "scsi.h"
 #include "hosts.h"
+#define ULTRASTOR_PRIVATE	/* Get the private stuff from ultrastor.h */
+#include "ultrastor.h"
 
 #define VERSION "1.0 beta"
 
@@ -117,6 +117,12 @@ struct mscp {
     Longword sense_data;
 };
 
+/* Scatter/gather list entry, used when sg is set in the mscp */
+struct sg_list {
+    Longword address;
+    Longword num_bytes;
+};
+
 /* Allowed BIOS base addresses for 14f (NULL indicates reserved) */
 static const void *const bios_segment_table[8] = {
     NULL,	     (void *)0xC4000, (void *)0xC8000, (void *)0xCC000,
@@ -158,8 +164,6 @@ static const unsigned short ultrastor_ports[] = {
 
 void ultrastor_interrupt(void);
 
-static void (*ultrastor_done)(int, int) = 0;
-
 static const struct {
     const char *signature;
     size_t offset;
@@ -309,46 +313,113 @@ const char *ultrastor_14f_info(void)
 	   " by David B. Gentzel\n";
 }
 
-static struct mscp mscp = {
-    OP_SCSI, DTD_SCSI, FALSE, TRUE, FALSE	/* This stuff doesn't change */
-};
+static struct mscp mscps[ULTRASTOR_MAX_CMDS];
+static struct sg_list sg_lists[ULTRASTOR_MAX_CMDS][ULTRASTOR_MAX_SG];
 
-int ultrastor_14f_queuecommand(unsigned char target, const void *cmnd,
-			       void *buff, int bufflen, void (*done)(int, int))
+/* The command on each mscp, and who to tell when it is done */
+static Scsi_Cmnd *SCint[ULTRASTOR_MAX_CMDS];
+static void (*ultrastor_done[ULTRASTOR_MAX_CMDS])(Scsi_Cmnd *);
+
+/* Read the mscp address from the ICM, and clean the ICM slot */
+static struct mscp *ultrastor_icm(void)
+{
+    unsigned int addr;
+
+    addr = inb_p(ICM_DATA_PTR(PORT_ADDRESS + 0));
+    addr |= inb_p(ICM_DATA_PTR(PORT_ADDRESS + 1)) << 8;
+    addr |= inb_p(ICM_DATA_PTR(PORT_ADDRESS + 2)) << 16;
+    addr |= inb_p(ICM_DATA_PTR(PORT_ADDRESS + 3)) << 24;
+
+    /* Clean ICM slot (set ICMINT bit to 0) */
+    outb_p(0x1, SYS_DOORBELL_INTR(PORT_ADDRESS));
+
+    return (struct mscp *)addr;
+}
+
+int ultrastor_14f_queuecommand(Scsi_Cmnd *SCpnt, void (*done)(Scsi_Cmnd *))
 {
     unsigned char in_byte;
+    unsigned long flags;
+    struct mscp *mscp;
+    void *buff = SCpnt->buffer;
+    int bufflen = SCpnt->bufflen;
+    int slot;
 
 #if (ULTRASTOR_DEBUG & UD_COMMAND)
     printk("US14F: queuecommand: called\n");
 #endif
 
-    /* Skip first (constant) byte */
-    memset((char *)&mscp + 1, 0, sizeof (struct mscp) - 1);
-    mscp.target_id = target;
-    /* mscp.lun = ???; */
-    mscp.transfer_data = *(Longword *)&buff;
-    mscp.transfer_data_length = *(Longword *)&bufflen,
-    mscp.length_of_scsi_cdbs = ((*(unsigned char *)cmnd <= 0x1F) ? 6 : 10);
-    memcpy(mscp.scsi_cdbs, cmnd, mscp.length_of_scsi_cdbs);
+    save_flags(flags);
+    cli();
+    for (slot = 0; slot < ULTRASTOR_MAX_CMDS; slot++)
+	if (!SCint[slot])
+	    break;
+    if (slot == ULTRASTOR_MAX_CMDS)
+	panic("US14F: queuecommand: no free mscp\n");
+    SCint[slot] = SCpnt;
+    ultrastor_done[slot] = done;
+    restore_flags(flags);
+
+    mscp = &mscps[slot];
+    memset(mscp, 0, sizeof (struct mscp));
+    mscp->opcode = OP_SCSI;
+    mscp->xdir = DTD_SCSI;
+    mscp->dcn = FALSE;
+    mscp->ca = TRUE;
+    mscp->sg = FALSE;
+    mscp->target_id = SCpnt->target;
+    mscp->lun = SCpnt->lun;
+    if (SCpnt->use_sg) {
+	struct scatterlist *sgpnt = (struct scatterlist *)buff;
+	struct sg_list *sg = sg_lists[slot];
+	int i;
+
+	if (SCpnt->use_sg > ULTRASTOR_MAX_SG)
+	    panic("US14F: queuecommand: too many segments\n");
+	for (i = 0; i < SCpnt->use_sg; i++) {
+	    sg[i].address = *(Longword *)&sgpnt[i].address;
+	    sg[i].num_bytes = *(Longword *)&sgpnt[i].length;
+	}
+	mscp->sg = TRUE;
+	mscp->number_of_sg_list = SCpnt->use_sg;
+	buff = sg;
+	bufflen = SCpnt->use_sg * sizeof (struct sg_list);
+    }
+    mscp->transfer_data = *(Longword *)&buff;
+    mscp->transfer_data_length = *(Longword *)&bufflen,
+    mscp->length_of_scsi_cdbs = ((SCpnt->cmnd[0] <= 0x1F) ? 6 : 10);
+    memcpy(mscp->scsi_cdbs, SCpnt->cmnd, mscp->length_of_scsi_cdbs);
+
+    /* The OGM takes one command at a time; don't let an interrupt that
+       queues another get in between. */
+    save_flags(flags);
+    cli();
 
     /* Find free OGM slot (OGMINT bit is 0) */
     do
 	in_byte = inb_p(LCL_DOORBELL_INTR(PORT_ADDRESS));
     while (!aborted && (in_byte & 1));
-    if (aborted)
+    if (aborted) {
 	/* ??? is this right? */
-	return (aborted << 16);
+	SCint[slot] = NULL;
+	restore_flags(flags);
+	SCpnt->result = aborted << 16;
+	aborted = 0;
+	if (done)
+	    done(SCpnt);
+	return SCpnt->result;
+    }
 
     /* Store pointer in OGM address bytes */
-    outb_p(BYTE(&mscp, 0), OGM_DATA_PTR(PORT_ADDRESS + 0));
-    outb_p(BYTE(&mscp, 1), OGM_DATA_PTR(PORT_ADDRESS + 1));
-    outb_p(BYTE(&mscp, 2), OGM_DATA_PTR(PORT_ADDRESS + 2));
-    outb_p(BYTE(&mscp, 3), OGM_DATA_PTR(PORT_ADDRESS + 3));
+    outb_p(BYTE(mscp, 0), OGM_DATA_PTR(PORT_ADDRESS + 0));
+    outb_p(BYTE(mscp, 1), OGM_DATA_PTR(PORT_ADDRESS + 1));
+    outb_p(BYTE(mscp, 2), OGM_DATA_PTR(PORT_ADDRESS + 2));
+    outb_p(BYTE(mscp, 3), OGM_DATA_PTR(PORT_ADDRESS + 3));
 
     /* Issue OGM interrupt */
     outb_p(0x1, LCL_DOORBELL_INTR(PORT_ADDRESS));
 
-    ultrastor_done = done;
+    restore_flags(flags);
 
 #if (ULTRASTOR_DEBUG & UD_COMMAND)
     printk("US14F: queuecommand: returning\n");
@@ -361,13 +432,22 @@ int ultrastor_14f_queuecommand(unsigned char target, const void *cmnd,
 int ultrastor_14f_command(unsigned char target, const void *cmnd,
 			  void *buff, int bufflen)
 {
+    static Scsi_Cmnd SCtmp;
     unsigned char in_byte;
+    struct mscp *mscp;
 
 #if (ULTRASTOR_DEBUG & UD_COMMAND)
     printk("US14F: command: called\n");
 #endif
 
-    (void)ultrastor_14f_queuecommand(target, cmnd, buff, bufflen, 0);
+    SCtmp.target = target;
+    SCtmp.lun = 0;
+    memcpy(SCtmp.cmnd, cmnd, (*(unsigned char *)cmnd <= 0x1F) ? 6 : 10);
+    SCtmp.buffer = buff;
+    SCtmp.bufflen = bufflen;
+    SCtmp.use_sg = 0;
+    if (ultrastor_14f_queuecommand(&SCtmp, 0))
+	return SCtmp.result;
 
     /* Wait for ICM interrupt */
     do
@@ -377,16 +457,16 @@ int ultrastor_14f_command(unsigned char target, const void *cmnd,
 	/* ??? is this right? */
 	return (aborted << 16);
 
-    /* Clean ICM slot (set ICMINT bit to 0) */
-    outb_p(0x1, SYS_DOORBELL_INTR(PORT_ADDRESS));
+    mscp = ultrastor_icm();
+    SCint[mscp - mscps] = NULL;
 
 #if (ULTRASTOR_DEBUG & UD_COMMAND)
     printk("US14F: command: returning %08X\n",
-	   (mscp.adapter_status << 16) | mscp.target_status);
+	   (mscp->adapter_status << 16) | mscp->target_status);
 #endif
 
     /* ??? not right, but okay for now? */
-    return (mscp.adapter_status << 16) | mscp.target_status;
+    return (mscp->adapter_status << 16) | mscp->target_status;
 }
 #endif
 
@@ -423,16 +503,29 @@ int ultrastor_14f_reset(void)
 #if USE_QUEUECOMMAND
 void ultrastor_interrupt_service(void)
 {
-    if (ultrastor_done == 0) {
-	printk("US14F: unexpected ultrastor interrupt\n\r");
-	/* ??? Anything else we should do here?  Reset? */
-	return;
+    struct mscp *mscp;
+    Scsi_Cmnd *SCtmp;
+    void (*done)(Scsi_Cmnd *);
+    unsigned int slot;
+
+    /* Several commands may have completed by the time we get here */
+    while (inb_p(SYS_DOORBELL_INTR(PORT_ADDRESS)) & 1) {
+	mscp = ultrastor_icm();
+	slot = mscp - mscps;
+	if (slot >= ULTRASTOR_MAX_CMDS || !(SCtmp = SCint[slot])
+	    || !(done = ultrastor_done[slot])) {
+	    printk("US14F: unexpected ultrastor interrupt\n\r");
+	    /* ??? Anything else we should do here?  Reset? */
+	    continue;
+	}
+#if (ULTRASTOR_DEBUG & UD_COMMAND)
+	printk("US14F: got an ultrastor interrupt: %u\n\r",
+	       (mscp->adapter_status << 16) | mscp->target_status);
+#endif
+	SCint[slot] = NULL;
+	SCtmp->result = (mscp->adapter_status << 16) | mscp->target_status;
+	done(SCtmp);
     }
-    printk("US14F: got an ultrastor interrupt: %u\n\r",
-	   (mscp.adapter_status << 16) | mscp.target_status);
-    ultrastor_done(host_number,
-		   (mscp.adapter_status << 16) | mscp.target_status);
-    ultrastor_done = 0;
 }
 
 __asm__("
@@ -17,14 +17,16 @@
 # define FALSE 0
 #endif
 
-/* ??? This should go eventually, once the queueing bug is fixed */
-#define USE_QUEUECOMMAND FALSE
+#define USE_QUEUECOMMAND TRUE
+
+/* Number of mscps, the commands we can have outstanding */
+#define ULTRASTOR_MAX_CMDS 8
+/* Scatter/gather list entries per command */
+#define ULTRASTOR_MAX_SG 16
 
 int ultrastor_14f_detect(int);
 const char *ultrastor_14f_info(void);
-int ultrastor_14f_queuecommand(unsigned char target, const void *cmnd,
-			       void *buff, int bufflen,
-			       void (*done)(int, int));
+int ultrastor_14f_queuecommand(Scsi_Cmnd *SCpnt, void (*done)(Scsi_Cmnd *));
 #if !USE_QUEUECOMMAND
 int ultrastor_14f_command(unsigned char target, const void *cmnd,
 			  void *buff, int bufflen);
@@ -41,7 +43,7 @@ int ultrastor_14f_reset(void);
 #define ULTRASTOR_14F \
     { "UltraStor 14F", ultrastor_14f_detect, ultrastor_14f_info, 0, \
       ultrastor_14f_queuecommand, ultrastor_14f_abort, ultrastor_14f_reset, \
-      TRUE, 0, 0 }
+      ULTRASTOR_MAX_CMDS, 0, 0, ULTRASTOR_MAX_SG }
 #endif
 
 #define UD_DETECT 0x1
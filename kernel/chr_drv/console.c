@@ -99,15 +99,15 @@ static struct {
 	unsigned char	vc_s_color;		/* Saved foreground & background */
 	unsigned char	vc_ulcolor;		/* Colour for underline mode */
 	unsigned char	vc_halfcolor;		/* Colour for half intensity mode */
-	unsigned long	vc_origin;		/* Used for EGA/VGA fast scroll	*/
-	unsigned long	vc_scr_end;		/* Used for EGA/VGA fast scroll	*/
+	unsigned long	vc_origin;		/* Start of screen (in vc_scrbuf) */
+	unsigned long	vc_scr_end;		/* End of screen		*/
 	unsigned long	vc_pos;
 	unsigned long	vc_x,vc_y;
 	unsigned long	vc_top,vc_bottom;
 	unsigned long	vc_state;
 	unsigned long	vc_npar,vc_par[NPAR];
-	unsigned long	vc_video_mem_start;	/* Start of video RAM		*/
-	unsigned long	vc_video_mem_end;	/* End of video RAM (sort of)	*/
+	unsigned long	vc_video_mem_start;	/* Start of screen buffer	*/
+	unsigned long	vc_video_mem_end;	/* End of screen buffer		*/
 	unsigned long	vc_saved_x;
 	unsigned long	vc_saved_y;
 	/* mode flags */
@@ -215,6 +215,49 @@ static int screen_size = 0;
 
 static void sysbeep(void);
 
+/*
+ * Every console draws into its own buffer in memory, vc_scrbuf[], the
+ * foreground one included. Changed lines of the foreground console are
+ * marked in dirty_lines[], and flush_screen() copies them to the video
+ * memory, from the CONSOLE_TIMER at most once a tick. Scrolling and
+ * console switches are memory to memory copies: the slow video memory
+ * only sees the result. (ORIG_VIDEO_LINES is a byte, thus the 256.)
+ */
+static unsigned char dirty_lines[256];
+
+static void flush_screen(void)
+{
+	int currcons = fg_console;
+	unsigned int i, j;
+
+	if (console_blanked || vtmode == KD_GRAPHICS)
+		return;
+	for (i = 0 ; i < video_num_lines ; i = j+1) {
+		for (j = i ; j < video_num_lines && dirty_lines[j] ; j++)
+			dirty_lines[j] = 0;
+		if (j > i)
+			memcpy((void *) (video_mem_base + i*video_size_row),
+				(void *) (origin + i*video_size_row),
+				(j-i) * video_size_row);
+	}
+}
+
+/*
+ * Lines t up to b have changed. Only the foreground console is ever
+ * flushed, the others are copied as a whole when switched to.
+ */
+static void mark_dirty(int currcons, unsigned int t, unsigned int b)
+{
+	if (currcons != fg_console)
+		return;
+	while (t < b)
+		dirty_lines[t++] = 1;
+	if (!(timer_active & (1<<CONSOLE_TIMER))) {
+		timer_table[CONSOLE_TIMER].expires = jiffies;
+		timer_active |= 1<<CONSOLE_TIMER;
+	}
+}
+
 /*
  * this is what the terminal answers to a ESC-Z or csi0c query.
  */
@@ -291,6 +334,10 @@ static void gotoxy(int currcons, int new_x, int new_y)
 	need_wrap = 0;
 }
 
+/*
+ * As nothing scrolls in video memory any more, the display always starts
+ * at its top: this just puts it back there.
+ */
 static void set_origin(int currcons)
 {
 	if (video_type != VIDEO_TYPE_EGAC && video_type != VIDEO_TYPE_EGAM)
@@ -299,64 +346,28 @@ static void set_origin(int currcons)
 		return;
 	cli();
 	outb_p(12, video_port_reg);
-	outb_p(0xff&((origin-video_mem_base)>>9), video_port_val);
+	outb_p(0, video_port_val);
 	outb_p(13, video_port_reg);
-	outb_p(0xff&((origin-video_mem_base)>>1), video_port_val);
+	outb_p(0, video_port_val);
 	sti();
 }
 
 static void scrup(int currcons, unsigned int t, unsigned int b)
 {
-	int hardscroll = 1;
-
 	if (b > video_num_lines || t >= b)
 		return;
-	if (video_type != VIDEO_TYPE_EGAC && video_type != VIDEO_TYPE_EGAM)
-		hardscroll = 0;
-	else if (t || b != video_num_lines)
-		hardscroll = 0;
-	if (hardscroll) {
-		origin += video_size_row;
-		pos += video_size_row;
-		scr_end += video_size_row;
-		if (scr_end > video_mem_end) {
-			__asm__("cld\n\t"
-				"rep\n\t"
-				"movsl\n\t"
-				"movl _video_num_columns,%1\n\t"
-				"rep\n\t"
-				"stosw"
-				::"a" (video_erase_char),
-				"c" ((video_num_lines-1)*video_num_columns>>1),
-				"D" (video_mem_start),
-				"S" (origin)
-				:"cx","di","si");
-			scr_end -= origin-video_mem_start;
-			pos -= origin-video_mem_start;
-			origin = video_mem_start;
-		} else {
-			__asm__("cld\n\t"
-				"rep\n\t"
-				"stosw"
-				::"a" (video_erase_char),
-				"c" (video_num_columns),
-				"D" (scr_end-video_size_row)
-				:"cx","di");
-		}
-		set_origin(currcons);
-	} else {
-		__asm__("cld\n\t"
-			"rep\n\t"
-			"movsl\n\t"
-			"movl _video_num_columns,%%ecx\n\t"
-			"rep\n\t"
-			"stosw"
-			::"a" (video_erase_char),
-			"c" ((b-t-1)*video_num_columns>>1),
-			"D" (origin+video_size_row*t),
-			"S" (origin+video_size_row*(t+1))
-			:"cx","di","si");
-	}
+	__asm__("cld\n\t"
+		"rep\n\t"
+		"movsl\n\t"
+		"movl _video_num_columns,%%ecx\n\t"
+		"rep\n\t"
+		"stosw"
+		::"a" (video_erase_char),
+		"c" ((b-t-1)*video_num_columns>>1),
+		"D" (origin+video_size_row*t),
+		"S" (origin+video_size_row*(t+1))
+		:"cx","di","si");
+	mark_dirty(currcons,t,b);
 }
 
 static void scrdown(int currcons, unsigned int t, unsigned int b)
@@ -376,6 +387,7 @@ static void scrdown(int currcons, unsigned int t, unsigned int b)
 		"D" (origin+video_size_row*b-4),
 		"S" (origin+video_size_row*(b-1)-4)
 		:"ax","cx","di","si");
+	mark_dirty(currcons,t,b);
 }
 
 static void lf(int currcons)
@@ -421,6 +433,7 @@ static inline void del(int currcons)
 		pos -= 2;
 		x--;
 		*(unsigned short *)pos = video_erase_char;
+		mark_dirty(currcons,y,y+1);
 		need_wrap = 0;
 	}
 }
@@ -434,14 +447,17 @@ static void csi_J(int currcons, int vpar)
 		case 0:	/* erase from cursor to end of display */
 			count = (scr_end-pos)>>1;
 			start = pos;
+			mark_dirty(currcons,y,video_num_lines);
 			break;
 		case 1:	/* erase from start to cursor */
 			count = ((pos-origin)>>1)+1;
 			start = origin;
+			mark_dirty(currcons,0,y+1);
 			break;
 		case 2: /* erase whole display */
 			count = video_num_columns * video_num_lines;
 			start = origin;
+			mark_dirty(currcons,0,video_num_lines);
 			break;
 		default:
 			return;
@@ -482,6 +498,7 @@ static void csi_K(int currcons, int vpar)
 		::"c" (count),
 		"D" (start),"a" (video_erase_char)
 		:"cx","di");
+	mark_dirty(currcons,y,y+1);
 	need_wrap = 0;
 }
 
@@ -582,9 +599,9 @@ static void csi_m(int currcons)
 static inline void hide_cursor(int currcons)
 {
 	outb_p(14, video_port_reg);
-	outb_p(0xff&((scr_end-video_mem_base)>>9), video_port_val);
+	outb_p(0xff&((scr_end-origin)>>9), video_port_val);
 	outb_p(15, video_port_reg);
-	outb_p(0xff&((scr_end-video_mem_base)>>1), video_port_val);
+	outb_p(0xff&((scr_end-origin)>>1), video_port_val);
 }
 
 static inline void set_cursor(int currcons)
@@ -594,9 +611,9 @@ static inline void set_cursor(int currcons)
 	cli();
 	if (deccm) {
 		outb_p(14, video_port_reg);
-		outb_p(0xff&((pos-video_mem_base)>>9), video_port_val);
+		outb_p(0xff&((pos-origin)>>9), video_port_val);
 		outb_p(15, video_port_reg);
-		outb_p(0xff&((pos-video_mem_base)>>1), video_port_val);
+		outb_p(0xff&((pos-origin)>>1), video_port_val);
 	} else
 		hide_cursor(currcons);
 	sti();
@@ -656,6 +673,7 @@ static void invert_screen(int currcons) {
 	else
 		for (p = (unsigned char *)origin+1; p < (unsigned char *)scr_end; p+=2)
 			*p ^= *p & 0x07 == 1 ? 0x70 : 0x77;
+	mark_dirty(currcons,0,video_num_lines);
 }
 
 static void set_mode(int currcons, int on_off)
@@ -690,7 +708,6 @@ static void set_mode(int currcons, int on_off)
 				break;
 			case 25:		/* Cursor on/off */
 				deccm = on_off;
-				set_cursor(currcons);
 				break;
 		} else switch(par[i]) {		/* ANSI modes set/reset */
 			case 4:			/* Insert Mode on/off */
@@ -742,6 +759,7 @@ static void insert_char(int currcons)
 		old = tmp;
 		p++;
 	}
+	mark_dirty(currcons,y,y+1);
 	need_wrap = 0;
 }
 
@@ -761,6 +779,7 @@ static void delete_char(int currcons)
 		p++;
 	}
 	*p = video_erase_char;
+	mark_dirty(currcons,y,y+1);
 	need_wrap = 0;
 }
 
@@ -894,18 +913,60 @@ static void reset_terminal(int currcons, int do_clear)
 	}
 }
 
+/*
+ * Fast path for con_write(): copy a run of printable characters from the
+ * write queue straight into the current row, a word per character. The
+ * run stops before the last column, where autowrap is the slow path's
+ * business, and at anything the translation table doesn't print.
+ * Returns the number of characters done.
+ */
+static inline int con_write_run(int currcons, struct tty_queue * queue)
+{
+	unsigned short * p = (unsigned short *) pos;
+	unsigned short a = attr << 8;
+	unsigned long tail, flags;
+	int n, c, done = 0;
+
+	n = video_num_columns - 1 - x;
+	save_flags(flags);
+	cli();
+	tail = queue->tail;
+	while (done < n && tail != queue->head &&
+	       (c = (unsigned char) translate[queue->buf[tail]])) {
+		*p++ = a | c;
+		tail = (tail+1) & (TTY_BUF_SIZE-1);
+		done++;
+	}
+	queue->tail = tail;
+	restore_flags(flags);
+	if (done)
+		mark_dirty(currcons,y,y+1);
+	x += done;
+	pos += done << 1;
+	return done;
+}
+
+/*
+ * The cursor is only moved once, when the queue has been emptied.
+ */
 void con_write(struct tty_struct * tty)
 {
 	int c;
 	unsigned int currcons;
 
 	wake_up(&tty->write_q->proc_list);
+	epoll_wakeup(tty->epoll);
 	currcons = tty - tty_table;
 	if (currcons >= NR_CONSOLES) {
 		printk("con_write: illegal tty\n\r");
 		return;
 	}
-	while (!tty->stopped &&	(c = GETCH(tty->write_q)) >= 0) {
+	while (!tty->stopped) {
+		if (state == ESnormal && !decim && x < video_num_columns - 1 &&
+		    con_write_run(currcons, tty->write_q))
+			continue;
+		if ((c = GETCH(tty->write_q)) < 0)
+			break;
 		if (state == ESnormal && translate[c]) {
 			if (need_wrap) {
 				cr(currcons);
@@ -916,6 +977,7 @@ void con_write(struct tty_struct * tty)
 			c = translate[c];
 			*(char *) pos = c;
 			*(char *) (pos+1) = attr;
+			mark_dirty(currcons,y,y+1);
 			if (x == video_num_columns - 1)
 				need_wrap = decawm;
 			else {
@@ -1261,6 +1323,8 @@ long con_init(long kmem_start)
 	kmem_start += NR_CONSOLES * screen_size;
 	timer_table[BLANK_TIMER].fn = blank_screen;
 	timer_table[BLANK_TIMER].expires = 0;
+	timer_table[CONSOLE_TIMER].fn = flush_screen;
+	timer_table[CONSOLE_TIMER].expires = 0;
 	if (blankinterval) {
 		timer_table[BLANK_TIMER].expires = jiffies+blankinterval;
 		timer_active |= 1<<BLANK_TIMER;
@@ -1329,10 +1393,8 @@ long con_init(long kmem_start)
 	}
 	currcons = fg_console = 0;
 
-	video_mem_start = video_mem_base;
-	video_mem_end = video_mem_term;
-	origin = video_mem_start;
-	scr_end	= video_mem_start + video_num_lines * video_size_row;
+	/* keep what the boot left on the screen */
+	memcpy((void *) origin, (void *) video_mem_base, screen_size);
 	gotoxy(currcons,0,0);
 	save_cur(currcons);
 	gotoxy(currcons,orig_x,orig_y);
@@ -1367,29 +1429,9 @@ void kbdsave(int new_console)
 	set_leds();
 }
 
-static void get_scrmem(int currcons)
-{
-	memcpy((void *)vc_scrbuf[fg_console],(void *)origin, screen_size);
-	video_mem_start = (unsigned long)vc_scrbuf[fg_console];
-	origin 	= video_mem_start;
-	scr_end = video_mem_end = video_mem_start+screen_size;
-	pos = origin + y*video_size_row + (x<<1);
-}
-
-static void set_scrmem(int currcons)
-{
-	video_mem_start = video_mem_base;
-	video_mem_end = video_mem_term;
-	origin	= video_mem_start;
-	scr_end	= video_mem_start + screen_size;
-	pos = origin + y*video_size_row + (x<<1);
-	memcpy((void *)video_mem_base, (void *)vc_scrbuf[fg_console], screen_size);
-}
-
 void blank_screen(void)
 {
 	timer_table[BLANK_TIMER].fn = unblank_screen;
-	get_scrmem(fg_console);
 	hide_cursor(fg_console);
 	console_blanked = 1;
 	memsetw((void *)video_mem_base, 0x0020, video_mem_term-video_mem_base );
@@ -1403,8 +1445,9 @@ void unblank_screen(void)
 		timer_active |= 1<<BLANK_TIMER;
 	}
 	console_blanked = 0;
-	set_scrmem(fg_console);
 	set_origin(fg_console);
+	mark_dirty(fg_console,0,video_num_lines);
+	flush_screen();
 	set_cursor(fg_console);
 }
 
@@ -1416,10 +1459,10 @@ void update_screen(int new_console)
 		return;
 	lock = 1;
 	kbdsave(new_console);
-	get_scrmem(fg_console); 
 	fg_console = new_console;
-	set_scrmem(fg_console); 
 	set_origin(fg_console);
+	mark_dirty(fg_console,0,video_num_lines);
+	flush_screen();
 	set_cursor(new_console);
 	lock = 0;
 }
@@ -1482,6 +1525,7 @@ void console_print(const char * b)
 		}
 		*(char *) pos = c;
 		*(char *) (pos+1) = attr;
+		mark_dirty(currcons,y,y+1);
 		if (x == video_num_columns - 1) {
 			need_wrap = 1;
 			continue;
@@ -1489,5 +1533,7 @@ void console_print(const char * b)
 		x++;
 		pos+=2;
 	}
+/* don't wait for the timer: this may be the last thing we ever print */
+	flush_screen();
 	set_cursor(currcons);
 }
@@ -48,6 +48,7 @@ void pty_close(unsigned int dev, struct file * filp)
 
 	tty = tty_table + dev;
 	wake_up(&tty->read_q->proc_list);
+	epoll_wakeup(tty->link->epoll);
 	if (IS_A_PTY_MASTER(dev)) {
 		tty->link->count--;
 		if (tty->link->pgrp > 0)
@@ -55,11 +56,25 @@ void pty_close(unsigned int dev, struct file * filp)
 	}
 }
 
+/*
+ * If the other side is raw and has nothing of its own pending in read_q,
+ * there is nothing to cook: the characters go straight to its secondary
+ * queue, a chunk at a time, rather than through read_q and
+ * copy_to_cooked() one by one.
+ */
 static inline void pty_copy(struct tty_struct * from, struct tty_struct * to)
 {
-	int c;
+	int c, raw = 0;
 
 	while (!from->stopped && !EMPTY(from->write_q)) {
+		if (TTY_RAW_INPUT(to) && EMPTY(to->read_q)) {
+			if (!(c = copy_to_raw(from->write_q, to)))
+				break;
+			raw += c;
+			if (current->signal & ~current->blocked)
+				break;
+			continue;
+		}
 		if (FULL(to->read_q)) {
 			if (FULL(to->secondary))
 				break;
@@ -72,7 +87,12 @@ static inline void pty_copy(struct tty_struct * from, struct tty_struct * to)
 			break;
 	}
 	TTY_READ_FLUSH(to);
+	if (raw) {
+		wake_up(&to->secondary->proc_list);
+		epoll_wakeup(to->epoll);
+	}
 	wake_up(&from->write_q->proc_list);
+	epoll_wakeup(from->epoll);
 }
 
 /*
@@ -44,6 +44,17 @@ struct serial_struct serial_table[NR_SERIALS] = {
 };
 
 static struct serial_struct * irq_info[16] = { NULL, };
+static struct serial_icounter serial_icount[NR_SERIALS];
+
+/*
+ * The 16550A has 16-byte FIFOs. We refill the transmit FIFO completely
+ * on each empty interrupt, and have the receiver interrupt at 8 bytes
+ * (1 below 2400 bps): at 14 there is only two characters' time left to
+ * get to the FIFO before it overruns.
+ */
+#define FIFO_SIZE(info)	((info)->type == PORT_16550A ? 16 : 1)
+#define FCR_TRIGGER_1	0x00
+#define FCR_TRIGGER_8	0x80
 
 static void modem_status_intr(struct serial_struct * info)
 {
@@ -91,30 +102,67 @@ static void send_intr(struct serial_struct * info)
 	unsigned short port = info->port;
 	unsigned int timer = SER1_TIMEOUT + info->line;
 	struct tty_queue * queue = info->tty->write_q;
-	int c, i = 0;
+	unsigned char buf[16];
+	int i, nr;
 
 	timer_active &= ~(1 << timer);
-	do {
-		if ((c = GETCH(queue)) < 0)
-			return;
-		outb(c,port);
-		i++;
-	} while (info->type == PORT_16550A &&
-		  i < 14 && !EMPTY(queue));
+	if (!(nr = get_tty_queue_buf(queue, buf, FIFO_SIZE(info))))
+		return;
+	for (i = 0 ; i < nr ; i++)
+		outb(buf[i],port);
+	serial_icount[info->line].tx += nr;
 	timer_table[timer].expires = jiffies + 10;
 	timer_active |= 1 << timer;
-	if (LEFT(queue) > WAKEUP_CHARS)
+	if (LEFT(queue) > WAKEUP_CHARS) {
 		wake_up(&queue->proc_list);
+		epoll_wakeup(info->tty->epoll);
+	}
 }
 
+static inline void count_errors(struct serial_struct * info,
+	unsigned char status)
+{
+	struct serial_icounter * icount = serial_icount + info->line;
+
+	if (status & 0x02)
+		icount->overrun++;
+	if (status & 0x04)
+		icount->parity++;
+	if (status & 0x08)
+		icount->frame++;
+	if (status & 0x10)
+		icount->brk++;
+}
+
+/*
+ * Empty the receive FIFO into a local buffer and put it in the read
+ * queue in one go, rather than taking the queue a character at a time.
+ */
 static void receive_intr(struct serial_struct * info)
 {
 	unsigned short port = info->port;
 	struct tty_queue * queue = info->tty->read_q;
+	struct serial_icounter * icount = serial_icount + info->line;
+	unsigned char buf[32], status;
+	int nr = 0, put;
 
+	status = inb(port+5);
 	do {
-		PUTCH(inb(port),queue);
-	} while (inb(port+5) & 1);
+		if (status & 0x1e)
+			count_errors(info, status);
+		buf[nr++] = inb(port);
+		if (nr == sizeof(buf)) {
+			put = put_tty_queue_buf(queue, buf, nr);
+			icount->rx += put;
+			icount->buf_overrun += nr - put;
+			nr = 0;
+		}
+	} while ((status = inb(port+5)) & 1);
+	if (nr) {
+		put = put_tty_queue_buf(queue, buf, nr);
+		icount->rx += put;
+		icount->buf_overrun += nr - put;
+	}
 	timer_active |= (1<<SER1_TIMER)<<info->line;
 }
 
@@ -122,7 +170,7 @@ static void line_status_intr(struct serial_struct * info)
 {
 	unsigned char status = inb(info->port+5);
 
-/*	printk("line status: %02x\n",status); */
+	count_errors(info, status);
 }
 
 static void (*jmp_table[4])(struct serial_struct *) = {
@@ -138,6 +186,7 @@ static void check_tty(struct serial_struct * info)
 
 	if (!info || !info->tty || !info->port)
 		return;
+	serial_icount[info->line].interrupts++;
 	while (1) {
 		ident = inb(info->port+2) & 7;
 		if (ident & 1)
@@ -248,7 +297,7 @@ static void init(struct serial_struct * info)
 				break;
 			case 3:
 				info->type = PORT_16550A;
-				outb_p(0xc7, port+2);
+				outb_p(0x07 | FCR_TRIGGER_8, port+2);
 				break;
 		}
 	} else
@@ -323,6 +372,9 @@ void change_speed(unsigned int line)
 	outb_p(quot & 0xff,port);	/* LS of divisor */
 	outb_p(quot >> 8,port+1);	/* MS of divisor */
 	outb(0x03,port+3);		/* reset DLAB */
+	if (info->type == PORT_16550A)
+		outb(0x01 | (quot > 48 ? FCR_TRIGGER_1 : FCR_TRIGGER_8),
+			port+2);
 	sti();
 /* set byte size and parity */
 	quot = cflag & (CSIZE | CSTOPB);
@@ -375,6 +427,16 @@ int get_serial_info(unsigned int line, struct serial_struct * info)
 	return 0;
 }
 
+int get_serial_icount(unsigned int line, struct serial_icounter * icount)
+{
+	if (line >= NR_SERIALS)
+		return -ENODEV;
+	if (!icount)
+		return -EFAULT;
+	memcpy_tofs(icount,serial_icount+line,sizeof(*icount));
+	return 0;
+}
+
 int set_serial_info(unsigned int line, struct serial_struct * info)
 {
 	struct serial_struct tmp;
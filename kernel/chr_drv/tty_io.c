@@ -21,6 +21,7 @@
 #include <linux/sched.h>
 #include <linux/tty.h>
 #include <linux/ctype.h>
+#include <linux/string.h>
 #include <asm/io.h>
 #include <asm/segment.h>
 #include <asm/system.h>
@@ -32,6 +33,12 @@
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
 
+/*
+ * Bounce buffer size for the bulk paths below. The raw input path can
+ * run from an interrupt, so keep it small.
+ */
+#define TTY_CHUNK 128
+
 #define QUEUES	(3*(NR_CONSOLES+NR_SERIALS+2*NR_PTYS))
 static struct tty_queue * tty_queues;
 struct tty_struct tty_table[256];
@@ -65,13 +72,14 @@ void put_tty_queue(char c, struct tty_queue * queue)
 	int head;
 	unsigned long flags;
 
-	__asm__ __volatile__("pushfl ; popl %0 ; cli":"=r" (flags));
+	save_flags(flags);
+	cli();
 	head = (queue->head + 1) & (TTY_BUF_SIZE-1);
 	if (head != queue->tail) {
 		queue->buf[queue->head] = c;
 		queue->head = head;
 	}
-	__asm__ __volatile__("pushl %0 ; popfl"::"r" (flags));
+	restore_flags(flags);
 }
 
 int get_tty_queue(struct tty_queue * queue)
@@ -79,43 +87,119 @@ int get_tty_queue(struct tty_queue * queue)
 	int result = -1;
 	unsigned long flags;
 
-	__asm__ __volatile__("pushfl ; popl %0 ; cli":"=r" (flags));
+	save_flags(flags);
+	cli();
 	if (queue->tail != queue->head) {
 		result = 0xff & queue->buf[queue->tail];
 		queue->tail = (queue->tail + 1) & (TTY_BUF_SIZE-1);
 	}
-	__asm__ __volatile__("pushl %0 ; popfl"::"r" (flags));
+	restore_flags(flags);
 	return result;
 }
 
+/*
+ * The bulk versions move up to nr characters in one go, with interrupts
+ * off only once. They return the number actually moved, which is less
+ * than nr if the queue fills up (or runs dry).
+ */
+int put_tty_queue_buf(struct tty_queue * queue, const unsigned char * buf, int nr)
+{
+	int head, chars, done = 0;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (nr > LEFT(queue))
+		nr = LEFT(queue);
+	head = queue->head;
+	while (nr > 0) {
+		chars = TTY_BUF_SIZE - head;
+		if (chars > nr)
+			chars = nr;
+		memcpy(queue->buf + head, buf, chars);
+		head = (head + chars) & (TTY_BUF_SIZE-1);
+		buf += chars;
+		done += chars;
+		nr -= chars;
+	}
+	queue->head = head;
+	restore_flags(flags);
+	return done;
+}
+
+int get_tty_queue_buf(struct tty_queue * queue, unsigned char * buf, int nr)
+{
+	int tail, chars, done = 0;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (nr > CHARS(queue))
+		nr = CHARS(queue);
+	tail = queue->tail;
+	while (nr > 0) {
+		chars = TTY_BUF_SIZE - tail;
+		if (chars > nr)
+			chars = nr;
+		memcpy(buf, queue->buf + tail, chars);
+		tail = (tail + chars) & (TTY_BUF_SIZE-1);
+		buf += chars;
+		done += chars;
+		nr -= chars;
+	}
+	queue->tail = tail;
+	restore_flags(flags);
+	return done;
+}
+
+/*
+ * Newlines and EOFs in a run of characters: the line count in
+ * secondary->data has to be kept up even when nothing is cooked, as
+ * the tty may be switched back to canonical mode.
+ */
+static int count_lines(struct tty_struct * tty, const unsigned char * buf, int nr)
+{
+	int lines = 0;
+	unsigned char eof = EOF_CHAR(tty);
+
+	while (nr-- > 0) {
+		if (*buf == 10 || (eof != __DISABLED_CHAR && *buf == eof))
+			lines++;
+		buf++;
+	}
+	return lines;
+}
+
 void tty_write_flush(struct tty_struct * tty)
 {
 	unsigned long flags;
 
-	__asm__ __volatile__("pushfl ; popl %0 ; cli":"=r" (flags));
+	save_flags(flags);
+	cli();
 	if (!EMPTY(tty->write_q) && !(TTY_WRITE_BUSY & tty->flags)) {
 		tty->flags |= TTY_WRITE_BUSY;
-		__asm__ __volatile__("pushl %0 ; popfl"::"r" (flags));
+		restore_flags(flags);
 		tty->write(tty);
 		cli();
 		tty->flags &= ~TTY_WRITE_BUSY;
 	}
-	__asm__ __volatile__("pushl %0 ; popfl"::"r" (flags));
+	restore_flags(flags);
 }
 
 void tty_read_flush(struct tty_struct * tty)
 {
 	unsigned long flags;
 
-	__asm__ __volatile__("pushfl ; popl %0 ; cli":"=r" (flags));
+	save_flags(flags);
+	cli();
 	if (!EMPTY(tty->read_q) && !(TTY_READ_BUSY & tty->flags)) {
 		tty->flags |= TTY_READ_BUSY;
-		__asm__ __volatile__("pushl %0 ; popfl"::"r" (flags));
+		restore_flags(flags);
 		copy_to_cooked(tty);
 		cli();
 		tty->flags &= ~TTY_READ_BUSY;
 	}
-	__asm__ __volatile__("pushl %0 ; popfl"::"r" (flags));
+	restore_flags(flags);
 }
 
 void change_console(unsigned int new_console)
@@ -142,6 +226,25 @@ void wait_for_keypress(void)
 	sleep_if_empty(tty_table[fg_console].secondary);
 }
 
+/*
+ * Raw input goes straight from a queue to secondary, a chunk at a time.
+ * Besides read_q, the ptys use this to hand the other side's write_q
+ * over directly. Returns the number of characters moved.
+ */
+int copy_to_raw(struct tty_queue * from, struct tty_struct * tty)
+{
+	unsigned char buf[TTY_CHUNK];
+	int nr, done = 0;
+
+	while ((nr = MIN(LEFT(tty->secondary), TTY_CHUNK)) &&
+	       (nr = get_tty_queue_buf(from, buf, nr))) {
+		tty->secondary->data += count_lines(tty, buf, nr);
+		put_tty_queue_buf(tty->secondary, buf, nr);
+		done += nr;
+	}
+	return done;
+}
+
 void copy_to_cooked(struct tty_struct * tty)
 {
 	int c;
@@ -151,7 +254,9 @@ void copy_to_cooked(struct tty_struct * tty)
 		printk("copy_to_cooked: missing queues\n\r");
 		return;
 	}
-	while (1) {
+	if (TTY_RAW_INPUT(tty))
+		copy_to_raw(tty->read_q, tty);
+	else while (1) {
 		if (FULL(tty->secondary))
 			break;
 		c = GETCH(tty->read_q);
@@ -267,6 +372,7 @@ void copy_to_cooked(struct tty_struct * tty)
 		wake_up(&tty->secondary->proc_list);
 	if (LEFT(tty->write_q) > TTY_BUF_SIZE/2)
 		wake_up(&tty->write_q->proc_list);
+	epoll_wakeup(tty->epoll);
 }
 
 int is_ignored(int sig)
@@ -296,12 +402,20 @@ int tty_signal(int sig, struct tty_struct *tty)
 	return -ERESTARTSYS;
 }
 
-static int read_chan(unsigned int channel, struct file * file, char * buf, int nr)
+/*
+ * read_chan() and write_chan() work on an iovec, so that readv/writev
+ * move all the segments while the tty is at hand. The iovec is consumed
+ * a byte at a time as characters are cooked, or a chunk at a time when
+ * nothing needs cooking (non-canonical input, no output processing).
+ */
+static int read_chan(unsigned int channel, struct file * file,
+	struct iovec * iov, int nr_segs)
 {
 	struct tty_struct * tty;
 	struct tty_struct * other_tty = NULL;
+	unsigned char buf[TTY_CHUNK];
 	int c;
-	char * b=buf;
+	int nr = iov_length(iov,nr_segs), done = 0;
 	int minimum,time;
 
 	if (channel > 255)
@@ -311,11 +425,12 @@ static int read_chan(unsigned int channel, struct file * file, char * buf, int n
 		return -EIO;
 	if ((tty->pgrp > 0) &&
 	    (current->tty == channel) &&
-	    (tty->pgrp != current->pgrp))
+	    (tty->pgrp != current->pgrp)) {
 		if (is_ignored(SIGTTIN) || is_orphaned_pgrp(current->pgrp))
 			return -EIO;
 		else
 			return(tty_signal(SIGTTIN, tty));
+	}
 	if (channel & 0x80)
 		other_tty = tty_table + (channel ^ 0x40);
 	time = 10L*tty->termios.c_cc[VTIME];
@@ -357,7 +472,15 @@ static int read_chan(unsigned int channel, struct file * file, char * buf, int n
 			continue;
 		}
 		sti();
-		do {
+		if (!L_CANON(tty)) do {
+			c = get_tty_queue_buf(tty->secondary, buf,
+				MIN(nr, TTY_CHUNK));
+			tty->secondary->data -= count_lines(tty, buf, c);
+			memcpy_toiovec(iov, (char *) buf, c);
+			done += c;
+			nr -= c;
+		} while (nr>0 && !EMPTY(tty->secondary));
+		else do {
 			c = GETCH(tty->secondary);
 			if ((EOF_CHAR(tty) != __DISABLED_CHAR &&
 			     c==EOF_CHAR(tty)) || c==10)
@@ -366,7 +489,11 @@ static int read_chan(unsigned int channel, struct file * file, char * buf, int n
 			     c==EOF_CHAR(tty)) && L_CANON(tty))
 				break;
 			else {
-				put_fs_byte(c,b++);
+				while (!iov->iov_len)
+					iov++;
+				put_fs_byte(c,iov->iov_base++);
+				iov->iov_len--;
+				done++;
 				if (!--nr)
 					break;
 			}
@@ -374,7 +501,7 @@ static int read_chan(unsigned int channel, struct file * file, char * buf, int n
 				break;
 		} while (nr>0 && !EMPTY(tty->secondary));
 		wake_up(&tty->read_q->proc_list);
-		if (L_CANON(tty) || b-buf >= minimum)
+		if (L_CANON(tty) || done >= minimum)
 			break;
 		if (time)
 			current->timeout = time+jiffies;
@@ -384,8 +511,8 @@ static int read_chan(unsigned int channel, struct file * file, char * buf, int n
 	if (other_tty && other_tty->write)
 		TTY_WRITE_FLUSH(other_tty);
 	current->timeout = 0;
-	if (b-buf)
-		return b-buf;
+	if (done)
+		return done;
 	if (current->signal & ~current->blocked)
 		return -ERESTARTSYS;
 	if (file->f_flags & O_NONBLOCK)
@@ -393,10 +520,13 @@ static int read_chan(unsigned int channel, struct file * file, char * buf, int n
 	return 0;
 }
 
-static int write_chan(unsigned int channel, struct file * file, char * buf, int nr)
+static int write_chan(unsigned int channel, struct file * file,
+	struct iovec * iov, int nr_segs)
 {
 	struct tty_struct * tty;
-	char c, *b=buf;
+	unsigned char buf[TTY_CHUNK];
+	char c;
+	int n, nr = iov_length(iov,nr_segs), done = 0;
 
 	if (channel > 255)
 		return -EIO;
@@ -427,8 +557,20 @@ static int write_chan(unsigned int channel, struct file * file, char * buf, int
 			sti();
 			continue;
 		}
-		while (nr>0 && !FULL(tty->write_q)) {
-			c=get_fs_byte(b);
+		if (!O_POST(tty)) while (nr>0 && !FULL(tty->write_q)) {
+			while (!iov->iov_len)
+				iov++;
+			n = MIN(iov->iov_len, TTY_CHUNK);
+			memcpy_fromfs(buf, iov->iov_base, n);
+			n = put_tty_queue_buf(tty->write_q, buf, n);
+			iov->iov_base += n; iov->iov_len -= n;
+			done += n; nr -= n;
+			tty->flags &= ~TTY_CR_PENDING;
+		}
+		else while (nr>0 && !FULL(tty->write_q)) {
+			while (!iov->iov_len)
+				iov++;
+			c=get_fs_byte(iov->iov_base);
 			if (O_POST(tty)) {
 				if (c=='\r' && O_CRNL(tty))
 					c='\n';
@@ -442,7 +584,8 @@ static int write_chan(unsigned int channel, struct file * file, char * buf, int
 				if (O_LCUC(tty))
 					c=toupper(c);
 			}
-			b++; nr--;
+			iov->iov_base++; iov->iov_len--;
+			done++; nr--;
 			tty->flags &= ~TTY_CR_PENDING;
 			PUTCH(c,tty->write_q);
 		}
@@ -450,53 +593,89 @@ static int write_chan(unsigned int channel, struct file * file, char * buf, int
 			schedule();
 	}
 	TTY_WRITE_FLUSH(tty);
-	if (b-buf)
-		return b-buf;
+	if (done)
+		return done;
 	if (current->signal & ~current->blocked)
 		return -ERESTARTSYS;
 	return 0;
 }
 
-static int tty_read(struct inode * inode, struct file * file, char * buf, int count)
+static int tty_readv(struct inode * inode, struct file * file, struct iovec * iov, int nr, off_t * ppos)
 {
 	int i;
 	
-	i = read_chan(current->tty,file,buf,count);
+	i = read_chan(current->tty,file,iov,nr);
 	if (i > 0)
 		inode->i_atime = CURRENT_TIME;
 	return i;
 }
 
-static int ttyx_read(struct inode * inode, struct file * file, char * buf, int count)
+static int ttyx_readv(struct inode * inode, struct file * file, struct iovec * iov, int nr, off_t * ppos)
 {
 	int i;
 	
-	i = read_chan(MINOR(inode->i_rdev),file,buf,count);
+	i = read_chan(MINOR(inode->i_rdev),file,iov,nr);
 	if (i > 0)
 		inode->i_atime = CURRENT_TIME;
 	return i;
 }
 
-static int tty_write(struct inode * inode, struct file * file, char * buf, int count)
+static int tty_writev(struct inode * inode, struct file * file, struct iovec * iov, int nr, off_t * ppos)
 {
 	int i;
 	
-	i = write_chan(current->tty,file,buf,count);
+	i = write_chan(current->tty,file,iov,nr);
 	if (i > 0)
 		inode->i_mtime = CURRENT_TIME;
 	return i;
 }
 
-static int ttyx_write(struct inode * inode, struct file * file, char * buf, int count)
+static int ttyx_writev(struct inode * inode, struct file * file, struct iovec * iov, int nr, off_t * ppos)
 {
 	int i;
 	
-	i = write_chan(MINOR(inode->i_rdev),file,buf,count);
+	i = write_chan(MINOR(inode->i_rdev),file,iov,nr);
 	if (i > 0)
 		inode->i_mtime = CURRENT_TIME;
 	return i;
 }
 
+static int tty_read(struct inode * inode, struct file * file, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return tty_readv(inode,file,&iov,1,&file->f_pos);
+}
+
+static int ttyx_read(struct inode * inode, struct file * file, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return ttyx_readv(inode,file,&iov,1,&file->f_pos);
+}
+
+static int tty_write(struct inode * inode, struct file * file, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return tty_writev(inode,file,&iov,1,&file->f_pos);
+}
+
+static int ttyx_write(struct inode * inode, struct file * file, char * buf, int count)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	return ttyx_writev(inode,file,&iov,1,&file->f_pos);
+}
+
 static int tty_lseek(struct inode * inode, struct file * file, off_t offset, int orig)
 {
 	return -EBADF;
@@ -581,7 +760,9 @@ static struct file_operations tty_fops = {
 	NULL,		/* tty_select */
 	tty_ioctl,
 	tty_open,
-	tty_release
+	tty_release,
+	tty_readv,
+	tty_writev
 };
 
 static struct file_operations ttyx_fops = {
@@ -592,7 +773,9 @@ static struct file_operations ttyx_fops = {
 	NULL,		/* ttyx_select */
 	tty_ioctl,	/* ttyx_ioctl */
 	tty_open,
-	tty_release
+	tty_release,
+	ttyx_readv,
+	ttyx_writev
 };
 
 long tty_init(long kmem_start)
@@ -390,6 +390,11 @@ int tty_ioctl(struct inode * inode, struct file * file,
 			if (!IS_A_SERIAL(dev))
 				return -EINVAL;
 			return set_serial_info(dev-64,(struct serial_struct *) arg);
+		case TIOCGICOUNT:
+			if (!IS_A_SERIAL(dev))
+				return -EINVAL;
+			verify_area((void *) arg,sizeof(struct serial_icounter));
+			return get_serial_icount(dev-64,(struct serial_icounter *) arg);
 		default:
 			return vt_ioctl(tty, dev, cmd, arg);
 	}
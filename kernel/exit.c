@@ -299,9 +299,15 @@ volatile void do_exit(long code)
 fake_volatile:
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
-	for (i=0 ; i<NR_OPEN ; i++)
+	for (i=0 ; i<current->max_fds ; i++)
 		if (current->filp[i])
 			sys_close(i);
+	if (current->filp != current->fd_array) {
+		free_page((unsigned long) current->filp);
+		current->filp = current->fd_array;
+		current->close_on_exec = current->fd_cloexec;
+		current->max_fds = NR_OPEN;
+	}
 	forget_original_parent(current);
 	iput(current->pwd);
 	current->pwd = NULL;
@@ -16,6 +16,7 @@
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/string.h>
 #include <asm/segment.h>
 #include <asm/system.h>
 
@@ -94,17 +95,32 @@ int sys_fork(long ebx,long ecx,long edx,
 	struct task_struct *p;
 	int i,nr;
 	struct file *f;
+	unsigned long fd_page = 0;
 
 	p = (struct task_struct *) get_free_page();
 	if (!p)
 		return -EAGAIN;
+	if (current->filp != current->fd_array &&
+	    !(fd_page = get_free_page())) {
+		free_page((unsigned long) p);
+		return -EAGAIN;
+	}
 	nr = find_empty_process();
 	if (nr < 0) {
+		free_page(fd_page);
 		free_page((unsigned long) p);
 		return nr;
 	}
 	task[nr] = p;
 	*p = *current;	/* NOTE! this doesn't copy the supervisor stack */
+	if (p->filp == current->fd_array) {
+		p->filp = p->fd_array;
+		p->close_on_exec = p->fd_cloexec;
+	} else {
+		p->filp = (struct file **) fd_page;
+		memcpy(p->filp, current->filp, PAGE_SIZE);
+		p->close_on_exec = (unsigned long *) (p->filp + NR_OPEN_MAX);
+	}
 	p->state = TASK_UNINTERRUPTIBLE;
 	p->flags &= ~PF_PTRACED;
 	p->pid = last_pid;
@@ -149,10 +165,11 @@ int sys_fork(long ebx,long ecx,long edx,
 	if (copy_mem(nr,p)) {
 		task[nr] = NULL;
 		REMOVE_LINKS(p);
+		free_page(fd_page);
 		free_page((long) p);
 		return -EAGAIN;
 	}
-	for (i=0; i<NR_OPEN;i++)
+	for (i=0; i<p->max_fds;i++)
 		if (f=p->filp[i])
 			f->f_count++;
 	if (current->pwd)
@@ -212,7 +212,7 @@ static inline void __sleep_on(struct task_struct **p, int state)
 		return;
 	if (current == task[0])
 		panic("task[0] trying to sleep");
-	__asm__("pushfl ; popl %0":"=r" (flags));
+	save_flags(flags);
 	current->next_wait = *p;
 	task[0]->next_wait = NULL;
 	*p = current;
@@ -222,7 +222,7 @@ static inline void __sleep_on(struct task_struct **p, int state)
 	if (current->next_wait != task[0])
 		wake_up(p);
 	current->next_wait = NULL;
-	__asm__("pushl %0 ; popfl"::"r" (flags));
+	restore_flags(flags);
 }
 
 void interruptible_sleep_on(struct task_struct **p)
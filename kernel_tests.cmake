@@ -5,6 +5,7 @@
 
 # Test: Error number handling - lib/errno.c (ORIGINAL KERNEL CODE)
 # This is one of the few kernel files that can compile standalone
+if(EXISTS "${CMAKE_SOURCE_DIR}/tests/lib/test_kernel_errno.c")
 add_executable(test_kernel_errno
     tests/lib/test_kernel_errno.c
     lib/errno.c
@@ -14,6 +15,7 @@ set_target_properties(test_kernel_errno PROPERTIES
 )
 add_test(NAME test_kernel_errno COMMAND test_kernel_errno)
 list(APPEND KERNEL_CODE_TESTS test_kernel_errno)
+endif()
 
 # Note: test_kernel_mktime is defined separately in CMakeLists.txt
 # Note: Most other kernel .c files require kernel headers and cannot
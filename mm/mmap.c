@@ -96,7 +96,7 @@ sys_mmap(unsigned long *buffer)
 	fd = (int) 		get_fs_long(buffer+4);	/* object to map */
 	off = (unsigned long)	get_fs_long(buffer+5);	/* offset in object */
 
-	if (fd >= NR_OPEN || fd < 0 || !(file = current->filp[fd]))
+	if (fd >= current->max_fds || fd < 0 || !(file = current->filp[fd]))
 		return (caddr_t) -EBADF;
 	if (addr > TASK_SIZE || (addr+(unsigned long) len) > TASK_SIZE)
 		return (caddr_t) -EINVAL;
@@ -0,0 +1,557 @@
+/*
+ * loopback internet domain sockets.
+ *
+ * there is no network here: AF_INET stream sockets can only talk to
+ * each other on 127.0.0.1 (or any 127.x.x.x). that's still enough for
+ * programs that use tcp to talk to a local server. data never goes
+ * through packets or checksums, it is copied straight into the
+ * receiver's buffer, just like unix stream sockets.
+ */
+
+#include <signal.h>
+#include <errno.h>
+#include <linux/string.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/fcntl.h>
+#include <termios.h>
+#include "kern_sock.h"
+
+struct inet_proto_data {
+	int refcnt;			/* cnt of reference 0=free */
+	struct socket *socket;		/* socket we're bound to */
+	int protocol;
+	unsigned long addr;		/* bound address, network order */
+	unsigned short port;		/* bound port, network order, or 0 */
+	short hashed;			/* port is ours, in inet_hash */
+	struct sock_ring ring;		/* receive ring, and buffer sizes */
+	struct inet_proto_data *peerupd;
+	struct inet_proto_data *hnext;	/* port hash chain */
+};
+
+/*
+ * bound ports are hashed. ports given out to sockets that connect or
+ * bind to port 0 come from the range below.
+ */
+#define INET_HASH_SIZE 64
+static struct inet_proto_data *inet_hash[INET_HASH_SIZE];
+
+#define IN_PORT_FIRST 32768
+#define IN_PORT_LAST 60999
+static int inet_next_port = IN_PORT_FIRST;
+
+#define IN_DATA(SOCK) ((struct inet_proto_data *)(SOCK)->data)
+#define IN_LOOPBACK(A) ((ntohl(A) >> 24) == IN_LOOPBACKNET)
+
+/*
+ * the receive ring is the one unix stream sockets use (sock_ring.c).
+ * the default is a few pages, as there's nothing but memory in the way.
+ */
+#define IN_BUF_DEFAULT (4*PAGE_SIZE)
+
+static int inet_proto_init(void);
+static int inet_proto_create(struct socket *sock, int protocol);
+static int inet_proto_dup(struct socket *newsock, struct socket *oldsock);
+static int inet_proto_release(struct socket *sock, struct socket *peer);
+static int inet_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
+			   int sockaddr_len);
+static int inet_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
+			      int sockaddr_len, int flags);
+static int inet_proto_socketpair(struct socket *sock1, struct socket *sock2);
+static int inet_proto_accept(struct socket *sock, struct socket *newsock);
+static int inet_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
+			      int *usockaddr_len, int peer);
+static int inet_proto_read(struct socket *sock, char *ubuf, int size,
+			   int nonblock);
+static int inet_proto_write(struct socket *sock, char *ubuf, int size,
+			    int nonblock);
+static int inet_proto_select(struct socket *sock, int which);
+static int inet_proto_ioctl(struct socket *sock, unsigned int cmd,
+			    unsigned long arg);
+static int inet_proto_readv(struct socket *sock, struct iovec *iov, int nr,
+			    int nonblock);
+static int inet_proto_writev(struct socket *sock, struct iovec *iov, int nr,
+			     int nonblock);
+static int inet_proto_sendmsg(struct socket *sock, struct msghdr *msg,
+			      int nonblock);
+static int inet_proto_recvmsg(struct socket *sock, struct msghdr *msg,
+			      int nonblock);
+static int inet_proto_setsockopt(struct socket *sock, int level, int optname,
+				 char *optval, int optlen);
+static int inet_proto_getsockopt(struct socket *sock, int level, int optname,
+				 char *optval, int *optlen);
+
+struct proto_ops inet_proto_ops = {
+	inet_proto_init,
+	inet_proto_create,
+	inet_proto_dup,
+	inet_proto_release,
+	inet_proto_bind,
+	inet_proto_connect,
+	inet_proto_socketpair,
+	inet_proto_accept,
+	inet_proto_getname,
+	inet_proto_read,
+	inet_proto_write,
+	inet_proto_select,
+	inet_proto_ioctl,
+	inet_proto_readv,
+	inet_proto_writev,
+	inet_proto_sendmsg,
+	inet_proto_recvmsg,
+	inet_proto_setsockopt,
+	inet_proto_getsockopt
+};
+
+static inline int
+inet_hashfn(unsigned short port)
+{
+	return ntohs(port) % INET_HASH_SIZE;
+}
+
+static struct inet_proto_data *
+inet_port_lookup(unsigned short port)
+{
+	struct inet_proto_data *upd;
+
+	for (upd = inet_hash[inet_hashfn(port)]; upd; upd = upd->hnext)
+		if (upd->port == port)
+			return upd;
+	return NULL;
+}
+
+static void
+inet_hash_insert(struct inet_proto_data *upd)
+{
+	struct inet_proto_data **p;
+
+	p = inet_hash + inet_hashfn(upd->port);
+	upd->hnext = *p;
+	*p = upd;
+	upd->hashed = 1;
+}
+
+static void
+inet_hash_remove(struct inet_proto_data *upd)
+{
+	struct inet_proto_data **p;
+
+	p = inet_hash + inet_hashfn(upd->port);
+	for ( ; *p; p = &(*p)->hnext)
+		if (*p == upd) {
+			*p = upd->hnext;
+			break;
+		}
+	upd->hnext = NULL;
+	upd->hashed = 0;
+}
+
+/*
+ * give the socket a free port from the anonymous range.
+ */
+static int
+inet_autobind(struct inet_proto_data *upd)
+{
+	unsigned short port;
+	int i;
+
+	for (i = IN_PORT_FIRST; i <= IN_PORT_LAST; ++i) {
+		port = htons(inet_next_port);
+		if (++inet_next_port > IN_PORT_LAST)
+			inet_next_port = IN_PORT_FIRST;
+		if (!inet_port_lookup(port)) {
+			upd->port = port;
+			inet_hash_insert(upd);
+			return 0;
+		}
+	}
+	return -EADDRINUSE;
+}
+
+static struct inet_proto_data *
+inet_data_alloc(void)
+{
+	struct inet_proto_data *upd;
+
+	upd = (struct inet_proto_data *) malloc(sizeof(*upd));
+	if (!upd)
+		return NULL;
+	upd->refcnt = 1;
+	upd->socket = NULL;
+	upd->addr = INADDR_ANY;
+	upd->port = 0;
+	upd->hashed = 0;
+	ring_init(&upd->ring, IN_BUF_DEFAULT);
+	upd->peerupd = NULL;
+	upd->hnext = NULL;
+	return upd;
+}
+
+static inline void
+inet_data_ref(struct inet_proto_data *upd)
+{
+	++upd->refcnt;
+}
+
+static void
+inet_data_deref(struct inet_proto_data *upd)
+{
+	if (upd->refcnt == 1) {
+		PRINTK("inet_data_deref: releasing data 0x%x\n", upd);
+		ring_free(&upd->ring);
+		free_s(upd, sizeof(*upd));
+		return;
+	}
+	--upd->refcnt;
+}
+
+/*
+ * only stream sockets: there's no udp.
+ */
+static int
+inet_proto_create(struct socket *sock, int protocol)
+{
+	struct inet_proto_data *upd;
+
+	PRINTK("inet_proto_create: socket 0x%x, proto %d\n", sock, protocol);
+	if (sock->type != SOCK_STREAM) {
+		PRINTK("inet_proto_create: only stream sockets\n");
+		return -ESOCKTNOSUPPORT;
+	}
+	if (protocol != 0 && protocol != IPPROTO_TCP) {
+		PRINTK("inet_proto_create: only tcp is supported\n");
+		return -EPROTONOSUPPORT;
+	}
+	if (!(upd = inet_data_alloc()))
+		return -ENOMEM;
+	if (!(upd->ring.buf[0] = (char *)get_free_page())) {
+		inet_data_deref(upd);
+		return -ENOMEM;
+	}
+	upd->protocol = protocol;
+	upd->socket = sock;
+	sock->data = (char *) upd;
+	return 0;
+}
+
+static int
+inet_proto_dup(struct socket *newsock, struct socket *oldsock)
+{
+	struct inet_proto_data *upd = IN_DATA(oldsock), *newupd;
+	int i;
+
+	if ((i = inet_proto_create(newsock, upd->protocol)) < 0)
+		return i;
+	newupd = IN_DATA(newsock);
+	newupd->ring.sndbuf = upd->ring.sndbuf;
+	newupd->ring.rcvbuf = upd->ring.rcvbuf;
+	newupd->ring.rcvlowat = newupd->ring.rd_want = upd->ring.rcvlowat;
+	return 0;
+}
+
+static int
+inet_proto_release(struct socket *sock, struct socket *peer)
+{
+	struct inet_proto_data *upd = IN_DATA(sock);
+
+	PRINTK("inet_proto_release: socket 0x%x, inet_data 0x%x\n",
+	       sock, upd);
+	if (!upd)
+		return 0;
+	if (upd->hashed)
+		inet_hash_remove(upd);
+	sock->data = NULL;
+	upd->socket = NULL;
+	if (upd->peerupd)
+		inet_data_deref(upd->peerupd);
+	inet_data_deref(upd);
+	return 0;
+}
+
+/*
+ * copy in a sockaddr_in and check that it is one of ours.
+ */
+static int
+inet_get_addr(struct sockaddr_in *sin, struct sockaddr *uaddr,
+	      int sockaddr_len)
+{
+	if (sockaddr_len < sizeof(struct sockaddr_in))
+		return -EINVAL;
+	verify_area(uaddr, sizeof(struct sockaddr_in));
+	memcpy_fromfs(sin, uaddr, sizeof(struct sockaddr_in));
+	if (sin->sin_family != AF_INET)
+		return -EAFNOSUPPORT;
+	return 0;
+}
+
+static int
+inet_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
+		int sockaddr_len)
+{
+	struct inet_proto_data *upd = IN_DATA(sock);
+	struct sockaddr_in sin;
+	int i;
+
+	if ((i = inet_get_addr(&sin, umyaddr, sockaddr_len)) < 0)
+		return i;
+	if (upd->port)
+		return -EINVAL;
+	if (sin.sin_addr.s_addr != INADDR_ANY &&
+	    !IN_LOOPBACK(sin.sin_addr.s_addr))
+		return -EADDRNOTAVAIL;
+	upd->addr = sin.sin_addr.s_addr;
+	if (!sin.sin_port)
+		return inet_autobind(upd);
+	if (ntohs(sin.sin_port) < IPPORT_RESERVED && !suser())
+		return -EACCES;
+	if (inet_port_lookup(sin.sin_port))
+		return -EADDRINUSE;
+	upd->port = sin.sin_port;
+	inet_hash_insert(upd);
+	PRINTK("inet_proto_bind: bound to port %d\n", ntohs(upd->port));
+	return 0;
+}
+
+/*
+ * find the socket listening on the port, and queue up on it like a unix
+ * socket would. an unbound socket gets a port first, so the server can
+ * tell who called.
+ */
+static int
+inet_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
+		   int sockaddr_len, int flags)
+{
+	struct inet_proto_data *upd = IN_DATA(sock), *serv_upd;
+	struct sockaddr_in sin;
+	int i;
+
+	if ((i = inet_get_addr(&sin, uservaddr, sockaddr_len)) < 0)
+		return i;
+	if (sin.sin_addr.s_addr != INADDR_ANY &&
+	    !IN_LOOPBACK(sin.sin_addr.s_addr))
+		return -ENETUNREACH;
+	if (!(serv_upd = inet_port_lookup(sin.sin_port)) ||
+	    !serv_upd->socket ||
+	    !(serv_upd->socket->flags & SO_ACCEPTCON) ||
+	    (serv_upd->addr != INADDR_ANY &&
+	     serv_upd->addr != sin.sin_addr.s_addr &&
+	     sin.sin_addr.s_addr != INADDR_ANY)) {
+		PRINTK("inet_proto_connect: nobody on port %d\n",
+		       ntohs(sin.sin_port));
+		return -ECONNREFUSED;
+	}
+	if (!upd->port && (i = inet_autobind(upd)) < 0)
+		return i;
+	if ((i = sock_awaitconn(sock, serv_upd->socket, flags)) < 0) {
+		PRINTK("inet_proto_connect: can't await connection\n");
+		return i;
+	}
+	inet_data_ref(IN_DATA(sock->conn));
+	upd->peerupd = IN_DATA(sock->conn);
+	return 0;
+}
+
+static int
+inet_proto_socketpair(struct socket *sock1, struct socket *sock2)
+{
+	return -EOPNOTSUPP;
+}
+
+/*
+ * the new socket has the listener's address, and refs the client's data
+ * for safe writes.
+ */
+static int
+inet_proto_accept(struct socket *sock, struct socket *newsock)
+{
+	struct inet_proto_data *newupd = IN_DATA(newsock);
+
+	newupd->addr = IN_DATA(sock)->addr;
+	newupd->port = IN_DATA(sock)->port;
+	inet_data_ref(IN_DATA(newsock->conn));
+	newupd->peerupd = IN_DATA(newsock->conn);
+	return 0;
+}
+
+static int
+inet_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
+		   int *usockaddr_len, int peer)
+{
+	struct inet_proto_data *upd = IN_DATA(sock);
+	struct sockaddr_in sin;
+	int len;
+
+	if (peer) {
+		if (sock->state != SS_CONNECTED || !upd->peerupd)
+			return -ENOTCONN;
+		upd = upd->peerupd;
+	}
+	verify_area(usockaddr_len, sizeof(*usockaddr_len));
+	if ((len = get_fs_long((unsigned long *)usockaddr_len)) <= 0)
+		return -EINVAL;
+	if (len > sizeof(sin))
+		len = sizeof(sin);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = upd->port;
+	sin.sin_addr.s_addr = upd->addr;
+	if (sin.sin_addr.s_addr == INADDR_ANY && sock->state == SS_CONNECTED)
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	verify_area(usockaddr, len);
+	memcpy_tofs(usockaddr, &sin, len);
+	put_fs_long(len, (unsigned long *)usockaddr_len);
+	return 0;
+}
+
+static int
+inet_proto_readv(struct socket *sock, struct iovec *iov, int nr, int nonblock)
+{
+	struct inet_proto_data *upd = IN_DATA(sock);
+	int size, avail;
+
+	if ((size = iov_length(iov, nr)) <= 0)
+		return 0;
+	if ((avail = ring_recv_wait(sock, &upd->ring, size, nonblock)) <= 0)
+		return avail;
+	size = ring_recv(&upd->ring, iov, size);
+	ring_recv_done(sock, &upd->ring);
+	return size;
+}
+
+static int
+inet_proto_writev(struct socket *sock, struct iovec *iov, int nr, int nonblock)
+{
+	struct inet_proto_data *pupd;
+	int size, space;
+
+	if ((size = iov_length(iov, nr)) <= 0)
+		return 0;
+	if (!(pupd = IN_DATA(sock)->peerupd))
+		return -ENOTCONN;
+	space = ring_send_wait(sock, &pupd->ring, &IN_DATA(sock)->ring,
+			       nonblock);
+	if (space < 0)
+		return space;
+	size = ring_send(sock, &pupd->ring, iov, size);
+	ring_send_done(sock, &pupd->ring);
+	return size;
+}
+
+static int
+inet_proto_read(struct socket *sock, char *ubuf, int size, int nonblock)
+{
+	struct iovec iov;
+
+	iov.iov_base = ubuf;
+	iov.iov_len = size;
+	return inet_proto_readv(sock, &iov, 1, nonblock);
+}
+
+static int
+inet_proto_write(struct socket *sock, char *ubuf, int size, int nonblock)
+{
+	struct iovec iov;
+
+	iov.iov_base = ubuf;
+	iov.iov_len = size;
+	return inet_proto_writev(sock, &iov, 1, nonblock);
+}
+
+static int
+inet_proto_sendmsg(struct socket *sock, struct msghdr *msg, int nonblock)
+{
+	if (msg->msg_name)
+		return -EISCONN;
+	if (msg->msg_control && msg->msg_controllen)
+		return -EINVAL;
+	return inet_proto_writev(sock, msg->msg_iov, msg->msg_iovlen,
+				 nonblock);
+}
+
+static int
+inet_proto_recvmsg(struct socket *sock, struct msghdr *msg, int nonblock)
+{
+	msg->msg_namelen = 0;
+	msg->msg_controllen = 0;
+	return inet_proto_readv(sock, msg->msg_iov, msg->msg_iovlen,
+				nonblock);
+}
+
+static int
+inet_proto_select(struct socket *sock, int which)
+{
+	struct inet_proto_data *upd = IN_DATA(sock);
+
+	return ring_select(sock, &upd->ring,
+			   upd->peerupd ? &upd->peerupd->ring : NULL, which);
+}
+
+static int
+inet_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
+{
+	struct inet_proto_data *upd = IN_DATA(sock), *peerupd;
+
+	peerupd = (sock->state == SS_CONNECTED) ? upd->peerupd : NULL;
+	switch (cmd) {
+	case TIOCINQ:
+		verify_area((void *)arg, sizeof(unsigned long));
+		put_fs_long(RING_AVAIL(&upd->ring), (unsigned long *)arg);
+		break;
+
+	case TIOCOUTQ:
+		verify_area((void *)arg, sizeof(unsigned long));
+		put_fs_long(peerupd ? RING_SPACE(&peerupd->ring) : 0,
+			    (unsigned long *)arg);
+		break;
+
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * the socket level buffer options are the ring's. TCP_NODELAY is
+ * accepted and ignored: nothing is ever held back.
+ */
+static int
+inet_proto_setsockopt(struct socket *sock, int level, int optname,
+		      char *optval, int optlen)
+{
+	if (level != SOL_SOCKET && level != IPPROTO_TCP)
+		return -ENOPROTOOPT;
+	if (optlen < sizeof(int))
+		return -EINVAL;
+	verify_area(optval, sizeof(int));
+	if (level == IPPROTO_TCP)
+		return (optname == TCP_NODELAY) ? 0 : -ENOPROTOOPT;
+	return ring_setsockopt(&IN_DATA(sock)->ring, optname,
+			       get_fs_long((unsigned long *)optval));
+}
+
+static int
+inet_proto_getsockopt(struct socket *sock, int level, int optname,
+		      char *optval, int *optlen)
+{
+	if (level == IPPROTO_TCP && optname == TCP_NODELAY)
+		return sock_put_opt(1, optval, optlen);
+	if (level != SOL_SOCKET)
+		return -ENOPROTOOPT;
+	return ring_getsockopt(&IN_DATA(sock)->ring, optname, optval, optlen);
+}
+
+static int
+inet_proto_init(void)
+{
+	int i;
+
+	PRINTK("inet_proto_init: initializing loopback...\n");
+	for (i = 0; i < INET_HASH_SIZE; ++i)
+		inet_hash[i] = NULL;
+	return 0;
+}
@@ -1,8 +1,6 @@
 #ifndef _KERN_SOCK_H
 #define _KERN_SOCK_H
 
-#define NSOCKETS 128			/* should be dynamic, later... */
-
 typedef enum {
 	SS_FREE = 0,			/* not allocated */
 	SS_UNCONNECTED,			/* unconnected to any socket */
@@ -20,7 +18,11 @@ typedef enum {
  *		server			client
  * conn		client connected to	server connected to
  * iconn	list of clients		-unused-
- *		 awaiting connections
+ *		 waiting for room
+ *		 in the accept queue
+ * aconn	accept queue:		-unused-
+ *		 connected sockets
+ *		 not yet accepted
  * wait		sleep for clients,	sleep for connection,
  *		sleep for i/o		sleep for i/o
  */
@@ -32,11 +34,20 @@ struct socket {
 	char *data;			/* protocol data */
 	struct socket *conn;		/* server socket connected to */
 	struct socket *iconn;		/* incomplete client connections */
+	struct socket *aconn;		/* accept queue */
+	struct socket *aconn_tail;
+	int qlen, backlog;		/* accept queue length and limit */
 	struct socket *next;
 	struct task_struct **wait;	/* ptr to place to wait on */
 	void *dummy;
 };
 
+/*
+ * sockets are malloc'ed, and their inode points back at them.
+ */
+#define SOCK_INODE(S) ((struct inode *)(S)->dummy)
+#define SOCKET_I(I) ((struct socket *)(I)->i_data[0])
+
 struct proto_ops {
 	int (*init)(void);
 	int (*create)(struct socket *sock, int protocol);
@@ -45,7 +56,7 @@ struct proto_ops {
 	int (*bind)(struct socket *sock, struct sockaddr *umyaddr,
 		    int sockaddr_len);
 	int (*connect)(struct socket *sock, struct sockaddr *uservaddr,
-		       int sockaddr_len);
+		       int sockaddr_len, int flags);
 	int (*socketpair)(struct socket *sock1, struct socket *sock2);
 	int (*accept)(struct socket *sock, struct socket *newsock);
 	int (*getname)(struct socket *sock, struct sockaddr *uaddr,
@@ -54,14 +65,71 @@ struct proto_ops {
 	int (*write)(struct socket *sock, char *ubuf, int size, int nonblock);
 	int (*select)(struct socket *sock, int which);
 	int (*ioctl)(struct socket *sock, unsigned int cmd, unsigned long arg);
+	int (*readv)(struct socket *sock, struct iovec *iov, int nr,
+		     int nonblock);
+	int (*writev)(struct socket *sock, struct iovec *iov, int nr,
+		      int nonblock);
+	/*
+	 * msg is in kernel space, and so is msg->msg_iov; msg_name and
+	 * msg_control still point to user space. recvmsg sets msg_namelen,
+	 * msg_controllen and msg_flags.
+	 */
+	int (*sendmsg)(struct socket *sock, struct msghdr *msg, int nonblock);
+	int (*recvmsg)(struct socket *sock, struct msghdr *msg, int nonblock);
+	int (*setsockopt)(struct socket *sock, int level, int optname,
+			  char *optval, int optlen);
+	int (*getsockopt)(struct socket *sock, int level, int optname,
+			  char *optval, int *optlen);
 };
 
-extern int sock_awaitconn(struct socket *mysock, struct socket *servsock);
+/*
+ * the byte ring stream sockets receive into, see sock_ring.c. the
+ * socket options that size it live here too.
+ */
+#define RING_MAX_PAGES 16
+
+struct sock_ring {
+	char *buf[RING_MAX_PAGES];	/* pages got as needed */
+	int size;
+	int head, tail, len;
+	int sndbuf, rcvbuf;		/* SO_SNDBUF, SO_RCVBUF */
+	int rcvlowat;			/* SO_RCVLOWAT */
+	int rd_want;			/* wake the reader at this much data */
+	int locked;			/* a copy in or out is going on */
+	struct task_struct *lock_wait;
+};
+
+#define RING_AVAIL(R) ((R)->len)
+#define RING_SPACE(R) ((R)->size - (R)->len)
+#define RING_WANT(DEST,SRC) \
+	((DEST)->rcvbuf > (SRC)->sndbuf ? (DEST)->rcvbuf : (SRC)->sndbuf)
+
+extern void ring_init(struct sock_ring *r, int size);
+extern void ring_free(struct sock_ring *r);
+extern int ring_recv_wait(struct socket *sock, struct sock_ring *r, int size,
+			  int nonblock);
+extern int ring_recv(struct sock_ring *r, struct iovec *iov, int todo);
+extern void ring_recv_done(struct socket *sock, struct sock_ring *r);
+extern int ring_send_wait(struct socket *sock, struct sock_ring *r,
+			  struct sock_ring *from, int nonblock);
+extern int ring_send(struct socket *sock, struct sock_ring *r,
+		     struct iovec *iov, int todo);
+extern void ring_send_done(struct socket *sock, struct sock_ring *r);
+extern int ring_select(struct socket *sock, struct sock_ring *r,
+		       struct sock_ring *peer, int which);
+extern int ring_setsockopt(struct sock_ring *r, int optname, int val);
+extern int ring_getsockopt(struct sock_ring *r, int optname, char *optval,
+			   int *optlen);
+extern int sock_put_opt(int val, char *optval, int *optlen);
+
+extern int sock_awaitconn(struct socket *mysock, struct socket *servsock,
+			  int flags);
+extern void sock_wake_up(struct socket *sock);
 
 #ifdef SOCK_DEBUG
 #define PRINTK printk
 #else
-#define PRINTK (void)
+#define PRINTK(x...) do { } while (0)
 #endif
 
 #endif /* _KERN_SOCK_H */
@@ -0,0 +1,363 @@
+/*
+ * the byte ring behind unix and inet stream sockets.
+ *
+ * stream data goes in a ring of whole pages in the receiver's data.
+ * buffer mgmt inspired by pipe code: contents can wrap around, and len
+ * tells full from empty. the ring is sized by the receiver's SO_RCVBUF
+ * or the sender's SO_SNDBUF, whichever is larger, and pages are only
+ * allocated when the writer first gets to them.
+ *
+ * copying to or from user space can sleep on a page fault, so the ring
+ * is locked from the moment a reader or writer finds what it waited for
+ * until its copy is done. another writer, a resize or the rewind of an
+ * emptied ring can't move or free the pages under it.
+ */
+
+#include <signal.h>
+#include <errno.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+#include <sys/socket.h>
+#include "kern_sock.h"
+
+#define RING_ADDR(R,POS) \
+	((R)->buf[(POS) / PAGE_SIZE] + ((POS) & (PAGE_SIZE-1)))
+
+void
+ring_init(struct sock_ring *r, int size)
+{
+	int i;
+
+	for (i = 0; i < RING_MAX_PAGES; ++i)
+		r->buf[i] = NULL;
+	r->size = r->rcvbuf = size;
+	r->head = r->tail = r->len = 0;
+	r->sndbuf = 0;
+	r->rcvlowat = r->rd_want = 1;
+	r->locked = 0;
+	r->lock_wait = NULL;
+}
+
+void
+ring_free(struct sock_ring *r)
+{
+	int i;
+
+	for (i = 0; i < RING_MAX_PAGES; ++i) {
+		free_page((unsigned long)r->buf[i]);
+		r->buf[i] = NULL;
+	}
+}
+
+static inline void
+ring_lock(struct sock_ring *r)
+{
+	cli();
+	while (r->locked)
+		sleep_on(&r->lock_wait);
+	r->locked = 1;
+	sti();
+}
+
+static inline void
+ring_unlock(struct sock_ring *r)
+{
+	r->locked = 0;
+	wake_up(&r->lock_wait);
+}
+
+/*
+ * resize the ring to size bytes (a multiple of the page size). growing
+ * is done at once unless the contents wrap around; shrinking waits
+ * until the ring is empty. called with the ring locked.
+ */
+static void
+ring_resize(struct sock_ring *r, int size)
+{
+	int i;
+
+	if (size > r->size) {
+		if (r->tail + r->len > r->size)
+			return;
+		r->head = r->tail + r->len;
+		r->size = size;
+	}
+	else if (size < r->size && !r->len) {
+		r->head = r->tail = 0;
+		r->size = size;
+		for (i = size / PAGE_SIZE; i < RING_MAX_PAGES; ++i) {
+			free_page((unsigned long)r->buf[i]);
+			r->buf[i] = NULL;
+		}
+	}
+}
+
+/*
+ * wait until there's something to read in our ring: SO_RCVLOWAT bytes
+ * (or as much as was asked for), or anything at all once the peer is
+ * gone or we can't block. the writer doesn't wake us up before then.
+ * returns what's there with the ring locked, or 0 at end of file.
+ */
+int
+ring_recv_wait(struct socket *sock, struct sock_ring *r, int size,
+	       int nonblock)
+{
+	int avail, want;
+
+	for (;;) {
+		if ((want = r->rcvlowat) > size)
+			want = size;
+		if (want > r->size)
+			want = r->size;
+		ring_lock(r);
+		if ((avail = RING_AVAIL(r)) >= want)
+			return avail;
+		if (avail && (sock->state != SS_CONNECTED || nonblock))
+			return avail;
+		ring_unlock(r);
+		if (sock->state != SS_CONNECTED) {
+			PRINTK("ring_recv_wait: socket not connected\n");
+			return (sock->state == SS_DISCONNECTING) ? 0 : -ENOTCONN;
+		}
+		if (nonblock)
+			return -EAGAIN;
+		r->rd_want = want;
+		interruptible_sleep_on(sock->wait);
+		r->rd_want = r->rcvlowat;
+		if (current->signal & ~current->blocked) {
+			PRINTK("ring_recv_wait: interrupted\n");
+			return -ERESTARTSYS;
+		}
+	}
+}
+
+/*
+ * copy up to todo bytes from the locked ring into the user's buffer,
+ * watching for wraparound and page ends. an emptied ring is rewound,
+ * so the next write starts at the beginning of a page.
+ */
+int
+ring_recv(struct sock_ring *r, struct iovec *iov, int todo)
+{
+	int avail, part, cando, done = 0;
+
+	while (todo && (avail = RING_AVAIL(r))) {
+		if ((cando = todo) > avail)
+			cando = avail;
+		if (cando > (part = r->size - r->tail))
+			cando = part;
+		if (cando > (part = PAGE_SIZE - (r->tail & (PAGE_SIZE-1))))
+			cando = part;
+		PRINTK("ring_recv: avail=%d, todo=%d, cando=%d\n",
+		       avail, todo, cando);
+		memcpy_toiovec(iov, RING_ADDR(r, r->tail), cando);
+		if ((r->tail += cando) == r->size)
+			r->tail = 0;
+		r->len -= cando;
+		todo -= cando;
+		done += cando;
+	}
+	if (!r->len)
+		r->head = r->tail = 0;
+	return done;
+}
+
+/*
+ * unlock our ring after a read, and let the writer know there's room.
+ */
+void
+ring_recv_done(struct socket *sock, struct sock_ring *r)
+{
+	ring_unlock(r);
+	if (sock->state == SS_CONNECTED)
+		sock_wake_up(sock->conn);
+}
+
+/*
+ * wait for room in the peer's ring r, which is first resized to what
+ * the two ends ask for. returns the space with the ring locked.
+ */
+int
+ring_send_wait(struct socket *sock, struct sock_ring *r,
+	       struct sock_ring *from, int nonblock)
+{
+	int space;
+
+	for (;;) {
+		if (sock->state != SS_CONNECTED) {
+			PRINTK("ring_send_wait: socket not connected\n");
+			if (sock->state == SS_DISCONNECTING) {
+				send_sig(SIGPIPE,current,1);
+				return -EPIPE;
+			}
+			return -ENOTCONN;
+		}
+		ring_lock(r);
+		ring_resize(r, RING_WANT(r, from));
+		if ((space = RING_SPACE(r)))
+			return space;
+		ring_unlock(r);
+		PRINTK("ring_send_wait: no space left...\n");
+		if (nonblock)
+			return -EAGAIN;
+		interruptible_sleep_on(sock->wait);
+		if (current->signal & ~current->blocked) {
+			PRINTK("ring_send_wait: interrupted\n");
+			return -ERESTARTSYS;
+		}
+	}
+}
+
+/*
+ * copy todo bytes from the user's buffer into the locked peer's ring,
+ * getting pages as we go. we write to our peer's ring: when we
+ * connected we ref'd its data, so the ring stays even after the peer
+ * has disconnected, which we check other ways. returns what was
+ * written, or an error if nothing was.
+ */
+int
+ring_send(struct socket *sock, struct sock_ring *r, struct iovec *iov,
+	  int todo)
+{
+	int space, part, cando, n, done = 0;
+	unsigned long page;
+
+	while (todo && (space = RING_SPACE(r))) {
+		/*
+		 * we may become disconnected inside this loop, so watch
+		 * for it (the ring is safe until we close)
+		 */
+		if (sock->state == SS_DISCONNECTING) {
+			if (done)
+				break;
+			send_sig(SIGPIPE,current,1);
+			return -EPIPE;
+		}
+		if (!r->buf[n = r->head / PAGE_SIZE]) {
+			if (!(page = get_free_page())) {
+				if (done)
+					break;
+				return -ENOMEM;
+			}
+			r->buf[n] = (char *)page;
+			continue;
+		}
+		if ((cando = todo) > space)
+			cando = space;
+		if (cando > (part = r->size - r->head))
+			cando = part;
+		if (cando > (part = PAGE_SIZE - (r->head & (PAGE_SIZE-1))))
+			cando = part;
+		PRINTK("ring_send: space=%d, todo=%d, cando=%d\n",
+		       space, todo, cando);
+		memcpy_fromiovec(RING_ADDR(r, r->head), iov, cando);
+		if ((r->head += cando) == r->size)
+			r->head = 0;
+		r->len += cando;
+		todo -= cando;
+		done += cando;
+	}
+	return done;
+}
+
+/*
+ * unlock the peer's ring after a write. the reader is only woken when
+ * there's as much as it waits for, or the ring is full.
+ */
+void
+ring_send_done(struct socket *sock, struct sock_ring *r)
+{
+	ring_unlock(r);
+	if (sock->state == SS_CONNECTED &&
+	    (RING_AVAIL(r) >= r->rd_want || !RING_SPACE(r)))
+		sock_wake_up(sock->conn);
+}
+
+/*
+ * peer is the ring we write to, NULL if there's none.
+ */
+int
+ring_select(struct socket *sock, struct sock_ring *r, struct sock_ring *peer,
+	    int which)
+{
+	if (which == SEL_IN) {
+		if (RING_AVAIL(r) &&	/* even if disconnected */
+		    (RING_AVAIL(r) >= r->rcvlowat || !RING_SPACE(r)))
+			return 1;
+		return sock->state != SS_CONNECTED;
+	}
+	if (which == SEL_OUT) {
+		if (sock->state != SS_CONNECTED || !peer)
+			return 1;
+		return RING_SPACE(peer) > 0;
+	}
+	return 0;
+}
+
+/*
+ * buffer sizes are rounded up to whole pages. data goes into the
+ * receiver's ring, so SO_SNDBUF (0 until set) only lets a sender make
+ * its peer's ring bigger.
+ */
+int
+ring_setsockopt(struct sock_ring *r, int optname, int val)
+{
+	switch (optname) {
+	case SO_SNDBUF:
+	case SO_RCVBUF:
+		if (val <= 0)
+			val = 1;
+		if (val > RING_MAX_PAGES * PAGE_SIZE)
+			val = RING_MAX_PAGES * PAGE_SIZE;
+		val = (val + PAGE_SIZE-1) & ~(PAGE_SIZE-1);
+		if (optname == SO_SNDBUF)
+			r->sndbuf = val;
+		else {
+			r->rcvbuf = val;
+			if (val < r->size) {
+				ring_lock(r);
+				ring_resize(r, val);
+				ring_unlock(r);
+			}
+		}
+		return 0;
+
+	case SO_RCVLOWAT:
+		if (val <= 0)
+			val = 1;
+		r->rcvlowat = r->rd_want = val;
+		return 0;
+	}
+	return -ENOPROTOOPT;
+}
+
+int
+ring_getsockopt(struct sock_ring *r, int optname, char *optval, int *optlen)
+{
+	switch (optname) {
+	case SO_SNDBUF:
+		return sock_put_opt(r->sndbuf, optval, optlen);
+	case SO_RCVBUF:
+		return sock_put_opt(r->rcvbuf, optval, optlen);
+	case SO_RCVLOWAT:
+		return sock_put_opt(r->rcvlowat, optval, optlen);
+	}
+	return -ENOPROTOOPT;
+}
+
+/*
+ * hand an int option back to the user.
+ */
+int
+sock_put_opt(int val, char *optval, int *optlen)
+{
+	verify_area(optlen, sizeof(*optlen));
+	if (get_fs_long((unsigned long *)optlen) < sizeof(int))
+		return -EINVAL;
+	verify_area(optval, sizeof(int));
+	put_fs_long(val, (unsigned long *)optval);
+	put_fs_long(sizeof(int), (unsigned long *)optlen);
+	return 0;
+}
@@ -14,16 +14,19 @@
 extern int sys_close(int fd);
 
 extern struct proto_ops unix_proto_ops;
+extern struct proto_ops inet_proto_ops;
 
 static struct {
 	short family;
 	char *name;
 	struct proto_ops *ops;
 } proto_table[] = {
-	AF_UNIX,	"AF_UNIX",	&unix_proto_ops
+	{ AF_UNIX,	"AF_UNIX",	&unix_proto_ops },
+	{ AF_INET,	"AF_INET",	&inet_proto_ops }
 };
 #define NPROTO (sizeof(proto_table) / sizeof(proto_table[0]))
 
+#ifdef SOCK_DEBUG
 static char *
 family_name(int family)
 {
@@ -34,6 +37,7 @@ family_name(int family)
 			return proto_table[i].name;
 	return "UNKNOWN";
 }
+#endif
 
 static int sock_lseek(struct inode *inode, struct file *file, off_t offset,
 		      int whence);
@@ -48,6 +52,10 @@ static void sock_close(struct inode *inode, struct file *file);
 		       select_table *seltable);
 static int sock_ioctl(struct inode *inode, struct file *file,
 		      unsigned int cmd, unsigned int arg);
+static int sock_readv(struct inode *inode, struct file *file,
+		      struct iovec *iov, int nr, off_t *ppos);
+static int sock_writev(struct inode *inode, struct file *file,
+		       struct iovec *iov, int nr, off_t *ppos);
 
 static struct file_operations socket_file_ops = {
 	sock_lseek,
@@ -57,13 +65,11 @@ static struct file_operations socket_file_ops = {
 	sock_select,	/* not in vfs yet */
 	sock_ioctl,
 	NULL,		/* no special open code... */
-	sock_close
+	sock_close,
+	sock_readv,
+	sock_writev
 };
 
-#define SOCK_INODE(S) ((struct inode *)(S)->dummy)
-
-static struct socket sockets[NSOCKETS];
-#define last_socket (sockets + NSOCKETS - 1)
 static struct task_struct *socket_wait_free = NULL;
 
 /*
@@ -72,23 +78,16 @@ static struct task_struct *socket_wait_free = NULL;
 static int
 get_fd(struct inode *inode)
 {
-	int fd, i;
+	int fd;
 	struct file *file;
 
 	/*
 	 * find a file descriptor suitable for return to the user.
 	 */
-	for (fd = 0; fd < NR_OPEN; ++fd)
-		if (!current->filp[fd])
-			break;
-	if (fd == NR_OPEN)
-		return -1;
-	current->close_on_exec &= ~(1 << fd);
-	for (file = file_table, i = 0; i < NR_FILE; ++i, ++file)
-		if (!file->f_count)
-			break;
-	if (i == NR_FILE)
-		return -1;
+	if ((fd = get_unused_fd()) < 0)
+		return fd;
+	if (!(file = get_empty_filp()))
+		return -ENFILE;
 	current->filp[fd] = file;
 	file->f_op = &socket_file_ops;
 	file->f_mode = 3;
@@ -111,15 +110,16 @@ toss_fd(int fd)
 	sys_close(fd);
 }
 
+/*
+ * i_sock is only set on the inodes sock_alloc() hands out, not on the
+ * S_IFSOCK names in the file system.
+ */
 static inline struct socket *
 socki_lookup(struct inode *inode)
 {
-	struct socket *sock;
-
-	for (sock = sockets; sock <= last_socket; ++sock)
-		if (sock->state != SS_FREE && SOCK_INODE(sock) == inode)
-			return sock;
-	return NULL;
+	if (!inode->i_sock)
+		return NULL;
+	return SOCKET_I(inode);
 }
 
 static inline struct socket *
@@ -127,7 +127,7 @@ sockfd_lookup(int fd, struct file **pfile)
 {
 	struct file *file;
 
-	if (fd < 0 || fd >= NR_OPEN || !(file = current->filp[fd]))
+	if (fd < 0 || fd >= current->max_fds || !(file = current->filp[fd]))
 		return NULL;
 	if (pfile)
 		*pfile = file;
@@ -140,37 +140,38 @@ sock_alloc(int wait)
 	struct socket *sock;
 
 	while (1) {
-		cli();
-		for (sock = sockets; sock <= last_socket; ++sock)
-			if (sock->state == SS_FREE) {
-				sock->state = SS_UNCONNECTED;
-				sti();
-				sock->flags = 0;
-				sock->ops = NULL;
-				sock->data = NULL;
-				sock->conn = NULL;
-				sock->iconn = NULL;
-				/*
-				 * this really shouldn't be necessary, but
-				 * everything else depends on inodes, so we
-				 * grab it.
-				 * sleeps are also done on the i_wait member
-				 * of this inode.
-				 * the close system call will iput this inode
-				 * for us.
-				 */
-				if (!(SOCK_INODE(sock) = get_empty_inode())) {
-					printk("sock_alloc: no more inodes\n");
-					sock->state = SS_FREE;
-					return NULL;
-				}
-				SOCK_INODE(sock)->i_mode = S_IFSOCK;
-				sock->wait = &SOCK_INODE(sock)->i_wait;
-				PRINTK("sock_alloc: socket 0x%x, inode 0x%x\n",
-				       sock, SOCK_INODE(sock));
-				return sock;
+		if ((sock = (struct socket *) malloc(sizeof(struct socket)))) {
+			sock->state = SS_UNCONNECTED;
+			sock->flags = 0;
+			sock->ops = NULL;
+			sock->data = NULL;
+			sock->conn = NULL;
+			sock->iconn = NULL;
+			sock->aconn = sock->aconn_tail = NULL;
+			sock->qlen = sock->backlog = 0;
+			sock->next = NULL;
+			/*
+			 * this really shouldn't be necessary, but
+			 * everything else depends on inodes, so we
+			 * grab it.
+			 * sleeps are also done on the i_wait member
+			 * of this inode.
+			 * the close system call will iput this inode
+			 * for us.
+			 */
+			if (!(sock->dummy = get_empty_inode())) {
+				printk("sock_alloc: no more inodes\n");
+				free_s(sock, sizeof(struct socket));
+				return NULL;
 			}
-		sti();
+			SOCK_INODE(sock)->i_mode = S_IFSOCK;
+			SOCK_INODE(sock)->i_sock = 1;
+			SOCK_INODE(sock)->i_data[0] = (unsigned long) sock;
+			sock->wait = &SOCK_INODE(sock)->i_wait;
+			PRINTK("sock_alloc: socket 0x%x, inode 0x%x\n",
+			       sock, SOCK_INODE(sock));
+			return sock;
+		}
 		if (!wait)
 			return NULL;
 		PRINTK("sock_alloc: no free sockets, sleeping...\n");
@@ -183,13 +184,25 @@ sock_alloc(int wait)
 	}
 }
 
+/*
+ * wakes up anyone sleeping on the socket, and tells epoll about it.
+ */
+void
+sock_wake_up(struct socket *sock)
+{
+	wake_up(sock->wait);
+	epoll_wakeup(SOCK_INODE(sock)->i_epoll);
+}
+
 static inline void
 sock_release_peer(struct socket *peer)
 {
 	peer->state = SS_DISCONNECTING;
-	wake_up(peer->wait);
+	sock_wake_up(peer);
 }
 
+static void sock_discard(struct socket *sock);
+
 static void
 sock_release(struct socket *sock)
 {
@@ -205,8 +218,19 @@ sock_release(struct socket *sock)
 	 */
 	for (peersock = sock->iconn; peersock; peersock = nextsock) {
 		nextsock = peersock->next;
+		peersock->conn = NULL;		/* we're going away */
 		sock_release_peer(peersock);
 	}
+	sock->iconn = NULL;
+	/*
+	 * connections nobody accepted are dropped
+	 */
+	while ((peersock = sock->aconn)) {
+		sock->aconn = peersock->next;
+		sock_discard(peersock);
+	}
+	sock->aconn_tail = NULL;
+	sock->qlen = 0;
 	/*
 	 * wake up anyone we're connected to. first, we release the
 	 * protocol, to give it a chance to flush data, etc.
@@ -217,9 +241,24 @@ sock_release(struct socket *sock)
 	if (peersock)
 		sock_release_peer(peersock);
 	sock->state = SS_FREE;		/* this really releases us */
+	SOCK_INODE(sock)->i_sock = 0;
+	SOCK_INODE(sock)->i_data[0] = 0;
+	free_s(sock, sizeof(struct socket));
 	wake_up(&socket_wait_free);
 }
 
+/*
+ * release a socket that never got a file, and its inode with it.
+ */
+static void
+sock_discard(struct socket *sock)
+{
+	struct inode *inode = SOCK_INODE(sock);
+
+	sock_release(sock);
+	iput(inode);
+}
+
 static int
 sock_lseek(struct inode *inode, struct file *file, off_t offset, int whence)
 {
@@ -257,6 +296,42 @@ sock_write(struct inode *inode, struct file *file, char *ubuf, int size)
 	return sock->ops->write(sock, ubuf, size,(file->f_flags & O_NONBLOCK));
 }
 
+static int
+sock_readv(struct inode *inode, struct file *file, struct iovec *iov, int nr,
+	   off_t *ppos)
+{
+	struct socket *sock;
+
+	PRINTK("sock_readv: iov=0x%x, nr=%d\n", iov, nr);
+	if (!(sock = socki_lookup(inode))) {
+		printk("sock_readv: can't find socket for inode!\n");
+		return -EBADF;
+	}
+	if (sock->flags & SO_ACCEPTCON)
+		return -EINVAL;
+	if (!sock->ops->readv)
+		return -EINVAL;
+	return sock->ops->readv(sock, iov, nr, (file->f_flags & O_NONBLOCK));
+}
+
+static int
+sock_writev(struct inode *inode, struct file *file, struct iovec *iov, int nr,
+	    off_t *ppos)
+{
+	struct socket *sock;
+
+	PRINTK("sock_writev: iov=0x%x, nr=%d\n", iov, nr);
+	if (!(sock = socki_lookup(inode))) {
+		printk("sock_writev: can't find socket for inode!\n");
+		return -EBADF;
+	}
+	if (sock->flags & SO_ACCEPTCON)
+		return -EINVAL;
+	if (!sock->ops->writev)
+		return -EINVAL;
+	return sock->ops->writev(sock, iov, nr, (file->f_flags & O_NONBLOCK));
+}
+
 static int
 sock_readdir(struct inode *inode, struct file *file, struct dirent *dirent,
 	     int count)
@@ -309,8 +384,8 @@ sock_select(struct inode *inode, struct file *file, int which,
 	if (sock->flags & SO_ACCEPTCON) {
 		if (which == SEL_IN) {
 			PRINTK("sock_select: %sconnections pending\n",
-			       sock->iconn ? "" : "no ");
-			return sock->iconn ? 1 : 0;
+			       sock->aconn ? "" : "no ");
+			return sock->aconn ? 1 : 0;
 		}
 		PRINTK("sock_select: nothing else for server socket\n");
 		return 0;
@@ -341,21 +416,15 @@ sock_close(struct inode *inode, struct file *file)
 	sock_release(sock);
 }
 
-int
-sock_awaitconn(struct socket *mysock, struct socket *servsock)
+/*
+ * a client waiting for room in the accept queue sits on the server's
+ * iconn list, so that it is told (conn = NULL) if the server goes away.
+ */
+static void
+sock_iconn_add(struct socket *mysock, struct socket *servsock)
 {
 	struct socket *last;
 
-	PRINTK("sock_awaitconn: trying to connect socket 0x%x to 0x%x\n",
-	       mysock, servsock);
-	if (!(servsock->flags & SO_ACCEPTCON)) {
-		PRINTK("sock_awaitconn: server not accepting connections\n");
-		return -EINVAL;
-	}
-
-	/*
-	 * put ourselves on the server's incomplete connection queue.
-	 */
 	mysock->next = NULL;
 	cli();
 	if (!(last = servsock->iconn))
@@ -368,37 +437,117 @@ sock_awaitconn(struct socket *mysock, struct socket *servsock)
 	mysock->state = SS_CONNECTING;
 	mysock->conn = servsock;
 	sti();
+}
 
-	/*
-	 * wake up server, then await connection. server will set state to
-	 * SS_CONNECTED if we're connected.
-	 */
-	wake_up(servsock->wait);
-	if (mysock->state != SS_CONNECTED) {
-		interruptible_sleep_on(mysock->wait);
-		if (mysock->state != SS_CONNECTED) {
-			/*
-			 * if we're not connected we could have been
-			 * 1) interrupted, so we need to remove ourselves
-			 *    from the server list
-			 * 2) rejected (mysock->conn == NULL), and have
-			 *    already been removed from the list
-			 */
-			if (mysock->conn == servsock) {
-				cli();
-				if ((last = servsock->iconn) == mysock)
-					servsock->iconn = mysock->next;
-				else {
-					while (last->next != mysock)
-						last = last->next;
-					last->next = mysock->next;
-				}
-				sti();
+static void
+sock_iconn_del(struct socket *mysock, struct socket *servsock)
+{
+	struct socket *last;
+
+	cli();
+	if ((last = servsock->iconn) == mysock)
+		servsock->iconn = mysock->next;
+	else {
+		while (last->next != mysock)
+			last = last->next;
+		last->next = mysock->next;
+	}
+	mysock->next = NULL;
+	sti();
+}
+
+/*
+ * connect to a listening socket. the connection is completed here, on
+ * the client's side: the server's end is created at once and put on the
+ * accept queue, so the client needn't wait for accept and can start
+ * writing. we only sleep while the queue is at its backlog.
+ */
+int
+sock_awaitconn(struct socket *mysock, struct socket *servsock, int flags)
+{
+	struct socket *newsock;
+	int i;
+
+	PRINTK("sock_awaitconn: trying to connect socket 0x%x to 0x%x\n",
+	       mysock, servsock);
+	if (!(servsock->flags & SO_ACCEPTCON)) {
+		PRINTK("sock_awaitconn: server not accepting connections\n");
+		return -EINVAL;
+	}
+	sock_iconn_add(mysock, servsock);
+	for (;;) {
+		while (servsock->qlen >= servsock->backlog) {
+			PRINTK("sock_awaitconn: accept queue full\n");
+			if (flags & O_NONBLOCK) {
+				i = -EAGAIN;
+				goto out;
 			}
-			return mysock->conn ? -EINTR : -EACCES;
+			interruptible_sleep_on(mysock->wait);
+			if (mysock->conn != servsock) {
+				i = -ECONNREFUSED;
+				goto gone;
+			}
+			if (current->signal & ~current->blocked) {
+				i = -ERESTARTSYS;
+				goto out;
+			}
+		}
+
+		/*
+		 * we can sleep getting the new socket and setting it up,
+		 * so each time check the server is still there, and after
+		 * both that no one else took the room on its queue.
+		 */
+		if (!(newsock = sock_alloc(0))) {
+			i = -ENOMEM;
+			goto out;
+		}
+		if (mysock->conn != servsock) {
+			sock_discard(newsock);
+			i = -ECONNREFUSED;
+			goto gone;
+		}
+		newsock->type = servsock->type;
+		newsock->ops = servsock->ops;
+		if ((i = servsock->ops->dup(newsock, servsock)) < 0) {
+			sock_discard(newsock);
+			goto out;
+		}
+		if (mysock->conn != servsock) {
+			sock_discard(newsock);
+			i = -ECONNREFUSED;
+			goto gone;
 		}
+		if (servsock->qlen < servsock->backlog)
+			break;
+		sock_discard(newsock);
 	}
+	sock_iconn_del(mysock, servsock);
+	newsock->conn = mysock;
+	mysock->conn = newsock;
+	newsock->state = SS_CONNECTED;
+	mysock->state = SS_CONNECTED;
+	servsock->ops->accept(servsock, newsock);
+
+	newsock->next = NULL;
+	if (servsock->aconn_tail)
+		servsock->aconn_tail->next = newsock;
+	else
+		servsock->aconn = newsock;
+	servsock->aconn_tail = newsock;
+	servsock->qlen++;
+	PRINTK("sock_awaitconn: connected 0x%x to 0x%x, %d queued\n",
+	       mysock, newsock, servsock->qlen);
+	sock_wake_up(servsock);
 	return 0;
+
+out:
+	if (mysock->conn == servsock)
+		sock_iconn_del(mysock, servsock);
+gone:
+	mysock->conn = NULL;
+	mysock->state = SS_UNCONNECTED;
+	return i;
 }
 
 /*
@@ -451,13 +600,13 @@ sock_socket(int family, int type, int protocol)
 	sock->type = type;
 	sock->ops = ops;
 	if ((i = sock->ops->create(sock, protocol)) < 0) {
-		sock_release(sock);
+		sock_discard(sock);
 		return i;
 	}
 
 	if ((fd = get_fd(SOCK_INODE(sock))) < 0) {
-		sock_release(sock);
-		return -EINVAL;
+		sock_discard(sock);
+		return fd;
 	}
 
 	return fd;
@@ -503,8 +652,8 @@ sock_socketpair(int family, int type, int protocol, int usockvec[2])
 	sock2->state = SS_CONNECTED;
 
 	verify_area(usockvec, 2 * sizeof(int));
-	put_fs_long(fd1, &usockvec[0]);
-	put_fs_long(fd2, &usockvec[1]);
+	put_fs_long(fd1, (unsigned long *)&usockvec[0]);
+	put_fs_long(fd2, (unsigned long *)&usockvec[1]);
 
 	return 0;
 }
@@ -546,24 +695,28 @@ sock_listen(int fd, int backlog)
 		PRINTK("sys_listen: socket isn't unconnected\n");
 		return -EINVAL;
 	}
-	if (sock->flags & SO_ACCEPTCON) {
-		PRINTK("sys_listen: socket already accepting connections!\n");
-		return -EINVAL;
-	}
+	if (backlog <= 0)
+		backlog = 1;
+	if (backlog > SOMAXCONN)
+		backlog = SOMAXCONN;
+	sock->backlog = backlog;	/* a second listen just changes this */
 	sock->flags |= SO_ACCEPTCON;
+	if (sock->iconn && sock->qlen < sock->backlog)
+		sock_wake_up(sock->iconn);
 	return 0;
 }
 
 /*
- * for accept, we attempt to create a new socket, set up the link with the
- * client, wake up the client, then return the new connected fd.
+ * for accept, the connection is already there: we take the first socket
+ * off the accept queue, give it a descriptor and let the next client
+ * waiting for room in. if the queue is empty we wait, unless
+ * nonblocking.
  */
 static int
 sock_accept(int fd, struct sockaddr *upeer_sockaddr, int *upeer_addrlen)
 {
 	struct file *file;
-	struct socket *sock, *clientsock, *newsock;
-	int i;
+	struct socket *sock, *newsock;
 
 	PRINTK("sys_accept: fd = %d\n", fd);
 	if (!(sock = sockfd_lookup(fd, &file)))
@@ -577,11 +730,7 @@ sock_accept(int fd, struct sockaddr *upeer_sockaddr, int *upeer_addrlen)
 		return -EINVAL;
 	}
 
-	/*
-	 * if there aren't any sockets awaiting connection, then wait for
-	 * one, unless nonblocking
-	 */
-	while (!(clientsock = sock->iconn)) {
+	while (!(newsock = sock->aconn)) {
 		if (file->f_flags & O_NONBLOCK)
 			return -EAGAIN;
 		interruptible_sleep_on(sock->wait);
@@ -590,41 +739,28 @@ sock_accept(int fd, struct sockaddr *upeer_sockaddr, int *upeer_addrlen)
 			return -ERESTARTSYS;
 		}
 	}
-
-	if (!(newsock = sock_alloc(0))) {
-		printk("sys_accept: no more sockets\n");
-		return -EINVAL;
-	}
-	newsock->type = sock->type;
-	newsock->ops = sock->ops;
-	if ((i = sock->ops->dup(newsock, sock)) < 0) {
-		sock_release(newsock);
-		return i;
-	}
-
-	if ((fd = get_fd(SOCK_INODE(newsock))) < 0) {
-		sock_release(newsock);
-		return -EINVAL;
-	}
+	if (!(sock->aconn = newsock->next))
+		sock->aconn_tail = NULL;
+	newsock->next = NULL;
+	sock->qlen--;
+	if (sock->iconn)
+		sock_wake_up(sock->iconn);
 
 	/*
-	 * great. finish the connection relative to server and client,
-	 * wake up the client and return the new fd to the server
+	 * getting a descriptor can sleep. if it fails, the connection
+	 * goes back at the head of the queue.
 	 */
-	sock->iconn = clientsock->next;
-	clientsock->next = NULL;
-	newsock->conn = clientsock;
-	clientsock->conn = newsock;
-	clientsock->state = SS_CONNECTED;
-	newsock->state = SS_CONNECTED;
-	newsock->ops->accept(sock, newsock);
-	PRINTK("sys_accept: connected socket 0x%x via 0x%x to 0x%x\n",
-	       sock, newsock, clientsock);
+	if ((fd = get_fd(SOCK_INODE(newsock))) < 0) {
+		if (!(newsock->next = sock->aconn))
+			sock->aconn_tail = newsock;
+		sock->aconn = newsock;
+		sock->qlen++;
+		return fd;
+	}
+	PRINTK("sys_accept: accepted socket 0x%x via 0x%x\n", newsock, sock);
 	if (upeer_sockaddr)
 		newsock->ops->getname(newsock, upeer_sockaddr,
 				      upeer_addrlen, 1);
-	wake_up(clientsock->wait);
-
 	return fd;
 }
 
@@ -635,16 +771,18 @@ static int
 sock_connect(int fd, struct sockaddr *uservaddr, int addrlen)
 {
 	struct socket *sock;
+	struct file *file;
 	int i;
 
 	PRINTK("sys_connect: fd = %d\n", fd);
-	if (!(sock = sockfd_lookup(fd, NULL)))
+	if (!(sock = sockfd_lookup(fd, &file)))
 		return -EBADF;
 	if (sock->state != SS_UNCONNECTED) {
 		PRINTK("sys_connect: socket not unconnected\n");
 		return -EINVAL;
 	}
-	if ((i = sock->ops->connect(sock, uservaddr, addrlen)) < 0) {
+	if ((i = sock->ops->connect(sock, uservaddr, addrlen,
+				    file->f_flags)) < 0) {
 		PRINTK("sys_connect: connect failed\n");
 		return i;
 	}
@@ -673,6 +811,179 @@ sock_getpeername(int fd, struct sockaddr *usockaddr, int *usockaddr_len)
 	return sock->ops->getname(sock, usockaddr, usockaddr_len, 1);
 }
 
+/*
+ * send and receive, with an optional address. these go through the
+ * protocol's sendmsg/recvmsg, so datagrams keep their boundaries.
+ */
+static int
+sock_sendto(int fd, void *buff, int len, unsigned int flags,
+	    struct sockaddr *addr, int addr_len)
+{
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov;
+
+	PRINTK("sys_sendto: fd = %d, len = %d\n", fd, len);
+	if (!(sock = sockfd_lookup(fd, &file)))
+		return -EBADF;
+	if (len < 0 || (flags & ~MSG_DONTWAIT))
+		return -EINVAL;
+	if (sock->flags & SO_ACCEPTCON)
+		return -EINVAL;
+	if (!sock->ops->sendmsg)
+		return -EINVAL;
+	iov.iov_base = buff;
+	iov.iov_len = len;
+	msg.msg_name = addr;
+	msg.msg_namelen = addr ? addr_len : 0;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_flags = 0;
+	return sock->ops->sendmsg(sock, &msg,
+		(file->f_flags & O_NONBLOCK) || (flags & MSG_DONTWAIT));
+}
+
+static int
+sock_recvfrom(int fd, void *buff, int len, unsigned int flags,
+	      struct sockaddr *addr, int *addr_len)
+{
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov;
+	int i;
+
+	PRINTK("sys_recvfrom: fd = %d, len = %d\n", fd, len);
+	if (!(sock = sockfd_lookup(fd, &file)))
+		return -EBADF;
+	if (len < 0 || (flags & ~MSG_DONTWAIT))
+		return -EINVAL;
+	if (sock->flags & SO_ACCEPTCON)
+		return -EINVAL;
+	if (!sock->ops->recvmsg)
+		return -EINVAL;
+	verify_area(buff, len);
+	iov.iov_base = buff;
+	iov.iov_len = len;
+	msg.msg_name = addr;
+	msg.msg_namelen = 0;
+	if (addr) {
+		verify_area(addr_len, sizeof(*addr_len));
+		msg.msg_namelen = get_fs_long((unsigned long *)addr_len);
+	}
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_flags = 0;
+	i = sock->ops->recvmsg(sock, &msg,
+		(file->f_flags & O_NONBLOCK) || (flags & MSG_DONTWAIT));
+	if (i >= 0 && addr)
+		put_fs_long(msg.msg_namelen, (unsigned long *)addr_len);
+	return i;
+}
+
+/*
+ * sendmsg and recvmsg copy the header and the iovec in; the name and
+ * ancillary data are left to the protocol.
+ */
+static int
+sock_sendmsg(int fd, struct msghdr *umsg, unsigned int flags)
+{
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov[UIO_MAXIOV];
+	int i;
+
+	PRINTK("sys_sendmsg: fd = %d\n", fd);
+	if (!(sock = sockfd_lookup(fd, &file)))
+		return -EBADF;
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+	if (sock->flags & SO_ACCEPTCON)
+		return -EINVAL;
+	if (!sock->ops->sendmsg)
+		return -EINVAL;
+	verify_area(umsg, sizeof(msg));
+	memcpy_fromfs(&msg, umsg, sizeof(msg));
+	if ((i = get_iovec(iov, msg.msg_iov, msg.msg_iovlen, WRITE)) < 0)
+		return i;
+	msg.msg_iov = iov;
+	msg.msg_flags = 0;
+	return sock->ops->sendmsg(sock, &msg,
+		(file->f_flags & O_NONBLOCK) || (flags & MSG_DONTWAIT));
+}
+
+static int
+sock_recvmsg(int fd, struct msghdr *umsg, unsigned int flags)
+{
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov[UIO_MAXIOV];
+	int i;
+
+	PRINTK("sys_recvmsg: fd = %d\n", fd);
+	if (!(sock = sockfd_lookup(fd, &file)))
+		return -EBADF;
+	if (flags & ~MSG_DONTWAIT)
+		return -EINVAL;
+	if (sock->flags & SO_ACCEPTCON)
+		return -EINVAL;
+	if (!sock->ops->recvmsg)
+		return -EINVAL;
+	verify_area(umsg, sizeof(msg));
+	memcpy_fromfs(&msg, umsg, sizeof(msg));
+	if ((i = get_iovec(iov, msg.msg_iov, msg.msg_iovlen, READ)) < 0)
+		return i;
+	msg.msg_iov = iov;
+	msg.msg_flags = 0;
+	i = sock->ops->recvmsg(sock, &msg,
+		(file->f_flags & O_NONBLOCK) || (flags & MSG_DONTWAIT));
+	if (i >= 0) {
+		put_fs_long(msg.msg_namelen, (unsigned long *)&umsg->msg_namelen);
+		put_fs_long(msg.msg_controllen,
+			    (unsigned long *)&umsg->msg_controllen);
+		put_fs_long(msg.msg_flags, (unsigned long *)&umsg->msg_flags);
+	}
+	return i;
+}
+
+/*
+ * socket options are all up to the protocol.
+ */
+static int
+sock_setsockopt(int fd, int level, int optname, char *optval, int optlen)
+{
+	struct socket *sock;
+
+	PRINTK("sys_setsockopt: fd = %d, level = %d, optname = %d\n",
+	       fd, level, optname);
+	if (!(sock = sockfd_lookup(fd, NULL)))
+		return -EBADF;
+	if (!sock->ops->setsockopt)
+		return -ENOPROTOOPT;
+	return sock->ops->setsockopt(sock, level, optname, optval, optlen);
+}
+
+static int
+sock_getsockopt(int fd, int level, int optname, char *optval, int *optlen)
+{
+	struct socket *sock;
+
+	PRINTK("sys_getsockopt: fd = %d, level = %d, optname = %d\n",
+	       fd, level, optname);
+	if (!(sock = sockfd_lookup(fd, NULL)))
+		return -EBADF;
+	if (!sock->ops->getsockopt)
+		return -ENOPROTOOPT;
+	return sock->ops->getsockopt(sock, level, optname, optval, optlen);
+}
+
 /*
  * system call vectors. since i want to rewrite sockets as streams, we have
  * this level of indirection. not a lot of overhead, since more of the work is
@@ -730,6 +1041,66 @@ sys_socketcall(int call, unsigned long *args)
 				       get_fs_long(args+2),
 				       (int *)get_fs_long(args+3));
 
+	case SYS_SEND:
+		verify_area(args, 4 * sizeof(long));
+		return sock_sendto(get_fs_long(args+0),
+				   (void *)get_fs_long(args+1),
+				   get_fs_long(args+2),
+				   get_fs_long(args+3), NULL, 0);
+
+	case SYS_RECV:
+		verify_area(args, 4 * sizeof(long));
+		return sock_recvfrom(get_fs_long(args+0),
+				     (void *)get_fs_long(args+1),
+				     get_fs_long(args+2),
+				     get_fs_long(args+3), NULL, NULL);
+
+	case SYS_SENDTO:
+		verify_area(args, 6 * sizeof(long));
+		return sock_sendto(get_fs_long(args+0),
+				   (void *)get_fs_long(args+1),
+				   get_fs_long(args+2),
+				   get_fs_long(args+3),
+				   (struct sockaddr *)get_fs_long(args+4),
+				   get_fs_long(args+5));
+
+	case SYS_RECVFROM:
+		verify_area(args, 6 * sizeof(long));
+		return sock_recvfrom(get_fs_long(args+0),
+				     (void *)get_fs_long(args+1),
+				     get_fs_long(args+2),
+				     get_fs_long(args+3),
+				     (struct sockaddr *)get_fs_long(args+4),
+				     (int *)get_fs_long(args+5));
+
+	case SYS_SETSOCKOPT:
+		verify_area(args, 5 * sizeof(long));
+		return sock_setsockopt(get_fs_long(args+0),
+				       get_fs_long(args+1),
+				       get_fs_long(args+2),
+				       (char *)get_fs_long(args+3),
+				       get_fs_long(args+4));
+
+	case SYS_GETSOCKOPT:
+		verify_area(args, 5 * sizeof(long));
+		return sock_getsockopt(get_fs_long(args+0),
+				       get_fs_long(args+1),
+				       get_fs_long(args+2),
+				       (char *)get_fs_long(args+3),
+				       (int *)get_fs_long(args+4));
+
+	case SYS_SENDMSG:
+		verify_area(args, 3 * sizeof(long));
+		return sock_sendmsg(get_fs_long(args+0),
+				    (struct msghdr *)get_fs_long(args+1),
+				    get_fs_long(args+2));
+
+	case SYS_RECVMSG:
+		verify_area(args, 3 * sizeof(long));
+		return sock_recvmsg(get_fs_long(args+0),
+				    (struct msghdr *)get_fs_long(args+1),
+				    get_fs_long(args+2));
+
 	default:
 		return -EINVAL;
 	}
@@ -738,11 +1109,8 @@ sys_socketcall(int call, unsigned long *args)
 void
 sock_init(void)
 {
-	struct socket *sock;
 	int i, ok;
 
-	for (sock = sockets; sock <= last_socket; ++sock)
-		sock->state = SS_FREE;
 	for (i = ok = 0; i < NPROTO; ++i) {
 		printk("sock_init: initializing family %d (%s)\n",
 		       proto_table[i].family, proto_table[i].name);
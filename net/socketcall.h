@@ -9,5 +9,13 @@
 #define SYS_GETSOCKNAME 6
 #define SYS_GETPEERNAME 7
 #define SYS_SOCKETPAIR 8
+#define SYS_SEND 9
+#define SYS_RECV 10
+#define SYS_SENDTO 11
+#define SYS_RECVFROM 12
+#define SYS_SETSOCKOPT 14
+#define SYS_GETSOCKOPT 15
+#define SYS_SENDMSG 16
+#define SYS_RECVMSG 17
 
-#endif _SOCKETCALL_
+#endif /* _SOCKETCALL_ */
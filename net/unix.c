@@ -12,30 +12,73 @@
 #include <termios.h>
 #include "kern_sock.h"
 
-static struct unix_proto_data {
+struct unix_proto_data {
 	int refcnt;			/* cnt of reference 0=free */
 	struct socket *socket;		/* socket we're bound to */
 	int protocol;
 	struct sockaddr_un sockaddr_un;
 	short sockaddr_len;		/* >0 if name bound */
-	char *buf;
-	int bp_head, bp_tail;
+	struct sock_ring ring;		/* stream data, and buffer sizes */
 	struct inode *inode;
 	struct unix_proto_data *peerupd;
-} unix_datas[NSOCKETS];
-#define last_unix_data (unix_datas + NSOCKETS - 1)
+	struct unix_proto_data *hnext;	/* bound name hash chain */
+	struct unix_rights *rights;	/* descriptors sent with stream data */
+	unsigned long rd_seq;		/* stream bytes read so far */
+	struct unix_msg *mq_head;	/* datagram/seqpacket queue */
+	struct unix_msg *mq_tail;
+	int mq_bytes;
+};
+
+/*
+ * datagram and seqpacket sockets don't use the byte ring: each send is
+ * copied whole into a message and queued on the receiver, so a recv
+ * never sees more or less than one send. messages come from malloc, so
+ * they can't be larger than a page.
+ */
+struct unix_msg {
+	struct unix_msg *next;
+	struct unix_proto_data *from;	/* sender, ref'd for its name */
+	struct unix_rights *rights;
+	int len;
+	char data[1];
+};
+
+#define UN_MSG_SIZE(LEN) (sizeof(struct unix_msg) - 1 + (LEN))
+#define UN_MSG_MAX (PAGE_SIZE - sizeof(struct unix_msg) + 1)
+#define UN_MSG_LIMIT (4*PAGE_SIZE)	/* queued bytes before senders block */
+
+/*
+ * descriptors passed with SCM_RIGHTS. while in flight we hold a
+ * reference to each file. a message carries its own; on a stream they
+ * are queued on the receiver, tagged with the position of the data they
+ * were sent with, and a read doesn't go past the next batch.
+ */
+#define UN_MAX_RIGHTS 16
+
+struct unix_rights {
+	struct unix_rights *next;
+	unsigned long seq;		/* stream position */
+	int nr;
+	struct file *fp[UN_MAX_RIGHTS];
+};
+
+/*
+ * bound names are hashed, so connect doesn't have to look at every
+ * socket in the system.
+ */
+#define UNIX_HASH_SIZE 64
+static struct unix_proto_data *unix_hash[UNIX_HASH_SIZE];
 
 #define UN_DATA(SOCK) ((struct unix_proto_data *)(SOCK)->data)
 #define UN_PATH_OFFSET ((unsigned long)((struct sockaddr_un *)0)->sun_path)
 
 /*
- * buffer size must be power of 2. buffer mgmt inspired by pipe code.
- * note that buffer contents can wraparound, and we can write one byte less
- * than full size to discern full vs empty.
+ * stream data goes in the receiver's ring (see sock_ring.c), a page
+ * of it unless asked for more. message sockets only use the ring's
+ * buffer sizes, as the limit on what may be queued.
  */
-#define BUF_SIZE PAGE_SIZE
-#define UN_BUF_AVAIL(UPD) (((UPD)->bp_head - (UPD)->bp_tail) & (BUF_SIZE-1))
-#define UN_BUF_SPACE(UPD) ((BUF_SIZE-1) - UN_BUF_AVAIL(UPD))
+#define UN_BUF_DEFAULT PAGE_SIZE
+#define UN_WANT(DEST,SRC) RING_WANT(&(DEST)->ring, &(SRC)->ring)
 
 static int unix_proto_init(void);
 static int unix_proto_create(struct socket *sock, int protocol);
@@ -44,7 +87,7 @@ static int unix_proto_release(struct socket *sock, struct socket *peer);
 static int unix_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
 			   int sockaddr_len);
 static int unix_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
-			      int sockaddr_len);
+			      int sockaddr_len, int flags);
 static int unix_proto_socketpair(struct socket *sock1, struct socket *sock2);
 static int unix_proto_accept(struct socket *sock, struct socket *newsock);
 static int unix_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
@@ -56,6 +99,18 @@ static int unix_proto_write(struct socket *sock, char *ubuf, int size,
 static int unix_proto_select(struct socket *sock, int which);
 static int unix_proto_ioctl(struct socket *sock, unsigned int cmd,
 			    unsigned long arg);
+static int unix_proto_readv(struct socket *sock, struct iovec *iov, int nr,
+			    int nonblock);
+static int unix_proto_writev(struct socket *sock, struct iovec *iov, int nr,
+			     int nonblock);
+static int unix_proto_sendmsg(struct socket *sock, struct msghdr *msg,
+			      int nonblock);
+static int unix_proto_recvmsg(struct socket *sock, struct msghdr *msg,
+			      int nonblock);
+static int unix_proto_setsockopt(struct socket *sock, int level, int optname,
+				 char *optval, int optlen);
+static int unix_proto_getsockopt(struct socket *sock, int level, int optname,
+				 char *optval, int *optlen);
 
 struct proto_ops unix_proto_ops = {
 	unix_proto_init,
@@ -70,7 +125,13 @@ struct proto_ops unix_proto_ops = {
 	unix_proto_read,
 	unix_proto_write,
 	unix_proto_select,
-	unix_proto_ioctl
+	unix_proto_ioctl,
+	unix_proto_readv,
+	unix_proto_writev,
+	unix_proto_sendmsg,
+	unix_proto_recvmsg,
+	unix_proto_setsockopt,
+	unix_proto_getsockopt
 };
 
 #ifdef SOCK_DEBUG
@@ -93,12 +154,24 @@ sockaddr_un_printk(struct sockaddr_un *sockun, int sockaddr_len)
 }
 #endif
 
+static inline int
+unix_hashfn(struct sockaddr_un *sockun, int sockaddr_len)
+{
+	unsigned char *p = (unsigned char *) sockun->sun_path;
+	unsigned int hash = 0;
+
+	for (sockaddr_len -= UN_PATH_OFFSET; sockaddr_len > 0; --sockaddr_len)
+		hash = (hash << 3) + (hash >> 28) + *p++;
+	return hash % UNIX_HASH_SIZE;
+}
+
 static struct unix_proto_data *
 unix_data_lookup(struct sockaddr_un *sockun, int sockaddr_len)
 {
 	struct unix_proto_data *upd;
 
-	for (upd = unix_datas; upd <= last_unix_data; ++upd) {
+	upd = unix_hash[unix_hashfn(sockun, sockaddr_len)];
+	for ( ; upd; upd = upd->hnext) {
 		if (upd->refcnt && upd->socket &&
 		    upd->sockaddr_len == sockaddr_len &&
 		    memcmp(&upd->sockaddr_un, sockun, sockaddr_len) == 0)
@@ -107,27 +180,50 @@ unix_data_lookup(struct sockaddr_un *sockun, int sockaddr_len)
 	return NULL;
 }
 
+static void
+unix_hash_insert(struct unix_proto_data *upd)
+{
+	struct unix_proto_data **p;
+
+	p = unix_hash + unix_hashfn(&upd->sockaddr_un, upd->sockaddr_len);
+	upd->hnext = *p;
+	*p = upd;
+}
+
+static void
+unix_hash_remove(struct unix_proto_data *upd)
+{
+	struct unix_proto_data **p;
+
+	p = unix_hash + unix_hashfn(&upd->sockaddr_un, upd->sockaddr_len);
+	for ( ; *p; p = &(*p)->hnext)
+		if (*p == upd) {
+			*p = upd->hnext;
+			break;
+		}
+	upd->hnext = NULL;
+}
+
 static struct unix_proto_data *
 unix_data_alloc(void)
 {
 	struct unix_proto_data *upd;
 
-	cli();
-	for (upd = unix_datas; upd <= last_unix_data; ++upd) {
-		if (!upd->refcnt) {
-			upd->refcnt = 1;
-			sti();
-			upd->socket = NULL;
-			upd->sockaddr_len = 0;
-			upd->buf = NULL;
-			upd->bp_head = upd->bp_tail = 0;
-			upd->inode = NULL;
-			upd->peerupd = NULL;
-			return upd;
-		}
-	}
-	sti();
-	return NULL;
+	upd = (struct unix_proto_data *) malloc(sizeof(*upd));
+	if (!upd)
+		return NULL;
+	upd->refcnt = 1;
+	upd->socket = NULL;
+	upd->sockaddr_len = 0;
+	ring_init(&upd->ring, UN_BUF_DEFAULT);
+	upd->inode = NULL;
+	upd->peerupd = NULL;
+	upd->hnext = NULL;
+	upd->rights = NULL;
+	upd->rd_seq = 0;
+	upd->mq_head = upd->mq_tail = NULL;
+	upd->mq_bytes = 0;
+	return upd;
 }
 
 static inline void
@@ -142,18 +238,169 @@ unix_data_deref(struct unix_proto_data *upd)
 {
 	if (upd->refcnt == 1) {
 		PRINTK("unix_data_deref: releasing data 0x%x\n", upd);
-		if (upd->buf) {
-			free_page((unsigned long)upd->buf);
-			upd->buf = NULL;
-			upd->bp_head = upd->bp_tail = 0;
-		}
+		ring_free(&upd->ring);
+		free_s(upd, sizeof(*upd));
+		return;
 	}
 	--upd->refcnt;
 }
 
+static void
+unix_rights_free(struct unix_rights *r)
+{
+	while (r->nr)
+		close_fp(r->fp[--r->nr]);
+	free_s(r, sizeof(*r));
+}
+
+static void
+unix_msg_free(struct unix_msg *msg)
+{
+	if (msg->from)
+		unix_data_deref(msg->from);
+	if (msg->rights)
+		unix_rights_free(msg->rights);
+	free_s(msg, UN_MSG_SIZE(msg->len));
+}
+
 /*
- * upon a create, we allocate an empty protocol data, and grab a page to
- * buffer writes
+ * a socket holds references to the descriptors queued on it, so two
+ * sockets in flight to each other would never be freed. rather than
+ * look for such cycles, we refuse to send the destination itself, or
+ * a unix socket that has descriptors queued: then none can form.
+ */
+static int
+unix_rights_busy(struct file *file, struct unix_proto_data *dest)
+{
+	struct inode *inode = file->f_inode;
+	struct unix_proto_data *upd;
+	struct unix_msg *msg;
+
+	if (!inode || !inode->i_sock ||
+	    SOCKET_I(inode)->ops != &unix_proto_ops ||
+	    !(upd = UN_DATA(SOCKET_I(inode))))
+		return 0;
+	if (upd == dest || upd->rights)
+		return 1;
+	for (msg = upd->mq_head; msg; msg = msg->next)
+		if (msg->rights)
+			return 1;
+	return 0;
+}
+
+/*
+ * pick the SCM_RIGHTS descriptors out of the sender's ancillary data
+ * and take a reference to each file. nothing else is understood.
+ */
+static int
+unix_get_rights(struct msghdr *mh, struct unix_proto_data *dest,
+		struct unix_rights **rp)
+{
+	struct unix_rights *r = NULL;
+	struct cmsghdr cmsg;
+	struct file *file;
+	char *p = mh->msg_control;
+	int left = mh->msg_controllen;
+	int i, n, fd, error;
+
+	*rp = NULL;
+	if (!p || left <= 0)
+		return 0;
+	verify_area(p, left);
+	while (left >= (int) sizeof(cmsg)) {
+		memcpy_fromfs(&cmsg, p, sizeof(cmsg));
+		error = -EINVAL;
+		if (cmsg.cmsg_len < (int) sizeof(cmsg) || cmsg.cmsg_len > left)
+			goto bad;
+		if (cmsg.cmsg_level != SOL_SOCKET ||
+		    cmsg.cmsg_type != SCM_RIGHTS)
+			goto bad;
+		n = (cmsg.cmsg_len - sizeof(cmsg)) / sizeof(int);
+		if (!r) {
+			error = -ENOMEM;
+			if (!(r = (struct unix_rights *) malloc(sizeof(*r))))
+				goto bad;
+			r->next = NULL;
+			r->seq = 0;
+			r->nr = 0;
+		}
+		error = -EINVAL;
+		if (r->nr + n > UN_MAX_RIGHTS)
+			goto bad;
+		for (i = 0; i < n; ++i) {
+			fd = get_fs_long((unsigned long *)CMSG_DATA(p) + i);
+			error = -EBADF;
+			if (fd < 0 || fd >= current->max_fds ||
+			    !(file = current->filp[fd]))
+				goto bad;
+			error = -ETOOMANYREFS;
+			if (unix_rights_busy(file, dest))
+				goto bad;
+			file->f_count++;
+			r->fp[r->nr++] = file;
+		}
+		i = CMSG_ALIGN(cmsg.cmsg_len);
+		p += i;
+		left -= i;
+	}
+	*rp = r;
+	return 0;
+
+bad:
+	if (r)
+		unix_rights_free(r);
+	return error;
+}
+
+/*
+ * install received descriptors in the reader's table and tell it about
+ * them. the files that don't fit, or without mh to put them in, are
+ * closed and MSG_CTRUNC is set.
+ */
+static void
+unix_put_rights(struct msghdr *mh, struct unix_rights *r)
+{
+	struct cmsghdr cmsg;
+	int i, n, fd;
+
+	if (!mh) {
+		if (r)
+			unix_rights_free(r);
+		return;
+	}
+	n = 0;
+	if (r && mh->msg_control && mh->msg_controllen >= CMSG_LEN(sizeof(int))) {
+		if ((n = (mh->msg_controllen - sizeof(cmsg)) / sizeof(int)) > r->nr)
+			n = r->nr;
+		verify_area(mh->msg_control, CMSG_LEN(n * sizeof(int)));
+	}
+	for (i = 0; i < n; ++i) {
+		if ((fd = get_unused_fd()) < 0)
+			break;
+		current->filp[fd] = r->fp[i];
+		r->fp[i] = NULL;
+		put_fs_long(fd, (unsigned long *)CMSG_DATA(mh->msg_control) + i);
+	}
+	mh->msg_controllen = 0;
+	if (i) {
+		cmsg.cmsg_len = CMSG_LEN(i * sizeof(int));
+		cmsg.cmsg_level = SOL_SOCKET;
+		cmsg.cmsg_type = SCM_RIGHTS;
+		memcpy_tofs(mh->msg_control, &cmsg, sizeof(cmsg));
+		mh->msg_controllen = cmsg.cmsg_len;
+	}
+	if (!r)
+		return;
+	if (i < r->nr)
+		mh->msg_flags |= MSG_CTRUNC;
+	while (r->nr > i)
+		close_fp(r->fp[--r->nr]);
+	free_s(r, sizeof(*r));
+}
+
+/*
+ * upon a create, we allocate an empty protocol data, and for stream
+ * sockets grab a page to buffer writes
  */
 static int
 unix_proto_create(struct socket *sock, int protocol)
@@ -165,18 +412,26 @@ unix_proto_create(struct socket *sock, int protocol)
 		PRINTK("unix_proto_create: protocol != 0\n");
 		return -EINVAL;
 	}
+	if (sock->type != SOCK_STREAM && sock->type != SOCK_DGRAM &&
+	    sock->type != SOCK_SEQPACKET) {
+		PRINTK("unix_proto_create: bad type %d\n", sock->type);
+		return -EINVAL;
+	}
 	if (!(upd = unix_data_alloc())) {
 		printk("unix_proto_create: can't allocate buffer\n");
 		return -ENOMEM;
 	}
-	if (!(upd->buf = (char *)get_free_page())) {
+	if (sock->type == SOCK_STREAM &&
+	    !(upd->ring.buf[0] = (char *)get_free_page())) {
 		printk("unix_proto_create: can't get page!\n");
 		unix_data_deref(upd);
 		return -ENOMEM;
 	}
+	if (sock->type != SOCK_STREAM)
+		upd->ring.rcvbuf = UN_MSG_LIMIT;
 	upd->protocol = protocol;
 	upd->socket = sock;
-	UN_DATA(sock) = upd;
+	sock->data = (char *) upd;
 	PRINTK("unix_proto_create: allocated data 0x%x\n", upd);
 	return 0;
 }
@@ -184,9 +439,16 @@ unix_proto_create(struct socket *sock, int protocol)
 static int
 unix_proto_dup(struct socket *newsock, struct socket *oldsock)
 {
-	struct unix_proto_data *upd = UN_DATA(oldsock);
+	struct unix_proto_data *upd = UN_DATA(oldsock), *newupd;
+	int i;
 
-	return unix_proto_create(newsock, upd->protocol);
+	if ((i = unix_proto_create(newsock, upd->protocol)) < 0)
+		return i;
+	newupd = UN_DATA(newsock);
+	newupd->ring.sndbuf = upd->ring.sndbuf;
+	newupd->ring.rcvbuf = upd->ring.rcvbuf;
+	newupd->ring.rcvlowat = newupd->ring.rd_want = upd->ring.rcvlowat;
+	return 0;
 }
 
 static int
@@ -208,8 +470,25 @@ unix_proto_release(struct socket *sock, struct socket *peer)
 		iput(upd->inode);
 		upd->inode = NULL;
 	}
-	UN_DATA(sock) = NULL;
+	if (upd->sockaddr_len)
+		unix_hash_remove(upd);
+	sock->data = NULL;
 	upd->socket = NULL;
+	while (upd->mq_head) {
+		struct unix_msg *msg = upd->mq_head;
+
+		upd->mq_head = msg->next;
+		unix_msg_free(msg);
+	}
+	upd->mq_tail = NULL;
+	upd->mq_bytes = 0;
+	while (upd->rights) {
+		struct unix_rights *r = upd->rights;
+
+		upd->rights = r->next;
+		unix_rights_free(r);
+	}
+	sock_wake_up(sock);		/* senders blocked on our queue */
 	if (upd->peerupd)
 		unix_data_deref(upd->peerupd);
 	unix_data_deref(upd);
@@ -267,6 +546,7 @@ unix_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
 	}
 
 	upd->sockaddr_len = sockaddr_len;	/* now its legal */
+	unix_hash_insert(upd);
 	PRINTK("unix_proto_bind: bound socket address: ");
 #ifdef SOCK_DEBUG
 	sockaddr_un_printk(&upd->sockaddr_un, upd->sockaddr_len);
@@ -280,7 +560,7 @@ unix_proto_bind(struct socket *sock, struct sockaddr *umyaddr,
  */
 static int
 unix_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
-		   int sockaddr_len)
+		   int sockaddr_len, int flags)
 {
 	int i;
 	struct unix_proto_data *serv_upd;
@@ -304,7 +584,22 @@ unix_proto_connect(struct socket *sock, struct sockaddr *uservaddr,
 		PRINTK("unix_proto_connect: can't locate peer\n");
 		return -EINVAL;
 	}
-	if ((i = sock_awaitconn(sock, serv_upd->socket)) < 0) {
+	if (serv_upd->socket->type != sock->type) {
+		PRINTK("unix_proto_connect: peer has type %d\n",
+		       serv_upd->socket->type);
+		return -EPROTOTYPE;
+	}
+	/*
+	 * a datagram connect only sets the default destination.
+	 */
+	if (sock->type == SOCK_DGRAM) {
+		if (UN_DATA(sock)->peerupd)
+			unix_data_deref(UN_DATA(sock)->peerupd);
+		unix_data_ref(serv_upd);
+		UN_DATA(sock)->peerupd = serv_upd;
+		return 0;
+	}
+	if ((i = sock_awaitconn(sock, serv_upd->socket, flags)) < 0) {
 		PRINTK("unix_proto_connect: can't await connection\n");
 		return i;
 	}
@@ -356,7 +651,11 @@ unix_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
 
 	PRINTK("unix_proto_getname: socket 0x%x for %s\n", sock,
 	       peer ? "peer" : "self");
-	if (peer) {
+	if (peer && sock->type == SOCK_DGRAM) {
+		if (!(upd = UN_DATA(sock)->peerupd))
+			return -ENOTCONN;
+	}
+	else if (peer) {
 		if (sock->state != SS_CONNECTED) {
 			PRINTK("unix_proto_getname: socket not connected\n");
 			return -EINVAL;
@@ -366,7 +665,7 @@ unix_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
 	else
 		upd = UN_DATA(sock);
 	verify_area(usockaddr_len, sizeof(*usockaddr_len));
-	if ((len = get_fs_long(usockaddr_len)) <= 0)
+	if ((len = get_fs_long((unsigned long *)usockaddr_len)) <= 0)
 		return -EINVAL;
 	if (len > upd->sockaddr_len)
 		len = upd->sockaddr_len;
@@ -374,196 +673,399 @@ unix_proto_getname(struct socket *sock, struct sockaddr *usockaddr,
 		verify_area(usockaddr, len);
 		memcpy_tofs(usockaddr, &upd->sockaddr_un, len);
 	}
-	put_fs_long(len, usockaddr_len);
+	put_fs_long(len, (unsigned long *)usockaddr_len);
 	return 0;
 }
 
 /*
- * we read from our own buf.
+ * queue one message on the destination: the socket we're connected to,
+ * or the one named in mh. a datagram socket may name another socket
+ * even when connected, which only sets its default; a seqpacket socket
+ * can't name any. the data is copied before we look for room, so the
+ * message is delivered all at once or not at all.
  */
 static int
-unix_proto_read(struct socket *sock, char *ubuf, int size, int nonblock)
+unix_msg_send(struct socket *sock, struct iovec *iov, int nr,
+	      struct msghdr *mh, int nonblock)
 {
-	struct unix_proto_data *upd;
-	int todo, avail;
+	struct unix_proto_data *upd = UN_DATA(sock), *dest;
+	struct sockaddr_un sockun;
+	struct sockaddr *uaddr = mh ? mh->msg_name : NULL;
+	int sockaddr_len = mh ? mh->msg_namelen : 0;
+	struct unix_msg *msg;
+	int len, error;
 
-	if ((todo = size) <= 0)
-		return 0;
-	upd = UN_DATA(sock);
-	while (!(avail = UN_BUF_AVAIL(upd))) {
-		if (sock->state != SS_CONNECTED) {
-			PRINTK("unix_proto_read: socket not connected\n");
-			return (sock->state == SS_DISCONNECTING) ? 0 : -EINVAL;
-		}
-		PRINTK("unix_proto_read: no data available...\n");
-		if (nonblock)
-			return -EAGAIN;
-		interruptible_sleep_on(sock->wait);
-		if (current->signal & ~current->blocked) {
-			PRINTK("unix_proto_read: interrupted\n");
-			return -ERESTARTSYS;
-		}
+	if ((len = iov_length(iov, nr)) < 0)
+		return -EINVAL;
+	if (len > UN_MSG_MAX)
+		return -EMSGSIZE;
+	if (sock->type == SOCK_SEQPACKET && sock->state != SS_CONNECTED) {
 		if (sock->state == SS_DISCONNECTING) {
-			PRINTK("unix_proto_read: disconnected\n");
-			return 0;
+			send_sig(SIGPIPE,current,1);
+			return -EPIPE;
 		}
+		return -ENOTCONN;
+	}
+	if (uaddr) {
+		if (sock->type != SOCK_DGRAM)
+			return -EISCONN;
+		if (sockaddr_len <= UN_PATH_OFFSET ||
+		    sockaddr_len >= sizeof(struct sockaddr_un))
+			return -EINVAL;
+		verify_area(uaddr, sockaddr_len);
+		memcpy_fromfs(&sockun, uaddr, sockaddr_len);
+		if (sockun.sun_family != AF_UNIX)
+			return -EINVAL;
+		if (!(dest = unix_data_lookup(&sockun, sockaddr_len)))
+			return -ECONNREFUSED;
+		if (dest->socket->type != SOCK_DGRAM)
+			return -EPROTOTYPE;
 	}
+	else if (!(dest = upd->peerupd))
+		return -EDESTADDRREQ;
+	unix_data_ref(dest);		/* we may sleep */
 
-	/*
-	 * copy from the read buffer into the user's buffer, watching for
-	 * wraparound. then we wake up the writer
-	 */
-	do {
-		int part, cando;
+	if (!(msg = (struct unix_msg *) malloc(UN_MSG_SIZE(len)))) {
+		unix_data_deref(dest);
+		return -ENOMEM;
+	}
+	msg->next = NULL;
+	msg->len = len;
+	msg->from = upd;
+	unix_data_ref(upd);
+	msg->rights = NULL;
+	if (mh && (error = unix_get_rights(mh, dest, &msg->rights)) < 0)
+		goto out;
+	memcpy_fromiovec(msg->data, iov, len);
 
-		if (avail <= 0) {
-			PRINTK("unix_proto_read: AVAIL IS NEGATIVE!!!\n");
-			send_sig(SIGKILL,current,1);
-			return -EINTR;
+	for (;;) {
+		if (!dest->socket || (sock->type == SOCK_SEQPACKET &&
+				      sock->state != SS_CONNECTED)) {
+			PRINTK("unix_msg_send: destination gone\n");
+			if (sock->type == SOCK_DGRAM) {
+				error = -ECONNREFUSED;
+				goto out;
+			}
+			send_sig(SIGPIPE,current,1);
+			error = -EPIPE;
+			goto out;
+		}
+		if (!dest->mq_head ||
+		    dest->mq_bytes + len <= UN_WANT(dest, upd))
+			break;
+		PRINTK("unix_msg_send: queue full...\n");
+		if (nonblock) {
+			error = -EAGAIN;
+			goto out;
 		}
+		interruptible_sleep_on(dest->socket->wait);
+		if (current->signal & ~current->blocked) {
+			error = -ERESTARTSYS;
+			goto out;
+		}
+	}
+	if (dest->mq_tail)
+		dest->mq_tail->next = msg;
+	else
+		dest->mq_head = msg;
+	dest->mq_tail = msg;
+	dest->mq_bytes += len;
+	sock_wake_up(dest->socket);
+	unix_data_deref(dest);
+	return len;
 
-		if ((cando = todo) > avail)
-			cando = avail;
-		if (cando > (part = BUF_SIZE - upd->bp_tail))
-			cando = part;
-		PRINTK("unix_proto_read: avail=%d, todo=%d, cando=%d\n",
-		       avail, todo, cando);
-		verify_area(ubuf, cando);
-		memcpy_tofs(ubuf, upd->buf + upd->bp_tail, cando);
-		upd->bp_tail = (upd->bp_tail + cando) & (BUF_SIZE-1);
-		ubuf += cando;
-		todo -= cando;
-		if (sock->state == SS_CONNECTED)
-			wake_up(sock->conn->wait);
-		avail = UN_BUF_AVAIL(upd);
-	} while (todo && avail);
-	return size - todo;
+out:
+	unix_msg_free(msg);
+	unix_data_deref(dest);
+	return error;
 }
 
 /*
- * we write to our peer's buf. when we connected we ref'd this peer so we
- * are safe that the buffer remains, even after the peer has disconnected,
- * which we check other ways.
+ * take the first message off our queue. if it doesn't fit, the rest is
+ * thrown away and MSG_TRUNC is set. mh, if given, gets the sender's name
+ * and any descriptors.
  */
 static int
-unix_proto_write(struct socket *sock, char *ubuf, int size, int nonblock)
+unix_msg_recv(struct socket *sock, struct iovec *iov, int nr,
+	      struct msghdr *mh, int nonblock)
 {
-	struct unix_proto_data *pupd;
-	int todo, space;
+	struct unix_proto_data *upd = UN_DATA(sock);
+	struct unix_msg *msg;
+	int size, len, clen = 0;
 
-	if ((todo = size) <= 0)
-		return 0;
-	if (sock->state != SS_CONNECTED) {
-		PRINTK("unix_proto_write: socket not connected\n");
-		if (sock->state == SS_DISCONNECTING) {
-			send_sig(SIGPIPE,current,1);
-			return -EINTR;
-		}
+	if ((size = iov_length(iov, nr)) < 0)
 		return -EINVAL;
+	if (mh) {			/* no descriptors, unless we find some */
+		clen = mh->msg_controllen;
+		mh->msg_controllen = 0;
 	}
-	pupd = UN_DATA(sock)->peerupd;	/* safer than sock->conn */
-
-	while (!(space = UN_BUF_SPACE(pupd))) {
-		PRINTK("unix_proto_write: no space left...\n");
+	while (!(msg = upd->mq_head)) {
+		if (sock->type == SOCK_SEQPACKET &&
+		    sock->state != SS_CONNECTED) {
+			PRINTK("unix_msg_recv: socket not connected\n");
+			return (sock->state == SS_DISCONNECTING) ? 0 : -ENOTCONN;
+		}
 		if (nonblock)
 			return -EAGAIN;
 		interruptible_sleep_on(sock->wait);
 		if (current->signal & ~current->blocked) {
-			PRINTK("unix_proto_write: interrupted\n");
+			PRINTK("unix_msg_recv: interrupted\n");
 			return -ERESTARTSYS;
 		}
-		if (sock->state == SS_DISCONNECTING) {
-			PRINTK("unix_proto_write: disconnected (SIGPIPE)\n");
-			send_sig(SIGPIPE,current,1);
-			return -EINTR;
+	}
+	if (!(upd->mq_head = msg->next))
+		upd->mq_tail = NULL;
+	upd->mq_bytes -= msg->len;
+
+	if ((len = msg->len) > size) {
+		len = size;
+		if (mh)
+			mh->msg_flags |= MSG_TRUNC;
+	}
+	memcpy_toiovec(iov, msg->data, len);
+	if (mh) {
+		if (!mh->msg_name || mh->msg_namelen < 0)
+			mh->msg_namelen = 0;
+		if (mh->msg_namelen > msg->from->sockaddr_len)
+			mh->msg_namelen = msg->from->sockaddr_len;
+		if (mh->msg_namelen) {
+			verify_area(mh->msg_name, mh->msg_namelen);
+			memcpy_tofs(mh->msg_name, &msg->from->sockaddr_un,
+				    mh->msg_namelen);
 		}
 	}
+	if (mh)
+		mh->msg_controllen = clen;
+	unix_put_rights(mh, msg->rights);
+	msg->rights = NULL;
+	unix_msg_free(msg);
+	sock_wake_up(sock);		/* there's room for blocked senders */
+	return len;
+}
+
+/*
+ * we read from our own ring. with SO_RCVLOWAT set we sleep until that
+ * much is there (or as much as was asked for). descriptors go with the
+ * first read that gets to their data, and no read goes past the start
+ * of the next batch.
+ */
+static int
+unix_stream_recv(struct socket *sock, struct iovec *iov, int nr,
+		 struct msghdr *mh, int nonblock)
+{
+	struct unix_proto_data *upd;
+	struct unix_rights *r;
+	int size, part, clen = 0;
+
+	if (mh) {			/* no descriptors, unless we find some */
+		clen = mh->msg_controllen;
+		mh->msg_controllen = 0;
+	}
+	if ((size = iov_length(iov, nr)) <= 0)
+		return 0;
+	upd = UN_DATA(sock);
+	if ((part = ring_recv_wait(sock, &upd->ring, size, nonblock)) <= 0)
+		return part;
+	if ((r = upd->rights) && (long)(r->seq - upd->rd_seq) <= 0)
+		upd->rights = r->next;
+	else
+		r = NULL;
+	if (upd->rights &&
+	    (part = upd->rights->seq - upd->rd_seq) > 0 && part < size)
+		size = part;
+	size = ring_recv(&upd->ring, iov, size);
+	upd->rd_seq += size;
+	ring_recv_done(sock, &upd->ring);
+	if (mh)
+		mh->msg_controllen = clen;
+	unix_put_rights(mh, r);
+	return size;
+}
 
+/*
+ * we write to our peer's ring, which we ref'd when we connected.
+ * descriptors are queued on the peer, tagged with where our data
+ * starts.
+ */
+static int
+unix_stream_send(struct socket *sock, struct iovec *iov, int nr,
+		 struct msghdr *mh, int nonblock)
+{
+	struct unix_proto_data *pupd;
+	struct unix_rights *r = NULL, **rp;
+	int size, error;
+
+	if ((size = iov_length(iov, nr)) <= 0)
+		return 0;
+	if (!(pupd = UN_DATA(sock)->peerupd))	/* safer than sock->conn */
+		return -ENOTCONN;
+	error = ring_send_wait(sock, &pupd->ring, &UN_DATA(sock)->ring,
+			       nonblock);
+	if (error < 0)
+		return error;
+	if (mh) {
+		if ((error = unix_get_rights(mh, pupd, &r)) < 0)
+			goto out;
+		if (r) {
+			r->seq = pupd->rd_seq + RING_AVAIL(&pupd->ring);
+			for (rp = &pupd->rights; *rp; rp = &(*rp)->next)
+				;
+			*rp = r;
+		}
+	}
 	/*
-	 * copy from the user's buffer to the write buffer, watching for
-	 * wraparound. then we wake up the reader
+	 * descriptors sent with no data would be handed to whatever read
+	 * gets to the next write, so they go back.
 	 */
-	do {
-		int part, cando;
+	if ((error = ring_send(sock, &pupd->ring, iov, size)) < 0 && r) {
+		for (rp = &pupd->rights; *rp; rp = &(*rp)->next)
+			if (*rp == r) {
+				*rp = r->next;
+				break;
+			}
+		unix_rights_free(r);
+	}
+out:
+	ring_send_done(sock, &pupd->ring);
+	return error;
+}
 
-		if (space <= 0) {
-			PRINTK("unix_proto_write: SPACE IS NEGATIVE!!!\n");
-			send_sig(SIGKILL,current,1);
-			return -EINTR;
-		}
+static int
+unix_proto_readv(struct socket *sock, struct iovec *iov, int nr, int nonblock)
+{
+	if (sock->type != SOCK_STREAM)
+		return unix_msg_recv(sock, iov, nr, NULL, nonblock);
+	return unix_stream_recv(sock, iov, nr, NULL, nonblock);
+}
 
-		/*
-		 * we may become disconnected inside this loop, so watch
-		 * for it (peerupd is safe until we close)
-		 */
-		if (sock->state == SS_DISCONNECTING) {
-			send_sig(SIGPIPE,current,1);
-			return -EINTR;
-		}
-		if ((cando = todo) > space)
-			cando = space;
-		if (cando > (part = BUF_SIZE - pupd->bp_head))
-			cando = part;
-		PRINTK("unix_proto_write: space=%d, todo=%d, cando=%d\n",
-		       space, todo, cando);
-		verify_area(ubuf, cando);
-		memcpy_fromfs(pupd->buf + pupd->bp_head, ubuf, cando);
-		pupd->bp_head = (pupd->bp_head + cando) & (BUF_SIZE-1);
-		ubuf += cando;
-		todo -= cando;
-		if (sock->state == SS_CONNECTED)
-			wake_up(sock->conn->wait);
-		space = UN_BUF_SPACE(pupd);
-	} while (todo && space);
-	return size - todo;
+static int
+unix_proto_writev(struct socket *sock, struct iovec *iov, int nr, int nonblock)
+{
+	if (sock->type != SOCK_STREAM)
+		return unix_msg_send(sock, iov, nr, NULL, nonblock);
+	return unix_stream_send(sock, iov, nr, NULL, nonblock);
 }
 
 static int
-unix_proto_select(struct socket *sock, int which)
+unix_proto_read(struct socket *sock, char *ubuf, int size, int nonblock)
 {
-	struct unix_proto_data *upd, *peerupd;
+	struct iovec iov;
 
-	if (which == SEL_IN) {
-		upd = UN_DATA(sock);
-		PRINTK("unix_proto_select: there is%s data available\n",
-		       UN_BUF_AVAIL(upd) ? "" : " no");
-		if (UN_BUF_AVAIL(upd))	/* even if disconnected */
-			return 1;
-		else if (sock->state != SS_CONNECTED) {
-			PRINTK("unix_proto_select: socket not connected (read EOF)\n");
-			return 1;
-		}
-		else
-			return 0;
+	iov.iov_base = ubuf;
+	iov.iov_len = size;
+	return unix_proto_readv(sock, &iov, 1, nonblock);
+}
+
+static int
+unix_proto_write(struct socket *sock, char *ubuf, int size, int nonblock)
+{
+	struct iovec iov;
+
+	iov.iov_base = ubuf;
+	iov.iov_len = size;
+	return unix_proto_writev(sock, &iov, 1, nonblock);
+}
+
+static int
+unix_proto_sendmsg(struct socket *sock, struct msghdr *msg, int nonblock)
+{
+	if (sock->type == SOCK_STREAM) {
+		if (msg->msg_name)
+			return -EISCONN;
+		return unix_stream_send(sock, msg->msg_iov, msg->msg_iovlen,
+					msg, nonblock);
 	}
+	return unix_msg_send(sock, msg->msg_iov, msg->msg_iovlen, msg,
+			     nonblock);
+}
+
+static int
+unix_proto_recvmsg(struct socket *sock, struct msghdr *msg, int nonblock)
+{
+	if (sock->type == SOCK_STREAM) {
+		msg->msg_namelen = 0;
+		return unix_stream_recv(sock, msg->msg_iov, msg->msg_iovlen,
+					msg, nonblock);
+	}
+	return unix_msg_recv(sock, msg->msg_iov, msg->msg_iovlen, msg,
+			     nonblock);
+}
+
+/*
+ * the message queue versions of select and ioctl. for a datagram socket
+ * without a default destination there's no queue to wait for, so it's
+ * always writable.
+ */
+static int
+unix_msg_select(struct socket *sock, int which)
+{
+	struct unix_proto_data *upd = UN_DATA(sock), *dest;
+	int connected;
+
+	connected = (sock->type == SOCK_DGRAM || sock->state == SS_CONNECTED);
+	if (which == SEL_IN)
+		return upd->mq_head || !connected;
 	if (which == SEL_OUT) {
-		if (sock->state != SS_CONNECTED) {
-			PRINTK("unix_proto_select: socket not connected (write EOF)\n");
+		if (!connected || !(dest = upd->peerupd) || !dest->socket)
 			return 1;
-		}
-		peerupd = UN_DATA(sock->conn);
-		PRINTK("unix_proto_select: there is%s space available\n",
-		       UN_BUF_SPACE(peerupd) ? "" : " no");
-		return (UN_BUF_SPACE(peerupd) > 0);
+		return !dest->mq_head || dest->mq_bytes < UN_WANT(dest, upd);
+	}
+	return 0;
+}
+
+static int
+unix_msg_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
+{
+	struct unix_proto_data *upd = UN_DATA(sock), *dest;
+	int space = 0;
+
+	switch (cmd) {
+	case TIOCINQ:
+		verify_area((void *)arg, sizeof(unsigned long));
+		put_fs_long(upd->mq_head ? upd->mq_head->len : 0,
+			    (unsigned long *)arg);
+		break;
+
+	case TIOCOUTQ:
+		verify_area((void *)arg, sizeof(unsigned long));
+		if ((dest = upd->peerupd) && dest->socket &&
+		    dest->mq_bytes < UN_WANT(dest, upd))
+			space = UN_WANT(dest, upd) - dest->mq_bytes;
+		put_fs_long(space, (unsigned long *)arg);
+		break;
+
+	default:
+		return -EINVAL;
 	}
-	/* SEL_EX */
-	PRINTK("unix_proto_select: there are no exceptions here?!\n");
 	return 0;
 }
 
+static int
+unix_proto_select(struct socket *sock, int which)
+{
+	struct unix_proto_data *upd = UN_DATA(sock);
+
+	if (sock->type != SOCK_STREAM)
+		return unix_msg_select(sock, which);
+	return ring_select(sock, &upd->ring,
+			   upd->peerupd ? &upd->peerupd->ring : NULL, which);
+}
+
 static int
 unix_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 {
 	struct unix_proto_data *upd, *peerupd;
 
+	if (sock->type != SOCK_STREAM)
+		return unix_msg_ioctl(sock, cmd, arg);
 	upd = UN_DATA(sock);
 	peerupd = (sock->state == SS_CONNECTED) ? UN_DATA(sock->conn) : NULL;
 
 	switch (cmd) {
 	case TIOCINQ:
 		verify_area((void *)arg, sizeof(unsigned long));
-		if (UN_BUF_AVAIL(upd) || peerupd)
-			put_fs_long(UN_BUF_AVAIL(upd), (unsigned long *)arg);
+		if (RING_AVAIL(&upd->ring) || peerupd)
+			put_fs_long(RING_AVAIL(&upd->ring), (unsigned long *)arg);
 		else
 			put_fs_long(1, (unsigned long *)arg); /* read EOF */
 		break;
@@ -571,7 +1073,7 @@ unix_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 	case TIOCOUTQ:
 		verify_area((void *)arg, sizeof(unsigned long));
 		if (peerupd)
-			put_fs_long(UN_BUF_SPACE(peerupd),
+			put_fs_long(RING_SPACE(&peerupd->ring),
 				    (unsigned long *)arg);
 		else
 			put_fs_long(0, (unsigned long *)arg);
@@ -583,13 +1085,39 @@ unix_proto_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 	return 0;
 }
 
+/*
+ * the buffer options are the ring's. for message sockets the buffer
+ * sizes are the most that may be queued.
+ */
+static int
+unix_proto_setsockopt(struct socket *sock, int level, int optname,
+		      char *optval, int optlen)
+{
+	if (level != SOL_SOCKET)
+		return -ENOPROTOOPT;
+	if (optlen < sizeof(int))
+		return -EINVAL;
+	verify_area(optval, sizeof(int));
+	return ring_setsockopt(&UN_DATA(sock)->ring, optname,
+			       get_fs_long((unsigned long *)optval));
+}
+
+static int
+unix_proto_getsockopt(struct socket *sock, int level, int optname,
+		      char *optval, int *optlen)
+{
+	if (level != SOL_SOCKET)
+		return -ENOPROTOOPT;
+	return ring_getsockopt(&UN_DATA(sock)->ring, optname, optval, optlen);
+}
+
 static int
 unix_proto_init(void)
 {
-	struct unix_proto_data *upd;
+	int i;
 
 	PRINTK("unix_proto_init: initializing...\n");
-	for (upd = unix_datas; upd <= last_unix_data; ++upd)
-		upd->refcnt = 0;
+	for (i = 0; i < UNIX_HASH_SIZE; ++i)
+		unix_hash[i] = NULL;
 	return 0;
 }
@@ -0,0 +1,78 @@
+/*
+ * ksim - just enough of the kernel around fs/ and net/ to run their
+ * system calls inside a test program.
+ *
+ * Kernel files are built for the host against tests/mocks, where user
+ * space is plain memory. Tasks are ucontext coroutines switched only in
+ * schedule(), like the real non-preemptive kernel. The test's main()
+ * is task 1; ksim_spawn() forks more tasks off it that share its open
+ * files the way fork() does, and close them when their function returns.
+ */
+#ifndef _KSIM_H
+#define _KSIM_H
+
+/* the user-visible kernel structs, not the host's */
+#include "../../include/sys/uio.h"
+#include "../../include/sys/socket.h"
+#include "../../include/sys/un.h"
+#include "../../include/netinet/in.h"
+#include "../../include/sys/epoll.h"
+/* the host's sys/types.h has none of these */
+typedef unsigned char cc_t;
+typedef unsigned int speed_t;
+typedef unsigned long tcflag_t;
+#include "../../include/termios.h"
+#include "../../include/linux/fcntl.h"
+#include "../../include/errno.h"
+#include "../../net/socketcall.h"
+
+#define KSIM_PAGE_SIZE 4096
+
+void ksim_init(void);
+int ksim_spawn(void (*fn)(void *), void * arg);
+int ksim_wait(void);
+void ksim_yield(void);
+int ksim_self(void);
+long ksim_signals(void);
+void ksim_set_fault(void (*hook)(void));
+int ksim_memory(void);
+int ksim_inodes(void);
+
+/* shared by the tests */
+void ksim_fill(char * buf, int n, int seed);
+void ksim_fault_in_tasks(void);
+int ksim_unix_pair(int type, int * vec);
+int ksim_set_opt(int fd, int optname, int val);
+int ksim_get_opt(int fd, int optname);
+
+/* ttys by minor number; queue 0 is read_q, 1 write_q, 2 secondary */
+void ksim_tty_flags(int minor, unsigned long iflag, unsigned long lflag);
+int ksim_tty_raw(int minor);
+int ksim_tty_input(int minor, const char * buf, int nr);
+int ksim_tty_output(int minor, const char * buf, int nr);
+int ksim_tty_chars(int minor, int which);
+int ksim_tty_lines(int minor);
+int ksim_tty_take(int minor, int which, char * buf, int nr);
+
+/* a bitmap ext file system of nzones zones, with only its zone maps */
+void ksim_ext_mount(int nzones, int firstdatazone);
+int ksim_ext_new_block(int goal);
+int ksim_ext_free_block(int block);
+int ksim_ext_padding(void);
+
+/* system calls under test */
+int sys_pipe(unsigned long * fildes);
+int sys_read(unsigned int fd, char * buf, unsigned int count);
+int sys_write(unsigned int fd, char * buf, unsigned int count);
+int sys_readv(unsigned int fd, const struct iovec * iov, int count);
+int sys_writev(unsigned int fd, const struct iovec * iov, int count);
+int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg);
+int sys_close(unsigned int fd);
+int sys_dup(unsigned int fildes);
+int sys_select(unsigned long * buffer);
+int sys_socketcall(int call, unsigned long * args);
+int sys_epoll_create(int size);
+int sys_epoll_ctl(unsigned long * buffer);
+int sys_epoll_wait(unsigned long * buffer);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * ksim, ext side: one bitmap ext file system that exists only as its
+ * super block and zone maps, for the allocator in fs/ext/bitmap.c.
+ * Every data block is the same scratch buffer, as the allocator only
+ * clears them.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/ext_fs.h>
+#include <linux/string.h>
+
+#define KSIM_EXT_DEV 0x0300
+
+static struct super_block super;
+static struct buffer_head maps[EXT_Z_MAP_SLOTS];
+static char map_data[EXT_Z_MAP_SLOTS][BLOCK_SIZE];
+static struct buffer_head scratch;
+static char scratch_data[BLOCK_SIZE];
+
+struct super_block * get_super(int dev)
+{
+	return (dev == KSIM_EXT_DEV && super.s_dev) ? &super : NULL;
+}
+
+struct buffer_head * get_hash_table(int dev, int block)
+{
+	return NULL;
+}
+
+struct buffer_head * getblk(int dev, int block)
+{
+	scratch.b_data = scratch_data;
+	scratch.b_dev = dev;
+	scratch.b_blocknr = block;
+	scratch.b_count = 1;
+	return &scratch;
+}
+
+struct inode * ext_freelist_new_inode(int dev)
+{
+	panic("ksim: no ext free lists");
+	return NULL;
+}
+
+void ext_freelist_free_inode(struct inode * inode)
+{
+	panic("ksim: no ext free lists");
+}
+
+unsigned long ext_freelist_count_free_inodes(struct super_block * sb)
+{
+	panic("ksim: no ext free lists");
+	return 0;
+}
+
+int ext_freelist_new_block(int dev)
+{
+	panic("ksim: no ext free lists");
+	return 0;
+}
+
+int ext_freelist_free_block(int dev, int block)
+{
+	panic("ksim: no ext free lists");
+	return 0;
+}
+
+unsigned long ext_freelist_count_free_blocks(struct super_block * sb)
+{
+	panic("ksim: no ext free lists");
+	return 0;
+}
+
+/*
+ * 'nzones' zones, of which the first 'firstdatazone' hold the super
+ * block, the maps and the inode table. All data zones are free, and
+ * the bits after the last zone are left clear: the allocator mustn't
+ * count on mkfs having set them.
+ */
+void ksim_ext_mount(int nzones, int firstdatazone)
+{
+	int i;
+
+	memset(&super, 0, sizeof(super));
+	super.s_dev = KSIM_EXT_DEV;
+	super.s_magic = EXT_BITMAP_SUPER_MAGIC;
+	super.s_nzones = nzones;
+	super.s_firstdatazone = firstdatazone;
+	super.s_zmap_blocks = (nzones - firstdatazone + 8192) / 8192;
+	if (super.s_zmap_blocks > EXT_Z_MAP_SLOTS)
+		panic("ksim: too many zone map blocks");
+	for (i = 0 ; i < super.s_zmap_blocks ; i++) {
+		memset(map_data[i], 0, BLOCK_SIZE);
+		maps[i].b_data = map_data[i];
+		super.s_zmap[i] = maps + i;
+	}
+	map_data[0][0] = 1;		/* bit 0 is reserved */
+}
+
+int ksim_ext_new_block(int goal)
+{
+	return ext_new_block(KSIM_EXT_DEV, goal);
+}
+
+int ksim_ext_free_block(int block)
+{
+	return ext_free_block(KSIM_EXT_DEV, block);
+}
+
+/*
+ * set bits in the zone maps that stand for no zone at all.
+ */
+int ksim_ext_padding(void)
+{
+	int bit, nr = 0;
+
+	for (bit = super.s_nzones - super.s_firstdatazone + 1 ;
+	     bit < super.s_zmap_blocks * 8192 ; bit++)
+		if (map_data[bit >> 13][(bit & 8191) >> 3] & (1 << (bit & 7)))
+			nr++;
+	return nr;
+}
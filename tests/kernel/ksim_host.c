@@ -0,0 +1,133 @@
+/*
+ * ksim, host side: task stacks and switching, memory, and the console.
+ * Nothing here needs the kernel's headers; the scheduler itself is in
+ * ksim_task.c, built like the kernel files it serves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ucontext.h>
+
+#define KSIM_TASKS 8
+#define KSIM_STACK (256*1024)
+
+extern void ksim_task_entry(void);
+
+static ucontext_t contexts[KSIM_TASKS];
+static void * stacks[KSIM_TASKS];
+static void (*fault_hook)(void);
+static int pages, objects;
+
+void ksim_ctx_new(int nr)
+{
+	if (!(stacks[nr] = malloc(KSIM_STACK))) {
+		fprintf(stderr, "ksim: out of memory for a stack\n");
+		abort();
+	}
+	getcontext(&contexts[nr]);
+	contexts[nr].uc_stack.ss_sp = stacks[nr];
+	contexts[nr].uc_stack.ss_size = KSIM_STACK;
+	contexts[nr].uc_link = NULL;
+	makecontext(&contexts[nr], ksim_task_entry, 0);
+}
+
+void ksim_ctx_free(int nr)
+{
+	free(stacks[nr]);
+	stacks[nr] = NULL;
+}
+
+void ksim_ctx_switch(int from, int to)
+{
+	swapcontext(&contexts[from], &contexts[to]);
+}
+
+/*
+ * every access to user memory comes through here first: a hook that
+ * yields makes it look like a page fault that slept.
+ */
+void ksim_user_access(void)
+{
+	if (fault_hook)
+		fault_hook();
+}
+
+void ksim_set_fault(void (*hook)(void))
+{
+	fault_hook = hook;
+}
+
+/*
+ * pages and malloc'd objects are counted, so tests can check that
+ * closing everything gives all of it back. Tables the kernel sizes to
+ * fill a page of 32-bit pointers take twice that here, so each page
+ * has a second one behind it.
+ */
+#define PAGE_ROOM (2*4096)
+
+unsigned long get_free_page(void)
+{
+	void * page;
+
+	if (posix_memalign(&page, 4096, PAGE_ROOM))
+		return 0;
+	memset(page, 0, PAGE_ROOM);
+	pages++;
+	return (unsigned long) page;
+}
+
+void free_page(unsigned long addr)
+{
+	if (!addr)
+		return;
+	memset((void *) addr, 0x6b, PAGE_ROOM);
+	free((void *) addr);
+	pages--;
+}
+
+void * ksim_malloc(unsigned int size)
+{
+	void * obj;
+
+	if ((obj = calloc(1, size)))
+		objects++;
+	return obj;
+}
+
+void free_s(void * obj, int size)
+{
+	if (!obj)
+		return;
+	free(obj);
+	objects--;
+}
+
+int ksim_memory(void)
+{
+	return pages + objects;
+}
+
+void verify_area(void * addr, int count)
+{
+}
+
+int printk(const char * fmt, ...)
+{
+	va_list args;
+	int i;
+
+	va_start(args, fmt);
+	printf("    printk: ");
+	i = vprintf(fmt, args);
+	va_end(args);
+	return i;
+}
+
+void panic(const char * str)
+{
+	printf("ksim: kernel panic: %s\n", str);
+	fflush(stdout);
+	abort();
+}
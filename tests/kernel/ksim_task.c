@@ -0,0 +1,426 @@
+/*
+ * ksim, kernel side: the task table, sleep_on()/wake_up() as in
+ * kernel/sched.c, and the inode and name lookups the fs and socket code
+ * call into, and the helpers the tests share. Built with the kernel's
+ * headers and tests/mocks.
+ *
+ * Task 0 is only the sentinel at the end of wait queues, task 1 is the
+ * test program, and spawned tasks get the slots after it. schedule()
+ * runs the next runnable task round robin; when nobody is, it moves
+ * time on to the nearest timeout.
+ */
+
+#include <errno.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/tty.h>
+#include <linux/stat.h>
+#include <linux/string.h>
+#include <asm/system.h>
+#include <sys/socket.h>
+#include "../../net/socketcall.h"
+
+#define KSIM_TASKS 8
+
+extern void ksim_ctx_new(int nr);
+extern void ksim_ctx_free(int nr);
+extern void ksim_ctx_switch(int from, int to);
+extern int sys_close(unsigned int fd);
+extern int sys_socketcall(int call, unsigned long * args);
+extern void sock_init(void);
+extern void ksim_tty_init(void);
+
+struct task_struct *task[NR_TASKS];
+struct task_struct *current;
+unsigned long volatile jiffies = 0;
+unsigned long startup_time = 0;
+int jiffies_offset = 0;
+
+static struct task_struct tasks[KSIM_TASKS];
+static void (*task_fn[KSIM_TASKS])(void *);
+static void * task_arg[KSIM_TASKS];
+static struct task_struct * exit_wait = NULL;
+static int waiting = 0, stuck = 0;
+
+struct inode inode_table[NR_INODE];
+
+static void init_task_slot(struct task_struct * p, int nr)
+{
+	p->state = TASK_RUNNING;
+	p->counter = p->priority = 15;
+	p->signal = p->blocked = 0;
+	p->pid = nr;
+	p->next_wait = NULL;
+	p->timeout = 0;
+	p->filp = p->fd_array;
+	p->close_on_exec = p->fd_cloexec;
+	p->max_fds = NR_OPEN;
+	task[nr] = p;
+}
+
+void ksim_init(void)
+{
+	init_task_slot(tasks+0, 0);
+	init_task_slot(tasks+1, 1);
+	current = task[1];
+	sock_init();
+	ksim_tty_init();
+}
+
+void schedule(void)
+{
+	struct task_struct * p;
+	unsigned long next_timeout;
+	int i, nr, from = current - tasks;
+
+	for (;;) {
+		next_timeout = 0;
+		for (i = 1 ; i < KSIM_TASKS ; i++) {
+			if (!(p = task[i]))
+				continue;
+			if (p->timeout && p->timeout <= jiffies) {
+				p->timeout = 0;
+				if (p->state == TASK_INTERRUPTIBLE)
+					p->state = TASK_RUNNING;
+			}
+			if ((p->signal & ~p->blocked) &&
+			    p->state == TASK_INTERRUPTIBLE)
+				p->state = TASK_RUNNING;
+			if (p->timeout && p->state == TASK_INTERRUPTIBLE &&
+			    (!next_timeout || p->timeout < next_timeout))
+				next_timeout = p->timeout;
+		}
+		for (i = 1 ; i < KSIM_TASKS ; i++) {
+			nr = 1 + (from + i - 1) % (KSIM_TASKS - 1);
+			if (task[nr] && task[nr]->state == TASK_RUNNING)
+				break;
+		}
+		if (i < KSIM_TASKS)
+			break;
+		if (next_timeout) {
+			jiffies = next_timeout;
+			continue;
+		}
+		if (!waiting)
+			panic("ksim: every task is asleep");
+		stuck = 1;
+		task[1]->state = TASK_RUNNING;
+	}
+	if (nr == from)
+		return;
+	current = task[nr];
+	ksim_ctx_switch(from, nr);
+}
+
+void wake_up(struct task_struct **p)
+{
+	struct task_struct * wakeup_ptr, * tmp;
+
+	if (p && *p) {
+		wakeup_ptr = *p;
+		*p = NULL;
+		while (wakeup_ptr && wakeup_ptr != task[0]) {
+			if (wakeup_ptr->state == TASK_ZOMBIE)
+				printk("wake_up: TASK_ZOMBIE\n");
+			else if (wakeup_ptr->state != TASK_STOPPED)
+				wakeup_ptr->state = TASK_RUNNING;
+			tmp = wakeup_ptr->next_wait;
+			wakeup_ptr->next_wait = task[0];
+			wakeup_ptr = tmp;
+		}
+	}
+}
+
+static void __sleep_on(struct task_struct **p, int state)
+{
+	if (!p)
+		return;
+	if (current == task[0])
+		panic("task[0] trying to sleep");
+	current->next_wait = *p;
+	task[0]->next_wait = NULL;
+	*p = current;
+	current->state = state;
+	schedule();
+	if (current->next_wait != task[0])
+		wake_up(p);
+	current->next_wait = NULL;
+}
+
+void interruptible_sleep_on(struct task_struct **p)
+{
+	__sleep_on(p,TASK_INTERRUPTIBLE);
+}
+
+void sleep_on(struct task_struct **p)
+{
+	__sleep_on(p,TASK_UNINTERRUPTIBLE);
+}
+
+int send_sig(long sig,struct task_struct * p,int priv)
+{
+	if (!p || sig < 1 || sig > 32)
+		return -EINVAL;
+	p->signal |= (1 << (sig-1));
+	return 0;
+}
+
+/*
+ * a spawned task starts here, and exits like do_exit() would: its
+ * files are closed and whoever is in ksim_wait() hears about it.
+ */
+void ksim_task_entry(void)
+{
+	int nr = current - tasks, fd;
+
+	task_fn[nr](task_arg[nr]);
+	for (fd = 0 ; fd < current->max_fds ; fd++)
+		if (current->filp[fd])
+			sys_close(fd);
+	current->state = TASK_ZOMBIE;
+	wake_up(&exit_wait);
+	schedule();
+	panic("ksim: zombie task ran");
+}
+
+/*
+ * fork a task off the caller, sharing its open files.
+ */
+int ksim_spawn(void (*fn)(void *), void * arg)
+{
+	struct task_struct * p;
+	int nr, fd;
+
+	for (nr = 2 ; nr < KSIM_TASKS ; nr++)
+		if (!task[nr])
+			break;
+	if (nr >= KSIM_TASKS)
+		panic("ksim: too many tasks");
+	p = tasks + nr;
+	*p = *current;
+	init_task_slot(p, nr);
+	for (fd = 0 ; fd < NR_OPEN ; fd++)
+		if ((p->fd_array[fd] = current->filp[fd]))
+			p->fd_array[fd]->f_count++;
+	task_fn[nr] = fn;
+	task_arg[nr] = arg;
+	ksim_ctx_new(nr);
+	return nr;
+}
+
+/*
+ * let the spawned tasks run until they have all exited. returns how
+ * many are left asleep with nobody to wake them.
+ */
+int ksim_wait(void)
+{
+	int nr, left;
+
+	stuck = 0;
+	for (;;) {
+		left = 0;
+		for (nr = 2 ; nr < KSIM_TASKS ; nr++)
+			if (task[nr] && task[nr]->state != TASK_ZOMBIE)
+				left++;
+		if (!left || stuck)
+			break;
+		waiting = 1;
+		sleep_on(&exit_wait);
+		waiting = 0;
+	}
+	for (nr = 2 ; nr < KSIM_TASKS ; nr++)
+		if (task[nr] && task[nr]->state == TASK_ZOMBIE) {
+			ksim_ctx_free(nr);
+			task[nr] = NULL;
+		}
+	return left;
+}
+
+void ksim_yield(void)
+{
+	schedule();
+}
+
+int ksim_self(void)
+{
+	return current - tasks;
+}
+
+long ksim_signals(void)
+{
+	long signal = current->signal;
+
+	current->signal = 0;
+	return signal;
+}
+
+/*
+ * only pipes, sockets and socket names use the inode table here.
+ */
+struct inode * get_empty_inode(void)
+{
+	struct inode * inode;
+
+	for (inode = inode_table ; inode < inode_table + NR_INODE ; inode++)
+		if (!inode->i_count) {
+			memset(inode, 0, sizeof(*inode));
+			inode->i_count = 1;
+			return inode;
+		}
+	panic("No free inodes in mem");
+	return NULL;
+}
+
+void iput(struct inode * inode)
+{
+	if (!inode)
+		return;
+	if (!inode->i_count) {
+		printk("iput: trying to free free inode\n");
+		return;
+	}
+	if (inode->i_pipe) {
+		wake_up(&inode->i_wait);
+		wake_up(&inode->i_wait2);
+	}
+	if (inode->i_count == 1 && inode->i_pipe)
+		free_pipe_pages(inode);
+	inode->i_count--;
+}
+
+struct inode * get_pipe_inode(void)
+{
+	struct inode * inode;
+
+	if (!(inode = get_empty_inode()))
+		return NULL;
+	init_pipe_inode(inode);
+	if (alloc_pipe_pages(inode)) {
+		inode->i_count = 0;
+		return NULL;
+	}
+	inode->i_count = 2;	/* sum of readers/writers */
+	PIPE_READERS(*inode) = PIPE_WRITERS(*inode) = 1;
+	inode->i_pipe = 1;
+	return inode;
+}
+
+int ksim_inodes(void)
+{
+	int nr = 0;
+	struct inode * inode;
+
+	for (inode = inode_table ; inode < inode_table + NR_INODE ; inode++)
+		if (inode->i_count)
+			nr++;
+	return nr;
+}
+
+/*
+ * there is no file system: every name can be made, and opening one
+ * gives a fresh inode. unix sockets find each other by their address.
+ */
+int do_mknod(const char * filename, int mode, int dev)
+{
+	return 0;
+}
+
+int open_namei(const char * pathname, int flag, int mode,
+	struct inode ** res_inode)
+{
+	*res_inode = get_empty_inode();
+	(*res_inode)->i_mode = mode;
+	return 0;
+}
+
+struct inode * namei(const char * pathname)
+{
+	return NULL;
+}
+
+struct inode * lnamei(const char * pathname)
+{
+	return NULL;
+}
+
+int permission(struct inode * inode,int mask)
+{
+	return 0;
+}
+
+int in_group_p(gid_t grp)
+{
+	return 0;
+}
+
+struct buffer_head * bread(int dev,int block)
+{
+	return NULL;
+}
+
+void brelse(struct buffer_head * buf)
+{
+}
+
+/*
+ * a byte pattern that doesn't repeat within a page.
+ */
+void ksim_fill(char * buf, int n, int seed)
+{
+	int i;
+
+	for (i = 0 ; i < n ; i++)
+		buf[i] = (char) (seed + i * 13 + i / 509);
+}
+
+/*
+ * a fault hook: spawned tasks sleep in every copy to or from user
+ * space, the test program never does.
+ */
+void ksim_fault_in_tasks(void)
+{
+	if (current != task[1])
+		schedule();
+}
+
+int ksim_unix_pair(int type, int * vec)
+{
+	unsigned long args[4];
+
+	vec[0] = vec[1] = -1;
+	args[0] = AF_UNIX;
+	args[1] = type;
+	args[2] = 0;
+	args[3] = (unsigned long) vec;
+	return sys_socketcall(SYS_SOCKETPAIR, args);
+}
+
+int ksim_set_opt(int fd, int optname, int val)
+{
+	unsigned long args[5], lval = val;
+
+	args[0] = fd;
+	args[1] = SOL_SOCKET;
+	args[2] = optname;
+	args[3] = (unsigned long) &lval;
+	args[4] = sizeof(int);
+	return sys_socketcall(SYS_SETSOCKOPT, args);
+}
+
+/*
+ * the kernel reads optlen as a long.
+ */
+int ksim_get_opt(int fd, int optname)
+{
+	unsigned long args[5], lval = 0, len = sizeof(int);
+	int error;
+
+	args[0] = fd;
+	args[1] = SOL_SOCKET;
+	args[2] = optname;
+	args[3] = (unsigned long) &lval;
+	args[4] = (unsigned long) &len;
+	if ((error = sys_socketcall(SYS_GETSOCKOPT, args)) < 0)
+		return error;
+	return (int) lval;
+}
@@ -0,0 +1,150 @@
+/*
+ * ksim, tty side: stand-ins for the console and serial drivers, so that
+ * tty_io.c and pty.c can run on their queues, and a few calls that let
+ * a test feed a tty and look at it from outside.
+ *
+ * Nothing drains the console or serial write queues: output written to
+ * them just stays there for the test to read back.
+ */
+
+#include <errno.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/tty.h>
+#include "../../kernel/chr_drv/vt_kern.h"
+
+struct vt_cons vt_cons[NR_CONSOLES];
+unsigned long video_num_columns = 80;
+unsigned long video_num_lines = 25;
+
+static struct tty_queue queues[3*(NR_CONSOLES+NR_SERIALS+2*NR_PTYS)];
+
+long con_init(long kmem_start)
+{
+	return kmem_start;
+}
+
+long rs_init(long kmem_start)
+{
+	return kmem_start;
+}
+
+void con_write(struct tty_struct * tty)
+{
+}
+
+void rs_write(struct tty_struct * tty)
+{
+}
+
+void update_screen(int new_console)
+{
+}
+
+int serial_open(unsigned int line, struct file * filp)
+{
+	return -ENODEV;
+}
+
+void serial_close(unsigned int line, struct file * filp)
+{
+}
+
+int tty_ioctl(struct inode * inode, struct file * file,
+	unsigned int cmd, unsigned int arg)
+{
+	return -EINVAL;
+}
+
+void flush_input(struct tty_struct * tty)
+{
+	tty->read_q->head = tty->read_q->tail;
+	tty->secondary->head = tty->secondary->tail;
+	tty->secondary->data = 0;
+}
+
+void flush_output(struct tty_struct * tty)
+{
+	tty->write_q->head = tty->write_q->tail;
+}
+
+int kill_pg(int pgrp, int sig, int priv)
+{
+	return 0;
+}
+
+int is_orphaned_pgrp(int pgrp)
+{
+	return 0;
+}
+
+void ksim_tty_init(void)
+{
+	tty_init((long) queues);
+}
+
+static struct tty_queue * tty_queue(int minor, int which)
+{
+	struct tty_struct * tty = TTY_TABLE(minor);
+
+	switch (which) {
+		case 0:
+			return tty->read_q;
+		case 1:
+			return tty->write_q;
+		default:
+			return tty->secondary;
+	}
+}
+
+void ksim_tty_flags(int minor, unsigned long iflag, unsigned long lflag)
+{
+	TTY_TABLE(minor)->termios.c_iflag = iflag;
+	TTY_TABLE(minor)->termios.c_lflag = lflag;
+}
+
+int ksim_tty_raw(int minor)
+{
+	return TTY_RAW_INPUT(TTY_TABLE(minor)) != 0;
+}
+
+/*
+ * characters arriving from the line, as the keyboard or serial
+ * interrupt would hand them over.
+ */
+int ksim_tty_input(int minor, const char * buf, int nr)
+{
+	struct tty_struct * tty = TTY_TABLE(minor);
+
+	nr = put_tty_queue_buf(tty->read_q, (const unsigned char *) buf, nr);
+	TTY_READ_FLUSH(tty);
+	return nr;
+}
+
+/*
+ * what write_chan() does with a user buffer, without the user.
+ */
+int ksim_tty_output(int minor, const char * buf, int nr)
+{
+	struct tty_struct * tty = TTY_TABLE(minor);
+
+	nr = put_tty_queue_buf(tty->write_q, (const unsigned char *) buf, nr);
+	TTY_WRITE_FLUSH(tty);
+	return nr;
+}
+
+int ksim_tty_chars(int minor, int which)
+{
+	return CHARS(tty_queue(minor, which));
+}
+
+int ksim_tty_lines(int minor)
+{
+	return TTY_TABLE(minor)->secondary->data;
+}
+
+int ksim_tty_take(int minor, int which, char * buf, int nr)
+{
+	return get_tty_queue_buf(tty_queue(minor, which),
+				 (unsigned char *) buf, nr);
+}
@@ -0,0 +1,185 @@
+/*
+ * Unit tests for fs/eventpoll.c
+ * EPOLL_CTL_ADD/MOD/DEL, closing watched files and the set itself,
+ * sets that outgrow their first page, and waking a sleeping waiter
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+
+#define NR_DUPS 120
+
+static struct epoll_event ev[NR_DUPS + 8];
+static int epfd, result[8];
+
+static int ep_ctl(int op, int fd, unsigned long events, unsigned long data)
+{
+    struct epoll_event event;
+    unsigned long args[4];
+
+    event.events = events;
+    event.data = data;
+    args[0] = epfd;
+    args[1] = op;
+    args[2] = fd;
+    args[3] = (unsigned long) &event;
+    return sys_epoll_ctl(args);
+}
+
+static int ep_wait(int maxevents, int timeout)
+{
+    unsigned long args[4];
+
+    memset(ev, 0, sizeof(ev));
+    args[0] = epfd;
+    args[1] = (unsigned long) ev;
+    args[2] = maxevents;
+    args[3] = (unsigned long) (long) timeout;
+    return sys_epoll_wait(args);
+}
+
+static void waiter_task(void * arg)
+{
+    result[ksim_self()] = ep_wait(4, -1);
+}
+
+int main(void) {
+    unsigned long fds[2];
+    int sv[2], dups[NR_DUPS], seen[NR_DUPS];
+    unsigned long args[4];
+    char buf[8];
+    int i, n, memory, before, full;
+
+    TEST_SUITE_BEGIN("Epoll");
+    ksim_init();
+    memory = ksim_memory();
+
+    TEST_CASE_BEGIN("add, modify and delete a pipe");
+    TEST_ASSERT_EQUAL(-EINVAL, sys_epoll_create(0), "size must be positive");
+    epfd = sys_epoll_create(1);
+    TEST_ASSERT(epfd >= 0, "epoll_create() gives a descriptor");
+    fds[0] = fds[1] = 0;
+    sys_pipe(fds);
+    TEST_ASSERT_EQUAL(0, ep_ctl(EPOLL_CTL_ADD, fds[0], EPOLLIN, 7),
+                      "add the read end");
+    TEST_ASSERT_EQUAL(-EEXIST, ep_ctl(EPOLL_CTL_ADD, fds[0], EPOLLIN, 7),
+                      "adding it twice says EEXIST");
+    TEST_ASSERT_EQUAL(-EPERM, ep_ctl(EPOLL_CTL_ADD, epfd, EPOLLIN, 0),
+                      "a set can't watch itself");
+    TEST_ASSERT_EQUAL(-EBADF, ep_ctl(EPOLL_CTL_ADD, 30, EPOLLIN, 0),
+                      "nor a descriptor that isn't open");
+    TEST_ASSERT_EQUAL(0, ep_wait(4, 0), "an empty pipe isn't ready");
+    sys_write(fds[1], "x", 1);
+    TEST_ASSERT_EQUAL(1, ep_wait(4, 0), "a written pipe is");
+    TEST_ASSERT(ev[0].events == EPOLLIN && ev[0].data == 7,
+                "with EPOLLIN and the data it was added with");
+    TEST_ASSERT_EQUAL(1, ep_wait(4, 0), "and stays ready until it is read");
+    TEST_ASSERT_EQUAL(0, ep_ctl(EPOLL_CTL_MOD, fds[0], EPOLLIN | EPOLLET, 9),
+                      "modify it to edge-triggered");
+    TEST_ASSERT(ep_wait(4, 0) == 1 && ev[0].data == 9,
+                "the new data comes back");
+    TEST_ASSERT_EQUAL(0, ep_wait(4, 0), "once per wakeup");
+    sys_write(fds[1], "y", 1);
+    TEST_ASSERT_EQUAL(1, ep_wait(4, 0), "the next write reports it again");
+    TEST_ASSERT_EQUAL(0, ep_ctl(EPOLL_CTL_DEL, fds[0], 0, 0), "delete it");
+    sys_write(fds[1], "z", 1);
+    TEST_ASSERT_EQUAL(0, ep_wait(4, 0), "deleted items aren't reported");
+    TEST_ASSERT_EQUAL(-ENOENT, ep_ctl(EPOLL_CTL_DEL, fds[0], 0, 0),
+                      "deleting it again says ENOENT");
+    TEST_ASSERT_EQUAL(-ENOENT, ep_ctl(EPOLL_CTL_MOD, fds[0], EPOLLIN, 0),
+                      "so does modifying it");
+    TEST_ASSERT_EQUAL(3, sys_read(fds[0], buf, sizeof(buf)), "drain the pipe");
+
+    TEST_CASE_BEGIN("closing watched descriptors");
+    dups[0] = sys_dup(fds[0]);
+    TEST_ASSERT_EQUAL(0, ep_ctl(EPOLL_CTL_ADD, fds[0], EPOLLIN, 1),
+                      "watch the read end");
+    TEST_ASSERT_EQUAL(0, ep_ctl(EPOLL_CTL_ADD, fds[1], EPOLLOUT, 2),
+                      "and the write end");
+    TEST_ASSERT_EQUAL(1, ep_wait(4, 0), "only the write end is ready");
+    sys_close(fds[0]);
+    sys_write(fds[1], "x", 1);
+    TEST_ASSERT_EQUAL(2, ep_wait(4, 0),
+                      "the read end is still watched while a dup keeps it open");
+    sys_close(dups[0]);
+    TEST_ASSERT(ep_wait(4, 0) == 1 && ev[0].data == 2,
+                "its last close drops it from the set");
+    TEST_ASSERT_EQUAL(-EBADF, ep_ctl(EPOLL_CTL_DEL, fds[0], 0, 0),
+                      "and the descriptor is gone");
+    sys_close(epfd);
+    TEST_ASSERT_EQUAL(1, ksim_inodes(), "closing the set frees its inode");
+    sys_close(fds[1]);
+    TEST_ASSERT_EQUAL(memory, ksim_memory(), "and its pages");
+
+    TEST_CASE_BEGIN("a set bigger than a page");
+    fds[0] = fds[1] = 0;
+    sys_pipe(fds);
+    for (i = 0; i < NR_DUPS; i++)
+        dups[i] = sys_dup(fds[0]);
+    before = ksim_memory();
+    epfd = sys_epoll_create(NR_DUPS);
+    for (i = n = 0; i < NR_DUPS; i++)
+        if (!ep_ctl(EPOLL_CTL_ADD, dups[i], EPOLLIN, i))
+            n++;
+    TEST_ASSERT_EQUAL(NR_DUPS, n, "every descriptor can be added");
+    TEST_ASSERT(ksim_memory() - before > 2, "the set took more than a page");
+    full = ksim_memory();
+    sys_write(fds[1], "x", 1);
+    memset(seen, 0, sizeof(seen));
+    n = ep_wait(NR_DUPS + 8, 0);
+    TEST_ASSERT_EQUAL(NR_DUPS, n, "all of them are ready");
+    for (i = 0; i < n; i++)
+        if (ev[i].data < NR_DUPS)
+            seen[ev[i].data]++;
+    for (i = 0; i < NR_DUPS && seen[i] == 1; i++)
+        ;
+    TEST_ASSERT_EQUAL(NR_DUPS, i, "each one reported once");
+    for (i = 0; i < NR_DUPS; i += 2)
+        ep_ctl(EPOLL_CTL_DEL, dups[i], 0, 0);
+    TEST_ASSERT_EQUAL(NR_DUPS / 2, ep_wait(NR_DUPS + 8, 0),
+                      "deleting half leaves the other half");
+    TEST_ASSERT(ev[0].data & 1, "and those are the odd ones");
+    for (i = 0; i < NR_DUPS; i += 2)
+        ep_ctl(EPOLL_CTL_ADD, dups[i], EPOLLIN, i);
+    TEST_ASSERT_EQUAL(NR_DUPS, ep_wait(NR_DUPS + 8, 0),
+                      "freed slots are used again");
+    TEST_ASSERT_EQUAL(full, ksim_memory(), "without adding pages");
+    TEST_ASSERT_EQUAL(NR_DUPS, ep_wait(NR_DUPS / 2, 0) + NR_DUPS / 2,
+                      "maxevents limits what one wait returns");
+    sys_close(epfd);
+    TEST_ASSERT_EQUAL(before, ksim_memory(), "closing the set frees every page");
+    for (i = 0; i < NR_DUPS; i++)
+        sys_close(dups[i]);
+
+    TEST_CASE_BEGIN("a write wakes a task sleeping in epoll_wait");
+    sys_read(fds[0], buf, 1);
+    epfd = sys_epoll_create(1);
+    ep_ctl(EPOLL_CTL_ADD, fds[0], EPOLLIN, 5);
+    n = ksim_spawn(waiter_task, NULL);
+    ksim_yield();
+    sys_write(fds[1], "x", 1);
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "the waiter wakes up");
+    TEST_ASSERT_EQUAL(1, result[n], "with the pipe ready");
+    sys_close(fds[0]);
+    sys_close(fds[1]);
+
+    TEST_CASE_BEGIN("a socket watched for input");
+    args[0] = AF_UNIX;
+    args[1] = SOCK_STREAM;
+    args[2] = 0;
+    args[3] = (unsigned long) sv;
+    TEST_ASSERT_EQUAL(0, sys_socketcall(SYS_SOCKETPAIR, args), "socketpair()");
+    TEST_ASSERT_EQUAL(0, ep_ctl(EPOLL_CTL_ADD, sv[0], EPOLLIN, 3),
+                      "sockets can be added");
+    TEST_ASSERT_EQUAL(0, ep_wait(4, 0), "nothing to read yet");
+    sys_write(sv[1], "hello", 5);
+    TEST_ASSERT(ep_wait(4, 0) == 1 && ev[0].data == 3,
+                "the peer's write makes it ready");
+    sys_close(sv[1]);
+    sys_close(sv[0]);
+    TEST_ASSERT_EQUAL(0, ep_wait(4, 0), "a closed socket leaves the set");
+    sys_close(epfd);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(), "no inodes are left in use");
+
+    TEST_SUITE_END();
+}
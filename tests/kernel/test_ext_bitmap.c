@@ -0,0 +1,57 @@
+/*
+ * Unit tests for fs/ext/bitmap.c
+ * goal-directed block allocation, wrapping around the zone maps, and
+ * a last map block that is only partly made of zones
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+
+#define FIRST 10			/* first data zone */
+#define NZONES (FIRST + 8191 + 100)	/* 100 zones in the second map block */
+#define LAST_MAP (FIRST + 8191)		/* the first zone of the second map */
+
+int main(void) {
+    int i, n, block, bad;
+
+    TEST_SUITE_BEGIN("Ext Bitmap");
+    ksim_init();
+    ksim_ext_mount(NZONES, FIRST);
+
+    TEST_CASE_BEGIN("blocks are allocated at or after the goal");
+    TEST_ASSERT_EQUAL(500, ksim_ext_new_block(500), "the goal itself if free");
+    TEST_ASSERT_EQUAL(501, ksim_ext_new_block(500), "else the next free one");
+    TEST_ASSERT_EQUAL(FIRST, ksim_ext_new_block(0),
+                      "a goal before the data zones means the first one");
+    TEST_ASSERT_EQUAL(FIRST + 1, ksim_ext_new_block(NZONES),
+                      "so does a goal past the end");
+
+    TEST_CASE_BEGIN("the last map block only holds the zones there are");
+    for (i = bad = 0; i < 100; i++)
+        if (ksim_ext_new_block(LAST_MAP + i) != LAST_MAP + i)
+            bad++;
+    TEST_ASSERT_EQUAL(0, bad, "its 100 zones can be allocated");
+    TEST_ASSERT_EQUAL(FIRST + 2, ksim_ext_new_block(NZONES - 1),
+                      "then a goal in it wraps around to the first map");
+    TEST_ASSERT_EQUAL(0, ksim_ext_padding(), "without touching the padding");
+
+    TEST_CASE_BEGIN("a full file system runs out cleanly");
+    for (n = bad = 0; (block = ksim_ext_new_block(LAST_MAP)); n++)
+        if (block < FIRST || block >= NZONES)
+            bad++;
+    TEST_ASSERT_EQUAL(0, bad, "every block is a data zone");
+    TEST_ASSERT_EQUAL(NZONES - FIRST - 105, n, "and all of them are handed out");
+    TEST_ASSERT_EQUAL(0, ksim_ext_new_block(FIRST), "then there are none");
+    TEST_ASSERT_EQUAL(0, ksim_ext_padding(), "and the padding is still clear");
+
+    TEST_CASE_BEGIN("freed blocks are found again");
+    ksim_ext_free_block(4000);
+    TEST_ASSERT_EQUAL(4000, ksim_ext_new_block(NZONES - 1),
+                      "a hole in the first map, from the last");
+    ksim_ext_free_block(NZONES - 1);
+    TEST_ASSERT_EQUAL(NZONES - 1, ksim_ext_new_block(FIRST),
+                      "the last zone, from the first map");
+    TEST_ASSERT_EQUAL(0, ksim_ext_new_block(FIRST), "and then none again");
+
+    TEST_SUITE_END();
+}
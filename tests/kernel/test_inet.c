@@ -0,0 +1,239 @@
+/*
+ * Unit tests for net/inet.c loopback stream sockets
+ * socket() and bind()/connect() addressing, accept(), and connects
+ * beyond the listen backlog
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+
+#define PAGE KSIM_PAGE_SIZE
+#define PORT 5000
+
+static char out[4*PAGE], in[4*PAGE];
+static int srv, result[8];
+
+static int in_socket(int type, int protocol)
+{
+    unsigned long args[3];
+
+    args[0] = AF_INET;
+    args[1] = type;
+    args[2] = protocol;
+    return sys_socketcall(SYS_SOCKET, args);
+}
+
+/* bind or connect, to addr:port given in host order */
+static int in_call(int call, int fd, unsigned long addr, int port)
+{
+    struct sockaddr_in sin;
+    unsigned long args[3];
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(addr);
+    args[0] = fd;
+    args[1] = (unsigned long) &sin;
+    args[2] = sizeof(sin);
+    return sys_socketcall(call, args);
+}
+
+static int in_listen(int fd, int backlog)
+{
+    unsigned long args[2];
+
+    args[0] = fd;
+    args[1] = backlog;
+    return sys_socketcall(SYS_LISTEN, args);
+}
+
+/* the kernel reads the address length as a long */
+static int in_accept(int fd, struct sockaddr_in * peer)
+{
+    unsigned long args[3], len = sizeof(*peer);
+
+    args[0] = fd;
+    args[1] = (unsigned long) peer;
+    args[2] = (unsigned long) (peer ? &len : NULL);
+    return sys_socketcall(SYS_ACCEPT, args);
+}
+
+static int in_name(int call, int fd, struct sockaddr_in * sin)
+{
+    unsigned long args[3], len = sizeof(*sin);
+
+    memset(sin, 0, sizeof(*sin));
+    args[0] = fd;
+    args[1] = (unsigned long) sin;
+    args[2] = (unsigned long) &len;
+    return sys_socketcall(call, args);
+}
+
+/* a forked client, that closes its copy of the listener first */
+static void connect_task(void * arg)
+{
+    sys_close(srv);
+    result[ksim_self()] = in_call(SYS_CONNECT, (int) (long) arg,
+                                  INADDR_LOOPBACK, PORT);
+}
+
+static int listener_ready(int epfd)
+{
+    struct epoll_event ev;
+    unsigned long args[4];
+
+    args[0] = epfd;
+    args[1] = (unsigned long) &ev;
+    args[2] = 1;
+    args[3] = 0;
+    return sys_epoll_wait(args);
+}
+
+int main(void) {
+    struct sockaddr_in sin, peer;
+    struct epoll_event event;
+    unsigned long args[4];
+    int cli, conn, other, epfd, n, memory;
+
+    TEST_SUITE_BEGIN("Loopback Inet Sockets");
+    ksim_init();
+    memory = ksim_memory();
+
+    TEST_CASE_BEGIN("socket() only makes tcp streams");
+    TEST_ASSERT_EQUAL(-ESOCKTNOSUPPORT, in_socket(SOCK_DGRAM, 0),
+                      "there is no udp");
+    TEST_ASSERT_EQUAL(-EPROTONOSUPPORT, in_socket(SOCK_STREAM, 17),
+                      "nor any protocol but tcp");
+    srv = in_socket(SOCK_STREAM, IPPROTO_TCP);
+    TEST_ASSERT(srv >= 0, "a tcp stream socket");
+    TEST_ASSERT_EQUAL(4*PAGE, ksim_get_opt(srv, SO_RCVBUF),
+                      "its ring starts at four pages");
+
+    TEST_CASE_BEGIN("binding and connecting");
+    TEST_ASSERT_EQUAL(-EADDRNOTAVAIL, in_call(SYS_BIND, srv, 0x0a000001, PORT),
+                      "only loopback addresses can be bound");
+    TEST_ASSERT_EQUAL(0, in_call(SYS_BIND, srv, INADDR_LOOPBACK, PORT),
+                      "bind 127.0.0.1");
+    TEST_ASSERT_EQUAL(-EINVAL, in_call(SYS_BIND, srv, INADDR_LOOPBACK, PORT + 1),
+                      "a bound socket can't be bound again");
+    other = in_socket(SOCK_STREAM, 0);
+    TEST_ASSERT_EQUAL(-EADDRINUSE, in_call(SYS_BIND, other, INADDR_ANY, PORT),
+                      "nor can its port be taken");
+    TEST_ASSERT_EQUAL(-ECONNREFUSED,
+                      in_call(SYS_CONNECT, other, INADDR_LOOPBACK, PORT),
+                      "connect before listen is refused");
+    TEST_ASSERT_EQUAL(0, in_listen(srv, 5), "listen()");
+    TEST_ASSERT_EQUAL(-ENETUNREACH,
+                      in_call(SYS_CONNECT, other, 0x0a000001, PORT),
+                      "other networks can't be reached");
+    TEST_ASSERT_EQUAL(-ECONNREFUSED,
+                      in_call(SYS_CONNECT, other, INADDR_LOOPBACK, PORT + 1),
+                      "nor can ports nobody listens on");
+    sys_close(other);
+    cli = in_socket(SOCK_STREAM, 0);
+    TEST_ASSERT_EQUAL(-ECONNREFUSED, in_call(SYS_CONNECT, cli, 0x7f000002, PORT),
+                      "a server bound to 127.0.0.1 isn't on 127.0.0.2");
+    TEST_ASSERT_EQUAL(0, in_call(SYS_CONNECT, cli, INADDR_LOOPBACK, PORT),
+                      "connect to 127.0.0.1");
+    TEST_ASSERT_EQUAL(0, in_name(SYS_GETSOCKNAME, cli, &sin),
+                      "getsockname()");
+    TEST_ASSERT(ntohs(sin.sin_port) >= 32768, "the client got a port");
+    conn = in_accept(srv, &peer);
+    TEST_ASSERT(conn >= 0, "accept()");
+    TEST_ASSERT(peer.sin_family == AF_INET && peer.sin_port == sin.sin_port,
+                "names the client's port");
+    TEST_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), peer.sin_addr.s_addr,
+                      "on 127.0.0.1");
+    in_name(SYS_GETPEERNAME, cli, &sin);
+    TEST_ASSERT_EQUAL(PORT, ntohs(sin.sin_port),
+                      "the client's peer is the server's port");
+
+    TEST_CASE_BEGIN("the connection carries data both ways");
+    ksim_fill(out, 3*PAGE, 1);
+    TEST_ASSERT_EQUAL(3*PAGE, sys_write(cli, out, 3*PAGE), "write three pages");
+    TEST_ASSERT_EQUAL(3*PAGE, sys_read(conn, in, 4*PAGE),
+                      "the server reads them");
+    TEST_ASSERT_MEM_EQUAL(out, in, 3*PAGE, "in order");
+    TEST_ASSERT_EQUAL(5, sys_write(conn, "hello", 5), "the server writes back");
+    TEST_ASSERT_EQUAL(5, sys_read(cli, in, 10), "and the client reads it");
+    TEST_ASSERT_MEM_EQUAL("hello", in, 5, "unchanged");
+
+    TEST_CASE_BEGIN("closing");
+    sys_close(conn);
+    TEST_ASSERT_EQUAL(0, sys_read(cli, in, 10),
+                      "the client reads end of file");
+    TEST_ASSERT_EQUAL(-EPIPE, sys_write(cli, out, 1),
+                      "and can't write");
+    ksim_signals();
+    sys_close(cli);
+
+    TEST_CASE_BEGIN("connecting beyond the backlog");
+    TEST_ASSERT_EQUAL(0, in_listen(srv, 1), "a second listen sets backlog 1");
+    epfd = sys_epoll_create(1);
+    event.events = EPOLLIN;
+    event.data = 0;
+    args[0] = epfd;
+    args[1] = EPOLL_CTL_ADD;
+    args[2] = srv;
+    args[3] = (unsigned long) &event;
+    sys_epoll_ctl(args);
+    sys_fcntl(srv, F_SETFL, O_NONBLOCK);
+    TEST_ASSERT_EQUAL(-EAGAIN, in_accept(srv, NULL),
+                      "a nonblocking accept with nobody queued says EAGAIN");
+    TEST_ASSERT_EQUAL(0, listener_ready(epfd), "the listener isn't ready");
+    cli = in_socket(SOCK_STREAM, 0);
+    TEST_ASSERT_EQUAL(0, in_call(SYS_CONNECT, cli, INADDR_LOOPBACK, PORT),
+                      "the first client connects without an accept");
+    TEST_ASSERT_EQUAL(3, sys_write(cli, "one", 3), "and can write at once");
+    TEST_ASSERT_EQUAL(1, listener_ready(epfd), "the listener is ready");
+    other = in_socket(SOCK_STREAM, 0);
+    sys_fcntl(other, F_SETFL, O_NONBLOCK);
+    TEST_ASSERT_EQUAL(-EAGAIN, in_call(SYS_CONNECT, other, INADDR_LOOPBACK, PORT),
+                      "a nonblocking client past the backlog says EAGAIN");
+    sys_fcntl(other, F_SETFL, 0);
+    memset(result, 0, sizeof(result));
+    n = ksim_spawn(connect_task, (void *) (long) other);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(0, result[n], "a blocking one waits");
+    conn = in_accept(srv, NULL);
+    TEST_ASSERT(conn >= 0, "accept the first client");
+    TEST_ASSERT_EQUAL(3, sys_read(conn, in, 10), "its data is there");
+    TEST_ASSERT_MEM_EQUAL("one", in, 3, "unchanged");
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "the waiting client gets in");
+    TEST_ASSERT_EQUAL(0, result[n], "connect() says so");
+    sys_close(conn);
+    conn = in_accept(srv, NULL);
+    TEST_ASSERT(conn >= 0, "and is accepted next");
+    TEST_ASSERT_EQUAL(3, sys_write(other, "two", 3), "it writes");
+    TEST_ASSERT_EQUAL(3, sys_read(conn, in, 10), "the server reads");
+    TEST_ASSERT_EQUAL(0, listener_ready(epfd), "the queue is empty again");
+    sys_close(conn);
+    sys_close(other);
+    sys_close(cli);
+
+    TEST_CASE_BEGIN("the listener goes away");
+    cli = in_socket(SOCK_STREAM, 0);
+    in_call(SYS_CONNECT, cli, INADDR_LOOPBACK, PORT);
+    other = in_socket(SOCK_STREAM, 0);
+    memset(result, 0, sizeof(result));
+    n = ksim_spawn(connect_task, (void *) (long) other);
+    ksim_yield();
+    sys_close(srv);
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "the waiting client wakes up");
+    TEST_ASSERT_EQUAL(-ECONNREFUSED, result[n], "and is refused");
+    TEST_ASSERT_EQUAL(-EPIPE, sys_write(cli, out, 1),
+                      "the queued client lost its connection");
+    ksim_signals();
+    sys_close(other);
+    sys_close(cli);
+    sys_close(epfd);
+    other = in_socket(SOCK_STREAM, 0);
+    TEST_ASSERT_EQUAL(0, in_call(SYS_BIND, other, INADDR_ANY, PORT),
+                      "the port is free again");
+    sys_close(other);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(), "no inodes are left in use");
+    TEST_ASSERT_EQUAL(memory, ksim_memory(), "every page was freed");
+
+    TEST_SUITE_END();
+}
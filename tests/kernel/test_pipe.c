@@ -0,0 +1,191 @@
+/*
+ * Unit tests for fs/pipe.c
+ * readv/writev across the end of the ring, F_SETPIPE_SZ, and copies
+ * that sleep halfway through while another task uses the same pipe
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+#include <signal.h>
+
+#define RING KSIM_PAGE_SIZE
+
+static unsigned long fds[2];
+static char out[4*RING], in[4*RING];
+static int result[8];
+
+static int write_all(int fd, char * buf, int n)
+{
+    return sys_write(fd, buf, n);
+}
+
+static int select_in(int fd, int n, unsigned long * set)
+{
+    unsigned long args[5];
+
+    memset(set, 0, 16 * sizeof(long));
+    set[fd / 32] = 1UL << (fd % 32);
+    args[0] = n;
+    args[1] = (unsigned long) set;
+    args[2] = args[3] = args[4] = 0;
+    return sys_select(args);
+}
+
+static void reader_task(void * arg)
+{
+    result[ksim_self()] = sys_read(fds[0], in, (int) (long) arg);
+}
+
+static void writer_task(void * arg)
+{
+    struct iovec iov[4];
+    char * buf = arg;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        iov[i].iov_base = buf + i * 500;
+        iov[i].iov_len = 500;
+    }
+    result[ksim_self()] = sys_writev(fds[1], iov, 4);
+}
+
+static void bytes_task(void * arg)
+{
+    result[ksim_self()] = write_all(fds[1], arg, 20);
+}
+
+int main(void) {
+    struct iovec iov[3];
+    unsigned long set[16];
+    int n, memory;
+    static char a[2000], b[2000], bs[20];
+
+    TEST_SUITE_BEGIN("Pipe Ring");
+    ksim_init();
+    memory = ksim_memory();
+
+    TEST_CASE_BEGIN("writev and readv across the end of the ring");
+    TEST_ASSERT_EQUAL(0, sys_pipe(fds), "pipe() succeeds");
+    TEST_ASSERT_EQUAL(RING, sys_fcntl(fds[0], F_GETPIPE_SZ, 0),
+                      "a new pipe holds one page");
+    ksim_fill(out, 3000, 1);
+    TEST_ASSERT_EQUAL(3000, write_all(fds[1], out, 3000), "write 3000 bytes");
+    TEST_ASSERT_EQUAL(2000, sys_read(fds[0], in, 2000), "read 2000 back");
+    TEST_ASSERT_MEM_EQUAL(out, in, 2000, "first 2000 bytes come out in order");
+    ksim_fill(out + 3000, 2500, 2);
+    iov[0].iov_base = out + 3000; iov[0].iov_len = 700;
+    iov[1].iov_base = out + 3700; iov[1].iov_len = 1000;
+    iov[2].iov_base = out + 4700; iov[2].iov_len = 800;
+    TEST_ASSERT_EQUAL(2500, sys_writev(fds[1], iov, 3),
+                      "writev of three segments wraps past the end of the page");
+    memset(in, 0, sizeof(in));
+    iov[0].iov_base = in + 2000; iov[0].iov_len = 1;
+    iov[1].iov_base = in + 2001; iov[1].iov_len = 2499;
+    iov[2].iov_base = in + 4500; iov[2].iov_len = 2000;
+    TEST_ASSERT_EQUAL(3500, sys_readv(fds[0], iov, 3),
+                      "readv gets everything that was left");
+    TEST_ASSERT_MEM_EQUAL(out + 2000, in + 2000, 3500,
+                          "the wrapped bytes come out in order");
+    sys_fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    TEST_ASSERT_EQUAL(-EAGAIN, sys_read(fds[0], in, 1),
+                      "an empty nonblocking pipe says EAGAIN");
+
+    TEST_CASE_BEGIN("F_SETPIPE_SZ keeps wrapped contents");
+    ksim_fill(out, 3000, 3);
+    write_all(fds[1], out, 3000);
+    sys_read(fds[0], in, 2000);
+    ksim_fill(out + 3000, 2000, 4);
+    write_all(fds[1], out + 3000, 2000);
+    TEST_ASSERT_EQUAL(RING, sys_fcntl(fds[1], F_SETPIPE_SZ, 1),
+                      "asking for the same number of pages changes nothing");
+    TEST_ASSERT_EQUAL(-EINVAL, sys_fcntl(fds[1], F_SETPIPE_SZ, 9*RING),
+                      "can't grow past eight pages");
+    TEST_ASSERT_EQUAL(3*RING, sys_fcntl(fds[1], F_SETPIPE_SZ, 2*RING+1),
+                      "size is rounded up to whole pages");
+    TEST_ASSERT_EQUAL(3*RING, sys_fcntl(fds[0], F_GETPIPE_SZ, 0),
+                      "both ends see the new size");
+    ksim_fill(out + 5000, 3*RING - 3000, 5);
+    sys_fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    TEST_ASSERT_EQUAL(3*RING - 3000, write_all(fds[1], out + 5000, 3*RING),
+                      "the grown pipe takes three pages before it is full");
+    TEST_ASSERT_EQUAL(-EBUSY, sys_fcntl(fds[1], F_SETPIPE_SZ, RING),
+                      "can't shrink below what the pipe holds");
+    TEST_ASSERT_EQUAL(3*RING, sys_read(fds[0], in + 2000, 4*RING),
+                      "and gives them all back");
+    TEST_ASSERT_MEM_EQUAL(out + 2000, in + 2000, 3*RING,
+                          "the old contents come first, unchanged");
+    TEST_ASSERT_EQUAL(RING, sys_fcntl(fds[0], F_SETPIPE_SZ, RING),
+                      "an empty pipe shrinks back to one page");
+
+    TEST_CASE_BEGIN("select on a pipe");
+    write_all(fds[1], "x", 1);
+    TEST_ASSERT_EQUAL(1, select_in(fds[0], fds[0] + 1, set),
+                      "a written pipe is readable");
+    TEST_ASSERT(set[0] & (1UL << fds[0]), "and its bit comes back set");
+    TEST_ASSERT_EQUAL(-EBADF, select_in(100, 101, set),
+                      "a bit past the end of the fd table says EBADF");
+    sys_read(fds[0], in, 1);
+    sys_close(fds[0]);
+    sys_close(fds[1]);
+
+    ksim_set_fault(ksim_fault_in_tasks);
+
+    TEST_CASE_BEGIN("resize waits for a read that sleeps in its copy");
+    memset(in, 0, sizeof(in));
+    sys_pipe(fds);
+    ksim_fill(out, 4000, 6);
+    write_all(fds[1], out, 4000);
+    n = ksim_spawn(reader_task, (void *) 4000L);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(2*RING, sys_fcntl(fds[1], F_SETPIPE_SZ, 2*RING),
+                      "F_SETPIPE_SZ during the read");
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "the reader finishes");
+    TEST_ASSERT_EQUAL(4000, result[n], "the reader got every byte");
+    TEST_ASSERT_MEM_EQUAL(out, in, 4000, "from the pages it started on");
+    sys_close(fds[0]);
+    sys_close(fds[1]);
+
+    TEST_CASE_BEGIN("a read during a sleeping write doesn't rewind the ring");
+    memset(in, 0, sizeof(in));
+    sys_pipe(fds);
+    write_all(fds[1], "AAAAAAAAAA", 10);
+    memset(bs, 'B', sizeof(bs));
+    n = ksim_spawn(bytes_task, bs);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(10, sys_read(fds[0], in, 10), "read the first ten bytes");
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "the writer finishes");
+    TEST_ASSERT_EQUAL(20, result[n], "the writer wrote all of its bytes");
+    TEST_ASSERT_EQUAL(20, sys_read(fds[0], in + 10, 30), "read the rest");
+    TEST_ASSERT_MEM_EQUAL("AAAAAAAAAA", in, 10, "the old bytes came first");
+    TEST_ASSERT_MEM_EQUAL(bs, in + 10, 20, "the new ones follow, intact");
+    sys_close(fds[0]);
+    sys_close(fds[1]);
+
+    TEST_CASE_BEGIN("atomic writes from two tasks don't interleave");
+    memset(in, 0, sizeof(in));
+    sys_pipe(fds);
+    memset(a, 'a', sizeof(a));
+    memset(b, 'b', sizeof(b));
+    result[2] = result[3] = 0;
+    ksim_spawn(writer_task, a);
+    ksim_spawn(writer_task, b);
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "both writers finish");
+    TEST_ASSERT(result[2] == 2000 && result[3] == 2000,
+                "each wrote 2000 bytes");
+    TEST_ASSERT_EQUAL(4000, sys_read(fds[0], in, 4000), "read them back");
+    TEST_ASSERT(!memcmp(in, a, 2000) || !memcmp(in, b, 2000),
+                "the first write is in one piece");
+    TEST_ASSERT(!memcmp(in + 2000, a, 2000) || !memcmp(in + 2000, b, 2000),
+                "so is the second");
+    ksim_set_fault(NULL);
+
+    TEST_CASE_BEGIN("writing with no reader");
+    sys_close(fds[0]);
+    TEST_ASSERT_EQUAL(-EPIPE, write_all(fds[1], out, 1), "write says EPIPE");
+    TEST_ASSERT(ksim_signals() & (1 << (SIGPIPE-1)), "and sends SIGPIPE");
+    sys_close(fds[1]);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(), "no inodes are left in use");
+    TEST_ASSERT_EQUAL(memory, ksim_memory(), "every page was freed");
+
+    TEST_SUITE_END();
+}
@@ -0,0 +1,129 @@
+/*
+ * Unit tests for net/sock_ring.c, the receive ring of unix and inet
+ * stream sockets, driven through a unix socketpair
+ * readv/writev wrapping around the ring pages, SO_RCVBUF/SO_SNDBUF
+ * sizing, SO_RCVLOWAT, and reads while a writer sleeps in its copy
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+
+#define PAGE KSIM_PAGE_SIZE
+
+static int sv[2], result[8];
+static char out[8*PAGE], in[8*PAGE];
+
+static void bytes_task(void * arg)
+{
+    result[ksim_self()] = sys_write(sv[1], arg, 20);
+}
+
+static void reader_task(void * arg)
+{
+    result[ksim_self()] = sys_read(sv[0], in, 200);
+}
+
+int main(void) {
+    struct iovec iov[3];
+    int n, memory;
+    static char bs[20];
+
+    TEST_SUITE_BEGIN("Socket Ring");
+    ksim_init();
+    memory = ksim_memory();
+
+    TEST_CASE_BEGIN("readv and writev wrap around the ring pages");
+    TEST_ASSERT_EQUAL(0, ksim_unix_pair(SOCK_STREAM, sv), "socketpair()");
+    TEST_ASSERT_EQUAL(PAGE, ksim_get_opt(sv[0], SO_RCVBUF),
+                      "the receive buffer starts at one page");
+    TEST_ASSERT_EQUAL(0, ksim_get_opt(sv[0], SO_SNDBUF),
+                      "SO_SNDBUF starts unset");
+    ksim_fill(out, 3000, 1);
+    TEST_ASSERT_EQUAL(3000, sys_write(sv[1], out, 3000), "write 3000 bytes");
+    TEST_ASSERT_EQUAL(2000, sys_read(sv[0], in, 2000), "read 2000 back");
+    TEST_ASSERT_MEM_EQUAL(out, in, 2000, "in order");
+    ksim_fill(out + 3000, 2500, 2);
+    iov[0].iov_base = out + 3000; iov[0].iov_len = 700;
+    iov[1].iov_base = out + 3700; iov[1].iov_len = 1000;
+    iov[2].iov_base = out + 4700; iov[2].iov_len = 800;
+    TEST_ASSERT_EQUAL(2500, sys_writev(sv[1], iov, 3),
+                      "writev of three segments wraps past the end of the ring");
+    memset(in, 0, sizeof(in));
+    iov[0].iov_base = in + 2000; iov[0].iov_len = 1;
+    iov[1].iov_base = in + 2001; iov[1].iov_len = 2499;
+    iov[2].iov_base = in + 4500; iov[2].iov_len = 2000;
+    TEST_ASSERT_EQUAL(3500, sys_readv(sv[0], iov, 3),
+                      "readv gets everything that was left");
+    TEST_ASSERT_MEM_EQUAL(out + 2000, in + 2000, 3500,
+                          "the wrapped bytes come out in order");
+    sys_fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    sys_fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    TEST_ASSERT_EQUAL(-EAGAIN, sys_read(sv[0], in, 1),
+                      "an empty nonblocking socket says EAGAIN");
+
+    TEST_CASE_BEGIN("SO_RCVBUF and SO_SNDBUF size the ring");
+    TEST_ASSERT_EQUAL(0, ksim_set_opt(sv[0], SO_RCVBUF, 3*PAGE + 1),
+                      "set SO_RCVBUF");
+    TEST_ASSERT_EQUAL(4*PAGE, ksim_get_opt(sv[0], SO_RCVBUF),
+                      "it is rounded up to whole pages");
+    ksim_fill(out, 5*PAGE, 3);
+    TEST_ASSERT_EQUAL(4*PAGE, sys_write(sv[1], out, 5*PAGE),
+                      "the peer can write that much");
+    TEST_ASSERT_EQUAL(-EAGAIN, sys_write(sv[1], out, 1),
+                      "and no more");
+    TEST_ASSERT_EQUAL(4*PAGE, sys_read(sv[0], in, 5*PAGE),
+                      "it all comes back");
+    TEST_ASSERT_MEM_EQUAL(out, in, 4*PAGE, "unchanged");
+    ksim_set_opt(sv[0], SO_RCVBUF, 1);
+    TEST_ASSERT_EQUAL(0, ksim_set_opt(sv[1], SO_SNDBUF, 2*PAGE),
+                      "set the writer's SO_SNDBUF");
+    TEST_ASSERT_EQUAL(2*PAGE, sys_write(sv[1], out, 5*PAGE),
+                      "a bigger SO_SNDBUF grows the peer's ring");
+    TEST_ASSERT_EQUAL(2*PAGE, sys_read(sv[0], in, 5*PAGE), "read it back");
+    TEST_ASSERT_MEM_EQUAL(out, in, 2*PAGE, "unchanged");
+    TEST_ASSERT_EQUAL(0, ksim_set_opt(sv[0], SO_RCVBUF, 100*PAGE),
+                      "SO_RCVBUF is capped");
+    TEST_ASSERT_EQUAL(16*PAGE, ksim_get_opt(sv[0], SO_RCVBUF),
+                      "at sixteen pages");
+    TEST_ASSERT_EQUAL(-ENOPROTOOPT, ksim_set_opt(sv[0], 0x7777, 1),
+                      "unknown options say ENOPROTOOPT");
+    sys_close(sv[0]);
+    sys_close(sv[1]);
+
+    ksim_set_fault(ksim_fault_in_tasks);
+
+    TEST_CASE_BEGIN("reading while a writer sleeps in its copy");
+    memset(in, 0, sizeof(in));
+    ksim_unix_pair(SOCK_STREAM, sv);
+    sys_write(sv[1], "AAAAAAAAAA", 10);
+    memset(bs, 'B', sizeof(bs));
+    n = ksim_spawn(bytes_task, bs);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(10, sys_read(sv[0], in, 10), "read the first ten bytes");
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "the writer finishes");
+    TEST_ASSERT_EQUAL(20, result[n], "the writer wrote all of its bytes");
+    TEST_ASSERT_EQUAL(20, sys_read(sv[0], in + 10, 30), "read the rest");
+    TEST_ASSERT_MEM_EQUAL("AAAAAAAAAA", in, 10, "the old bytes came first");
+    TEST_ASSERT_MEM_EQUAL(bs, in + 10, 20, "the new ones follow, intact");
+    ksim_set_fault(NULL);
+
+    TEST_CASE_BEGIN("SO_RCVLOWAT holds the reader back");
+    TEST_ASSERT_EQUAL(0, ksim_set_opt(sv[0], SO_RCVLOWAT, 100),
+                      "set SO_RCVLOWAT");
+    memset(result, 0, sizeof(result));
+    n = ksim_spawn(reader_task, NULL);
+    ksim_yield();
+    sys_write(sv[1], out, 50);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(0, result[n], "50 bytes don't wake the reader");
+    sys_write(sv[1], out + 50, 60);
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "110 bytes do");
+    TEST_ASSERT_EQUAL(110, result[n], "and it gets them all");
+    TEST_ASSERT_MEM_EQUAL(out, in, 110, "in order");
+    sys_close(sv[0]);
+    sys_close(sv[1]);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(), "no inodes are left in use");
+    TEST_ASSERT_EQUAL(memory, ksim_memory(), "every page was freed");
+
+    TEST_SUITE_END();
+}
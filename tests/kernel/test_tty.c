@@ -0,0 +1,127 @@
+/*
+ * Unit tests for kernel/chr_drv/tty_io.c and pty.c
+ * which termios settings take the raw input path, what that path does
+ * to the characters and to the queues, and ptys handing output to a raw
+ * other side straight into its secondary queue
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+
+#define LINE 64			/* the first serial line: raw out of tty_init() */
+#define MASTER 128		/* the first pty pair */
+#define SLAVE 192
+#define TTY_BUF 4096		/* TTY_BUF_SIZE */
+
+static char out[2*TTY_BUF], in[2*TTY_BUF];
+
+int main(void) {
+    static const unsigned long iflags[] = {
+        ISTRIP, INLCR, IGNCR, ICRNL, IUCLC, IXON
+    };
+    static const unsigned long lflags[] = { ICANON, ISIG, ECHO };
+    int i, n, lines;
+
+    TEST_SUITE_BEGIN("Tty");
+    ksim_init();
+
+    TEST_CASE_BEGIN("which settings count as raw input");
+    ksim_tty_flags(LINE, 0, 0);
+    TEST_ASSERT(ksim_tty_raw(LINE), "no input flags at all is raw");
+    for (i = n = 0; i < 6; i++) {
+        ksim_tty_flags(LINE, iflags[i], 0);
+        n += ksim_tty_raw(LINE);
+    }
+    TEST_ASSERT_EQUAL(0, n, "any input mapping or IXON is not");
+    for (i = n = 0; i < 3; i++) {
+        ksim_tty_flags(LINE, 0, lflags[i]);
+        n += ksim_tty_raw(LINE);
+    }
+    TEST_ASSERT_EQUAL(0, n, "nor is ICANON, ISIG or ECHO");
+    ksim_tty_flags(LINE, IXANY | IMAXBEL, ECHOCTL | TOSTOP | IEXTEN);
+    TEST_ASSERT(ksim_tty_raw(LINE), "flags that change no input still are");
+
+    TEST_CASE_BEGIN("raw input goes to secondary untouched");
+    ksim_tty_flags(LINE, 0, 0);
+    for (i = lines = 0; i < 1000; i++) {
+        out[i] = (char) (i * 7);
+        if (out[i] == '\n' || out[i] == 4)
+            lines++;
+    }
+    TEST_ASSERT_EQUAL(1000, ksim_tty_input(LINE, out, 1000), "1000 bytes in");
+    TEST_ASSERT_EQUAL(0, ksim_tty_chars(LINE, 0), "read_q is emptied");
+    TEST_ASSERT_EQUAL(0, ksim_tty_chars(LINE, 1), "nothing is echoed");
+    TEST_ASSERT_EQUAL(lines, ksim_tty_lines(LINE),
+                      "newlines and EOFs are still counted");
+    TEST_ASSERT_EQUAL(1000, ksim_tty_take(LINE, 2, in, sizeof(in)),
+                      "secondary holds all of them");
+    TEST_ASSERT_MEM_EQUAL(out, in, 1000, "every byte as it came in");
+
+    TEST_CASE_BEGIN("raw input waits in read_q while secondary is full");
+    for (i = 0; i < TTY_BUF + 100; i++)
+        out[i] = (char) (i % 251);
+    n = ksim_tty_input(LINE, out, TTY_BUF - 1);
+    n += ksim_tty_input(LINE, out + n, 101);
+    TEST_ASSERT_EQUAL(TTY_BUF + 100, n, "read_q takes what didn't fit");
+    TEST_ASSERT_EQUAL(TTY_BUF - 1, ksim_tty_chars(LINE, 2), "secondary is full");
+    TEST_ASSERT_EQUAL(101, ksim_tty_chars(LINE, 0), "the rest is in read_q");
+    TEST_ASSERT_EQUAL(1000, ksim_tty_take(LINE, 2, in, 1000), "read some");
+    ksim_tty_input(LINE, out, 0);
+    TEST_ASSERT_EQUAL(0, ksim_tty_chars(LINE, 0), "and read_q moves up");
+    n = ksim_tty_take(LINE, 2, in + 1000, sizeof(in) - 1000);
+    TEST_ASSERT_EQUAL(TTY_BUF + 100, n + 1000, "everything arrives");
+    TEST_ASSERT_MEM_EQUAL(out, in, TTY_BUF + 100, "in order");
+
+    TEST_CASE_BEGIN("cooked input is still cooked");
+    ksim_tty_flags(LINE, ICRNL, ICANON | ECHO);
+    ksim_tty_input(LINE, "ab\r", 3);
+    TEST_ASSERT_EQUAL(3, ksim_tty_take(LINE, 2, in, sizeof(in)), "three bytes");
+    TEST_ASSERT_MEM_EQUAL("ab\n", in, 3, "CR becomes NL");
+    TEST_ASSERT_EQUAL(4, ksim_tty_take(LINE, 1, in, sizeof(in)), "and is echoed");
+    TEST_ASSERT_MEM_EQUAL("ab\n\r", in, 4, "as NL CR");
+
+    TEST_CASE_BEGIN("a raw pty slave gets the master's output directly");
+    ksim_tty_flags(SLAVE, 0, 0);
+    for (i = 0; i < 6000; i++)
+        out[i] = (char) (i * 13 + i / 509);
+    TEST_ASSERT_EQUAL(3000, ksim_tty_output(MASTER, out, 3000), "write 3000");
+    TEST_ASSERT_EQUAL(3000, ksim_tty_chars(SLAVE, 2), "they reach secondary");
+    TEST_ASSERT_EQUAL(3000, ksim_tty_output(MASTER, out + 3000, 3000),
+                      "write 3000 more");
+    TEST_ASSERT_EQUAL(TTY_BUF - 1, ksim_tty_chars(SLAVE, 2), "secondary fills");
+    TEST_ASSERT_EQUAL(0, ksim_tty_chars(SLAVE, 0), "nothing goes through read_q");
+    TEST_ASSERT_EQUAL(6000 - (TTY_BUF - 1), ksim_tty_chars(MASTER, 1),
+                      "the rest waits in the master's write_q");
+    n = ksim_tty_take(SLAVE, 2, in, sizeof(in));
+    ksim_tty_output(MASTER, out, 0);
+    n += ksim_tty_take(SLAVE, 2, in + n, sizeof(in) - n);
+    TEST_ASSERT_EQUAL(6000, n, "the slave reads all of it");
+    TEST_ASSERT_MEM_EQUAL(out, in, 6000, "every byte in order");
+
+    TEST_CASE_BEGIN("a cooked pty slave takes it through read_q");
+    ksim_tty_flags(SLAVE, 0, ICANON);
+    for (i = 0; i < 6000; i++)
+        out[i] = 'a' + i % 26;
+    ksim_tty_output(MASTER, out, 3000);
+    ksim_tty_output(MASTER, out + 3000, 3000);
+    TEST_ASSERT_EQUAL(TTY_BUF - 1, ksim_tty_chars(SLAVE, 2), "secondary fills");
+    TEST_ASSERT_EQUAL(6000 - (TTY_BUF - 1), ksim_tty_chars(SLAVE, 0),
+                      "the rest is in read_q");
+
+    TEST_CASE_BEGIN("a raw pty slave with input pending keeps its order");
+    ksim_tty_flags(SLAVE, 0, 0);
+    for (i = 6000; i < 6100; i++)
+        out[i] = '0' + i % 10;
+    TEST_ASSERT_EQUAL(100, ksim_tty_output(MASTER, out + 6000, 100),
+                      "write 100 more");
+    TEST_ASSERT_EQUAL(6100 - (TTY_BUF - 1), ksim_tty_chars(SLAVE, 0),
+                      "they queue up behind read_q");
+    n = ksim_tty_take(SLAVE, 2, in, sizeof(in));
+    ksim_tty_input(SLAVE, out, 0);
+    n += ksim_tty_take(SLAVE, 2, in + n, sizeof(in) - n);
+    TEST_ASSERT_EQUAL(6100, n, "the slave reads all of it");
+    TEST_ASSERT_MEM_EQUAL(out, in, 6100, "in the order it was written");
+    TEST_ASSERT_EQUAL(0, ksim_tty_chars(MASTER, 1), "the master is drained");
+
+    TEST_SUITE_END();
+}
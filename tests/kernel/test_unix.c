@@ -0,0 +1,163 @@
+/*
+ * Unit tests for net/unix.c stream sockets
+ * passing descriptors with SCM_RIGHTS, and closing the peer; the ring
+ * the data goes through has its own tests in test_sock_ring.c
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+
+#define PAGE KSIM_PAGE_SIZE
+
+static char out[PAGE], in[PAGE];
+
+/*
+ * one descriptor per message: the kernel reads each one as a long, so
+ * the control buffers are zeroed past the int it is stored in.
+ */
+static int send_fd(int sock, char * data, int fd)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    unsigned long ctl[4], args[3];
+    struct cmsghdr * cmsg = (struct cmsghdr *) ctl;
+
+    memset(ctl, 0, sizeof(ctl));
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    *(int *) CMSG_DATA(cmsg) = fd;
+    iov.iov_base = data;
+    iov.iov_len = strlen(data);
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl;
+    mh.msg_controllen = cmsg->cmsg_len;
+    args[0] = sock;
+    args[1] = (unsigned long) &mh;
+    args[2] = 0;
+    return sys_socketcall(SYS_SENDMSG, args);
+}
+
+/* *fd is -1 unless a descriptor came with the data */
+static int recv_fd(int sock, char * buf, int len, int ctllen, int * fd,
+                   int * flags)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    unsigned long ctl[4], args[3];
+    struct cmsghdr * cmsg = (struct cmsghdr *) ctl;
+    int n;
+
+    memset(ctl, 0, sizeof(ctl));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctllen ? ctl : NULL;
+    mh.msg_controllen = ctllen;
+    args[0] = sock;
+    args[1] = (unsigned long) &mh;
+    args[2] = 0;
+    n = sys_socketcall(SYS_RECVMSG, args);
+    *fd = -1;
+    if (mh.msg_controllen == CMSG_LEN(sizeof(int)) &&
+        cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        *fd = *(int *) CMSG_DATA(cmsg);
+    *flags = mh.msg_flags;
+    return n;
+}
+
+int main(void) {
+    unsigned long fds[2];
+    int sv[2], pv[2], qv[2];
+    int n, fd, flags, memory;
+
+    TEST_SUITE_BEGIN("Unix Stream Sockets");
+    ksim_init();
+    memory = ksim_memory();
+
+    TEST_CASE_BEGIN("SCM_RIGHTS passes a pipe");
+    ksim_unix_pair(SOCK_STREAM, pv);
+    fds[0] = fds[1] = 0;
+    sys_pipe(fds);
+    TEST_ASSERT_EQUAL(1, send_fd(pv[1], "r", fds[0]),
+                      "send the read end with one byte");
+    sys_close(fds[0]);
+    sys_write(fds[1], "piped", 5);
+    memset(in, 0, sizeof(in));
+    TEST_ASSERT_EQUAL(1, recv_fd(pv[0], in, 10, CMSG_SPACE(sizeof(int)),
+                                 &fd, &flags), "receive the byte");
+    TEST_ASSERT(fd >= 0 && fd != pv[0] && fd != pv[1] && fd != fds[1],
+                "and a new descriptor");
+    TEST_ASSERT_EQUAL(0, flags & MSG_CTRUNC, "nothing was cut off");
+    TEST_ASSERT_EQUAL(5, sys_read(fd, in + 1, 10),
+                      "it reads from the pipe");
+    TEST_ASSERT_MEM_EQUAL("rpiped", in, 6, "what was written to it");
+    sys_close(fd);
+
+    TEST_CASE_BEGIN("descriptors stay with their data");
+    sys_write(pv[1], "abc", 3);
+    send_fd(pv[1], "d", fds[1]);
+    TEST_ASSERT_EQUAL(3, recv_fd(pv[0], in, 10, CMSG_SPACE(sizeof(int)),
+                                 &fd, &flags), "a read stops short of them");
+    TEST_ASSERT_EQUAL(-1, fd, "and gets none");
+    TEST_ASSERT_EQUAL(1, recv_fd(pv[0], in, 10, CMSG_SPACE(sizeof(int)),
+                                 &fd, &flags), "the next read starts there");
+    TEST_ASSERT(fd >= 0, "and gets the descriptor");
+    sys_close(fd);
+    sys_close(fds[1]);
+
+    TEST_CASE_BEGIN("no room for the descriptor");
+    fds[0] = fds[1] = 0;
+    sys_pipe(fds);
+    send_fd(pv[1], "w", fds[1]);
+    sys_close(fds[1]);
+    TEST_ASSERT_EQUAL(1, recv_fd(pv[0], in, 10, 0, &fd, &flags),
+                      "receive without a control buffer");
+    TEST_ASSERT(flags & MSG_CTRUNC, "says MSG_CTRUNC");
+    TEST_ASSERT_EQUAL(0, sys_read(fds[0], in, 1),
+                      "and the write end it dropped is closed");
+    sys_close(fds[0]);
+
+    TEST_CASE_BEGIN("sockets that could never be freed");
+    TEST_ASSERT_EQUAL(-ETOOMANYREFS, send_fd(pv[1], "x", pv[0]),
+                      "a socket can't be sent to itself");
+    ksim_unix_pair(SOCK_STREAM, qv);
+    fds[0] = fds[1] = 0;
+    sys_pipe(fds);
+    send_fd(qv[1], "y", fds[0]);
+    TEST_ASSERT_EQUAL(-ETOOMANYREFS, send_fd(pv[1], "x", qv[0]),
+                      "nor one with descriptors queued on it");
+    TEST_ASSERT_EQUAL(1, send_fd(pv[1], "x", qv[1]),
+                      "its peer can go");
+    TEST_ASSERT_EQUAL(-EBADF, send_fd(pv[1], "x", 30),
+                      "a descriptor that isn't open says EBADF");
+
+    TEST_CASE_BEGIN("descriptors nobody received");
+    n = ksim_inodes();
+    sys_close(qv[1]);
+    sys_close(fds[0]);
+    sys_close(fds[1]);
+    TEST_ASSERT_EQUAL(n, ksim_inodes(),
+                      "files in flight stay open after their last close");
+    sys_close(pv[1]);
+    sys_close(pv[0]);
+    sys_close(qv[0]);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(),
+                      "closing the receivers frees them");
+
+    TEST_CASE_BEGIN("closing the peer");
+    ksim_unix_pair(SOCK_STREAM, sv);
+    sys_close(sv[0]);
+    TEST_ASSERT_EQUAL(-EPIPE, sys_write(sv[1], out, 1),
+                      "a write to a closed peer says EPIPE");
+    ksim_signals();
+    sys_close(sv[1]);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(), "no inodes are left in use");
+    TEST_ASSERT_EQUAL(memory, ksim_memory(), "every page was freed");
+
+    TEST_SUITE_END();
+}
@@ -0,0 +1,263 @@
+/*
+ * Unit tests for net/unix.c datagram and seqpacket sockets
+ * message boundaries, the receive queue limit, sending with and
+ * without an address, and closing the peer
+ */
+
+#include "../test_framework.h"
+#include "ksim.h"
+#include <signal.h>
+
+#define PAGE KSIM_PAGE_SIZE
+#define MSG 1000
+
+static char out[2*PAGE], in[2*PAGE];
+static int rcv, result[8];
+
+static int un_socket(int type)
+{
+    unsigned long args[3];
+
+    args[0] = AF_UNIX;
+    args[1] = type;
+    args[2] = 0;
+    return sys_socketcall(SYS_SOCKET, args);
+}
+
+static int un_name(struct sockaddr_un * sun, const char * path)
+{
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, path);
+    return sizeof(sun->sun_family) + strlen(path);
+}
+
+/* bind or connect fd to path */
+static int un_call(int call, int fd, const char * path)
+{
+    struct sockaddr_un sun;
+    unsigned long args[3];
+
+    args[2] = un_name(&sun, path);
+    args[0] = fd;
+    args[1] = (unsigned long) &sun;
+    return sys_socketcall(call, args);
+}
+
+/* to path, or to the default destination if path is NULL */
+static int un_sendto(int fd, char * buf, int len, const char * path)
+{
+    struct sockaddr_un sun;
+    unsigned long args[6];
+
+    args[0] = fd;
+    args[1] = (unsigned long) buf;
+    args[2] = len;
+    args[3] = 0;
+    args[4] = path ? (unsigned long) &sun : 0;
+    args[5] = path ? un_name(&sun, path) : 0;
+    return sys_socketcall(SYS_SENDTO, args);
+}
+
+/* *from gets the sender's path; the kernel reads its length as a long */
+static int un_recvfrom(int fd, char * buf, int len, char * from)
+{
+    struct sockaddr_un sun;
+    unsigned long args[6], addrlen = sizeof(sun);
+    int n;
+
+    memset(&sun, 0, sizeof(sun));
+    args[0] = fd;
+    args[1] = (unsigned long) buf;
+    args[2] = len;
+    args[3] = 0;
+    args[4] = (unsigned long) &sun;
+    args[5] = (unsigned long) &addrlen;
+    n = sys_socketcall(SYS_RECVFROM, args);
+    from[0] = '\0';
+    if (addrlen > sizeof(sun.sun_family)) {
+        memcpy(from, sun.sun_path, addrlen - sizeof(sun.sun_family));
+        from[addrlen - sizeof(sun.sun_family)] = '\0';
+    }
+    return n;
+}
+
+static int recv_flags(int fd, char * buf, int len)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    unsigned long args[3];
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    args[0] = fd;
+    args[1] = (unsigned long) &mh;
+    args[2] = 0;
+    if (sys_socketcall(SYS_RECVMSG, args) < 0)
+        return -1;
+    return mh.msg_flags;
+}
+
+/* a forked sender, that closes its copy of the receiver first */
+static void send_task(void * arg)
+{
+    sys_close(rcv);
+    result[ksim_self()] = sys_write((int) (long) arg, out, MSG);
+}
+
+/* messages of MSG bytes that fit before a nonblocking send fails */
+static int fill_queue(int fd)
+{
+    int n, error;
+
+    sys_fcntl(fd, F_SETFL, O_NONBLOCK);
+    for (n = 0; (error = sys_write(fd, out, MSG)) == MSG; n++)
+        ;
+    sys_fcntl(fd, F_SETFL, 0);
+    return error == -EAGAIN ? n : error;
+}
+
+int main(void) {
+    int sv[2], pv[2];
+    int a, b, c, n, memory;
+    char from[110];
+
+    TEST_SUITE_BEGIN("Unix Datagram Sockets");
+    ksim_init();
+    memory = ksim_memory();
+
+    TEST_CASE_BEGIN("datagrams keep their boundaries");
+    TEST_ASSERT_EQUAL(0, ksim_unix_pair(SOCK_DGRAM, sv), "a datagram pair");
+    TEST_ASSERT_EQUAL(3, sys_write(sv[1], "one", 3), "send three bytes");
+    TEST_ASSERT_EQUAL(5, sys_write(sv[1], "three", 5), "then five");
+    TEST_ASSERT_EQUAL(3, sys_read(sv[0], in, 100),
+                      "a read gets only the first message");
+    TEST_ASSERT_MEM_EQUAL("one", in, 3, "whole");
+    TEST_ASSERT_EQUAL(5, sys_read(sv[0], in, 100), "the next the second");
+    TEST_ASSERT_MEM_EQUAL("three", in, 5, "whole");
+    sys_write(sv[1], "truncated", 9);
+    sys_write(sv[1], "next", 4);
+    TEST_ASSERT_EQUAL(MSG_TRUNC, recv_flags(sv[0], in, 5),
+                      "a short read says MSG_TRUNC");
+    TEST_ASSERT_MEM_EQUAL("trunc", in, 5, "and gets the start");
+    TEST_ASSERT_EQUAL(4, sys_read(sv[0], in, 100),
+                      "the rest of that message is gone");
+    TEST_ASSERT_MEM_EQUAL("next", in, 4, "the next read gets the next one");
+    TEST_ASSERT_EQUAL(-EMSGSIZE, sys_write(sv[1], out, PAGE),
+                      "a message must fit in a page");
+
+    TEST_CASE_BEGIN("seqpacket keeps them too");
+    TEST_ASSERT_EQUAL(0, ksim_unix_pair(SOCK_SEQPACKET, pv),
+                      "a seqpacket pair");
+    ksim_fill(out, 2*MSG, 1);
+    TEST_ASSERT_EQUAL(MSG, sys_write(pv[0], out, MSG), "send one message");
+    TEST_ASSERT_EQUAL(MSG, sys_write(pv[0], out + MSG, MSG), "and another");
+    TEST_ASSERT_EQUAL(MSG, sys_read(pv[1], in, 2*PAGE),
+                      "a big read still gets one message");
+    TEST_ASSERT_MEM_EQUAL(out, in, MSG, "the first");
+    TEST_ASSERT_EQUAL(MSG, sys_read(pv[1], in, 2*PAGE), "then the second");
+    TEST_ASSERT_MEM_EQUAL(out + MSG, in, MSG, "in order");
+    TEST_ASSERT_EQUAL(0, un_sendto(pv[0], out, 0, NULL),
+                      "send() can send an empty message");
+    TEST_ASSERT_EQUAL(3, sys_write(pv[0], "end", 3), "before another");
+    TEST_ASSERT_EQUAL(0, sys_read(pv[1], in, 100), "and is read as one");
+    TEST_ASSERT_EQUAL(3, sys_read(pv[1], in, 100), "apart from the next");
+
+    TEST_CASE_BEGIN("the receive queue limit");
+    TEST_ASSERT_EQUAL(4*PAGE, ksim_get_opt(sv[0], SO_RCVBUF),
+                      "four pages may be queued");
+    TEST_ASSERT_EQUAL(16, fill_queue(sv[1]),
+                      "a nonblocking sender stops at sixteen messages");
+    n = 0;
+    while (sys_fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0 &&
+           sys_read(sv[0], in, MSG) == MSG)
+        n++;
+    sys_fcntl(sv[0], F_SETFL, 0);
+    TEST_ASSERT_EQUAL(16, n, "they are all there");
+    ksim_set_opt(sv[0], SO_RCVBUF, PAGE);
+    TEST_ASSERT_EQUAL(PAGE, ksim_get_opt(sv[0], SO_RCVBUF),
+                      "SO_RCVBUF shrinks the queue");
+    TEST_ASSERT_EQUAL(4, fill_queue(sv[1]), "to one page");
+    ksim_set_opt(sv[1], SO_SNDBUF, 2*PAGE);
+    TEST_ASSERT_EQUAL(4, fill_queue(sv[1]),
+                      "the sender's SO_SNDBUF lets it queue more");
+    memset(result, 0, sizeof(result));
+    rcv = -1;
+    n = ksim_spawn(send_task, (void *) (long) sv[1]);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(0, result[n], "a blocking sender waits");
+    TEST_ASSERT_EQUAL(MSG, sys_read(sv[0], in, MSG), "until one is read");
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "it wakes up");
+    TEST_ASSERT_EQUAL(MSG, result[n], "and sends the whole message");
+    sys_close(sv[0]);
+    sys_close(sv[1]);
+
+    TEST_CASE_BEGIN("sending with and without an address");
+    a = un_socket(SOCK_DGRAM);
+    b = un_socket(SOCK_DGRAM);
+    c = un_socket(SOCK_DGRAM);
+    TEST_ASSERT_EQUAL(0, un_call(SYS_BIND, a, "/a"), "bind /a");
+    TEST_ASSERT_EQUAL(0, un_call(SYS_BIND, b, "/b"), "bind /b");
+    TEST_ASSERT_EQUAL(-EDESTADDRREQ, sys_write(c, "x", 1),
+                      "an unconnected send needs an address");
+    TEST_ASSERT_EQUAL(-ECONNREFUSED, un_sendto(c, "x", 1, "/nobody"),
+                      "to a name somebody bound");
+    TEST_ASSERT_EQUAL(2, un_sendto(b, "to", 2, "/a"), "sendto /a");
+    TEST_ASSERT_EQUAL(2, un_recvfrom(a, in, 10, from), "a gets it");
+    TEST_ASSERT_STR_EQUAL("/b", from, "from /b");
+    TEST_ASSERT_EQUAL(0, un_call(SYS_CONNECT, c, "/a"), "connect to /a");
+    TEST_ASSERT_EQUAL(3, sys_write(c, "def", 3),
+                      "a send goes to the default destination");
+    TEST_ASSERT_EQUAL(5, un_sendto(c, "other", 5, "/b"),
+                      "a connected socket may still name another");
+    TEST_ASSERT_EQUAL(5, un_recvfrom(b, in, 10, from), "b gets that one");
+    TEST_ASSERT_MEM_EQUAL("other", in, 5, "unchanged");
+    TEST_ASSERT_STR_EQUAL("", from, "from an unbound socket");
+    TEST_ASSERT_EQUAL(3, sys_read(a, in, 10), "and a the default one");
+    TEST_ASSERT_EQUAL(-EISCONN, un_sendto(pv[0], "x", 1, "/a"),
+                      "a connected seqpacket socket can't name one");
+    n = un_socket(SOCK_SEQPACKET);
+    TEST_ASSERT_EQUAL(-ENOTCONN, sys_write(n, "x", 1),
+                      "an unconnected one can't send");
+    TEST_ASSERT_EQUAL(-ENOTCONN, un_sendto(n, "x", 1, "/a"),
+                      "even to an address");
+    TEST_ASSERT_EQUAL(-EPROTOTYPE, un_call(SYS_CONNECT, n, "/a"),
+                      "nor connect to a datagram socket");
+    sys_close(n);
+
+    TEST_CASE_BEGIN("closing the peer");
+    sys_close(a);
+    TEST_ASSERT_EQUAL(-ECONNREFUSED, sys_write(c, "x", 1),
+                      "a datagram to a closed socket is refused");
+    TEST_ASSERT_EQUAL(-ECONNREFUSED, un_sendto(b, "x", 1, "/a"),
+                      "and its name is gone");
+    sys_close(b);
+    sys_close(c);
+    sys_write(pv[0], "last", 4);
+    sys_close(pv[0]);
+    TEST_ASSERT_EQUAL(4, sys_read(pv[1], in, 10),
+                      "a seqpacket peer still reads what was queued");
+    TEST_ASSERT_EQUAL(0, sys_read(pv[1], in, 10), "then end of file");
+    TEST_ASSERT_EQUAL(-EPIPE, sys_write(pv[1], "x", 1),
+                      "and a send says EPIPE");
+    TEST_ASSERT(ksim_signals() & (1 << (SIGPIPE-1)), "with SIGPIPE");
+    sys_close(pv[1]);
+    ksim_unix_pair(SOCK_SEQPACKET, pv);
+    fill_queue(pv[0]);
+    memset(result, 0, sizeof(result));
+    rcv = pv[1];
+    n = ksim_spawn(send_task, (void *) (long) pv[0]);
+    ksim_yield();
+    TEST_ASSERT_EQUAL(0, result[n], "a sender waits on a full queue");
+    sys_close(pv[1]);
+    TEST_ASSERT_EQUAL(0, ksim_wait(), "closing the receiver wakes it");
+    TEST_ASSERT_EQUAL(-EPIPE, result[n], "with EPIPE");
+    sys_close(pv[0]);
+    TEST_ASSERT_EQUAL(0, ksim_inodes(), "no inodes are left in use");
+    TEST_ASSERT_EQUAL(memory, ksim_memory(), "every page was freed");
+
+    TEST_SUITE_END();
+}
@@ -0,0 +1,79 @@
+/*
+ * Host stand-in for <asm/segment.h>, used when kernel files are built
+ * into the unit tests: user space is the test's own memory. Every
+ * access goes through ksim_user_access() first, which is where a test
+ * can make the "page fault" sleep and let another task run.
+ *
+ * User longs are 32 bits on the 386, so put_fs_long() stores only that
+ * much and int fields next to each other survive. get_fs_long() reads
+ * a host long, so socketcall-style argument vectors can carry pointers:
+ * ints the kernel reads that way must sit in long-sized storage.
+ */
+#ifndef _MOCK_ASM_SEGMENT_H
+#define _MOCK_ASM_SEGMENT_H
+
+extern void ksim_user_access(void);
+
+static inline unsigned char get_fs_byte(const char * addr)
+{
+	ksim_user_access();
+	return *(const unsigned char *) addr;
+}
+
+static inline unsigned short get_fs_word(const unsigned short *addr)
+{
+	ksim_user_access();
+	return *addr;
+}
+
+static inline unsigned long get_fs_long(const unsigned long *addr)
+{
+	ksim_user_access();
+	return *addr;
+}
+
+static inline void put_fs_byte(char val,char *addr)
+{
+	ksim_user_access();
+	*addr = val;
+}
+
+static inline void put_fs_word(short val,short * addr)
+{
+	ksim_user_access();
+	*addr = val;
+}
+
+static inline void put_fs_long(unsigned long val,unsigned long * addr)
+{
+	ksim_user_access();
+	*(unsigned int *) addr = val;
+}
+
+static inline void memcpy_tofs(void * to, void * from, unsigned long n)
+{
+	ksim_user_access();
+	__builtin_memcpy(to, from, n);
+}
+
+static inline void memcpy_fromfs(void * to, void * from, unsigned long n)
+{
+	ksim_user_access();
+	__builtin_memcpy(to, from, n);
+}
+
+static inline unsigned long get_fs(void)
+{
+	return 0x17;
+}
+
+static inline unsigned long get_ds(void)
+{
+	return 0x10;
+}
+
+static inline void set_fs(unsigned long val)
+{
+}
+
+#endif
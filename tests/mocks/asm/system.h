@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for <asm/system.h>. The tests run one kernel task at a
+ * time and never take interrupts, so there is nothing to mask.
+ */
+#ifndef _MOCK_ASM_SYSTEM_H
+#define _MOCK_ASM_SYSTEM_H
+
+#define sti()
+#define cli()
+#define nop()
+#define save_flags(x) ((x) = 0)
+#define restore_flags(x) ((void) (x))
+
+#endif
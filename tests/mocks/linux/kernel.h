@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for <linux/kernel.h>: the same prototypes, except that
+ * panic() and do_exit() are plain void. gcc warns about every call to
+ * a volatile void function, and has no option to turn that off.
+ */
+void verify_area(void * addr,int count);
+void panic(const char * str);
+void do_exit(long error_code);
+int printk(const char * fmt, ...);
+void * malloc(unsigned int size);
+void free_s(void * obj, int size);
+
+#define free(x) free_s((x), 0)
+
+#define suser() (current->euid == 0)